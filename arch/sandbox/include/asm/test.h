@@ -369,4 +369,22 @@ bool sandbox_sf_bootdev_enabled(void);
  */
 void sandbox_sf_set_enable_bootdevs(bool enable);
 
+/**
+ * sandbox_virtio_blk_get_stats() - Get and reset virtio-blk emulation stats
+ *
+ * @dev: sandbox virtio transport device emulating a block device
+ * @notifiesp: Returns the number of times the driver kicked a queue
+ * @max_batchp: Returns the most requests found in a queue on one kick
+ */
+void sandbox_virtio_blk_get_stats(struct udevice *dev, uint *notifiesp,
+				  uint *max_batchp);
+
+/**
+ * sandbox_virtio_blk_get_disk() - Get the contents of an emulated disk
+ *
+ * @dev: sandbox virtio transport device emulating a block device
+ * Returns: pointer to the disk contents, or NULL if not a block device
+ */
+void *sandbox_virtio_blk_get_disk(struct udevice *dev);
+
 #endif
@@ -0,0 +1,324 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Loading images from an external-data FIT which is not in memory
+ *
+ * The FDT part of the FIT is read first. Each image is then read from the
+ * source in chunks, with every chunk fed to the hashes for that image while
+ * it is still in the cache, so the data is only walked once. Compressed images
+ * are unpacked a chunk at a time too, where the compression type allows it.
+ */
+
+#define LOG_CATEGORY LOGC_BOOT
+
+#include <decomp_stream.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <memalign.h>
+#include <watchdog.h>
+#include <asm/global_data.h>
+#include <linux/kernel.h>
+#include <linux/libfdt.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+int fit_stream_read_header(struct fit_stream *stream, void **fitp)
+{
+	struct fdt_header hdr;
+	ulong size;
+	void *fit;
+	long ret;
+
+	ret = stream->read(stream, 0, sizeof(hdr), &hdr);
+	if (ret != sizeof(hdr))
+		return ret < 0 ? ret : -EIO;
+	if (fdt_check_header(&hdr))
+		return -EINVAL;
+
+	size = fdt_totalsize(&hdr);
+	fit = malloc(size);
+	if (!fit)
+		return -ENOMEM;
+	ret = stream->read(stream, 0, size, fit);
+	if (ret != size) {
+		free(fit);
+		return ret < 0 ? ret : -EIO;
+	}
+	ret = fit_check_format(fit, size);
+	if (ret) {
+		free(fit);
+		return ret;
+	}
+	*fitp = fit;
+
+	return 0;
+}
+
+void fit_stream_abort_hashes(struct fit_stream_hash *hashes, int count)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, value, FIT_MAX_HASH_LEN);
+
+	while (count--)
+		hashes[count].algo->hash_finish(hashes[count].algo,
+						hashes[count].ctx, value,
+						FIT_MAX_HASH_LEN);
+}
+
+int fit_stream_start_hashes(const void *fit, int noffset,
+			    struct fit_stream_hash *hashes)
+{
+	int node, count = 0;
+	int ret = 0;
+
+	fdt_for_each_subnode(node, fit, noffset) {
+		const char *name = fit_get_name(fit, node, NULL);
+		struct fit_stream_hash *hash;
+		const char *algo;
+		int ignore;
+
+		if (strncmp(name, FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+		fit_image_hash_get_ignore(fit, node, &ignore);
+		if (ignore)
+			continue;
+		if (fit_image_hash_get_algo(fit, node, &algo)) {
+			ret = log_msg_ret("alg", -EINVAL);
+			break;
+		}
+		if (count == FIT_STREAM_MAX_HASHES) {
+			ret = log_msg_ret("max", -E2BIG);
+			break;
+		}
+
+		hash = &hashes[count];
+		hash->noffset = node;
+		ret = hash_progressive_lookup_algo(algo, &hash->algo);
+		if (ret) {
+			log_err("Unsupported hash algorithm '%s'\n", algo);
+			break;
+		}
+		if (hash->algo->hash_init(hash->algo, &hash->ctx)) {
+			ret = log_msg_ret("ini", -ENOMEM);
+			break;
+		}
+		count++;
+	}
+	if (ret) {
+		fit_stream_abort_hashes(hashes, count);
+		return ret;
+	}
+
+	return count;
+}
+
+int fit_stream_update_hashes(struct fit_stream_hash *hashes, int count,
+			     const void *buf, ulong len, bool last)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct fit_stream_hash *hash = &hashes[i];
+
+		if (hash->algo->hash_update(hash->algo, hash->ctx, buf, len,
+					    last))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+int fit_stream_check_hashes(const void *fit, struct fit_stream_hash *hashes,
+			    int count)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, value, FIT_MAX_HASH_LEN);
+	int i, ret = 0;
+
+	for (i = 0; i < count; i++) {
+		struct fit_stream_hash *hash = &hashes[i];
+		u8 *fit_value;
+		bool ok;
+		int len;
+
+		ok = !hash->algo->hash_finish(hash->algo, hash->ctx, value,
+					      FIT_MAX_HASH_LEN) &&
+		     !fit_image_hash_get_value(fit, hash->noffset, &fit_value,
+					       &len) &&
+		     len == hash->algo->digest_size &&
+		     !memcmp(value, fit_value, len);
+		printf("%s%s ", hash->algo->name, ok ? "+" : "-");
+		if (!ok)
+			ret = -EBADMSG;
+	}
+
+	return ret;
+}
+
+/**
+ * fit_stream_read_data() - read an image's data, hashing it as it arrives
+ *
+ * @stream:	Source of the FIT
+ * @pos:	Offset of the data from the start of the FIT
+ * @size:	Size of the data
+ * @buf:	Where to put the data
+ * @hashes:	Hashes to update
+ * @count:	Number of hashes
+ * @ds:		Decompressor to pass each chunk to, in which case @buf holds
+ *		only one chunk, or NULL to read the whole of the data to @buf
+ * Return: 0 if OK, -ve on error
+ */
+static int fit_stream_read_data(struct fit_stream *stream, ulong pos,
+				ulong size, void *buf,
+				struct fit_stream_hash *hashes, int count,
+				struct decomp_stream *ds)
+{
+	ulong chunk = stream->chunk_size ?: CONFIG_FIT_STREAM_CHUNK_SIZE;
+	ulong done;
+
+	for (done = 0; done < size; done += chunk) {
+		ulong len = min(chunk, size - done);
+		bool last = done + len == size;
+		void *ptr = ds ? buf : buf + done;
+		long ret;
+
+		ret = stream->read(stream, pos + done, len, ptr);
+		if (ret != len)
+			return ret < 0 ? ret : -EIO;
+		ret = fit_stream_update_hashes(hashes, count, ptr, len, last);
+		if (ret)
+			return ret;
+		if (ds) {
+			ret = decomp_stream_write(ds, ptr, len);
+			if (ret)
+				return ret;
+		}
+		schedule();
+	}
+
+	return 0;
+}
+
+bool fit_stream_has_sigs(const void *fit, int noffset)
+{
+	int node;
+
+	if (!FIT_IMAGE_ENABLE_VERIFY)
+		return false;
+	fdt_for_each_subnode(node, fit, noffset) {
+		const char *name = fit_get_name(fit, node, NULL);
+
+		if (!strncmp(name, FIT_SIG_NODENAME, strlen(FIT_SIG_NODENAME)))
+			return true;
+	}
+
+	return false;
+}
+
+int fit_image_load_stream(struct fit_stream *stream, const void *fit,
+			  int noffset, void *dst, ulong dst_size, ulong *lenp)
+{
+	struct fit_stream_hash hashes[FIT_STREAM_MAX_HASHES];
+	ulong chunk = stream->chunk_size ?: CONFIG_FIT_STREAM_CHUNK_SIZE;
+	struct decomp_stream ds, *dsp = NULL;
+	int pos, size, count, ret;
+	void *buf = dst;
+	u8 comp, type;
+
+	if (!fit_image_get_data_position(fit, noffset, &pos)) {
+		/* absolute position within the FIT */
+	} else if (!fit_image_get_data_offset(fit, noffset, &pos)) {
+		pos += ALIGN(fdt_totalsize(fit), 4);
+	} else {
+		log_debug("Image '%s' does not have external data\n",
+			  fit_get_name(fit, noffset, NULL));
+		return -ENOENT;
+	}
+	if (fit_image_get_data_size(fit, noffset, &size))
+		return log_msg_ret("siz", -EINVAL);
+	if (fit_image_get_comp(fit, noffset, &comp))
+		comp = IH_COMP_NONE;
+	if (fit_image_get_type(fit, noffset, &type))
+		type = IH_TYPE_INVALID;
+
+	if (comp == IH_COMP_NONE) {
+		if (size > dst_size)
+			return log_msg_ret("spc", -ENOSPC);
+	} else if (CONFIG_IS_ENABLED(DECOMP_STREAM) &&
+		   decomp_stream_supported(comp) &&
+		   !fit_stream_has_sigs(fit, noffset)) {
+		/* unpack each chunk into place as it arrives */
+		buf = malloc(min(chunk, (ulong)size));
+		if (!buf)
+			return log_msg_ret("chk", -ENOMEM);
+		ret = decomp_stream_init(&ds, comp, dst, dst_size);
+		if (ret) {
+			free(buf);
+			return log_msg_ret("dsi", ret);
+		}
+		dsp = &ds;
+	} else {
+		/* compressed data needs somewhere to live until it is unpacked */
+		buf = malloc(size);
+		if (!buf)
+			return log_msg_ret("buf", -ENOMEM);
+	}
+
+	printf("   Loading '%s' ", fit_get_name(fit, noffset, NULL));
+	count = fit_stream_start_hashes(fit, noffset, hashes);
+	if (count < 0) {
+		ret = count;
+		if (dsp)
+			decomp_stream_finish(dsp, NULL);
+		goto err;
+	}
+	ret = fit_stream_read_data(stream, pos, size, buf, hashes, count, dsp);
+	if (dsp) {
+		int dret = decomp_stream_finish(dsp, lenp);
+
+		if (!ret)
+			ret = dret;
+	}
+	if (ret) {
+		fit_stream_abort_hashes(hashes, count);
+		goto err;
+	}
+	ret = fit_stream_check_hashes(fit, hashes, count);
+	if (ret)
+		goto err;
+
+	if (FIT_IMAGE_ENABLE_VERIFY) {
+		int no_sigs = 1;
+
+		if (fit_image_verify_required_sigs(fit, noffset, buf, size,
+						   gd_fdt_blob(), &no_sigs)) {
+			ret = -EPERM;
+			goto err;
+		}
+	}
+	puts("OK\n");
+
+	if (dsp) {
+		free(buf);
+		return 0;
+	}
+	if (comp == IH_COMP_NONE) {
+		*lenp = size;
+		return 0;
+	}
+
+	/* image_decomp() takes the space as a uint, so do not let it wrap */
+	ret = image_decomp(comp, map_to_sysmem(dst), map_to_sysmem(buf), type,
+			   dst, buf, size, min_t(ulong, dst_size, UINT_MAX),
+			   lenp);
+	*lenp -= map_to_sysmem(dst);
+	free(buf);
+
+	return ret;
+
+err:
+	puts("error!\n");
+	if (buf != dst)
+		free(buf);
+
+	return ret;
+}
@@ -10,7 +10,9 @@
 
 #include <blk.h>
 #include <command.h>
+#include <display_options.h>
 #include <mapmem.h>
+#include <time.h>
 #include <vsprintf.h>
 
 int blk_common_cmd(int argc, char *const argv[], enum uclass_id uclass_id,
@@ -68,8 +70,8 @@ int blk_common_cmd(int argc, char *const argv[], enum uclass_id uclass_id,
 			lbaint_t blk = hextoul(argv[3], NULL);
 			ulong cnt = hextoul(argv[4], NULL);
 			struct blk_desc *desc;
+			ulong n, start, us;
 			void *vaddr;
-			ulong n;
 			int ret;
 
 			printf("\n%s read: device %d block # "LBAFU", count %lu ... ",
@@ -79,19 +81,23 @@ int blk_common_cmd(int argc, char *const argv[], enum uclass_id uclass_id,
 			if (ret)
 				return CMD_RET_FAILURE;
 			vaddr = map_sysmem(paddr, desc->blksz * cnt);
+			start = timer_get_us();
 			n = blk_dread(desc, blk, cnt, vaddr);
+			us = timer_get_us() - start;
 			unmap_sysmem(vaddr);
 
-			printf("%ld blocks read: %s\n", n,
-			       n == cnt ? "OK" : "ERROR");
+			/* show the throughput, so that transfer sizes can be tuned */
+			printf("%ld blocks read: %s in %lu ms (", n,
+			       n == cnt ? "OK" : "ERROR", us / 1000);
+			print_rate((u64)desc->blksz * n, us, ")\n");
 			return n == cnt ? CMD_RET_SUCCESS : CMD_RET_FAILURE;
 		} else if (strcmp(argv[1], "write") == 0) {
 			phys_addr_t paddr = hextoul(argv[2], NULL);
 			lbaint_t blk = hextoul(argv[3], NULL);
 			ulong cnt = hextoul(argv[4], NULL);
 			struct blk_desc *desc;
+			ulong n, start, us;
 			void *vaddr;
-			ulong n;
 			int ret;
 
 			printf("\n%s write: device %d block # "LBAFU", count %lu ... ",
@@ -101,11 +107,14 @@ int blk_common_cmd(int argc, char *const argv[], enum uclass_id uclass_id,
 			if (ret)
 				return CMD_RET_FAILURE;
 			vaddr = map_sysmem(paddr, desc->blksz * cnt);
+			start = timer_get_us();
 			n = blk_dwrite(desc, blk, cnt, vaddr);
+			us = timer_get_us() - start;
 			unmap_sysmem(vaddr);
 
-			printf("%ld blocks written: %s\n", n,
-			       n == cnt ? "OK" : "ERROR");
+			printf("%ld blocks written: %s in %lu ms (", n,
+			       n == cnt ? "OK" : "ERROR", us / 1000);
+			print_rate((u64)desc->blksz * n, us, ")\n");
 			return n == cnt ? CMD_RET_SUCCESS : CMD_RET_FAILURE;
 		} else if (strcmp(argv[1], "erase") == 0) {
 			lbaint_t blk = hextoul(argv[2], NULL);
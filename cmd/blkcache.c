@@ -18,19 +18,28 @@ static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "readahead hits: %u\n"
+	       "readaheads: %u\n"
 	       "entries: %u\n"
+	       "size: %lu\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "max cache entries: %u\n"
+	       "max size: %lu\n"
+	       "readahead blocks: %u\n",
+	       stats.hits, stats.misses, stats.ra_hits, stats.readaheads,
+	       stats.entries, stats.size, stats.max_blocks_per_entry,
+	       stats.max_entries, stats.max_size, stats.ra_blocks);
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
-	unsigned blocks_per_entry, max_entries;
-	if (argc != 3)
+	unsigned blocks_per_entry, max_entries, ra_blocks;
+	struct block_cache_stats stats;
+	unsigned long max_size;
+
+	if (argc < 3 || argc > 5)
 		return CMD_RET_USAGE;
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
@@ -38,12 +47,21 @@ static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 	blkcache_configure(blocks_per_entry, max_entries);
 	printf("changed to max of %u entries of %u blocks each\n",
 	       max_entries, blocks_per_entry);
+	if (argc < 4)
+		return 0;
+
+	blkcache_stats(&stats);
+	max_size = simple_strtoul(argv[3], 0, 0);
+	ra_blocks = argc > 4 ? simple_strtoul(argv[4], 0, 0) : stats.ra_blocks;
+	blkcache_configure_size(max_size, ra_blocks);
+	printf("changed to max of %lu bytes, readahead %u blocks\n",
+	       max_size, ra_blocks);
 	return 0;
 }
 
 static struct cmd_tbl cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
-	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(configure, 5, 0, blkc_configure, "", ""),
 };
 
 static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
@@ -67,9 +85,10 @@ static int do_blkcache(struct cmd_tbl *cmdtp, int flag,
 }
 
 U_BOOT_CMD(
-	blkcache, 4, 0, do_blkcache,
+	blkcache, 6, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <blocks> <entries> [<size> [<readahead>]] "
+	"- set max blocks per entry, max cache entries,\n"
+	"    max bytes cached and readahead window in blocks\n"
 );
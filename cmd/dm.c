@@ -7,10 +7,13 @@
  */
 
 #include <command.h>
+#include <asm/global_data.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <linux/string.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 static int do_dm_dump_driver_compat(struct cmd_tbl *cmdtp, int flag, int argc,
 				    char * const argv[])
 {
@@ -48,6 +51,17 @@ static int do_dm_dump_mem(struct cmd_tbl *cmdtp, int flag, int argc,
 }
 #endif /* DM_STATS */
 
+#if CONFIG_IS_ENABLED(OFNODE_CACHE)
+static int do_dm_ofnode_cache(struct cmd_tbl *cmdtp, int flag, int argc,
+			      char *const argv[])
+{
+	printf("Control FDT lookups: %u from cache, %u by scanning\n",
+	       gd->ofnode_cache_hits, gd->ofnode_cache_misses);
+
+	return 0;
+}
+#endif /* OFNODE_CACHE */
+
 static int do_dm_dump_static_driver_info(struct cmd_tbl *cmdtp, int flag,
 					 int argc, char * const argv[])
 {
@@ -112,11 +126,20 @@ static int do_dm_dump_uclass(struct cmd_tbl *cmdtp, int flag, int argc,
 #define DM_MEM
 #endif
 
+#if CONFIG_IS_ENABLED(OFNODE_CACHE)
+#define DM_OFCACHE_HELP	"dm ofcache       Show how many node lookups used the cache\n"
+#define DM_OFCACHE	U_BOOT_SUBCMD_MKENT(ofcache, 1, 1, do_dm_ofnode_cache),
+#else
+#define DM_OFCACHE_HELP
+#define DM_OFCACHE
+#endif
+
 U_BOOT_LONGHELP(dm,
 	"compat        Dump list of drivers with compatibility strings\n"
 	"dm devres        Dump list of device resources for each device\n"
 	"dm drivers       Dump list of drivers with uclass and instances\n"
 	DM_MEM_HELP
+	DM_OFCACHE_HELP
 	"dm static        Dump list of drivers with static platform data\n"
 	"dm tree [-s][-e][name]   Dump tree of driver model devices (-s=sort)\n"
 	"dm uclass [-e][name]     Dump list of instances for each uclass");
@@ -126,6 +149,7 @@ U_BOOT_CMD_WITH_SUBCMDS(dm, "Driver model low level access", dm_help_text,
 	U_BOOT_SUBCMD_MKENT(devres, 1, 1, do_dm_dump_devres),
 	U_BOOT_SUBCMD_MKENT(drivers, 1, 1, do_dm_dump_drivers),
 	DM_MEM
+	DM_OFCACHE
 	U_BOOT_SUBCMD_MKENT(static, 1, 1, do_dm_dump_static_driver_info),
 	U_BOOT_SUBCMD_MKENT(tree, 4, 1, do_dm_dump_tree),
 	U_BOOT_SUBCMD_MKENT(uclass, 3, 1, do_dm_dump_uclass));
@@ -107,6 +107,8 @@ static int do_fastboot_usb(int argc, char *const argv[],
 			break;
 		schedule();
 		dm_usb_gadget_handle_interrupts(udc);
+		if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_STREAM))
+			fastboot_stream_poll();
 	}
 
 	ret = CMD_RET_SUCCESS;
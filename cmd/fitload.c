@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Load an image from an external-data FIT in a filesystem, without reading
+ * the rest of the FIT
+ */
+
+#include <command.h>
+#include <env.h>
+#include <fs.h>
+#include <image.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <asm/global_data.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/**
+ * struct fitload_priv - Where the FIT comes from
+ *
+ * @ifname:	Interface name, e.g. "mmc"
+ * @dev_part:	Device and partition, e.g. "0:1"
+ * @fname:	Filename of the FIT
+ */
+struct fitload_priv {
+	const char *ifname;
+	const char *dev_part;
+	const char *fname;
+};
+
+static long fitload_read(struct fit_stream *stream, ulong offset, ulong size,
+			 void *buf)
+{
+	struct fitload_priv *priv = stream->priv;
+	loff_t actread;
+
+	/* fs_read() closes the filesystem, so select it each time */
+	if (fs_set_blk_dev(priv->ifname, priv->dev_part, FS_TYPE_ANY))
+		return -ENODEV;
+	if (fs_read(priv->fname, map_to_sysmem(buf), offset, size, &actread))
+		return -EIO;
+
+	return actread;
+}
+
+/**
+ * fitload_find_image() - find the image to load and check its configuration
+ *
+ * Configuration signatures cover the FIT header, including the hashes of the
+ * images, so they are checked here before anything is loaded. The image's
+ * hashes are then checked as it is read.
+ *
+ * @fit:	FIT header
+ * @conf:	Configuration name, or "-" for the default configuration
+ * @prop:	Property in the configuration which names the image, e.g.
+ *		"kernel"
+ * Return: image node offset, or -ve on error
+ */
+static int fitload_find_image(const void *fit, const char *conf,
+			      const char *prop)
+{
+	int cfg_noffset, noffset;
+
+	cfg_noffset = fit_conf_get_node(fit, strcmp(conf, "-") ? conf : NULL);
+	if (cfg_noffset < 0) {
+		printf("Cannot find configuration '%s'\n", conf);
+		return -ENOENT;
+	}
+	printf("   Using '%s' configuration\n",
+	       fdt_get_name(fit, cfg_noffset, NULL));
+
+	if (FIT_IMAGE_ENABLE_VERIFY) {
+		puts("   Verifying Hash Integrity ... ");
+		if (fit_config_verify(fit, cfg_noffset)) {
+			puts("Bad Data Hash\n");
+			return -EACCES;
+		}
+		puts("OK\n");
+	}
+
+	noffset = fit_conf_get_prop_node(fit, cfg_noffset, prop,
+					 IH_PHASE_NONE);
+	if (noffset < 0) {
+		printf("Cannot find '%s' image in configuration\n", prop);
+		return -ENOENT;
+	}
+
+	return noffset;
+}
+
+static int do_fitload(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	struct fitload_priv priv;
+	struct fit_stream stream = {
+		.read	= fitload_read,
+		.priv	= &priv,
+	};
+	ulong addr, len;
+	void *fit;
+	int noffset, ret;
+
+	if (argc != 7)
+		return CMD_RET_USAGE;
+
+	priv.ifname = argv[1];
+	priv.dev_part = argv[2];
+	addr = hextoul(argv[3], NULL);
+	priv.fname = argv[4];
+	if (addr >= gd->ram_top) {
+		printf("Address %lx is outside RAM\n", addr);
+		return CMD_RET_FAILURE;
+	}
+
+	ret = fit_stream_read_header(&stream, &fit);
+	if (ret) {
+		printf("Cannot read FIT from '%s' (err=%d)\n", priv.fname, ret);
+		return CMD_RET_FAILURE;
+	}
+
+	noffset = fitload_find_image(fit, argv[5], argv[6]);
+	if (noffset < 0) {
+		ret = noffset;
+	} else {
+		ret = fit_image_load_stream(&stream, fit, noffset,
+					    map_sysmem(addr, 0),
+					    gd->ram_top - addr, &len);
+		unmap_sysmem(map_sysmem(addr, 0));
+	}
+	free(fit);
+	if (ret) {
+		printf("Failed to load '%s' image (err=%d)\n", argv[6], ret);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("%lu bytes loaded to %lx\n", len, addr);
+	env_set_hex("filesize", len);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	fitload, 7, 0, do_fitload,
+	"load an image from an external-data FIT in a filesystem",
+	"<interface> <dev[:part]> <addr> <filename> <config> <prop>\n"
+	"    - read the image named by property <prop> (e.g. kernel) of\n"
+	"      configuration <config> ('-' for the default) from FIT file\n"
+	"      <filename> on <interface> <dev[:part]> to address <addr>,\n"
+	"      checking the configuration's signatures and the image's\n"
+	"      hashes and decompressing it if needed. Only the FDT part of\n"
+	"      the FIT and the image itself are read."
+);
@@ -139,6 +139,26 @@ U_BOOT_CMD(
 	"List supported filesystem types", ""
 );
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+static int do_fsmounts(struct cmd_tbl *cmdtp, int flag, int argc,
+		       char *const argv[])
+{
+	ulong hits, probes;
+	int count;
+
+	count = fs_mount_stats(&hits, &probes);
+	printf("Filesystems mounted: %d\n", count);
+	printf("Accesses without probing: %lu, probes: %lu\n", hits, probes);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	fsmounts, 1, 1, do_fsmounts,
+	"Show filesystems kept mounted between accesses", ""
+);
+#endif
+
 static int do_mv_wrapper(struct cmd_tbl *cmdtp, int flag, int argc,
 			 char *const argv[])
 {
@@ -394,7 +394,7 @@ static lbaint_t mmc_sparse_reserve(struct sparse_storage *info,
 static int do_mmc_sparse_write(struct cmd_tbl *cmdtp, int flag,
 			       int argc, char *const argv[])
 {
-	struct sparse_storage sparse;
+	struct sparse_storage sparse = {};
 	struct blk_desc *dev_desc;
 	struct mmc *mmc;
 	char dest[11];
@@ -569,9 +569,25 @@ static int do_mtd_io(struct cmd_tbl *cmdtp, int flag, int argc,
 
 	/* Loop over the pages to do the actual read/write */
 	while (remaining) {
-		/* Skip the block if it is bad */
-		if (mtd_is_aligned_with_block_size(mtd, off) &&
-		    mtd_block_isbad(mtd, off)) {
+		if (read && has_pages && !woob &&
+		    mtd_is_aligned_with_block_size(mtd, off)) {
+			loff_t start = off;
+			u64 run;
+
+			/* Read the whole run of good blocks at once */
+			ret = mtd_block_good_run(mtd, &start, remaining, &run);
+			if (!ret && !run)
+				ret = -EINVAL;
+			if (ret) {
+				printf("Failure while reading at offset 0x%llx\n",
+				       off);
+				break;
+			}
+			off = start;
+			io_op.len = run;
+		} else if (mtd_is_aligned_with_block_size(mtd, off) &&
+			   mtd_block_isbad(mtd, off)) {
+			/* Skip the block if it is bad */
 			off += mtd->erasesize;
 			continue;
 		}
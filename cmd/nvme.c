@@ -6,11 +6,57 @@
 
 #include <blk.h>
 #include <command.h>
+#include <display_options.h>
 #include <dm.h>
+#include <mapmem.h>
 #include <nvme.h>
+#include <time.h>
 
 static int nvme_curr_dev;
 
+/* Read the same range repeatedly and report the sustained throughput */
+static int nvme_bench(int argc, char *const argv[])
+{
+	struct blk_desc *desc;
+	ulong addr, cnt, loops, i, start, us;
+	lbaint_t blk;
+	void *buf;
+
+	if (argc < 5)
+		return CMD_RET_USAGE;
+
+	addr = hextoul(argv[2], NULL);
+	blk = hextoul(argv[3], NULL);
+	cnt = hextoul(argv[4], NULL);
+	loops = argc > 5 ? dectoul(argv[5], NULL) : 1;
+	if (!cnt || !loops)
+		return CMD_RET_USAGE;
+
+	if (blk_get_desc(UCLASS_NVME, nvme_curr_dev, &desc))
+		return CMD_RET_FAILURE;
+
+	buf = map_sysmem(addr, desc->blksz * cnt);
+	start = timer_get_us();
+	for (i = 0; i < loops; i++) {
+		/* make sure that every pass goes to the device */
+		blkcache_invalidate(desc->uclass_id, desc->devnum);
+		if (blk_dread(desc, blk, cnt, buf) != cnt)
+			break;
+	}
+	us = timer_get_us() - start;
+	unmap_sysmem(buf);
+
+	if (i < loops) {
+		printf("Read failed on pass %lu\n", i + 1);
+		return CMD_RET_FAILURE;
+	}
+
+	printf("%lu x %lu blocks read in %lu ms (", loops, cnt, us / 1000);
+	print_rate((u64)desc->blksz * cnt * loops, us, ")\n");
+
+	return CMD_RET_SUCCESS;
+}
+
 static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 		   char *const argv[])
 {
@@ -37,6 +83,8 @@ static int do_nvme(struct cmd_tbl *cmdtp, int flag, int argc,
 			return ret;
 		}
 	}
+	if (argc >= 2 && !strcmp(argv[1], "bench"))
+		return nvme_bench(argc, argv);
 
 	return blk_common_cmd(argc, argv, UCLASS_NVME, &nvme_curr_dev);
 }
@@ -52,5 +100,7 @@ U_BOOT_CMD(
 	"nvme read addr blk# cnt - read `cnt' blocks starting at block\n"
 	"     `blk#' to memory address `addr'\n"
 	"nvme write addr blk# cnt - write `cnt' blocks starting at block\n"
-	"     `blk#' from memory address `addr'"
+	"     `blk#' from memory address `addr'\n"
+	"nvme bench addr blk# cnt [loops] - read `cnt' blocks starting at\n"
+	"     block `blk#' to `addr' `loops' times and show the throughput"
 );
@@ -584,6 +584,149 @@ static int do_spi_flash_test(int argc, char *const argv[])
 	return 0;
 }
 
+/**
+ * sf_bench_show() - Show how long one stage of the benchmark took
+ *
+ * @name: Name of the stage
+ * @len: Number of bytes handled
+ * @us: Time taken in microseconds
+ */
+static void sf_bench_show(const char *name, ulong len, ulong us)
+{
+	printf("%-10s %10lu us  ", name, us);
+	print_rate(len, us, "\n");
+}
+
+/**
+ * sf_bench_read() - Time reading a region, in requests of up to @chunk bytes
+ *
+ * @name: Name of the stage
+ * @offset: Offset within flash to read from
+ * @len: Number of bytes to read
+ * @chunk: Largest number of bytes to read at once
+ * @buf: Buffer to read into
+ * Return: 0 if ok, -ve on error
+ */
+static int sf_bench_read(const char *name, ulong offset, ulong len,
+			 ulong chunk, u8 *buf)
+{
+	ulong start, pos;
+	int err;
+
+	start = timer_get_us();
+	for (pos = 0; pos < len; pos += chunk) {
+		err = spi_flash_read(flash, offset + pos,
+				     min(chunk, len - pos), buf + pos);
+		if (err) {
+			printf("Read failed (err = %d)\n", err);
+			return err;
+		}
+	}
+	sf_bench_show(name, len, timer_get_us() - start);
+
+	return 0;
+}
+
+/**
+ * spi_flash_bench() - Measure erase, program and read speed
+ *
+ * Reads are timed twice: once as a single request, which lets the driver use
+ * the largest transfers the controller allows (through its direct mapping or
+ * DMA where it has them), and once a page at a time, which shows how much of
+ * the time goes in setting up each transfer.
+ *
+ * @offset: Offset within flash to use
+ * @len: Number of bytes to use
+ * @read_only: true to only read, leaving the flash contents unchanged
+ * @buf: Buffer for the test pattern, @len bytes, or NULL if @read_only
+ * @vbuf: Buffer to read into, @len bytes
+ * Return: 0 if ok, -ve on error
+ */
+static int spi_flash_bench(ulong offset, ulong len, bool read_only, u8 *buf,
+			   u8 *vbuf)
+{
+	ulong start, i;
+	int err;
+
+	if (!read_only) {
+		for (i = 0; i < len; i++)
+			buf[i] = i * 31 + (i >> 8);
+
+		start = timer_get_us();
+		err = spi_flash_erase(flash, offset, len);
+		if (err) {
+			printf("Erase failed (err = %d)\n", err);
+			return err;
+		}
+		sf_bench_show("erase", len, timer_get_us() - start);
+
+		start = timer_get_us();
+		err = spi_flash_write(flash, offset, len, buf);
+		if (err) {
+			printf("Write failed (err = %d)\n", err);
+			return err;
+		}
+		sf_bench_show("write", len, timer_get_us() - start);
+	}
+
+	err = sf_bench_read("read", offset, len, len, vbuf);
+	if (!err && !read_only && memcmp(buf, vbuf, len))
+		err = -EIO;
+	if (!err) {
+		memset(vbuf, '\0', len);
+		err = sf_bench_read("page-read", offset, len,
+				    flash->page_size ?: len, vbuf);
+	}
+	if (!err && !read_only && memcmp(buf, vbuf, len))
+		err = -EIO;
+	if (err == -EIO)
+		printf("Verify failed\n");
+
+	return err;
+}
+
+static int do_spi_flash_bench(int argc, char *const argv[])
+{
+	bool read_only = false;
+	ulong offset, len;
+	u8 *buf, *vbuf;
+	char *endp;
+	int ret;
+
+	if (argc > 1 && !strcmp(argv[1], "-r")) {
+		read_only = true;
+		argc--;
+		argv++;
+	}
+	if (argc != 3)
+		return CMD_RET_USAGE;
+	offset = hextoul(argv[1], &endp);
+	if (*argv[1] == 0 || *endp != 0)
+		return CMD_RET_USAGE;
+	len = hextoul(argv[2], &endp);
+	if (*argv[2] == 0 || *endp != 0)
+		return CMD_RET_USAGE;
+	if (!len || offset >= flash->size || len > flash->size - offset) {
+		printf("Region %#lx+%#lx is outside the flash\n", offset, len);
+		return CMD_RET_FAILURE;
+	}
+
+	buf = read_only ? NULL : memalign(ARCH_DMA_MINALIGN, len);
+	vbuf = memalign(ARCH_DMA_MINALIGN, len);
+	if ((!read_only && !buf) || !vbuf) {
+		printf("Cannot allocate memory (%lu bytes)\n", len);
+		ret = -ENOMEM;
+	} else {
+		printf("SF: bench %lu bytes @ %#lx%s\n", len, offset,
+		       read_only ? " (read only)" : "");
+		ret = spi_flash_bench(offset, len, read_only, buf, vbuf);
+	}
+	free(vbuf);
+	free(buf);
+
+	return ret ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+
 static int do_spi_flash(struct cmd_tbl *cmdtp, int flag, int argc,
 			char *const argv[])
 {
@@ -616,6 +759,8 @@ static int do_spi_flash(struct cmd_tbl *cmdtp, int flag, int argc,
 		ret = do_spi_protect(argc, argv);
 	else if (IS_ENABLED(CONFIG_CMD_SF_TEST) && !strcmp(cmd, "test"))
 		ret = do_spi_flash_test(argc, argv);
+	else if (IS_ENABLED(CONFIG_CMD_SF_BENCH) && !strcmp(cmd, "bench"))
+		ret = do_spi_flash_bench(argc, argv);
 	else
 		ret = CMD_RET_USAGE;
 
@@ -643,6 +788,10 @@ U_BOOT_LONGHELP(sf,
 #endif
 #ifdef CONFIG_CMD_SF_TEST
 	"\nsf test offset len		- run a very basic destructive test"
+#endif
+#ifdef CONFIG_CMD_SF_BENCH
+	"\nsf bench [-r] offset len	- measure erase, write and read speed\n"
+	"					  (-r: read only, non-destructive)"
 #endif
 	);
 
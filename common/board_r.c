@@ -98,6 +98,10 @@ static int initr_reloc(void)
 {
 	/* tell others: relocation done */
 	gd->flags |= GD_FLG_RELOC | GD_FLG_FULL_MALLOC_INIT;
+#if CONFIG_IS_ENABLED(OFNODE_CACHE)
+	/* the pre-reloc cache was in memory which is no longer available */
+	gd->ofnode_cache = NULL;
+#endif
 
 	return 0;
 }
@@ -262,6 +266,10 @@ static int initr_dm(void)
 	gd->dm_root = NULL;
 #ifdef CONFIG_TIMER
 	gd->timer = NULL;
+#endif
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/* the pre-reloc index was in memory which is no longer available */
+	gd->dm_compat_index = NULL;
 #endif
 	bootstage_start(BOOTSTAGE_ID_ACCUM_DM_R, "dm_r");
 	ret = dm_init_and_scan(false);
@@ -20,6 +20,7 @@
 #include <version_string.h>
 #include <efi_loader.h>
 #include <event.h>
+#include <dm/device-internal.h>
 
 static void run_preboot_environment_command(void)
 {
@@ -72,6 +73,10 @@ void main_loop(void)
 	if (cli_process_fdt(&s))
 		cli_secure_boot_cmd(s);
 
+	/* devices probed in the background must be ready before booting */
+	if (dm_probe_join())
+		printf("Warning: some devices failed to probe\n");
+
 	autoboot_command(s);
 
 	/* if standard boot if enabled, assume that it will be able to boot */
@@ -4,6 +4,9 @@
  * Written by Simon Glass <sjg@chromium.org>
  */
 
+#include <blk.h>
+#include <bootstage.h>
+#include <decomp_stream.h>
 #include <errno.h>
 #include <fpga.h>
 #include <gzip.h>
@@ -18,6 +21,7 @@
 #include <asm/io.h>
 #include <linux/libfdt.h>
 #include <linux/printk.h>
+#include <linux/sizes.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -193,6 +197,271 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return ALIGN(data_size, spl_get_bl_len(info));
 }
 
+#if CONFIG_IS_ENABLED(LOAD_FIT_STREAM)
+/* Amount of data to decompress between checks on the block device */
+#define SPL_FIT_STREAM_PIECE	SZ_16K
+
+/**
+ * struct spl_fit_stream - State of reading an image in chunks
+ *
+ * Chunks are read into two buffers in turn. With a block device which
+ * supports asynchronous requests, the read of each chunk is started before
+ * the previous one is decompressed.
+ *
+ * @info:	Device to read from
+ * @offset:	Offset on the device of the first chunk
+ * @size:	Number of bytes to read, a multiple of the block length
+ * @chunk:	Size of each chunk, a multiple of the block length
+ * @buf:	Buffer for each chunk, used in turn
+ * @hashes:	Hashes of the image, calculated over the compressed data
+ * @hash_count:	Number of hashes
+ * @desc:	Block device to submit requests to, or NULL to read each chunk
+ *		with @info->read
+ * @busy:	true if the request for each buffer has been submitted and
+ *		not waited for
+ * @req:	Request for each buffer
+ * @sg:		Buffer list for each request
+ */
+struct spl_fit_stream {
+	struct spl_load_info *info;
+	ulong offset;
+	ulong size;
+	ulong chunk;
+	void *buf[2];
+	struct fit_stream_hash hashes[FIT_STREAM_MAX_HASHES];
+	int hash_count;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	struct blk_desc *desc;
+	bool busy[2];
+	struct blk_req req[2];
+	struct blk_sg sg[2];
+#endif
+};
+
+/**
+ * spl_fit_stream_start() - Start reading a chunk
+ *
+ * @st:		Stream state
+ * @pos:	Position of the chunk within the data
+ * Return: 0 if OK, -ve on error
+ */
+static int spl_fit_stream_start(struct spl_fit_stream *st, ulong pos)
+{
+	int idx = (pos / st->chunk) & 1;
+	ulong len = min(st->chunk, st->size - pos);
+	ulong count;
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	if (st->desc) {
+		struct blk_desc *desc = st->desc;
+
+		st->sg[idx].buf = st->buf[idx];
+		st->sg[idx].blkcnt = len >> desc->log2blksz;
+		blk_req_init(&st->req[idx], desc->bdev, BLK_REQ_READ,
+			     (st->offset + pos) >> desc->log2blksz,
+			     &st->sg[idx], 1);
+		if (!blk_req_submit(&st->req[idx])) {
+			st->busy[idx] = true;
+			return 0;
+		}
+		/* nothing else is in flight, so carry on with plain reads */
+		st->desc = NULL;
+	}
+#endif
+	bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ, "spl_fit_read");
+	count = st->info->read(st->info, st->offset + pos, len, st->buf[idx]);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ);
+
+	return count < len ? -EIO : 0;
+}
+
+/**
+ * spl_fit_stream_wait() - Wait for a chunk to be read
+ *
+ * @st:		Stream state
+ * @idx:	Buffer which the chunk is being read into
+ * Return: 0 if OK, -ve on error
+ */
+static int spl_fit_stream_wait(struct spl_fit_stream *st, int idx)
+{
+	int ret = 0;
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	if (st->busy[idx]) {
+		bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ,
+				"spl_fit_read");
+		ret = blk_req_wait(&st->req[idx]);
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ);
+		st->busy[idx] = false;
+	}
+#endif
+
+	return ret;
+}
+
+/**
+ * spl_fit_stream_unpack() - Hash and decompress data which has been read
+ *
+ * The data is passed to the hashes and the decompressor a piece at a time,
+ * checking on the read of the next chunk in between.
+ *
+ * @st:		Stream state
+ * @ds:		Decompressor
+ * @src:	Compressed data
+ * @len:	Number of bytes at @src
+ * @last:	true if this is the end of the image data
+ * Return: 0 if OK, -ve on error
+ */
+static int spl_fit_stream_unpack(struct spl_fit_stream *st,
+				 struct decomp_stream *ds, const void *src,
+				 ulong len, bool last)
+{
+	int ret = 0;
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_DECOMP, "spl_fit_decomp");
+	while (len && !ret) {
+		ulong n = min_t(ulong, len, SPL_FIT_STREAM_PIECE);
+
+		ret = fit_stream_update_hashes(st->hashes, st->hash_count, src,
+					       n, last && n == len);
+		if (!ret)
+			ret = decomp_stream_write(ds, src, n);
+		src += n;
+		len -= n;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+		if (st->desc)
+			blk_req_poll(st->desc->bdev);
+#endif
+	}
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_DECOMP);
+
+	return ret;
+}
+
+/**
+ * load_simple_fit_stream() - Read and decompress an image at the same time
+ *
+ * The hashes of the image are calculated over the compressed data as it is
+ * read and checked once it is all unpacked. An image with signatures is not
+ * streamed, since those must be checked before it is decompressed, and an
+ * image without them is rejected if the keys require image signatures.
+ *
+ * @info:	Device to read from
+ * @fit:	FIT header
+ * @node:	Image node
+ * @offset:	Offset on the device to read from, aligned to the block length
+ * @size:	Number of bytes to read, a multiple of the block length
+ * @overhead:	Number of bytes at @offset which come before the image data
+ * @length:	Size of the compressed image data
+ * @comp:	Compression type (IH_COMP_...)
+ * @dst:	Where to decompress the image to
+ * @lenp:	Returns the size of the decompressed image
+ * Return: 0 if OK, -ENOSYS if the image cannot be decompressed as it is read,
+ * -EPERM if a hash is wrong or a required signature is missing, other -ve on
+ * error
+ */
+static int load_simple_fit_stream(struct spl_load_info *info, const void *fit,
+				  int node, ulong offset, ulong size,
+				  ulong overhead, ulong length, int comp,
+				  void *dst, size_t *lenp)
+{
+	ulong bl_len = spl_get_bl_len(info);
+	ulong end = overhead + length;
+	struct spl_fit_stream st = {
+		.info = info,
+		.offset = offset,
+		.size = size,
+	};
+	struct decomp_stream ds;
+	const char *name;
+	ulong pos, out;
+	int ret, dret;
+
+	if (!decomp_stream_supported(comp) || fit_stream_has_sigs(fit, node))
+		return -ENOSYS;
+
+	st.chunk = ALIGN(ALIGN(CONFIG_VAL(LOAD_FIT_STREAM_CHUNK_SIZE), bl_len),
+			 ARCH_DMA_MINALIGN);
+	st.buf[0] = map_sysmem(ALIGN(CONFIG_SYS_LOAD_ADDR, ARCH_DMA_MINALIGN),
+			       2 * st.chunk);
+	st.buf[1] = st.buf[0] + st.chunk;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	st.desc = spl_load_get_blk_desc(info);
+	if (st.desc && st.desc->blksz != bl_len)
+		st.desc = NULL;
+#endif
+
+	st.hash_count = fit_stream_start_hashes(fit, node, st.hashes);
+	if (st.hash_count < 0)
+		return st.hash_count;
+	ret = decomp_stream_init(&ds, comp, dst, CONFIG_SYS_BOOTM_LEN);
+	if (ret) {
+		fit_stream_abort_hashes(st.hashes, st.hash_count);
+		return ret;
+	}
+
+	ret = spl_fit_stream_start(&st, 0);
+	for (pos = 0; !ret && pos < size; pos += st.chunk) {
+		int idx = (pos / st.chunk) & 1;
+		ulong from = max(pos, overhead);
+		ulong to = min(pos + st.chunk, end);
+
+		ret = spl_fit_stream_wait(&st, idx);
+		if (!ret && pos + st.chunk < size)
+			ret = spl_fit_stream_start(&st, pos + st.chunk);
+		if (!ret && to > from)
+			ret = spl_fit_stream_unpack(&st, &ds,
+						    st.buf[idx] + from - pos,
+						    to - from, to == end);
+	}
+
+	/* the buffers must not be in use once this returns */
+	spl_fit_stream_wait(&st, 0);
+	spl_fit_stream_wait(&st, 1);
+	dret = decomp_stream_finish(&ds, &out);
+	if (!ret)
+		ret = dret;
+	if (ret) {
+		fit_stream_abort_hashes(st.hashes, st.hash_count);
+		puts("Uncompressing error\n");
+		return ret;
+	}
+	*lenp = out;
+
+	name = fit_get_name(fit, node, NULL);
+	printf("## Checking hash(es) for Image %s ... ", name);
+	if (fit_stream_check_hashes(fit, st.hashes, st.hash_count)) {
+		printf("error!\nBad hash value in '%s' image node\n", name);
+		return -EPERM;
+	}
+
+	/*
+	 * Keys may require every image to be signed. The image has no
+	 * signature nodes, else it would not have been streamed, so the data
+	 * is not looked at and this fails if any such key is present.
+	 */
+	if (FIT_IMAGE_ENABLE_VERIFY) {
+		int no_sigs;
+
+		if (fit_image_verify_required_sigs(fit, node, NULL, 0,
+						   gd_fdt_blob(), &no_sigs))
+			return -EPERM;
+	}
+	puts("OK\n");
+
+	return 0;
+}
+#else
+static inline int load_simple_fit_stream(struct spl_load_info *info,
+					 const void *fit, int node,
+					 ulong offset, ulong size,
+					 ulong overhead, ulong length,
+					 int comp, void *dst, size_t *lenp)
+{
+	return -ENOSYS;
+}
+#endif
+
 /**
  * load_simple_fit(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -225,6 +494,7 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 	const void *data;
 	const void *fit = ctx->fit;
 	bool external_data = false;
+	bool unpacked = false;
 
 	log_debug("starting\n");
 	if (CONFIG_IS_ENABLED(BOOTMETH_VBE) &&
@@ -279,6 +549,7 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 	if (external_data) {
 		ulong read_offset;
 		void *src_ptr;
+		int ret;
 
 		/* External data */
 		if (fit_image_get_data_size(fit, node, &len))
@@ -305,8 +576,26 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 		log_debug("reading from offset %x / %lx size %lx to %p: ",
 			  offset, read_offset, size, src_ptr);
 
-		if (info->read(info, read_offset, size, src_ptr) < length)
-			return -EIO;
+		if (spl_decompression_enabled() &&
+		    (image_comp == IH_COMP_GZIP || image_comp == IH_COMP_LZMA)) {
+			ret = load_simple_fit_stream(info, fit, node,
+						     read_offset, size,
+						     overhead, length,
+						     image_comp,
+						     map_sysmem(load_addr, 0),
+						     &length);
+			if (ret && ret != -ENOSYS)
+				return ret;
+			unpacked = !ret;
+		}
+
+		if (!unpacked) {
+			bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ,
+					"spl_fit_read");
+			if (info->read(info, read_offset, size, src_ptr) < length)
+				return -EIO;
+			bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_READ);
+		}
 
 		debug("External data: dst=%p, offset=%x, size=%lx\n",
 		      src_ptr, offset, (unsigned long)length);
@@ -322,35 +611,46 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 		src = (void *)data;	/* cast away const */
 	}
 
-	if (CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
+	if (CONFIG_IS_ENABLED(FIT_SIGNATURE) && !unpacked) {
 		printf("## Checking hash(es) for Image %s ... ",
 		       fit_get_name(fit, node, NULL));
+		bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_VERIFY,
+				"spl_fit_verify");
 		if (!fit_image_verify_with_data(fit, node, gd_fdt_blob(), src,
 						length))
 			return -EPERM;
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_VERIFY);
 		puts("OK\n");
 	}
 
-	if (CONFIG_IS_ENABLED(FIT_IMAGE_POST_PROCESS))
+	if (CONFIG_IS_ENABLED(FIT_IMAGE_POST_PROCESS) && !unpacked)
 		board_fit_image_post_process(fit, node, &src, &length);
 
 	load_ptr = map_sysmem(load_addr, length);
-	if (IS_ENABLED(CONFIG_SPL_GZIP) && image_comp == IH_COMP_GZIP) {
+	if (unpacked) {
+		/* already decompressed into place while it was read */
+	} else if (IS_ENABLED(CONFIG_SPL_GZIP) && image_comp == IH_COMP_GZIP) {
 		size = length;
+		bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_DECOMP,
+				"spl_fit_decomp");
 		if (gunzip(load_ptr, CONFIG_SYS_BOOTM_LEN, src, &size)) {
 			puts("Uncompressing error\n");
 			return -EIO;
 		}
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_DECOMP);
 		length = size;
 	} else if (IS_ENABLED(CONFIG_SPL_LZMA) && image_comp == IH_COMP_LZMA) {
 		size = CONFIG_SYS_BOOTM_LEN;
 		ulong loadEnd;
 
+		bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_DECOMP,
+				"spl_fit_decomp");
 		if (image_decomp(IH_COMP_LZMA, CONFIG_SYS_LOAD_ADDR, 0, 0,
 				 load_ptr, src, length, size, &loadEnd)) {
 			puts("Uncompressing error\n");
 			return -EIO;
 		}
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_DECOMP);
 		length = loadEnd - CONFIG_SYS_LOAD_ADDR;
 	} else {
 		memmove(load_ptr, src, length);
@@ -46,6 +46,7 @@ int mmc_load_image_raw_sector(struct spl_image_info *spl_image,
 	struct spl_load_info load;
 
 	spl_load_init(&load, h_spl_load_read, bd, bd->blksz);
+	spl_load_set_blk_desc(&load, bd);
 	ret = spl_load(spl_image, bootdev, &load, 0, sector << bd->log2blksz);
 	if (ret) {
 		puts("mmc_load_image_raw_sector: mmc block read error\n");
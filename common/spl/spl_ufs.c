@@ -36,6 +36,7 @@ static int spl_ufs_load_image(struct spl_image_info *spl_image,
 		return -ENODEV;
 
 	spl_load_init(&load, spl_ufs_load_read, bd, bd->blksz);
+	spl_load_set_blk_desc(&load, bd);
 	err = spl_load(spl_image, bootdev, &load, 0, sector << bd->log2blksz);
 	if (err) {
 		puts("spl_ufs_load_image: ufs block read error\n");
@@ -42,6 +42,7 @@
 #include <asm/byteorder.h>
 #include <asm/cache.h>
 #include <asm/processor.h>
+#include <asm/unaligned.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <linux/delay.h>
@@ -59,11 +60,21 @@
 static const unsigned char us_direction[256/8] = {
 	0x28, 0x81, 0x14, 0x14, 0x20, 0x01, 0x90, 0x77,
 	0x0C, 0x20, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x01, 0x00, 0x40, 0x00, 0x01, 0x00, 0x01,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 #define US_DIRECTION(x) ((us_direction[x>>3] >> (x & 7)) & 1)
 
+/*
+ * SBC READ(16) and WRITE(16), used for blocks which a 32-bit LBA cannot
+ * reach. Note that SCSI_READ16 in scsi.h is not the SBC opcode.
+ */
+#define USB_STOR_READ16		0x88
+#define USB_STOR_WRITE16	0x8a
+
+/* Service action of SCSI_RD_CAPAC16 */
+#define USB_STOR_SAI_RD_CAPAC16	0x10
+
 static struct scsi_cmd usb_ccb __aligned(ARCH_DMA_MINALIGN);
 static __u32 CBWTag;
 
@@ -971,9 +982,17 @@ static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
 	 * Windows 7 limiting transfers to 128 sectors for both USB2 and USB3
 	 * and Apple Mac OS X 10.11 limiting transfers to 256 sectors for USB2
 	 * and 2048 for USB3 devices.
+	 *
+	 * SuperSpeed devices are newer than the ones with this problem, and
+	 * with each command costing a full CBW/data/CSW round trip the small
+	 * limit wastes much of the link, so follow OS X and allow 2048 sectors
+	 * for them.
 	 */
 	unsigned short blk = 240;
 
+	if (udev->speed >= USB_SPEED_SUPER)
+		blk = CONFIG_USB_STORAGE_SS_MAX_XFER_BLK;
+
 #if CONFIG_IS_ENABLED(DM_USB)
 	size_t size;
 	int ret;
@@ -1079,9 +1098,43 @@ static int usb_read_capacity(struct scsi_cmd *srb, struct us_data *ss)
 	return -1;
 }
 
+static int usb_read_capacity_16(struct scsi_cmd *srb, struct us_data *ss)
+{
+	int retry = 3;
+
+	do {
+		memset(&srb->cmd[0], 0, 16);
+		srb->cmd[0] = SCSI_RD_CAPAC16;
+		srb->cmd[1] = USB_STOR_SAI_RD_CAPAC16;
+		srb->cmd[13] = 32;
+		srb->datalen = 32;
+		srb->cmdlen = 16;
+		if (ss->transport(srb, ss) == USB_STOR_TRANSPORT_GOOD)
+			return 0;
+	} while (retry--);
+
+	return -1;
+}
+
+/* Issue READ(16) or WRITE(16), for transfers reaching beyond 2 TiB */
+static int usb_rw_16(struct scsi_cmd *srb, struct us_data *ss, u8 opcode,
+		     lbaint_t start, unsigned short blocks)
+{
+	memset(&srb->cmd[0], 0, 16);
+	srb->cmd[0] = opcode;
+	put_unaligned_be64(start, &srb->cmd[2]);
+	put_unaligned_be32(blocks, &srb->cmd[10]);
+	srb->cmdlen = 16;
+	debug("rw16: op %x start " LBAF " blocks %x\n", opcode, start, blocks);
+	return ss->transport(srb, ss);
+}
+
 static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
-		       unsigned long start, unsigned short blocks)
+		       lbaint_t start, unsigned short blocks)
 {
+	if (upper_32_bits(start + blocks - 1))
+		return usb_rw_16(srb, ss, USB_STOR_READ16, start, blocks);
+
 	memset(&srb->cmd[0], 0, 12);
 	srb->cmd[0] = SCSI_READ10;
 	srb->cmd[1] = srb->lun << 5;
@@ -1092,13 +1145,16 @@ static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
 	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
 	srb->cmd[8] = (unsigned char) blocks & 0xff;
 	srb->cmdlen = ss->cmd12 ? 12 : 10;
-	debug("read10: start %lx blocks %x\n", start, blocks);
+	debug("read10: start " LBAF " blocks %x\n", start, blocks);
 	return ss->transport(srb, ss);
 }
 
 static int usb_write_10(struct scsi_cmd *srb, struct us_data *ss,
-			unsigned long start, unsigned short blocks)
+			lbaint_t start, unsigned short blocks)
 {
+	if (upper_32_bits(start + blocks - 1))
+		return usb_rw_16(srb, ss, USB_STOR_WRITE16, start, blocks);
+
 	memset(&srb->cmd[0], 0, 12);
 	srb->cmd[0] = SCSI_WRITE10;
 	srb->cmd[1] = srb->lun << 5;
@@ -1109,7 +1165,7 @@ static int usb_write_10(struct scsi_cmd *srb, struct us_data *ss,
 	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
 	srb->cmd[8] = (unsigned char) blocks & 0xff;
 	srb->cmdlen = ss->cmd12 ? 12 : 10;
-	debug("write10: start %lx blocks %x\n", start, blocks);
+	debug("write10: start " LBAF " blocks %x\n", start, blocks);
 	return ss->transport(srb, ss);
 }
 
@@ -1441,8 +1497,9 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	unsigned char perq, modi;
 	ALLOC_CACHE_ALIGN_BUFFER(u32, cap, 2);
 	ALLOC_CACHE_ALIGN_BUFFER(u8, usb_stor_buf, 36);
-	u32 capacity, blksz;
 	struct scsi_cmd *pccb = &usb_ccb;
+	lbaint_t capacity;
+	u32 blksz;
 
 	pccb->pdata = usb_stor_buf;
 
@@ -1508,10 +1565,20 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	cap[1] = cpu_to_be32(cap[1]);
 #endif
 
-	capacity = be32_to_cpu(cap[0]) + 1;
+	capacity = (lbaint_t)be32_to_cpu(cap[0]) + 1;
 	blksz = be32_to_cpu(cap[1]);
 
-	debug("Capacity = 0x%08x, blocksz = 0x%08x\n", capacity, blksz);
+	/* the device is too large for READ CAPACITY(10), so ask again */
+	if (IS_ENABLED(CONFIG_SYS_64BIT_LBA) && !ss->cmd12 &&
+	    cap[0] == cpu_to_be32(0xffffffff)) {
+		pccb->pdata = usb_stor_buf;
+		if (!usb_read_capacity_16(pccb, ss)) {
+			capacity = get_unaligned_be64(usb_stor_buf) + 1;
+			blksz = get_unaligned_be32(usb_stor_buf + 8);
+		}
+	}
+
+	debug("Capacity = " LBAF ", blocksz = 0x%08x\n", capacity, blksz);
 	dev_desc->lba = capacity;
 	dev_desc->blksz = blksz;
 	dev_desc->log2blksz = LOG2(dev_desc->blksz);
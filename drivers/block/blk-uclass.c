@@ -11,6 +11,7 @@
 #include <log.h>
 #include <malloc.h>
 #include <part.h>
+#include <watchdog.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/uclass-internal.h>
@@ -18,6 +19,20 @@
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
 
+/**
+ * struct blk_uclass_priv - Uclass information about each block device
+ *
+ * @reqs: Asynchronous requests which have not finished, oldest first
+ * @active: Request which the driver is working on, or NULL
+ * @busy: true while starting requests or moving them along, so that a
+ *	request submitted from a completion function is only queued
+ */
+struct blk_uclass_priv {
+	struct list_head reqs;
+	struct blk_req *active;
+	bool busy;
+};
+
 static struct {
 	enum uclass_id id;
 	const char *name;
@@ -40,6 +55,9 @@ static struct {
 	{ UCLASS_MTD, "ubi" },
 };
 
+/* Last value given to a blk_desc's seq, so that no two values are the same */
+static uint blk_seq;
+
 static enum uclass_id uclass_name_to_iftype(const char *uclass_idname)
 {
 	int i;
@@ -429,19 +447,13 @@ static int blk_buffer_aligned(struct bounce_buffer *state)
 	return 1;	/* Default, any buffer is OK */
 }
 
-long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
+static long blk_read_dev(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
+			 void *buf)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
 	ulong blks_read;
 
-	if (!ops->read)
-		return -ENOSYS;
-
-	if (blkcache_read(desc->uclass_id, desc->devnum,
-			  start, blkcnt, desc->blksz, buf))
-		return blkcnt;
-
 	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
 		struct blk_bounce_buffer bbstate = { .dev = dev };
 		int ret;
@@ -460,6 +472,43 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 		blks_read = ops->read(dev, start, blkcnt, buf);
 	}
 
+	return blks_read;
+}
+
+long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	lbaint_t racnt;
+	long blks_read;
+	void *rabuf;
+
+	if (!ops->read)
+		return -ENOSYS;
+
+	if (CONFIG_IS_ENABLED(BLK_ASYNC))
+		blk_req_flush(dev);
+
+	if (blkcache_read(desc->uclass_id, desc->devnum,
+			  start, blkcnt, desc->blksz, buf))
+		return blkcnt;
+
+	/* small sequential reads are served from a larger readahead window */
+	rabuf = blkcache_readahead(desc->uclass_id, desc->devnum, start, blkcnt,
+				   desc->blksz, &racnt);
+	if (rabuf && start < desc->lba) {
+		racnt = min(racnt, desc->lba - start);
+		blks_read = racnt > blkcnt ?
+			blk_read_dev(dev, start, racnt, rabuf) : 0;
+		blkcache_readahead_done(desc->uclass_id, desc->devnum, start,
+					blks_read > 0 ? blks_read : 0);
+		if (blks_read >= (long)blkcnt) {
+			memcpy(buf, rabuf, blkcnt * desc->blksz);
+			return blkcnt;
+		}
+	}
+
+	blks_read = blk_read_dev(dev, start, blkcnt, buf);
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
 			      desc->blksz, buf);
@@ -477,7 +526,11 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 	if (!ops->write)
 		return -ENOSYS;
 
+	if (CONFIG_IS_ENABLED(BLK_ASYNC))
+		blk_req_flush(dev);
+
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blk_changed(desc);
 
 	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
 		struct blk_bounce_buffer bbstate = { .dev = dev };
@@ -509,11 +562,249 @@ long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
 	if (!ops->erase)
 		return -ENOSYS;
 
+	if (CONFIG_IS_ENABLED(BLK_ASYNC))
+		blk_req_flush(dev);
+
 	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	blk_changed(desc);
 
 	return ops->erase(dev, start, blkcnt);
 }
 
+void blk_changed(struct blk_desc *desc)
+{
+	desc->seq = ++blk_seq;
+}
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+void blk_req_init(struct blk_req *req, struct udevice *dev,
+		  enum blk_req_op op, lbaint_t start, struct blk_sg *sg,
+		  int sg_count)
+{
+	memset(req, '\0', sizeof(*req));
+	req->dev = dev;
+	req->op = op;
+	req->start = start;
+	req->sg = sg;
+	req->sg_count = sg_count;
+	INIT_LIST_HEAD(&req->sibling);
+}
+
+lbaint_t blk_req_blkcnt(const struct blk_req *req)
+{
+	lbaint_t blkcnt = 0;
+	int i;
+
+	for (i = 0; i < req->sg_count; i++)
+		blkcnt += req->sg[i].blkcnt;
+
+	return blkcnt;
+}
+
+lbaint_t blk_req_next(struct blk_req *req, lbaint_t max, lbaint_t *startp,
+		      void **bufp)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(req->dev);
+	struct blk_sg *sg;
+	lbaint_t cnt;
+
+	while (req->sg_idx < req->sg_count &&
+	       req->sg_off == req->sg[req->sg_idx].blkcnt) {
+		req->sg_idx++;
+		req->sg_off = 0;
+	}
+	if (req->sg_idx == req->sg_count)
+		return 0;
+
+	sg = &req->sg[req->sg_idx];
+	cnt = min(max, sg->blkcnt - req->sg_off);
+	*startp = req->start + req->queued;
+	*bufp = sg->buf + req->sg_off * desc->blksz;
+	req->sg_off += cnt;
+	req->queued += cnt;
+
+	return cnt;
+}
+
+void blk_req_complete(struct blk_req *req, int status)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(req->dev);
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(req->dev);
+
+	if (priv->active == req)
+		priv->active = NULL;
+	list_del_init(&req->sibling);
+	if (req->op == BLK_REQ_WRITE) {
+		blkcache_invalidate(desc->uclass_id, desc->devnum);
+		blk_changed(desc);
+	}
+	req->status = status;
+	if (req->complete)
+		req->complete(req);
+}
+
+/**
+ * blk_req_run() - Carry out a request synchronously
+ *
+ * This is used for devices which cannot carry out requests asynchronously.
+ *
+ * @req: Request to carry out
+ * Return: 0 if OK, -ve on error
+ */
+static int blk_req_run(struct blk_req *req)
+{
+	int i;
+
+	for (i = 0; i < req->sg_count; i++) {
+		struct blk_sg *sg = &req->sg[i];
+		long ret;
+
+		if (req->op == BLK_REQ_READ)
+			ret = blk_read(req->dev, req->start + req->done,
+				       sg->blkcnt, sg->buf);
+		else
+			ret = blk_write(req->dev, req->start + req->done,
+					sg->blkcnt, sg->buf);
+		if (ret != sg->blkcnt)
+			return ret < 0 ? ret : -EIO;
+		req->done += ret;
+	}
+
+	return 0;
+}
+
+/**
+ * blk_req_start() - Start queued requests while the device is free
+ *
+ * Requests which the driver cannot carry out asynchronously are run to
+ * completion here, after which the next one is started.
+ *
+ * @dev: Block device
+ */
+static void blk_req_start(struct udevice *dev)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (priv->busy)
+		return;
+	priv->busy = true;
+	while (!priv->active && !list_empty(&priv->reqs)) {
+		struct blk_req *req;
+		int ret = -ENOSYS;
+
+		req = list_first_entry(&priv->reqs, struct blk_req, sibling);
+		priv->active = req;
+		/* the bounce buffer is only set up for synchronous transfers */
+		if (ops->submit && !(IS_ENABLED(CONFIG_BOUNCE_BUFFER) &&
+				     desc->bb)) {
+			ret = ops->submit(dev, req);
+			if (!ret)
+				continue;
+			if (ret == -EAGAIN) {
+				priv->active = NULL;
+				break;
+			}
+		}
+		if (ret == -ENOSYS)
+			ret = blk_req_run(req);
+		blk_req_complete(req, ret);
+	}
+	priv->busy = false;
+}
+
+int blk_req_submit(struct blk_req *req)
+{
+	struct udevice *dev = req->dev;
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (!device_active(dev))
+		return -ENODEV;
+	if (req->op == BLK_REQ_READ ? !ops->read : !ops->write)
+		return -ENOSYS;
+
+	if (req->op == BLK_REQ_WRITE) {
+		blkcache_invalidate(desc->uclass_id, desc->devnum);
+		blk_changed(desc);
+	}
+	req->status = -EINPROGRESS;
+	req->done = 0;
+	req->queued = 0;
+	req->sg_idx = 0;
+	req->sg_off = 0;
+	list_add_tail(&req->sibling, &priv->reqs);
+	blk_req_start(dev);
+
+	return 0;
+}
+
+int blk_req_poll(struct udevice *dev)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (!priv->busy && priv->active) {
+		if (!ops->poll)
+			return -ENOSYS;
+		priv->busy = true;
+		ops->poll(dev, priv->active);
+		priv->busy = false;
+	}
+	blk_req_start(dev);
+
+	return list_count_nodes(&priv->reqs);
+}
+
+int blk_req_wait(struct blk_req *req)
+{
+	while (req->status == -EINPROGRESS) {
+		int ret = blk_req_poll(req->dev);
+
+		if (ret < 0)
+			return ret;
+		schedule();
+	}
+
+	return req->status;
+}
+
+void blk_req_flush(struct udevice *dev)
+{
+	struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+	/*
+	 * A transfer made while requests are being started or completed
+	 * cannot wait for them
+	 */
+	if (!priv || priv->busy)
+		return;
+	while (!list_empty(&priv->reqs)) {
+		LIST_HEAD(failed);
+		int ret;
+
+		ret = blk_req_poll(dev);
+		if (ret >= 0) {
+			schedule();
+			continue;
+		}
+
+		/* the requests cannot move on, so fail them all */
+		log_err("Cannot complete block requests on %s (err=%d)\n",
+			dev->name, ret);
+		list_splice_init(&priv->reqs, &failed);
+		priv->busy = true;
+		while (!list_empty(&failed))
+			blk_req_complete(list_first_entry(&failed,
+							  struct blk_req,
+							  sibling), ret);
+		priv->busy = false;
+	}
+}
+#endif /* BLK_ASYNC */
+
 ulong blk_dread(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
 		void *buffer)
 {
@@ -826,8 +1117,22 @@ static int part_create_block_devices(struct udevice *blk_dev)
 	return 0;
 }
 
+static int blk_pre_probe(struct udevice *dev)
+{
+	if (CONFIG_IS_ENABLED(BLK_ASYNC)) {
+		struct blk_uclass_priv *priv = dev_get_uclass_priv(dev);
+
+		INIT_LIST_HEAD(&priv->reqs);
+	}
+
+	return 0;
+}
+
 static int blk_post_probe(struct udevice *dev)
 {
+	/* the device may hold something quite different from last time */
+	blk_changed(dev_get_uclass_plat(dev));
+
 	if (CONFIG_IS_ENABLED(PARTITIONS) && blk_enabled()) {
 		struct blk_desc *desc = dev_get_uclass_plat(dev);
 
@@ -841,9 +1146,22 @@ static int blk_post_probe(struct udevice *dev)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	if (CONFIG_IS_ENABLED(BLK_ASYNC))
+		blk_req_flush(dev);
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
+	.pre_probe	= blk_pre_probe,
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
 	.per_device_plat_auto	= sizeof(struct blk_desc),
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	.per_device_auto	= sizeof(struct blk_uclass_priv),
+#endif
 };
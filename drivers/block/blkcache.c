@@ -7,56 +7,230 @@
 #include <blk.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <asm/global_data.h>
 #include <linux/ctype.h>
+#include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 
-struct block_cache_node {
+/* Number of hash buckets used to index cache entries, as a power of two */
+#define BLKCACHE_HASH_BITS	6
+#define BLKCACHE_HASH_SIZE	(1 << BLKCACHE_HASH_BITS)
+
+/* Number of back-to-back sequential reads before readahead kicks in */
+#define BLKCACHE_RA_TRIGGER	2
+
+/**
+ * struct blkcache_dev - per-device block-cache state
+ *
+ * @lh: Entry in the list of known devices
+ * @iftype: uclass_id_x for type of device
+ * @devnum: device index of particular type
+ * @blksz: size in bytes of each block
+ * @next: block following the last read, used to detect sequential streams
+ * @seq: number of consecutive sequential reads seen so far
+ * @ra_buf: readahead window, or NULL if not allocated yet
+ * @ra_start: first block held in @ra_buf
+ * @ra_cnt: number of valid blocks in @ra_buf
+ */
+struct blkcache_dev {
 	struct list_head lh;
 	int iftype;
 	int devnum;
+	unsigned long blksz;
+	lbaint_t next;
+	unsigned int seq;
+	char *ra_buf;
+	lbaint_t ra_start;
+	lbaint_t ra_cnt;
+};
+
+/**
+ * struct block_cache_node - a cached run of blocks
+ *
+ * @lh: Entry in the MRU list of all cached runs
+ * @hn: Entry in the hash chain for the segment containing @start
+ * @bdev: Device the blocks belong to
+ * @start: first block number
+ * @blkcnt: number of blocks held
+ * @size: number of bytes allocated for @cache
+ * @cache: cached data
+ */
+struct block_cache_node {
+	struct list_head lh;
+	struct hlist_node hn;
+	struct blkcache_dev *bdev;
 	lbaint_t start;
 	lbaint_t blkcnt;
-	unsigned long blksz;
+	unsigned long size;
 	char *cache;
 };
 
 static LIST_HEAD(block_cache);
+static LIST_HEAD(blkcache_devs);
+static struct hlist_head blkcache_hash[BLKCACHE_HASH_SIZE];
 
 static struct block_cache_stats _stats = {
 	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_entries = 128,
+	.max_size = CONFIG_BLOCK_CACHE_SIZE,
+	.ra_blocks = CONFIG_BLOCK_CACHE_READAHEAD,
 };
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+/*
+ * Entries are indexed by the aligned segment holding their first block. A
+ * segment is at least max_blocks_per_entry long, so an entry covering a given
+ * block always starts in that block's segment or in the one before it.
+ */
+static lbaint_t blkcache_seg(lbaint_t start)
+{
+	return start >> order_base_2(max(_stats.max_blocks_per_entry, 1U));
+}
+
+static struct hlist_head *blkcache_bucket(struct blkcache_dev *bdev,
+					  lbaint_t seg)
+{
+	u32 key;
+
+	key = lower_32_bits(seg) ^ upper_32_bits(seg);
+	key ^= (bdev->iftype << 24) ^ (bdev->devnum << 16);
+
+	return &blkcache_hash[(key * 0x9e3779b1) >> (32 - BLKCACHE_HASH_BITS)];
+}
+
+static struct blkcache_dev *blkcache_dev_find(int iftype, int devnum)
+{
+	struct blkcache_dev *bdev;
+
+	list_for_each_entry(bdev, &blkcache_devs, lh)
+		if (bdev->iftype == iftype && bdev->devnum == devnum)
+			return bdev;
+
+	return NULL;
+}
+
+static void cache_remove(struct block_cache_node *node)
+{
+	list_del(&node->lh);
+	hlist_del(&node->hn);
+	_stats.entries--;
+	_stats.size -= node->size;
+	debug("drop: start " LBAF ", count " LBAFU "\n",
+	      node->start, node->blkcnt);
+}
+
+static void cache_free(struct block_cache_node *node)
+{
+	free(node->cache);
+	free(node);
+}
+
+static void blkcache_dev_flush(struct blkcache_dev *bdev)
+{
+	struct block_cache_node *node, *n;
+
+	list_for_each_entry_safe(node, n, &block_cache, lh) {
+		if (node->bdev == bdev) {
+			cache_remove(node);
+			cache_free(node);
+		}
+	}
+	bdev->ra_cnt = 0;
+	bdev->seq = 0;
+}
+
+static struct blkcache_dev *blkcache_dev_get(int iftype, int devnum,
+					     unsigned long blksz)
+{
+	struct blkcache_dev *bdev;
+
+	bdev = blkcache_dev_find(iftype, devnum);
+	if (bdev) {
+		if (bdev->blksz != blksz) {
+			/* device was re-initialised with another block size */
+			blkcache_dev_flush(bdev);
+			free(bdev->ra_buf);
+			bdev->ra_buf = NULL;
+			bdev->blksz = blksz;
+		}
+		if (blkcache_devs.next != &bdev->lh) {
+			/* keep the most recently used device first */
+			list_del(&bdev->lh);
+			list_add(&bdev->lh, &blkcache_devs);
+		}
+		return bdev;
+	}
+
+	bdev = calloc(1, sizeof(*bdev));
+	if (!bdev)
+		return NULL;
+	bdev->iftype = iftype;
+	bdev->devnum = devnum;
+	bdev->blksz = blksz;
+	list_add(&bdev->lh, &blkcache_devs);
+
+	return bdev;
+}
+
+static struct block_cache_node *cache_find(struct blkcache_dev *bdev,
+					   lbaint_t start, lbaint_t blkcnt)
 {
 	struct block_cache_node *node;
+	lbaint_t seg = blkcache_seg(start);
+	int i;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
+	for (i = 0; i < 2 && i <= seg; i++) {
+		hlist_for_each_entry(node, blkcache_bucket(bdev, seg - i), hn) {
+			if (node->bdev == bdev &&
+			    node->start <= start &&
+			    node->start + node->blkcnt >= start + blkcnt) {
+				if (block_cache.next != &node->lh) {
+					/* maintain MRU ordering */
+					list_del(&node->lh);
+					list_add(&node->lh, &block_cache);
+				}
+				return node;
 			}
-			return node;
 		}
-	return 0;
+	}
+
+	return NULL;
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
+	struct block_cache_node *node;
+	struct blkcache_dev *bdev;
+
+	bdev = blkcache_dev_get(iftype, devnum, blksz);
+	if (!bdev) {
+		++_stats.misses;
+		return 0;
+	}
+
+	/* track sequential streams so that blkcache_readahead() can kick in */
+	if (start == bdev->next)
+		bdev->seq++;
+	else
+		bdev->seq = 0;
+	bdev->next = start + blkcnt;
+
+	if (bdev->ra_cnt && bdev->ra_start <= start &&
+	    bdev->ra_start + bdev->ra_cnt >= start + blkcnt) {
+		memcpy(buffer, bdev->ra_buf + (start - bdev->ra_start) * blksz,
+		       blksz * blkcnt);
+		debug("ra hit: start " LBAF ", count " LBAFU "\n",
+		      start, blkcnt);
+		++_stats.hits;
+		++_stats.ra_hits;
+		return 1;
+	}
+
+	node = cache_find(bdev, start, blkcnt);
 	if (node) {
 		const char *src = node->cache + (start - node->start) * blksz;
 		memcpy(buffer, src, blksz * blkcnt);
@@ -76,69 +250,114 @@ void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
+	struct block_cache_node *node, *victim;
+	struct blkcache_dev *bdev;
+	unsigned long bytes;
 
 	/* don't cache big stuff */
 	if (blkcnt > _stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
+	bytes = blksz * blkcnt;
+	if (_stats.max_entries == 0 || bytes > _stats.max_size)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
+	bdev = blkcache_dev_get(iftype, devnum, blksz);
+	if (!bdev)
+		return;
+
+	/* pop LRU entries until the new one fits, recycling one if possible */
+	node = NULL;
+	while (!list_empty(&block_cache) &&
+	       (_stats.entries >= _stats.max_entries ||
+		_stats.size + bytes > _stats.max_size)) {
+		victim = list_last_entry(&block_cache, struct block_cache_node,
+					 lh);
+		cache_remove(victim);
+		if (!node && victim->size == bytes)
+			node = victim;
+		else
+			cache_free(victim);
+	}
+
+	if (!node) {
 		node = malloc(sizeof(*node));
 		if (!node)
 			return;
-		node->cache = 0;
-	}
-
-	if (!node->cache) {
 		node->cache = malloc(bytes);
 		if (!node->cache) {
 			free(node);
 			return;
 		}
+		node->size = bytes;
 	}
 
 	debug("fill: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
+	node->bdev = bdev;
 	node->start = start;
 	node->blkcnt = blkcnt;
-	node->blksz = blksz;
 	memcpy(node->cache, buffer, bytes);
 	list_add(&node->lh, &block_cache);
+	hlist_add_head(&node->hn, blkcache_bucket(bdev, blkcache_seg(start)));
 	_stats.entries++;
+	_stats.size += node->size;
+}
+
+void *blkcache_readahead(int iftype, int devnum, lbaint_t start,
+			 lbaint_t blkcnt, unsigned long blksz, lbaint_t *cntp)
+{
+	struct blkcache_dev *bdev;
+
+	if (blkcnt >= _stats.ra_blocks)
+		return NULL;
+
+	bdev = blkcache_dev_find(iftype, devnum);
+	if (!bdev || bdev->blksz != blksz || bdev->seq < BLKCACHE_RA_TRIGGER)
+		return NULL;
+
+	if (!bdev->ra_buf) {
+		bdev->ra_buf = memalign(ARCH_DMA_MINALIGN,
+					ALIGN(_stats.ra_blocks * blksz,
+					      ARCH_DMA_MINALIGN));
+		if (!bdev->ra_buf)
+			return NULL;
+	}
+	bdev->ra_cnt = 0;
+	*cntp = _stats.ra_blocks;
+
+	return bdev->ra_buf;
+}
+
+void blkcache_readahead_done(int iftype, int devnum, lbaint_t start,
+			     lbaint_t cnt)
+{
+	struct blkcache_dev *bdev;
+
+	bdev = blkcache_dev_find(iftype, devnum);
+	if (!bdev || !bdev->ra_buf)
+		return;
+
+	debug("readahead: start " LBAF ", count " LBAFU "\n", start, cnt);
+	bdev->ra_start = start;
+	bdev->ra_cnt = cnt;
+	if (cnt)
+		++_stats.readaheads;
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct blkcache_dev *bdev, *n;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if (iftype == -1 ||
-		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
+	list_for_each_entry_safe(bdev, n, &blkcache_devs, lh) {
+		if (iftype == -1) {
+			blkcache_dev_flush(bdev);
+			list_del(&bdev->lh);
+			free(bdev->ra_buf);
+			free(bdev);
+		} else if (bdev->iftype == iftype && bdev->devnum == devnum) {
+			blkcache_dev_flush(bdev);
 		}
 	}
 }
@@ -155,6 +374,19 @@ void blkcache_configure(unsigned blocks, unsigned entries)
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.ra_hits = 0;
+	_stats.readaheads = 0;
+}
+
+void blkcache_configure_size(unsigned long max_size, unsigned ra_blocks)
+{
+	/* invalidate cache if there is a change */
+	if ((max_size != _stats.max_size) ||
+	    (ra_blocks != _stats.ra_blocks))
+		blkcache_invalidate(-1, 0);
+
+	_stats.max_size = max_size;
+	_stats.ra_blocks = ra_blocks;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -162,6 +394,8 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.ra_hits = 0;
+	_stats.readaheads = 0;
 }
 
 void blkcache_free(void)
@@ -52,9 +52,46 @@ static unsigned long host_block_write(struct udevice *dev,
 	return -EIO;
 }
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+/* Blocks moved by each call to host_block_poll() */
+#define HOST_BLOCK_POLL_BLKS	64
+
+static int host_block_submit(struct udevice *dev, struct blk_req *req)
+{
+	/* the transfer is done a piece at a time as the request is polled */
+	return 0;
+}
+
+static void host_block_poll(struct udevice *dev, struct blk_req *req)
+{
+	lbaint_t start, cnt;
+	void *buf;
+	ulong ret;
+
+	cnt = blk_req_next(req, HOST_BLOCK_POLL_BLKS, &start, &buf);
+	if (cnt) {
+		if (req->op == BLK_REQ_READ)
+			ret = host_block_read(dev, start, cnt, buf);
+		else
+			ret = host_block_write(dev, start, cnt, buf);
+		if (ret != cnt) {
+			blk_req_complete(req, -EIO);
+			return;
+		}
+		req->done += cnt;
+	}
+	if (req->done == blk_req_blkcnt(req))
+		blk_req_complete(req, 0);
+}
+#endif
+
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
+#endif
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
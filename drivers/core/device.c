@@ -33,6 +33,7 @@
 #include <linux/err.h>
 #include <linux/list.h>
 #include <power-domain.h>
+#include <uthread.h>
 #include <linux/printk.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -482,16 +483,130 @@ static int device_get_dma_constraints(struct udevice *dev)
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(DM_ASYNC_PROBE)
+/**
+ * struct probe_pending - a probe which has activated a device but not finished
+ *
+ * @sibling: Entry in the probe_pending list
+ * @dev: Device being probed
+ * @owner: Thread running the probe
+ */
+struct probe_pending {
+	struct list_head sibling;
+	struct udevice *dev;
+	struct uthread *owner;
+};
+
+static LIST_HEAD(probe_pending);
+static unsigned int probe_grp_id;
+static int probe_async_err;
+
+static void device_probe_start(struct probe_pending *pend, struct udevice *dev)
+{
+	pend->dev = dev;
+	pend->owner = uthread_current();
+	list_add(&pend->sibling, &probe_pending);
+}
+
+static void device_probe_end(struct probe_pending *pend)
+{
+	if (pend->dev)
+		list_del(&pend->sibling);
+}
+
+/*
+ * A device is marked as activated before its probe() method runs, so another
+ * thread may find it activated while its probe is still waiting on hardware.
+ * Let that probe finish first; the thread running it (e.g. a probe() method
+ * which ends up probing its own device again) must not wait for itself.
+ */
+static void device_probe_wait(struct udevice *dev)
+{
+	struct probe_pending *pend;
+
+	while (true) {
+		list_for_each_entry(pend, &probe_pending, sibling) {
+			if (pend->dev == dev)
+				break;
+		}
+		if (list_entry_is_head(pend, &probe_pending, sibling) ||
+		    pend->owner == uthread_current())
+			return;
+		uthread_schedule();
+	}
+}
+
+static void device_probe_thread(void *arg)
+{
+	struct udevice *dev = arg;
+	int ret;
+
+	ret = device_probe(dev);
+	if (ret) {
+		log_warning("Background probe of '%s' failed: %d (%s)\n",
+			    dev->name, ret, errno_str(ret));
+		if (!probe_async_err)
+			probe_async_err = ret;
+	}
+}
+
+int device_probe_async(struct udevice *dev)
+{
+	if (!dev)
+		return -EINVAL;
+
+	if (device_active(dev) ||
+	    !(dev->uclass->uc_drv->flags & DM_UC_FLAG_ASYNC_PROBE))
+		return device_probe(dev);
+
+	if (!probe_grp_id)
+		probe_grp_id = uthread_grp_new_id();
+	if (uthread_create(NULL, device_probe_thread, dev, 0, probe_grp_id))
+		return device_probe(dev);
+
+	return 0;
+}
+
+int dm_probe_join(void)
+{
+	int ret;
+
+	if (!probe_grp_id)
+		return 0;
+
+	while (!uthread_grp_done(probe_grp_id))
+		uthread_schedule();
+
+	ret = probe_async_err;
+	probe_async_err = 0;
+	probe_grp_id = 0;
+
+	return ret;
+}
+#else
+struct probe_pending {
+};
+
+static inline void device_probe_start(struct probe_pending *pend,
+				      struct udevice *dev) {}
+static inline void device_probe_end(struct probe_pending *pend) {}
+static inline void device_probe_wait(struct udevice *dev) {}
+#endif
+
 int device_probe(struct udevice *dev)
 {
+	struct probe_pending pend = {};
 	const struct driver *drv;
 	int ret;
 
 	if (!dev)
 		return -EINVAL;
 
-	if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
-		return 0;
+	if (dev_get_flags(dev) & DM_FLAG_ACTIVATED) {
+		device_probe_wait(dev);
+		if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
+			return 0;
+	}
 
 	ret = device_notify(dev, EVT_DM_PRE_PROBE);
 	if (ret)
@@ -514,13 +629,20 @@ int device_probe(struct udevice *dev)
 		 * The device might have already been probed during
 		 * the call to device_probe() on its parent device
 		 * (e.g. PCI bridge devices). Test the flags again
-		 * so that we don't mess up the device.
+		 * so that we don't mess up the device. If that probe was
+		 * running in the background and failed, it cleared the flag
+		 * and freed the device's data, so start again.
 		 */
-		if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
-			return 0;
+		if (dev_get_flags(dev) & DM_FLAG_ACTIVATED) {
+			device_probe_wait(dev);
+			if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
+				return 0;
+			return device_probe(dev);
+		}
 	}
 
 	dev_or_flags(dev, DM_FLAG_ACTIVATED);
+	device_probe_start(&pend, dev);
 
 	if (CONFIG_IS_ENABLED(POWER_DOMAIN) && dev->parent &&
 	    (device_get_uclass_id(dev) != UCLASS_POWER_DOMAIN) &&
@@ -605,6 +727,8 @@ int device_probe(struct udevice *dev)
 	if (ret)
 		goto fail_event;
 
+	device_probe_end(&pend);
+
 	return 0;
 fail_event:
 fail_uclass:
@@ -613,6 +737,7 @@ fail_uclass:
 			__func__, dev->name);
 	}
 fail:
+	device_probe_end(&pend);
 	dev_bic_flags(dev, DM_FLAG_ACTIVATED);
 
 	device_free(dev);
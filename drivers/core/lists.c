@@ -8,9 +8,12 @@
 
 #define LOG_CATEGORY LOGC_DM
 
+#include <bootstage.h>
 #include <debug_uart.h>
 #include <errno.h>
 #include <log.h>
+#include <malloc.h>
+#include <sort.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -18,7 +21,11 @@
 #include <dm/uclass.h>
 #include <dm/util.h>
 #include <fdtdec.h>
+#include <asm/global_data.h>
 #include <linux/compiler.h>
+#include <linux/kernel.h>
+
+DECLARE_GLOBAL_DATA_PTR;
 
 struct driver *lists_driver_lookup_name(const char *name)
 {
@@ -196,11 +203,215 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
-int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
-		   struct driver *drv, bool pre_reloc_only)
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+/**
+ * struct dm_compat_entry - A compatible string in the index
+ *
+ * Indexes are used rather than pointers so that the index does not depend on
+ * where U-Boot is running.
+ *
+ * @hash:	Hash of the string
+ * @drv:	Position of the driver in the driver linker list
+ * @id:		Position of the string in the driver's of_match table
+ */
+struct dm_compat_entry {
+	u32 hash;
+	u16 drv;
+	u16 id;
+};
+
+/**
+ * struct dm_compat_index - The compatible strings of all drivers
+ *
+ * @count:	Number of entries
+ * @entries:	Entries, sorted by hash, then driver, then string
+ */
+struct dm_compat_index {
+	int count;
+	struct dm_compat_entry entries[];
+};
+
+/* FNV-1a, which is quick and spreads short, similar strings well */
+static u32 lists_compat_hash(const char *str)
+{
+	u32 hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (u8)*str++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static int lists_compat_cmp(const void *va, const void *vb)
+{
+	const struct dm_compat_entry *a = va, *b = vb;
+
+	if (a->hash != b->hash)
+		return a->hash < b->hash ? -1 : 1;
+	if (a->drv != b->drv)
+		return a->drv - b->drv;
+
+	return a->id - b->id;
+}
+
+/**
+ * lists_compat_index() - get the index of compatible strings
+ *
+ * The index is built the first time it is needed in each phase of U-Boot.
+ *
+ * Return: index, or NULL if it could not be built
+ */
+static struct dm_compat_index *lists_compat_index(void)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	struct dm_compat_index *idx = gd->dm_compat_index;
+	const struct udevice_id *of_match;
+	struct dm_compat_entry *entry;
+	int count = 0;
+	int i;
+
+	if (idx || n_ents > U16_MAX)
+		return idx;
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_DM_COMPAT, "dm_compat");
+	for (i = 0; i < n_ents; i++) {
+		for (of_match = driver[i].of_match;
+		     of_match && of_match->compatible; of_match++)
+			count++;
+	}
+	idx = malloc(sizeof(*idx) + count * sizeof(*entry));
+	if (idx) {
+		idx->count = count;
+		entry = idx->entries;
+		for (i = 0; i < n_ents; i++) {
+			for (of_match = driver[i].of_match;
+			     of_match && of_match->compatible; of_match++) {
+				entry->hash =
+					lists_compat_hash(of_match->compatible);
+				entry->drv = i;
+				entry->id = of_match - driver[i].of_match;
+				entry++;
+			}
+		}
+		qsort(idx->entries, count, sizeof(*entry), lists_compat_cmp);
+		gd->dm_compat_index = idx;
+		log_debug("Indexed %d compatible strings\n", count);
+	}
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_DM_COMPAT);
+
+	return idx;
+}
+
+/**
+ * lists_compat_find() - look up a compatible string in the index
+ *
+ * @idx:	Index to search
+ * @compat:	Compatible string
+ * @start:	Position of the first driver to consider
+ * @idp:	Returns the matching string in the driver's of_match table
+ * Return: position of the driver, or -ENOENT if none
+ */
+static int lists_compat_find(struct dm_compat_index *idx, const char *compat,
+			     int start, const struct udevice_id **idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	struct dm_compat_entry key = {
+		.hash	= lists_compat_hash(compat),
+		.drv	= start,
+	};
+	int lo = 0, hi = idx->count;
+
+	/* find the first entry at or after the key */
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (lists_compat_cmp(&idx->entries[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < idx->count && idx->entries[lo].hash == key.hash; lo++) {
+		struct dm_compat_entry *entry = &idx->entries[lo];
+		const struct udevice_id *id;
+
+		id = &driver[entry->drv].of_match[entry->id];
+		if (!strcmp(id->compatible, compat)) {
+			*idp = id;
+			return entry->drv;
+		}
+	}
+
+	return -ENOENT;
+}
+#endif
+
+int lists_driver_lookup_compat(const char *compat, struct driver **drvp,
+			       const struct udevice_id **idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	int start = *drvp ? *drvp - driver + 1 : 0;
+	int i;
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	struct dm_compat_index *idx = lists_compat_index();
+
+	if (idx) {
+		i = lists_compat_find(idx, compat, start, idp);
+		if (i < 0)
+			return i;
+		*drvp = &driver[i];
+
+		return 0;
+	}
+#endif
+	for (i = start; i < n_ents; i++) {
+		if (!driver_check_compatible(driver[i].of_match, idp, compat)) {
+			*drvp = &driver[i];
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * lists_next_driver() - find the next driver to try for a compatible string
+ *
+ * @drv:	Driver to use, or NULL to try all drivers
+ * @entry:	Previous driver tried, or NULL for the first
+ * @compat:	Compatible string to match
+ * @idp:	Returns the matching string in the driver's of_match table, or
+ *		NULL if @drv is used and has no table
+ * Return: next driver, or NULL if there are no more
+ */
+static struct driver *lists_next_driver(struct driver *drv,
+					struct driver *entry,
+					const char *compat,
+					const struct udevice_id **idp)
+{
+	*idp = NULL;
+	if (drv) {
+		if (entry)
+			return NULL;
+		if (drv->of_match &&
+		    driver_check_compatible(drv->of_match, idp, compat))
+			return NULL;
+		return drv;
+	}
+	if (lists_driver_lookup_compat(compat, &entry, idp))
+		return NULL;
+
+	return entry;
+}
+
+int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
+		   struct driver *drv, bool pre_reloc_only)
+{
 	const struct udevice_id *id;
 	struct driver *entry;
 	struct udevice *dev;
@@ -235,24 +446,11 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		log_debug("   - attempt to match compatible string '%s'\n",
 			  compat);
 
-		for (entry = driver; entry != driver + n_ents; entry++) {
-			/* Search for drivers with matching drv or existing of_match */
-			if (drv) {
-				if (drv != entry)
-					continue;
-			} else if (!entry->of_match) {
-				continue;
-			}
-
-			id = NULL;
-			if (entry->of_match) {
-				ret = driver_check_compatible(entry->of_match, &id,
-							      compat);
-				if (ret)
-					continue;
+		for (entry = NULL;
+		     (entry = lists_next_driver(drv, entry, compat, &id));) {
+			if (id)
 				log_debug("   - found match at driver '%s' for '%s'\n",
 					  entry->name, id->compatible);
-			}
 
 			if (pre_reloc_only) {
 				if (!ofnode_pre_reloc(node) &&
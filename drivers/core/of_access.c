@@ -19,6 +19,7 @@
  * Linux version.
  */
 
+#include <bootstage.h>
 #include <log.h>
 #include <malloc.h>
 #include <asm/global_data.h>
@@ -29,6 +30,7 @@
 #include <linux/ctype.h>
 #include <linux/err.h>
 #include <linux/ioport.h>
+#include <linux/log2.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -67,6 +69,239 @@ struct alias_prop {
 	char stem[0];
 };
 
+#if CONFIG_IS_ENABLED(OF_LIVE_INDEX)
+enum {
+	OF_INDEX_TREES		= 4,	/* trees which can be indexed at once */
+	OF_INDEX_PATHS		= 64,	/* entries in each path cache */
+	OF_INDEX_MIN_SIZE	= 16,	/* smallest phandle table */
+};
+
+/**
+ * struct of_index - Lookup tables for a live tree
+ *
+ * Both tables only speed up lookups. Anything which is not found in them is
+ * looked for by walking the tree as usual.
+ *
+ * @root:	Root node of the tree, or NULL if this entry is not in use
+ * @phandles:	Nodes which have a phandle, in an open-addressed hash table
+ *		indexed by phandle. Since dtc numbers phandles from 1, this is
+ *		normally a direct lookup
+ * @mask:	Number of entries in @phandles, minus one
+ * @stale:	true if a node has been removed since @phandles was built
+ * @paths:	Nodes recently found by their full path, indexed by a hash of
+ *		the path
+ */
+struct of_index {
+	struct device_node *root;
+	struct device_node **phandles;
+	uint mask;
+	bool stale;
+	struct device_node *paths[OF_INDEX_PATHS];
+};
+
+static struct of_index of_index_list[OF_INDEX_TREES];
+
+/* next entry to reuse when all are taken */
+static uint of_index_victim;
+
+static struct of_index *of_index_find(const struct device_node *root)
+{
+	int i;
+
+	for (i = 0; i < OF_INDEX_TREES; i++) {
+		if (of_index_list[i].root == root)
+			return &of_index_list[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * of_index_fill() - Build the phandle table for a tree
+ *
+ * Nodes are added in the order in which of_find_node_by_phandle() would walk
+ * them, so the first node with a given phandle is the one found.
+ *
+ * @idx:	Index to fill in, with @idx->root set
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+static int of_index_fill(struct of_index *idx)
+{
+	struct device_node *np;
+	uint count = 0, size;
+
+	free(idx->phandles);
+	idx->phandles = NULL;
+	for_each_of_allnodes_from(idx->root, np) {
+		if (np->phandle)
+			count++;
+	}
+
+	/* keep the table at most half full so that probe chains are short */
+	size = roundup_pow_of_two(max_t(uint, count * 2, OF_INDEX_MIN_SIZE));
+	idx->phandles = calloc(size, sizeof(*idx->phandles));
+	if (!idx->phandles)
+		return -ENOMEM;
+	idx->mask = size - 1;
+	idx->stale = false;
+
+	for_each_of_allnodes_from(idx->root, np) {
+		uint i;
+
+		if (!np->phandle)
+			continue;
+		for (i = np->phandle & idx->mask; idx->phandles[i];
+		     i = (i + 1) & idx->mask) {
+			if (idx->phandles[i]->phandle == np->phandle)
+				break;
+		}
+		if (!idx->phandles[i])
+			idx->phandles[i] = np;
+	}
+
+	return 0;
+}
+
+int of_index_build(struct device_node *root)
+{
+	struct of_index *idx;
+	int ret;
+
+	if (!root)
+		return -EINVAL;
+	bootstage_start(BOOTSTAGE_ID_ACCUM_OF_INDEX, "of_index");
+	idx = of_index_find(root) ?: of_index_find(NULL);
+	while (!idx) {
+		/* keep the control tree, since it is used the most */
+		idx = &of_index_list[of_index_victim++ % OF_INDEX_TREES];
+		if (idx->root == gd->of_root)
+			idx = NULL;
+	}
+	of_index_drop(idx->root);
+
+	idx->root = root;
+	ret = of_index_fill(idx);
+	if (ret)
+		of_index_drop(root);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_OF_INDEX);
+
+	return ret;
+}
+
+void of_index_drop(struct device_node *root)
+{
+	struct of_index *idx;
+
+	if (!root)
+		return;
+	idx = of_index_find(root);
+	if (!idx)
+		return;
+	free(idx->phandles);
+	memset(idx, '\0', sizeof(*idx));
+}
+
+/**
+ * of_index_lookup() - Find the index for the tree which a lookup uses
+ *
+ * @root:	Root node passed to the lookup, or NULL for the control tree
+ * Return: index, or NULL if the tree is not indexed
+ */
+static struct of_index *of_index_lookup(const struct device_node *root)
+{
+	if (!root)
+		root = gd->of_root;
+
+	return root ? of_index_find(root) : NULL;
+}
+
+/**
+ * of_index_phandle() - Look up a phandle in the index
+ *
+ * @root:	Root node passed to the lookup, or NULL for the control tree
+ * @handle:	Phandle to find
+ * Return: node, or NULL if not in the index
+ */
+static struct device_node *of_index_phandle(const struct device_node *root,
+					    phandle handle)
+{
+	struct of_index *idx = of_index_lookup(root);
+	struct device_node *np;
+	uint i;
+
+	if (!idx || (idx->stale && of_index_fill(idx)))
+		return NULL;
+	for (i = handle & idx->mask; idx->phandles[i]; i = (i + 1) & idx->mask) {
+		np = idx->phandles[i];
+		if (np->phandle == handle)
+			return np;
+	}
+
+	return NULL;
+}
+
+/**
+ * of_index_path() - Find the path-cache entry for a path
+ *
+ * Only full paths are cached, since the full path of each node is held in the
+ * node and an entry can be checked against it.
+ *
+ * @root:	Root node of the tree
+ * @path:	Path to look up
+ * Return: entry to check and update, or NULL if the path is not cached
+ */
+static struct device_node **of_index_path(const struct device_node *root,
+					  const char *path)
+{
+	struct of_index *idx;
+	uint hash = 0;
+
+	if (*path != '/' || strchr(path, ':'))
+		return NULL;
+	idx = of_index_lookup(root);
+	if (!idx)
+		return NULL;
+	while (*path)
+		hash = hash * 31 + *path++;
+
+	return &idx->paths[hash % OF_INDEX_PATHS];
+}
+
+/**
+ * of_index_removed() - Note that a node has been removed from its tree
+ *
+ * @np:		Node which has been removed
+ */
+static void of_index_removed(struct device_node *np)
+{
+	struct of_index *idx;
+
+	while (np->parent)
+		np = np->parent;
+	idx = of_index_find(np);
+	if (idx) {
+		idx->stale = true;
+		memset(idx->paths, '\0', sizeof(idx->paths));
+	}
+}
+#else
+static struct device_node *of_index_phandle(const struct device_node *root,
+					    phandle handle)
+{
+	return NULL;
+}
+
+static struct device_node **of_index_path(const struct device_node *root,
+					  const char *path)
+{
+	return NULL;
+}
+
+static void of_index_removed(struct device_node *np)
+{
+}
+#endif
+
 int of_n_addr_cells(const struct device_node *np)
 {
 	const __be32 *ip;
@@ -348,6 +583,7 @@ struct device_node *of_find_node_opts_by_path(struct device_node *root,
 					      const char **opts)
 {
 	struct device_node *np = NULL;
+	struct device_node **cached;
 	struct property *pp;
 	const char *separator = strchr(path, ':');
 
@@ -359,6 +595,10 @@ struct device_node *of_find_node_opts_by_path(struct device_node *root,
 	if (strcmp(path, "/") == 0)
 		return of_node_get(root);
 
+	cached = of_index_path(root, path);
+	if (cached && *cached && !strcmp((*cached)->full_name, path))
+		return of_node_get(*cached);
+
 	/* The path could begin with an alias */
 	if (*path != '/') {
 		int len;
@@ -400,6 +640,8 @@ struct device_node *of_find_node_opts_by_path(struct device_node *root,
 		if (separator && separator < path)
 			break;
 	}
+	if (cached && np)
+		*cached = np;
 
 	return np;
 }
@@ -453,6 +695,10 @@ struct device_node *of_find_node_by_phandle(struct device_node *root,
 	if (!handle)
 		return NULL;
 
+	np = of_index_phandle(root, handle);
+	if (np)
+		return of_node_get(np);
+
 	for_each_of_allnodes_from(root, np)
 		if (np->phandle == handle)
 			break;
@@ -1171,6 +1417,7 @@ int of_remove_node(struct device_node *to_remove)
 		prev->sibling = np->sibling;
 	else
 		parent->child = np->sibling;
+	of_index_removed(np);
 
 	/*
 	 * don't free it, since if this is an unflattened tree, all the memory
@@ -796,6 +796,172 @@ int ofnode_get_path(ofnode node, char *buf, int buflen)
 	}
 }
 
+#if CONFIG_IS_ENABLED(OFNODE_CACHE)
+/**
+ * struct ofnode_cache_entry - A node found in the control FDT
+ *
+ * @key:	Phandle of the node, or hash of its path
+ * @offset:	Offset of the node, or -1 if the entry is empty
+ */
+struct ofnode_cache_entry {
+	u32 key;
+	int offset;
+};
+
+/**
+ * struct ofnode_cache - Nodes recently looked up in the control FDT
+ *
+ * Adding or removing a node or property moves the nodes after it, which
+ * changes the size of the structure block, so the entries are dropped when
+ * that size or the position of the FDT changes. Each hit is checked against
+ * the node as well.
+ *
+ * @fdt:	FDT which the entries refer to
+ * @size:	Size of its structure block when the entries were added
+ * @phandles:	Nodes found by phandle, indexed by phandle
+ * @paths:	Nodes found by full path, indexed by a hash of the path
+ */
+struct ofnode_cache {
+	const void *fdt;
+	u32 size;
+	struct ofnode_cache_entry phandles[CONFIG_OFNODE_CACHE_SIZE];
+	struct ofnode_cache_entry paths[CONFIG_OFNODE_CACHE_SIZE];
+};
+
+/**
+ * ofnode_cache_get() - get the cache for a flat tree
+ *
+ * @fdt:	Tree being searched
+ * Return: cache, or NULL if @fdt is not the control FDT or there is no memory
+ */
+static struct ofnode_cache *ofnode_cache_get(const void *fdt)
+{
+	struct ofnode_cache *cache = gd->ofnode_cache;
+
+	if (fdt != gd->fdt_blob)
+		return NULL;
+	if (!cache) {
+		cache = malloc(sizeof(*cache));
+		if (!cache)
+			return NULL;
+		cache->fdt = NULL;
+		gd->ofnode_cache = cache;
+	}
+	if (cache->fdt != fdt || cache->size != fdt_size_dt_struct(fdt)) {
+		/* this sets each offset to -1 */
+		memset(cache->phandles, 0xff, sizeof(cache->phandles));
+		memset(cache->paths, 0xff, sizeof(cache->paths));
+		cache->fdt = fdt;
+		cache->size = fdt_size_dt_struct(fdt);
+	}
+
+	return cache;
+}
+
+/**
+ * ofnode_cache_name_ok() - check a node against the last part of its path
+ *
+ * @fdt:	Tree to check
+ * @offset:	Offset of node
+ * @path:	Full path of the node, which may leave out the unit address
+ * Return: true if the node has the name at the end of @path
+ */
+static bool ofnode_cache_name_ok(const void *fdt, int offset, const char *path)
+{
+	const char *want = strrchr(path, '/') + 1;
+	int wlen = strlen(want);
+	const char *name;
+	int len;
+
+	name = fdt_get_name(fdt, offset, &len);
+
+	return name && len >= wlen && !memcmp(name, want, wlen) &&
+		(len == wlen || name[wlen] == '@');
+}
+
+/**
+ * ofnode_fdt_phandle() - find a node in a flat tree by phandle
+ *
+ * @fdt:	Tree to search
+ * @phandle:	Phandle to find
+ * Return: offset of node, or -ve FDT_ERR_... value if not found
+ */
+static int ofnode_fdt_phandle(const void *fdt, uint phandle)
+{
+	struct ofnode_cache *cache = ofnode_cache_get(fdt);
+	struct ofnode_cache_entry *entry;
+	int offset;
+
+	if (!cache)
+		return fdt_node_offset_by_phandle(fdt, phandle);
+
+	entry = &cache->phandles[phandle % CONFIG_OFNODE_CACHE_SIZE];
+	if (entry->key == phandle && entry->offset >= 0 &&
+	    fdt_get_phandle(fdt, entry->offset) == phandle) {
+		gd->ofnode_cache_hits++;
+		return entry->offset;
+	}
+	gd->ofnode_cache_misses++;
+	offset = fdt_node_offset_by_phandle(fdt, phandle);
+	if (offset >= 0) {
+		entry->key = phandle;
+		entry->offset = offset;
+	}
+
+	return offset;
+}
+
+/**
+ * ofnode_fdt_path() - find a node in a flat tree by path
+ *
+ * Paths which start with an alias are not cached.
+ *
+ * @fdt:	Tree to search
+ * @path:	Path to find
+ * Return: offset of node, or -ve FDT_ERR_... value if not found
+ */
+static int ofnode_fdt_path(const void *fdt, const char *path)
+{
+	struct ofnode_cache *cache = NULL;
+	struct ofnode_cache_entry *entry;
+	const char *p;
+	int offset;
+	u32 hash;
+
+	if (*path == '/')
+		cache = ofnode_cache_get(fdt);
+	if (!cache)
+		return fdt_path_offset(fdt, path);
+
+	for (hash = 0, p = path; *p; p++)
+		hash = hash * 31 + *p;
+	entry = &cache->paths[hash % CONFIG_OFNODE_CACHE_SIZE];
+	if (entry->key == hash && entry->offset >= 0 &&
+	    ofnode_cache_name_ok(fdt, entry->offset, path)) {
+		gd->ofnode_cache_hits++;
+		return entry->offset;
+	}
+	gd->ofnode_cache_misses++;
+	offset = fdt_path_offset(fdt, path);
+	if (offset >= 0) {
+		entry->key = hash;
+		entry->offset = offset;
+	}
+
+	return offset;
+}
+#else
+static int ofnode_fdt_phandle(const void *fdt, uint phandle)
+{
+	return fdt_node_offset_by_phandle(fdt, phandle);
+}
+
+static int ofnode_fdt_path(const void *fdt, const char *path)
+{
+	return fdt_path_offset(fdt, path);
+}
+#endif
+
 ofnode ofnode_get_by_phandle(uint phandle)
 {
 	ofnode node;
@@ -803,8 +969,7 @@ ofnode ofnode_get_by_phandle(uint phandle)
 	if (of_live_active())
 		node = np_to_ofnode(of_find_node_by_phandle(NULL, phandle));
 	else
-		node.of_offset = fdt_node_offset_by_phandle(gd->fdt_blob,
-							    phandle);
+		node.of_offset = ofnode_fdt_phandle(gd->fdt_blob, phandle);
 
 	return node;
 }
@@ -817,8 +982,7 @@ ofnode oftree_get_by_phandle(oftree tree, uint phandle)
 		node = np_to_ofnode(of_find_node_by_phandle(tree.np, phandle));
 	else
 		node = ofnode_from_tree_offset(tree,
-			fdt_node_offset_by_phandle(oftree_lookup_fdt(tree),
-						   phandle));
+			ofnode_fdt_phandle(oftree_lookup_fdt(tree), phandle));
 
 	return node;
 }
@@ -1140,7 +1304,7 @@ ofnode ofnode_path(const char *path)
 	if (of_live_active())
 		return np_to_ofnode(of_find_node_by_path(path));
 	else
-		return offset_to_ofnode(fdt_path_offset(gd->fdt_blob, path));
+		return offset_to_ofnode(ofnode_fdt_path(gd->fdt_blob, path));
 }
 
 ofnode oftree_root(oftree tree)
@@ -1160,7 +1324,7 @@ ofnode oftree_path(oftree tree, const char *path)
 	} else if (*path != '/' && tree.fdt != gd->fdt_blob) {
 		return ofnode_null();  /* Aliases only on control FDT */
 	} else {
-		int offset = fdt_path_offset(tree.fdt, path);
+		int offset = ofnode_fdt_path(tree.fdt, path);
 
 		return ofnode_from_tree_offset(tree, offset);
 	}
@@ -131,6 +131,8 @@ int dm_init(bool of_live)
 
 int dm_uninit(void)
 {
+	dm_probe_join();
+
 	/* Remove non-vital devices first */
 	device_remove(dm_root(), DM_REMOVE_NON_VITAL);
 	device_remove(dm_root(), DM_REMOVE_NORMAL);
@@ -143,6 +145,7 @@ int dm_uninit(void)
 #if CONFIG_IS_ENABLED(DM_DEVICE_REMOVE)
 int dm_remove_devices_flags(uint flags)
 {
+	dm_probe_join();
 	device_remove(dm_root(), flags);
 
 	return 0;
@@ -150,6 +153,8 @@ int dm_remove_devices_flags(uint flags)
 
 void dm_remove_devices_active(void)
 {
+	dm_probe_join();
+
 	/* Remove non-vital devices first */
 	device_remove(dm_root(), DM_REMOVE_ACTIVE_ALL | DM_REMOVE_NON_VITAL);
 	device_remove(dm_root(), DM_REMOVE_ACTIVE_ALL);
@@ -310,7 +315,11 @@ static int dm_probe_devices(struct udevice *dev, bool pre_reloc_only)
 		goto probe_children;
 
 	if (dev_get_flags(dev) & DM_FLAG_PROBE_AFTER_BIND) {
-		ret = device_probe(dev);
+		/* threads cannot run before relocation */
+		if (pre_reloc_only)
+			ret = device_probe(dev);
+		else
+			ret = device_probe_async(dev);
 		if (ret)
 			return ret;
 	}
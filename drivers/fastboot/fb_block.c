@@ -8,8 +8,10 @@
 #include <fastboot.h>
 #include <fastboot-internal.h>
 #include <fb_block.h>
+#include <fb_mmc.h>
 #include <image-sparse.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 
 /**
@@ -37,6 +39,34 @@ struct fb_block_sparse {
 	struct blk_desc	*dev_desc;
 };
 
+/**
+ * struct fb_block_stream - An image being written to a partition as it is
+ * downloaded
+ *
+ * @dev_desc: Block device being written
+ * @info: Partition being written
+ * @part_name: Name of the partition
+ * @size: Size of the image in bytes
+ * @started: true once the first piece of the image has arrived
+ * @is_sparse: true if the image is a sparse image
+ * @blk: Next block to write, for a raw image
+ * @sparse_priv: Private data for @sparse
+ * @sparse: Storage for a sparse image
+ * @ss: State of a sparse image
+ */
+static struct fb_block_stream {
+	struct blk_desc *dev_desc;
+	struct disk_partition info;
+	const char *part_name;
+	u32 size;
+	bool started;
+	bool is_sparse;
+	lbaint_t blk;
+	struct fb_block_sparse sparse_priv;
+	struct sparse_storage sparse;
+	struct sparse_stream ss;
+} fb_block_stream;
+
 /* Write 0s instead of using erase operation, inefficient but functional */
 static lbaint_t fb_block_soft_erase(struct blk_desc *block_dev, lbaint_t blk,
 				    lbaint_t cur_blkcnt, lbaint_t erase_buf_blks,
@@ -124,6 +154,52 @@ static lbaint_t fb_block_sparse_reserve(struct sparse_storage *info,
 	return blkcnt;
 }
 
+static lbaint_t fb_block_sparse_erase(struct sparse_storage *info,
+				      lbaint_t blk, lbaint_t blkcnt)
+{
+	struct fb_block_sparse *sparse = info->priv;
+
+	if (fastboot_progress_callback)
+		fastboot_progress_callback("erasing");
+
+	return blk_derase(sparse->dev_desc, blk, blkcnt);
+}
+
+/**
+ * fb_block_sparse_init() - Set up storage for writing a sparse image
+ *
+ * Fill chunks of zeroes are erased rather than written, where erasing is
+ * known to leave zeroes behind.
+ *
+ * @sparse: Storage to set up
+ * @sparse_priv: Private data for the storage
+ * @dev_desc: Block device we're going write to
+ * @info: Partition we're going write to
+ */
+static void fb_block_sparse_init(struct sparse_storage *sparse,
+				 struct fb_block_sparse *sparse_priv,
+				 struct blk_desc *dev_desc,
+				 struct disk_partition *info)
+{
+	memset(sparse, '\0', sizeof(*sparse));
+	sparse_priv->dev_desc = dev_desc;
+
+	sparse->blksz = info->blksz;
+	sparse->start = info->start;
+	sparse->size = info->size;
+	sparse->write = fb_block_sparse_write;
+	sparse->reserve = fb_block_sparse_reserve;
+	sparse->mssg = fastboot_fail;
+	sparse->stats = &fastboot_sparse_stats;
+	sparse->priv = sparse_priv;
+
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_MMC) &&
+	    dev_desc->uclass_id == UCLASS_MMC) {
+		sparse->erase = fb_block_sparse_erase;
+		sparse->erase_align = fastboot_mmc_zero_erase_align(dev_desc);
+	}
+}
+
 int fastboot_block_get_part_info(const char *part_name,
 				 struct blk_desc **dev_desc,
 				 struct disk_partition *part_info,
@@ -291,19 +367,11 @@ void fastboot_block_write_sparse_image(struct blk_desc *dev_desc, struct disk_pa
 	struct sparse_storage sparse;
 	int err;
 
-	sparse_priv.dev_desc = dev_desc;
-
-	sparse.blksz = info->blksz;
-	sparse.start = info->start;
-	sparse.size = info->size;
-	sparse.write = fb_block_sparse_write;
-	sparse.reserve = fb_block_sparse_reserve;
-	sparse.mssg = fastboot_fail;
+	fb_block_sparse_init(&sparse, &sparse_priv, dev_desc, info);
 
 	printf("Flashing sparse image at offset " LBAFU "\n",
 	       sparse.start);
 
-	sparse.priv = &sparse_priv;
 	err = write_sparse_image(&sparse, part_name, buffer,
 				 response);
 	if (!err)
@@ -327,3 +395,107 @@ void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 					       download_buffer, download_bytes, response);
 	}
 }
+
+void fastboot_block_stream_open(struct blk_desc *dev_desc, struct disk_partition *info,
+				const char *part_name, u32 size)
+{
+	struct fb_block_stream *st = &fb_block_stream;
+
+	memset(st, '\0', sizeof(*st));
+	st->dev_desc = dev_desc;
+	st->info = *info;
+	st->part_name = part_name;
+	st->size = size;
+}
+
+/* Decide what sort of image is arriving, from its first piece */
+static int fb_block_stream_start(struct fb_block_stream *st, const void *data,
+				 u32 len, char *response)
+{
+	struct disk_partition *info = &st->info;
+
+	st->started = true;
+	st->is_sparse = len >= sizeof(sparse_header_t) &&
+			is_sparse_image((void *)data);
+	if (st->is_sparse) {
+		fb_block_sparse_init(&st->sparse, &st->sparse_priv,
+				     st->dev_desc, info);
+
+		printf("Flashing sparse image at offset " LBAFU "\n",
+		       st->sparse.start);
+		sparse_stream_init(&st->ss, &st->sparse);
+		return 0;
+	}
+
+	if (DIV_ROUND_UP(st->size, info->blksz) > info->size) {
+		pr_err("too large for partition: '%s'\n", st->part_name);
+		fastboot_fail("too large for partition", response);
+		return -EFBIG;
+	}
+	printf("Flashing Raw Image\n");
+	st->blk = info->start;
+
+	return 0;
+}
+
+int fastboot_block_stream_write(const void *data, u32 len, char *response)
+{
+	struct fb_block_stream *st = &fb_block_stream;
+	lbaint_t blksz = st->info.blksz;
+	lbaint_t blkcnt, blks;
+	u32 tail;
+	int ret;
+
+	if (!st->started) {
+		ret = fb_block_stream_start(st, data, len, response);
+		if (ret)
+			return ret;
+	}
+	if (st->is_sparse)
+		return sparse_stream_write(&st->ss, data, len, response);
+
+	blkcnt = lldiv(len, blksz);
+	blks = fb_block_write(st->dev_desc, st->blk, blkcnt, data);
+	if (blks != blkcnt)
+		goto err;
+	st->blk += blks;
+
+	/* only the last piece can end part-way through a block */
+	tail = len - blkcnt * blksz;
+	if (tail) {
+		ALLOC_CACHE_ALIGN_BUFFER(u8, buf, blksz);
+
+		memcpy(buf, data + blkcnt * blksz, tail);
+		memset(buf + tail, '\0', blksz - tail);
+		if (fb_block_write(st->dev_desc, st->blk, 1, buf) != 1)
+			goto err;
+		st->blk++;
+	}
+
+	return 0;
+
+err:
+	pr_err("failed writing to device %d\n", st->dev_desc->devnum);
+	fastboot_fail("failed writing to device", response);
+
+	return -EIO;
+}
+
+int fastboot_block_stream_close(char *response)
+{
+	struct fb_block_stream *st = &fb_block_stream;
+	int ret;
+
+	if (st->is_sparse) {
+		ret = sparse_stream_finish(&st->ss, st->part_name, response);
+		if (ret)
+			return ret;
+	} else {
+		printf("........ wrote " LBAFU " bytes to '%s'\n",
+		       (st->blk - st->info.start) * st->info.blksz,
+		       st->part_name);
+	}
+	fastboot_okay(NULL, response);
+
+	return 0;
+}
@@ -12,6 +12,7 @@
 #include <fb_mmc.h>
 #include <fb_nand.h>
 #include <fb_spi_flash.h>
+#include <image-sparse.h>
 #include <part.h>
 #include <stdlib.h>
 #include <vsprintf.h>
@@ -32,6 +33,23 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+/**
+ * flash_result - final response to a flash command, sent after its statistics
+ */
+static char flash_result[FASTBOOT_RESPONSE_LEN];
+
+/**
+ * flash_stat - next type of sparse chunk to report after a flash command
+ */
+static int flash_stat;
+
+static const char *const flash_stat_names[SPARSE_STAT_COUNT] = {
+	[SPARSE_STAT_RAW] = "raw",
+	[SPARSE_STAT_FILL] = "fill",
+	[SPARSE_STAT_ZERO] = "zero",
+	[SPARSE_STAT_DONT_CARE] = "skip",
+};
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -45,6 +63,7 @@ static void oem_partconf(char *, char *);
 static void oem_bootbus(char *, char *);
 static void oem_console(char *, char *);
 static void oem_board(char *, char *);
+static void oem_stream(char *, char *);
 static void run_ucmd(char *, char *);
 static void run_acmd(char *, char *);
 
@@ -120,6 +139,10 @@ static const struct {
 		.command = "oem board",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_OEM_BOARD, (oem_board), (NULL))
 	},
+	[FASTBOOT_COMMAND_OEM_STREAM] = {
+		.command = "oem stream",
+		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM, (oem_stream), (NULL))
+	},
 	[FASTBOOT_COMMAND_UCMD] = {
 		.command = "UCmd",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT, (run_ucmd), (NULL))
@@ -130,6 +153,54 @@ static const struct {
 	},
 };
 
+/**
+ * flash_report() - Arrange to report how a sparse image was written
+ *
+ * @response: Pointer to fastboot response buffer, holding the result of the
+ *	      flash command
+ *
+ * If a sparse image was written, the result is held back and the time spent
+ * on each type of chunk is sent to the client first, as INFO messages.
+ */
+static void __maybe_unused flash_report(char *response)
+{
+	int i;
+
+	for (i = 0; i < SPARSE_STAT_COUNT; i++) {
+		if (fastboot_sparse_stats.stat[i].chunks)
+			break;
+	}
+	if (i == SPARSE_STAT_COUNT)
+		return;
+
+	strlcpy(flash_result, response, sizeof(flash_result));
+	flash_stat = 0;
+	fastboot_response(FASTBOOT_MULTIRESPONSE_START, response, NULL);
+}
+
+/**
+ * flash_report_next() - Write the next message about a flash command
+ *
+ * @response: Pointer to fastboot response buffer
+ */
+static void __maybe_unused flash_report_next(char *response)
+{
+	while (flash_stat < SPARSE_STAT_COUNT) {
+		int type = flash_stat++;
+		struct sparse_stat *stat = &fastboot_sparse_stats.stat[type];
+
+		if (!stat->chunks)
+			continue;
+		fastboot_response("INFO", response,
+				  "%s: %llu KiB in %lu ms, %u chunk%s",
+				  flash_stat_names[type], stat->bytes >> 10,
+				  stat->us / 1000, stat->chunks,
+				  stat->chunks == 1 ? "" : "s");
+		return;
+	}
+	strlcpy(response, flash_result, FASTBOOT_RESPONSE_LEN);
+}
+
 /**
  * fastboot_handle_command - Handle fastboot command
  *
@@ -171,6 +242,12 @@ void fastboot_multiresponse(int cmd, char *response)
 	case FASTBOOT_COMMAND_GETVAR:
 		fastboot_getvar_all(response);
 		break;
+	case FASTBOOT_COMMAND_FLASH:
+		if (CONFIG_IS_ENABLED(FASTBOOT_FLASH)) {
+			flash_report_next(response);
+			break;
+		}
+		fallthrough;
 	case FASTBOOT_COMMAND_OEM_CONSOLE:
 		if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_CONSOLE)) {
 			char buf[FASTBOOT_RESPONSE_LEN] = { 0 };
@@ -247,13 +324,19 @@ static void download(char *cmd_parameter, char *response)
 	 *
 	 * where cmd_parameter is an 8 digit hexadecimal number
 	 */
-	if (fastboot_bytes_expected > fastboot_buf_size) {
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_STREAM) &&
+	    fastboot_stream_selected()) {
+		/* written as it arrives, so the buffer size does not matter */
+		if (fastboot_stream_start(fastboot_bytes_expected, response)) {
+			fastboot_bytes_expected = 0;
+			return;
+		}
+	} else if (fastboot_bytes_expected > fastboot_buf_size) {
 		fastboot_fail(cmd_parameter, response);
-	} else {
-		printf("Starting download of %d bytes\n",
-		       fastboot_bytes_expected);
-		fastboot_response("DATA", response, "%s", cmd_parameter);
+		return;
 	}
+	printf("Starting download of %d bytes\n", fastboot_bytes_expected);
+	fastboot_response("DATA", response, "%s", cmd_parameter);
 }
 
 /**
@@ -278,7 +361,7 @@ u32 fastboot_data_remaining(void)
  * of bytes that have been transferred.
  *
  * On completion sets image_size and ${filesize} to the total size of the
- * downloaded image.
+ * downloaded image, unless it was written to flash as it arrived.
  */
 void fastboot_data_download(const void *fastboot_data,
 			    unsigned int fastboot_data_len,
@@ -295,8 +378,11 @@ void fastboot_data_download(const void *fastboot_data,
 		return;
 	}
 	/* Download data to fastboot_buf_addr */
-	memcpy(fastboot_buf_addr + fastboot_bytes_received,
-	       fastboot_data, fastboot_data_len);
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_STREAM) && fastboot_stream_active())
+		fastboot_stream_data(fastboot_data, fastboot_data_len);
+	else
+		memcpy(fastboot_buf_addr + fastboot_bytes_received,
+		       fastboot_data, fastboot_data_len);
 
 	pre_dot_num = fastboot_bytes_received / BYTES_PER_DOT;
 	fastboot_bytes_received += fastboot_data_len;
@@ -316,14 +402,23 @@ void fastboot_data_download(const void *fastboot_data,
  * @response: Pointer to fastboot response buffer
  *
  * Set image_size and ${filesize} to the total size of the downloaded image.
+ * If the image was written to flash as it arrived, the buffer only holds
+ * what was left over from that, so image_size is set to 0 instead, to stop
+ * later commands from using it.
  */
 void fastboot_data_complete(char *response)
 {
 	/* Download complete. Respond with "OKAY" */
 	fastboot_okay(NULL, response);
 	printf("\ndownloading of %d bytes finished\n", fastboot_bytes_received);
-	image_size = fastboot_bytes_received;
-	env_set_hex("filesize", image_size);
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_STREAM) &&
+	    fastboot_stream_active()) {
+		fastboot_stream_complete();
+		image_size = 0;
+	} else {
+		image_size = fastboot_bytes_received;
+		env_set_hex("filesize", image_size);
+	}
 	fastboot_bytes_expected = 0;
 	fastboot_bytes_received = 0;
 }
@@ -335,10 +430,23 @@ void fastboot_data_complete(char *response)
  * @response: Pointer to fastboot response buffer
  *
  * Writes the previously downloaded image to the partition indicated by
- * cmd_parameter. Writes to response.
+ * cmd_parameter. Writes to response. If the image was written as it was
+ * downloaded, this just reports the result.
  */
 static void __maybe_unused flash(char *cmd_parameter, char *response)
 {
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_STREAM) &&
+	    fastboot_stream_flash(cmd_parameter, response)) {
+		flash_report(response);
+		return;
+	}
+
+	if (!image_size) {
+		fastboot_fail("no image downloaded", response);
+		return;
+	}
+
+	memset(&fastboot_sparse_stats, '\0', sizeof(fastboot_sparse_stats));
 	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_BLOCK))
 		fastboot_block_flash_write(cmd_parameter, fastboot_buf_addr,
 					   image_size, response);
@@ -354,6 +462,7 @@ static void __maybe_unused flash(char *cmd_parameter, char *response)
 	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_SPI))
 		fastboot_spi_flash_write(cmd_parameter, fastboot_buf_addr,
 					 image_size, response);
+	flash_report(response);
 }
 
 /**
@@ -589,3 +698,16 @@ static void __maybe_unused oem_board(char *cmd_parameter, char *response)
 {
 	fastboot_oem_board(cmd_parameter, (void *)fastboot_buf_addr, image_size, response);
 }
+
+/**
+ * oem_stream() - Execute the OEM stream command
+ *
+ * @cmd_parameter: Pointer to partition name, or NULL to stop streaming
+ * @response: Pointer to fastboot response buffer
+ *
+ * Chooses a partition which later downloads are written to as they arrive.
+ */
+static void __maybe_unused oem_stream(char *cmd_parameter, char *response)
+{
+	fastboot_stream_select(cmd_parameter, response);
+}
@@ -14,6 +14,7 @@
 #include <command.h>
 #include <env.h>
 #include <fastboot.h>
+#include <image-sparse.h>
 #include <net.h>
 #include <vsprintf.h>
 
@@ -32,6 +33,11 @@ u32 fastboot_buf_size;
  */
 void (*fastboot_progress_callback)(const char *msg);
 
+/**
+ * fastboot_sparse_stats - time spent writing the last sparse image
+ */
+struct sparse_stats fastboot_sparse_stats;
+
 /**
  * fastboot_response() - Writes a response of the form "$tag$reason".
  *
@@ -155,7 +155,12 @@ static void getvar_version_bootloader(char *var_parameter, char *response)
 
 static void getvar_downloadsize(char *var_parameter, char *response)
 {
-	fastboot_response("OKAY", response, "0x%08x", fastboot_buf_size);
+	u32 size = fastboot_buf_size;
+
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_STREAM) &&
+	    fastboot_stream_selected())
+		size = FASTBOOT_STREAM_MAX_SIZE;
+	fastboot_response("OKAY", response, "0x%08x", size);
 }
 
 static void getvar_serialno(char *var_parameter, char *response)
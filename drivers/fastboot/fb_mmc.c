@@ -343,6 +343,23 @@ int fastboot_mmc_get_part_info(const char *part_name,
 	return ret;
 }
 
+u32 fastboot_mmc_zero_erase_align(struct blk_desc *dev_desc)
+{
+	struct mmc *mmc = find_mmc_device(dev_desc->devnum);
+
+	if (!mmc)
+		return 0;
+	if (IS_SD(mmc)) {
+		if (mmc->scr[0] & SD_DATA_STAT_AFTER_ERASE)
+			return 0;
+	} else if (!mmc->ext_csd || mmc->ext_csd[EXT_CSD_ERASED_MEM_CONT]) {
+		return 0;
+	}
+
+	/* trim works on single blocks; erase takes whole erase groups */
+	return mmc->can_trim ? 1 : mmc->erase_grp_size;
+}
+
 static struct blk_desc *fastboot_mmc_get_dev(char *response)
 {
 	struct blk_desc *ret = blk_get_dev("mmc",
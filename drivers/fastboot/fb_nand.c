@@ -8,6 +8,7 @@
 #include <blk.h>
 
 #include <fastboot.h>
+#include <fastboot-internal.h>
 #include <image-sparse.h>
 
 #include <linux/printk.h>
@@ -194,7 +195,7 @@ void fastboot_nand_flash_write(const char *cmd, void *download_buffer,
 
 	if (is_sparse_image(download_buffer)) {
 		struct fb_nand_sparse sparse_priv;
-		struct sparse_storage sparse;
+		struct sparse_storage sparse = {};
 
 		sparse_priv.mtd = mtd;
 		sparse_priv.part = part;
@@ -205,6 +206,7 @@ void fastboot_nand_flash_write(const char *cmd, void *download_buffer,
 		sparse.write = fb_nand_sparse_write;
 		sparse.reserve = fb_nand_sparse_reserve;
 		sparse.mssg = fastboot_fail;
+		sparse.stats = &fastboot_sparse_stats;
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
 		       sparse.start);
@@ -7,6 +7,7 @@
 #include <config.h>
 #include <env.h>
 #include <fastboot.h>
+#include <fastboot-internal.h>
 #include <image-sparse.h>
 #include <spi.h>
 #include <spi_flash.h>
@@ -178,7 +179,7 @@ void fastboot_spi_flash_write(const char *cmd, void *download_buffer,
 		return;
 
 	if (is_sparse_image(download_buffer)) {
-		struct sparse_storage sparse;
+		struct sparse_storage sparse = {};
 
 		sparse.blksz = flash->sector_size;
 		sparse.start = part_info.start / sparse.blksz;
@@ -186,6 +187,7 @@ void fastboot_spi_flash_write(const char *cmd, void *download_buffer,
 		sparse.write = fb_spi_flash_sparse_write;
 		sparse.reserve = fb_spi_flash_sparse_reserve;
 		sparse.mssg = fastboot_fail;
+		sparse.stats = &fastboot_sparse_stats;
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
 		       sparse.start);
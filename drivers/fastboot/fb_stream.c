@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Writing fastboot images to flash while they are downloaded
+ *
+ * Once a partition has been chosen with 'oem stream:<partition>', each
+ * download is written to it as it arrives instead of being collected in the
+ * download buffer first. The buffer is split into a ring of slots. The
+ * transport fills one slot while full slots are written out, either between
+ * transfers when the transport polls (only USB does), or when the ring fills
+ * up. The result is kept for the 'flash' command which follows the download.
+ */
+
+#include <blk.h>
+#include <fastboot.h>
+#include <fastboot-internal.h>
+#include <fb_block.h>
+#include <fb_mmc.h>
+#include <image-sparse.h>
+#include <part.h>
+#include <linux/sizes.h>
+
+/**
+ * struct fb_stream - State of streaming to a partition
+ *
+ * @part_name: Partition which downloads are written to, or "" if none
+ * @active: true while a download is being written
+ * @pending: true if @result holds the result of a download which has not been
+ *	     reported by a 'flash' command yet
+ * @err: Error which stopped the current download being written, or 0
+ * @slot_size: Size of each slot in the ring
+ * @slots: Number of slots in the ring
+ * @head: Slot being filled
+ * @tail: Oldest full slot
+ * @full: Number of full slots waiting to be written
+ * @fill: Number of bytes in the slot being filled
+ * @result: Response for the 'flash' command
+ */
+static struct fb_stream {
+	char part_name[FASTBOOT_COMMAND_LEN];
+	bool active;
+	bool pending;
+	int err;
+	u32 slot_size;
+	uint slots;
+	uint head;
+	uint tail;
+	uint full;
+	u32 fill;
+	char result[FASTBOOT_RESPONSE_LEN];
+} fb_stream;
+
+/**
+ * fb_stream_get_part_info() - Look up the partition to write to
+ *
+ * @part_name: Name of partition
+ * @dev_desc: Returns the block device
+ * @info: Returns the partition
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 if OK, -ve on error
+ */
+static int fb_stream_get_part_info(const char *part_name,
+				   struct blk_desc **dev_desc,
+				   struct disk_partition *info, char *response)
+{
+	int ret;
+
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_MMC))
+		ret = fastboot_mmc_get_part_info(part_name, dev_desc, info,
+						 response);
+	else
+		ret = fastboot_block_get_part_info(part_name, dev_desc, info,
+						   response);
+
+	return ret < 0 ? ret : 0;
+}
+
+void fastboot_stream_select(const char *part_name, char *response)
+{
+	struct fb_stream *fs = &fb_stream;
+	struct disk_partition info;
+	struct blk_desc *dev_desc;
+
+	fs->pending = false;
+	if (!part_name || !*part_name) {
+		*fs->part_name = '\0';
+		fastboot_okay(NULL, response);
+		return;
+	}
+	if (fb_stream_get_part_info(part_name, &dev_desc, &info, response))
+		return;
+	strlcpy(fs->part_name, part_name, sizeof(fs->part_name));
+	fastboot_okay(NULL, response);
+}
+
+bool fastboot_stream_selected(void)
+{
+	return *fb_stream.part_name;
+}
+
+bool fastboot_stream_active(void)
+{
+	return fb_stream.active;
+}
+
+int fastboot_stream_start(u32 size, char *response)
+{
+	struct fb_stream *fs = &fb_stream;
+	struct disk_partition info;
+	struct blk_desc *dev_desc;
+
+	/* the last download was abandoned part-way through */
+	if (fs->active) {
+		fastboot_block_stream_close(fs->result);
+		fs->active = false;
+	}
+	fs->pending = false;
+	memset(&fastboot_sparse_stats, '\0', sizeof(fastboot_sparse_stats));
+	fs->slot_size = min_t(u32, CONFIG_FASTBOOT_STREAM_SLOT_SIZE,
+			      fastboot_buf_size / 2) & ~(SZ_4K - 1);
+	if (!fs->slot_size) {
+		fastboot_fail("download buffer too small", response);
+		return -ENOSPC;
+	}
+	if (fb_stream_get_part_info(fs->part_name, &dev_desc, &info, response))
+		return -ENOENT;
+
+	fastboot_block_stream_open(dev_desc, &info, fs->part_name, size);
+	fs->slots = fastboot_buf_size / fs->slot_size;
+	fs->head = 0;
+	fs->tail = 0;
+	fs->full = 0;
+	fs->fill = 0;
+	fs->err = 0;
+	fs->active = true;
+
+	return 0;
+}
+
+/**
+ * fb_stream_write_slot() - Write out the oldest full slot
+ *
+ * Once a write has failed, the rest of the download is dropped.
+ *
+ * @fs: Stream state
+ * @len: Number of bytes in the slot
+ */
+static void fb_stream_write_slot(struct fb_stream *fs, u32 len)
+{
+	void *slot = fastboot_buf_addr + fs->tail * fs->slot_size;
+
+	if (!fs->err)
+		fs->err = fastboot_block_stream_write(slot, len, fs->result);
+	fs->tail = (fs->tail + 1) % fs->slots;
+	fs->full--;
+}
+
+void fastboot_stream_data(const void *data, u32 len)
+{
+	struct fb_stream *fs = &fb_stream;
+
+	while (len) {
+		u32 n = min(len, fs->slot_size - fs->fill);
+
+		/* make room if the transport has got ahead of the writes */
+		if (fs->full == fs->slots)
+			fb_stream_write_slot(fs, fs->slot_size);
+
+		memcpy(fastboot_buf_addr + fs->head * fs->slot_size + fs->fill,
+		       data, n);
+		fs->fill += n;
+		data += n;
+		len -= n;
+		if (fs->fill == fs->slot_size) {
+			fs->head = (fs->head + 1) % fs->slots;
+			fs->full++;
+			fs->fill = 0;
+		}
+	}
+}
+
+void fastboot_stream_poll(void)
+{
+	struct fb_stream *fs = &fb_stream;
+
+	if (fs->active && fs->full)
+		fb_stream_write_slot(fs, fs->slot_size);
+}
+
+void fastboot_stream_complete(void)
+{
+	struct fb_stream *fs = &fb_stream;
+	char response[FASTBOOT_RESPONSE_LEN];
+
+	while (fs->full)
+		fb_stream_write_slot(fs, fs->slot_size);
+	if (fs->fill) {
+		fs->full++;
+		fb_stream_write_slot(fs, fs->fill);
+	}
+
+	/* keep the message from the first failure */
+	fastboot_block_stream_close(fs->err ? response : fs->result);
+	fs->active = false;
+	fs->pending = true;
+}
+
+bool fastboot_stream_flash(const char *part_name, char *response)
+{
+	struct fb_stream *fs = &fb_stream;
+
+	if (!fs->pending)
+		return false;
+	fs->pending = false;
+	if (!part_name || strcmp(part_name, fs->part_name))
+		fastboot_response("FAIL", response,
+				  "image was written to '%s'", fs->part_name);
+	else
+		strlcpy(response, fs->result, FASTBOOT_RESPONSE_LEN);
+
+	return true;
+}
@@ -455,29 +455,35 @@ int mmc_send_stop_transmission(struct mmc *mmc, bool write)
 	return mmc_send_cmd(mmc, &cmd, NULL);
 }
 
-static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
-			   lbaint_t blkcnt)
+static void mmc_read_blocks_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
+				struct mmc_data *data, void *dst,
+				lbaint_t start, lbaint_t blkcnt)
 {
-	struct mmc_cmd cmd;
-	struct mmc_data data;
-
 	if (blkcnt > 1)
-		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
+		cmd->cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
 	else
-		cmd.cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
+		cmd->cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
 
 	if (mmc->high_capacity)
-		cmd.cmdarg = start;
+		cmd->cmdarg = start;
 	else
-		cmd.cmdarg = start * mmc->read_bl_len;
+		cmd->cmdarg = start * mmc->read_bl_len;
 
-	cmd.resp_type = MMC_RSP_R1;
+	cmd->resp_type = MMC_RSP_R1;
 
-	data.dest = dst;
-	data.blocks = blkcnt;
-	data.blocksize = mmc->read_bl_len;
-	data.flags = MMC_DATA_READ;
+	data->dest = dst;
+	data->blocks = blkcnt;
+	data->blocksize = mmc->read_bl_len;
+	data->flags = MMC_DATA_READ;
+}
+
+static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
+			   lbaint_t blkcnt)
+{
+	struct mmc_cmd cmd;
+	struct mmc_data data;
 
+	mmc_read_blocks_cmd(mmc, &cmd, &data, dst, start, blkcnt);
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
@@ -562,6 +568,88 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	return blkcnt;
 }
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC) && CONFIG_IS_ENABLED(DM_MMC)
+/**
+ * mmc_bstart_next() - Start reading the next piece of a block request
+ *
+ * @mmc:	MMC device
+ * @req:	Request being carried out
+ * Return: 0 if started, 1 if the whole request has been read, -ve on error
+ */
+static int mmc_bstart_next(struct mmc *mmc, struct blk_req *req)
+{
+	struct mmc_cmd cmd;
+	lbaint_t start, cnt;
+	void *dst;
+
+	cnt = blk_req_next(req, mmc->async_b_max, &start, &dst);
+	if (!cnt)
+		return 1;
+	mmc_read_blocks_cmd(mmc, &cmd, &mmc->async_data, dst, start, cnt);
+
+	return mmc_start_data(mmc, &cmd, &mmc->async_data);
+}
+
+int mmc_bsubmit(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	lbaint_t blkcnt = blk_req_blkcnt(req);
+	struct mmc *mmc;
+	int i, ret;
+
+	/* writes need the card's status checking, so are made synchronously */
+	if (req->op != BLK_REQ_READ)
+		return -ENOSYS;
+
+	mmc = find_mmc_device(block_dev->devnum);
+	if (!mmc)
+		return -ENODEV;
+	ret = blk_dselect_hwpart(block_dev, block_dev->hwpart);
+	if (ret < 0)
+		return ret;
+	if (req->start + blkcnt > block_dev->lba)
+		return -EINVAL;
+	if (mmc_set_blocklen(mmc, mmc->read_bl_len))
+		return -EIO;
+
+	mmc->async_b_max = mmc->cfg->b_max;
+	for (i = 0; i < req->sg_count; i++) {
+		mmc->async_b_max = min_t(uint, mmc->async_b_max,
+					 mmc_get_b_max(mmc, req->sg[i].buf,
+						       req->sg[i].blkcnt));
+	}
+
+	ret = mmc_bstart_next(mmc, req);
+	if (ret == 1)
+		blk_req_complete(req, 0);
+
+	return ret < 0 ? ret : 0;
+}
+
+void mmc_bpoll(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	struct mmc_data *data = &mmc->async_data;
+	int ret;
+
+	ret = mmc_poll_data(mmc, data);
+	if (ret == -EBUSY)
+		return;
+	if (!ret && data->blocks > 1)
+		ret = mmc_send_stop_transmission(mmc, false);
+	if (ret) {
+		blk_req_complete(req, -EIO);
+		return;
+	}
+
+	req->done += data->blocks;
+	ret = mmc_bstart_next(mmc, req);
+	if (ret)
+		blk_req_complete(req, ret < 0 ? ret : 0);
+}
+#endif
+
 static int mmc_go_idle(struct mmc *mmc)
 {
 	struct mmc_cmd cmd;
@@ -2768,6 +2856,9 @@ static int mmc_startup(struct mmc *mmc)
 	bdesc->blksz = mmc->read_bl_len;
 	bdesc->log2blksz = LOG2(bdesc->blksz);
 	bdesc->lba = lldiv(mmc->capacity, mmc->read_bl_len);
+	/* this may not be the card which was here before */
+	if (CONFIG_IS_ENABLED(BLK))
+		blk_changed(bdesc);
 #if !defined(CONFIG_XPL_BUILD) || \
 		(defined(CONFIG_SPL_LIBCOMMON_SUPPORT) && \
 		!CONFIG_IS_ENABLED(USE_TINY_PRINTF))
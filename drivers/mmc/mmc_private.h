@@ -25,6 +25,33 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		void *dst);
 #endif
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC) && CONFIG_IS_ENABLED(DM_MMC)
+int mmc_bsubmit(struct udevice *dev, struct blk_req *req);
+void mmc_bpoll(struct udevice *dev, struct blk_req *req);
+
+/**
+ * mmc_start_data() - Send a command without waiting for its data
+ *
+ * @mmc:	MMC device
+ * @cmd:	Command to send
+ * @data:	Data to transfer, which must remain valid until the transfer
+ *		has finished
+ * Return: 0 if OK, -ENOSYS if the controller cannot do this, other -ve on
+ * error
+ */
+int mmc_start_data(struct mmc *mmc, struct mmc_cmd *cmd,
+		   struct mmc_data *data);
+
+/**
+ * mmc_poll_data() - Check on a transfer started by mmc_start_data()
+ *
+ * @mmc:	MMC device
+ * @data:	Data being transferred
+ * Return: 0 if finished, -EBUSY if still in progress, other -ve on error
+ */
+int mmc_poll_data(struct mmc *mmc, struct mmc_data *data);
+#endif
+
 #if CONFIG_IS_ENABLED(MMC_WRITE)
 
 #if CONFIG_IS_ENABLED(BLK)
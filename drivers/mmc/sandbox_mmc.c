@@ -30,6 +30,7 @@ struct sandbox_mmc_priv {
 	char *buf;
 	int csize;	/* CSIZE value to report */
 	int size;
+	const char *async_src;	/* data for the read started by start_data() */
 };
 
 /**
@@ -128,6 +129,37 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+/*
+ * Reads started here are only copied when they are polled, as if the data
+ * arrived in the background
+ */
+static int sandbox_mmc_start_data(struct udevice *dev, struct mmc_cmd *cmd,
+				  struct mmc_data *data)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	if (cmd->cmdidx != MMC_CMD_READ_SINGLE_BLOCK &&
+	    cmd->cmdidx != MMC_CMD_READ_MULTIPLE_BLOCK)
+		return -ENOSYS;
+	priv->async_src = &priv->buf[cmd->cmdarg * data->blocksize];
+
+	return 0;
+}
+
+static int sandbox_mmc_poll_data(struct udevice *dev, struct mmc_data *data)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	if (!priv->async_src)
+		return -EINVAL;
+	memcpy(data->dest, priv->async_src, data->blocks * data->blocksize);
+	priv->async_src = NULL;
+
+	return 0;
+}
+#endif
+
 static int sandbox_mmc_set_ios(struct udevice *dev)
 {
 	return 0;
@@ -142,6 +174,10 @@ static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	.start_data = sandbox_mmc_start_data,
+	.poll_data = sandbox_mmc_poll_data,
+#endif
 };
 
 static int sandbox_mmc_of_to_plat(struct udevice *dev)
@@ -1672,6 +1672,60 @@ int mtd_block_isbad(struct mtd_info *mtd, loff_t ofs)
 }
 EXPORT_SYMBOL_GPL(mtd_block_isbad);
 
+/**
+ * mtd_block_good_run() - Find the next run of good blocks
+ * @mtd: MTD device
+ * @ofs: offset to start from; on return, the start of the run, after skipping
+ *	any bad blocks
+ * @len: maximum length of the run
+ * @run: returns the length of the run, which stops at the first bad block
+ *	after @ofs, at the end of the device or after @len bytes. This is 0 if
+ *	there are no good blocks left
+ *
+ * This lets loops which skip bad blocks read or write a whole run of good
+ * blocks at once, rather than checking and accessing each block in turn.
+ *
+ * Return: 0 if OK, -ve on error
+ */
+int mtd_block_good_run(struct mtd_info *mtd, loff_t *ofs, u64 len, u64 *run)
+{
+	loff_t start = *ofs, end;
+	int ret;
+
+	*run = 0;
+	if (start < 0 || start > mtd->size)
+		return -EINVAL;
+
+	/* Skip the bad blocks at the start */
+	for (;;) {
+		if (start >= mtd->size)
+			return 0;
+		ret = mtd_block_isbad(mtd, start);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+		start += mtd->erasesize - mtd_mod_by_eb(start, mtd);
+	}
+
+	/* Extend the run up to the next bad block */
+	end = start + mtd->erasesize - mtd_mod_by_eb(start, mtd);
+	while (end - start < len && end < mtd->size) {
+		ret = mtd_block_isbad(mtd, end);
+		if (ret < 0)
+			return ret;
+		if (ret)
+			break;
+		end += mtd->erasesize;
+	}
+
+	*ofs = start;
+	*run = min_t(u64, end - start, len);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mtd_block_good_run);
+
 int mtd_block_markbad(struct mtd_info *mtd, loff_t ofs)
 {
 	if (!mtd->_block_markbad)
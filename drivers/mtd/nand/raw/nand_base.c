@@ -3639,6 +3639,10 @@ static int nand_block_isbad(struct mtd_info *mtd, loff_t offs)
 	int chipnr = (int)(offs >> chip->chip_shift);
 	int ret;
 
+	/* The bad block table in memory can be used without the chip */
+	if (chip->bbt)
+		return nand_block_checkbad(mtd, offs, 0);
+
 	/* Select the NAND device */
 	nand_get_device(mtd, FL_READING);
 	chip->select_chip(mtd, chipnr);
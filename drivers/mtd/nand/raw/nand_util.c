@@ -415,29 +415,21 @@ static int check_skip_len(struct mtd_info *mtd, loff_t offset, size_t length,
 	int ret = 0;
 
 	while (len_excl_bad < length) {
-		size_t block_len, block_off;
-		loff_t block_start;
+		loff_t start = offset;
+		u64 run;
 
-		if (offset >= mtd->size)
+		if (mtd_block_good_run(mtd, &offset, length - len_excl_bad,
+				       &run) || !run)
 			return -1;
 
-		block_start = offset & ~(loff_t)(mtd->erasesize - 1);
-		block_off = offset & (mtd->erasesize - 1);
-		block_len = mtd->erasesize - block_off;
-
-		if (!nand_block_isbad(mtd, block_start))
-			len_excl_bad += block_len;
-		else
+		if (offset != start)
 			ret = 1;
 
-		offset += block_len;
-		*used += block_len;
+		len_excl_bad += run;
+		*used += offset - start + run;
+		offset += run;
 	}
 
-	/* If the length is not a multiple of block_len, adjust. */
-	if (len_excl_bad > length)
-		*used -= (len_excl_bad - length);
-
 	return ret;
 }
 
@@ -749,23 +741,30 @@ int nand_read_skip_bad(struct mtd_info *mtd, loff_t offset, size_t *length,
 	}
 
 	while (left_to_read > 0) {
-		size_t block_offset = offset & (mtd->erasesize - 1);
+		loff_t start = offset;
 		size_t read_length;
+		u64 run;
 
 		schedule();
 
-		if (nand_block_isbad(mtd, offset & ~(mtd->erasesize - 1))) {
-			printf("Skipping bad block 0x%08llx\n",
-				offset & ~(mtd->erasesize - 1));
-			offset += mtd->erasesize - block_offset;
-			continue;
+		/* Read each run of good blocks in one go */
+		rval = mtd_block_good_run(mtd, &offset, left_to_read, &run);
+		if (!rval && !run)
+			rval = -EINVAL;
+		if (rval) {
+			printf("NAND read from offset %llx failed %d\n",
+			       offset, rval);
+			*length -= left_to_read;
+			return rval;
 		}
 
-		if (left_to_read < (mtd->erasesize - block_offset))
-			read_length = left_to_read;
-		else
-			read_length = mtd->erasesize - block_offset;
+		if (offset != start) {
+			start &= ~(loff_t)(mtd->erasesize - 1);
+			for (; start < offset; start += mtd->erasesize)
+				printf("Skipping bad block 0x%08llx\n", start);
+		}
 
+		read_length = run;
 		rval = nand_read(mtd, offset, &read_length, p_buffer);
 		if (rval && rval != -EUCLEAN) {
 			printf("NAND read from offset %llx failed %d\n",
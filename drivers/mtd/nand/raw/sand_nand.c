@@ -273,6 +273,16 @@ static void sand_nand_command(struct mtd_info *mtd, unsigned int command,
 			bitmap_clear(chip->programmed, chip->page_addr,
 				     chip->pages_per_erase);
 		break;
+	case STATE_READ:
+		/* Sub-page reads move around in the page which was read */
+		if (command == NAND_CMD_RNDOUT) {
+			if (column < 0 || column >= chip->chunksize)
+				new_state = STATE_IDLE;
+			else
+				chip->column = column;
+			break;
+		}
+		fallthrough;
 	default:
 		chip->column = column;
 		chip->page_addr = page_addr;
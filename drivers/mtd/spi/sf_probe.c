@@ -40,8 +40,12 @@ static int spi_nor_create_read_dirmap(struct spi_nor *nor)
 		op->dummy.nbytes *= 2;
 
 	nor->dirmap.rdesc = spi_mem_dirmap_create(nor->spi, &info);
-	if (IS_ERR(nor->dirmap.rdesc))
-		return PTR_ERR(nor->dirmap.rdesc);
+	if (IS_ERR(nor->dirmap.rdesc)) {
+		int ret = PTR_ERR(nor->dirmap.rdesc);
+
+		nor->dirmap.rdesc = NULL;
+		return ret;
+	}
 
 	return 0;
 }
@@ -66,12 +70,26 @@ static int spi_nor_create_write_dirmap(struct spi_nor *nor)
 		op->addr.nbytes = 0;
 
 	nor->dirmap.wdesc = spi_mem_dirmap_create(nor->spi, &info);
-	if (IS_ERR(nor->dirmap.wdesc))
-		return PTR_ERR(nor->dirmap.wdesc);
+	if (IS_ERR(nor->dirmap.wdesc)) {
+		int ret = PTR_ERR(nor->dirmap.wdesc);
+
+		nor->dirmap.wdesc = NULL;
+		return ret;
+	}
 
 	return 0;
 }
 
+static void spi_nor_destroy_dirmaps(struct spi_nor *nor)
+{
+	if (nor->dirmap.wdesc)
+		spi_mem_dirmap_destroy(nor->dirmap.wdesc);
+	if (nor->dirmap.rdesc)
+		spi_mem_dirmap_destroy(nor->dirmap.rdesc);
+	nor->dirmap.wdesc = NULL;
+	nor->dirmap.rdesc = NULL;
+}
+
 /**
  * spi_flash_probe_slave() - Probe for a SPI flash device on a bus
  *
@@ -100,14 +118,19 @@ static int spi_flash_probe_slave(struct spi_flash *flash)
 	if (ret)
 		goto err_read_id;
 
+	/*
+	 * A direct mapping is only a faster way of doing the same operations,
+	 * so carry on without one if the controller cannot set it up
+	 */
 	if (CONFIG_IS_ENABLED(SPI_DIRMAP)) {
 		ret = spi_nor_create_read_dirmap(flash);
 		if (ret)
-			return ret;
+			log_debug("SF: No read mapping (err=%d)\n", ret);
 
 		ret = spi_nor_create_write_dirmap(flash);
 		if (ret)
-			return ret;
+			log_debug("SF: No write mapping (err=%d)\n", ret);
+		ret = 0;
 	}
 
 	if (CONFIG_IS_ENABLED(SPI_FLASH_MTD))
@@ -148,10 +171,8 @@ struct spi_flash *spi_flash_probe(unsigned int busnum, unsigned int cs,
 
 void spi_flash_free(struct spi_flash *flash)
 {
-	if (CONFIG_IS_ENABLED(SPI_DIRMAP)) {
-		spi_mem_dirmap_destroy(flash->dirmap.wdesc);
-		spi_mem_dirmap_destroy(flash->dirmap.rdesc);
-	}
+	if (CONFIG_IS_ENABLED(SPI_DIRMAP))
+		spi_nor_destroy_dirmaps(flash);
 
 	if (CONFIG_IS_ENABLED(SPI_FLASH_MTD))
 		spi_flash_mtd_unregister(flash);
@@ -224,10 +245,8 @@ static int spi_flash_std_remove(struct udevice *dev)
 	struct spi_flash *flash = dev_get_uclass_priv(dev);
 	int ret;
 
-	if (CONFIG_IS_ENABLED(SPI_DIRMAP)) {
-		spi_mem_dirmap_destroy(flash->dirmap.wdesc);
-		spi_mem_dirmap_destroy(flash->dirmap.rdesc);
-	}
+	if (CONFIG_IS_ENABLED(SPI_DIRMAP))
+		spi_nor_destroy_dirmaps(flash);
 
 	ret = spi_nor_remove(flash);
 	if (ret)
@@ -78,6 +78,7 @@
 #include <linux/random.h>
 #include <u-boot/crc.h>
 #else
+#include <bootstage.h>
 #include <div64.h>
 #include <linux/bug.h>
 #include <linux/err.h>
@@ -833,6 +834,7 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 		return 0;
 	}
 
+	ubi_io_read_hdrs(ubi, pnum);
 	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
 	if (err < 0)
 		return err;
@@ -1215,6 +1217,32 @@ static void destroy_ai(struct ubi_attach_info *ai)
 	kfree(ai);
 }
 
+/**
+ * alloc_hdrs_buf - allocate the buffer used to read both headers of a PEB.
+ * @ubi: UBI device description object
+ *
+ * Returns zero in case of success and %-ENOMEM in case of failure.
+ */
+static int alloc_hdrs_buf(struct ubi_device *ubi)
+{
+	ubi->hdrs_buf = kmalloc(ubi->vid_hdr_aloffset + ubi->vid_hdr_alsize,
+				GFP_KERNEL);
+	ubi->hdrs_pnum = -1;
+
+	return ubi->hdrs_buf ? 0 : -ENOMEM;
+}
+
+/**
+ * free_hdrs_buf - free the buffer used to read both headers of a PEB.
+ * @ubi: UBI device description object
+ */
+static void free_hdrs_buf(struct ubi_device *ubi)
+{
+	kfree(ubi->hdrs_buf);
+	ubi->hdrs_buf = NULL;
+	ubi->hdrs_pnum = -1;
+}
+
 /**
  * scan_all - scan entire MTD device.
  * @ubi: UBI device description object
@@ -1243,14 +1271,18 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 	if (!vidh)
 		goto out_ech;
 
+	if (alloc_hdrs_buf(ubi))
+		goto out_vidh;
+
 	for (pnum = start; pnum < ubi->peb_count; pnum++) {
 		cond_resched();
 
 		dbg_gen("process PEB %d", pnum);
 		err = scan_peb(ubi, ai, pnum, NULL, NULL);
 		if (err < 0)
-			goto out_vidh;
+			goto out_hdrs;
 	}
+	free_hdrs_buf(ubi);
 
 	ubi_msg(ubi, "scanning is finished");
 
@@ -1294,6 +1326,8 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 
 	return 0;
 
+out_hdrs:
+	free_hdrs_buf(ubi);
 out_vidh:
 	ubi_free_vid_hdr(ubi, vidh);
 out_ech:
@@ -1352,6 +1386,9 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 	if (!vidh)
 		goto out_ech;
 
+	if (alloc_hdrs_buf(ubi))
+		goto out_vidh;
+
 	for (pnum = 0; pnum < UBI_FM_MAX_START; pnum++) {
 		int vol_id = -1;
 		unsigned long long sqnum = -1;
@@ -1360,7 +1397,7 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 		dbg_gen("process PEB %d", pnum);
 		err = scan_peb(ubi, *ai, pnum, &vol_id, &sqnum);
 		if (err < 0)
-			goto out_vidh;
+			goto out_hdrs;
 
 		if (vol_id == UBI_FM_SB_VOLUME_ID && sqnum > max_sqnum) {
 			max_sqnum = sqnum;
@@ -1368,6 +1405,7 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 		}
 	}
 
+	free_hdrs_buf(ubi);
 	ubi_free_vid_hdr(ubi, vidh);
 	kfree(ech);
 
@@ -1381,6 +1419,8 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 
 	return ubi_scan_fastmap(ubi, *ai, fm_anchor);
 
+out_hdrs:
+	free_hdrs_buf(ubi);
 out_vidh:
 	ubi_free_vid_hdr(ubi, vidh);
 out_ech:
@@ -1408,6 +1448,7 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 	if (!ai)
 		return -ENOMEM;
 
+	bootstage_start(BOOTSTAGE_ID_ACCUM_UBI_ATTACH, "ubi_attach");
 #ifdef CONFIG_MTD_UBI_FASTMAP
 	/* On small flash devices we disable fastmap in any case. */
 	if ((int)mtd_div_by_eb(ubi->mtd->size, ubi->mtd) <= UBI_FM_MAX_START) {
@@ -1482,6 +1523,7 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 #endif
 
 	destroy_ai(ai);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_UBI_ATTACH);
 	return 0;
 
 out_wl:
@@ -1491,6 +1533,7 @@ out_vtbl:
 	vfree(ubi->vtbl);
 out_ai:
 	destroy_ai(ai);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_UBI_ATTACH);
 	return err;
 }
 
@@ -276,6 +276,9 @@ int ubi_io_write(struct ubi_device *ubi, const void *buf, int pnum, int offset,
 		return -EIO;
 	}
 
+	if (pnum == ubi->hdrs_pnum)
+		ubi->hdrs_pnum = -1;
+
 	addr = (loff_t)pnum * ubi->peb_size + offset;
 	err = mtd_write(ubi->mtd, addr, len, &written, buf);
 	if (err) {
@@ -327,6 +330,9 @@ static int do_sync_erase(struct ubi_device *ubi, int pnum)
 		return -EROFS;
 	}
 
+	if (pnum == ubi->hdrs_pnum)
+		ubi->hdrs_pnum = -1;
+
 retry:
 	init_waitqueue_head(&wq);
 	memset(&ei, 0, sizeof(struct erase_info));
@@ -647,6 +653,77 @@ int ubi_io_mark_bad(const struct ubi_device *ubi, int pnum)
 	return err;
 }
 
+/**
+ * ubi_io_read_hdrs - read the EC and VID headers of a PEB at once.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock number to read from
+ *
+ * When attaching, both headers of every PEB are read. This function reads
+ * them with a single request into @ubi->hdrs_buf, so that the following
+ * 'ubi_io_read_ec_hdr()' and 'ubi_io_read_vid_hdr()' calls for @pnum do not
+ * have to go to the flash again. This saves a request per PEB, and a NAND
+ * page read when both headers are in the same page.
+ *
+ * A bit-flip is reported for both headers, which makes no difference as
+ * either way the PEB is scrubbed. The read goes to the MTD layer directly,
+ * without the retries and error messages of 'ubi_io_read()': if it fails,
+ * nothing is kept and nothing is printed, so that the headers are then read
+ * separately and the failure is reported once, for the right header and
+ * length.
+ */
+void ubi_io_read_hdrs(struct ubi_device *ubi, int pnum)
+{
+	int err, len = ubi->vid_hdr_aloffset + ubi->vid_hdr_alsize;
+	size_t read;
+
+	ubi->hdrs_pnum = -1;
+	if (!ubi->hdrs_buf)
+		return;
+
+	/* See 'ubi_io_read()' for why the first byte is changed */
+	*((uint8_t *)ubi->hdrs_buf) ^= 0xFF;
+
+	err = mtd_read(ubi->mtd, (loff_t)pnum * ubi->peb_size, len, &read,
+		       ubi->hdrs_buf);
+	if (read != len)
+		return;
+
+	if (mtd_is_bitflip(err)) {
+		ubi_msg(ubi, "fixable bit-flip detected at PEB %d", pnum);
+		err = UBI_IO_BITFLIPS;
+	} else if (err) {
+		return;
+	} else if (ubi_dbg_is_bitflip(ubi)) {
+		dbg_gen("bit-flip (emulated)");
+		err = UBI_IO_BITFLIPS;
+	}
+
+	ubi->hdrs_pnum = pnum;
+	ubi->hdrs_err = err;
+}
+
+/**
+ * read_hdr - read (part of) a header of a PEB.
+ * @ubi: UBI device description object
+ * @buf: buffer where to store the read data
+ * @pnum: physical eraseblock number to read from
+ * @offset: offset within the physical eraseblock from where to read
+ * @len: how many bytes to read
+ *
+ * This is the same as 'ubi_io_read()', except that it uses the headers read
+ * by 'ubi_io_read_hdrs()' if they are for @pnum.
+ */
+static int read_hdr(const struct ubi_device *ubi, void *buf, int pnum,
+		    int offset, int len)
+{
+	if (ubi->hdrs_buf && pnum == ubi->hdrs_pnum) {
+		memcpy(buf, ubi->hdrs_buf + offset, len);
+		return ubi->hdrs_err;
+	}
+
+	return ubi_io_read(ubi, buf, pnum, offset, len);
+}
+
 /**
  * validate_ec_hdr - validate an erase counter header.
  * @ubi: UBI device description object
@@ -728,7 +805,7 @@ int ubi_io_read_ec_hdr(struct ubi_device *ubi, int pnum,
 	dbg_io("read EC header from PEB %d", pnum);
 	ubi_assert(pnum >= 0 && pnum < ubi->peb_count);
 
-	read_err = ubi_io_read(ubi, ec_hdr, pnum, 0, UBI_EC_HDR_SIZE);
+	read_err = read_hdr(ubi, ec_hdr, pnum, 0, UBI_EC_HDR_SIZE);
 	if (read_err) {
 		if (read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 			return read_err;
@@ -998,8 +1075,8 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 	ubi_assert(pnum >= 0 &&  pnum < ubi->peb_count);
 
 	p = (char *)vid_hdr - ubi->vid_hdr_shift;
-	read_err = ubi_io_read(ubi, p, pnum, ubi->vid_hdr_aloffset,
-			  ubi->vid_hdr_alsize);
+	read_err = read_hdr(ubi, p, pnum, ubi->vid_hdr_aloffset,
+			    ubi->vid_hdr_alsize);
 	if (read_err && read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 		return read_err;
 
@@ -17,15 +17,15 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		CONFIG_NVME_IO_QUEUE_DEPTH
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
-#define NVME_CQ_ALLOCATION	ALIGN(NVME_CQ_SIZE(NVME_Q_DEPTH), \
-				      ARCH_DMA_MINALIGN)
+#define NVME_CQ_ALLOCATION(depth)	ALIGN(NVME_CQ_SIZE(depth), \
+					      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
+#define NVME_MAX_XFER_SHIFT	22
 
 static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 {
@@ -44,8 +44,20 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+/**
+ * nvme_setup_prps() - fill in the PRP list for a transfer
+ *
+ * The list comes from an I/O slot, allocated by nvme_alloc_io_slots() to be
+ * large enough for the maximum transfer size, so nothing is allocated here.
+ *
+ * @dev:	NVMe device
+ * @prp_list:	PRP list to fill in
+ * @prp2:	Returns the value to use for PRP entry 2
+ * @total_len:	Number of bytes to transfer
+ * @dma_addr:	Address of the buffer
+ */
+static void nvme_setup_prps(struct nvme_dev *dev, u64 *prp_list, u64 *prp2,
+			    int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
@@ -59,7 +71,7 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 
 	if (length <= 0) {
 		*prp2 = 0;
-		return 0;
+		return;
 	}
 
 	if (length)
@@ -67,27 +79,13 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 
 	if (length <= page_size) {
 		*prp2 = dma_addr;
-		return 0;
+		return;
 	}
 
 	nprps = DIV_ROUND_UP(length, page_size);
 	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
 
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
-		/*
-		 * Always increase in increments of pages.  It doesn't waste
-		 * much memory and reduces the number of allocations.
-		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
-			printf("Error: malloc prp_pool fail\n");
-			return -ENOMEM;
-		}
-		dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
-	}
-
-	prp_pool = dev->prp_pool;
+	prp_pool = prp_list;
 	i = 0;
 	while (nprps) {
 		if ((i == (prps_per_page - 1)) && nprps > 1) {
@@ -100,12 +98,10 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)prp_list;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
+	flush_dcache_range((ulong)prp_list, (ulong)prp_list +
 			   num_pages * page_size);
-
-	return 0;
 }
 
 static __le16 nvme_get_cmd_id(void)
@@ -127,7 +123,7 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 	 * as the cache line should never become dirty.
 	 */
 	ulong start = (ulong)&nvmeq->cqes[0];
-	ulong stop = start + NVME_CQ_ALLOCATION;
+	ulong stop = start + NVME_CQ_ALLOCATION(nvmeq->q_depth);
 
 	invalidate_dcache_range(start, stop);
 
@@ -137,10 +133,16 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 /**
  * nvme_submit_cmd() - copy a command into a queue and ring the doorbell
  *
+ * When @ring is false the doorbell is left for nvme_ring_sq(), so that
+ * several commands can be handed to the controller with a single write.
+ * Controllers with their own submit_cmd() method always ring it.
+ *
  * @nvmeq:	The queue to use
  * @cmd:	The command to send
+ * @ring:	true to ring the doorbell now
  */
-static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
+static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd,
+			    bool ring)
 {
 	struct nvme_ops *ops;
 	u16 tail = nvmeq->sq_tail;
@@ -157,10 +159,27 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 
 	if (++tail == nvmeq->q_depth)
 		tail = 0;
-	writel(tail, nvmeq->q_db);
+	if (ring)
+		writel(tail, nvmeq->q_db);
 	nvmeq->sq_tail = tail;
 }
 
+/**
+ * nvme_ring_sq() - tell the controller about commands added to a queue
+ *
+ * @nvmeq:	The queue to use
+ */
+static void nvme_ring_sq(struct nvme_queue *nvmeq)
+{
+	struct nvme_ops *ops;
+
+	ops = (struct nvme_ops *)nvmeq->dev->udev->driver->ops;
+	if (ops && ops->submit_cmd)
+		return;
+
+	writel(nvmeq->sq_tail, nvmeq->q_db);
+}
+
 static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 				struct nvme_command *cmd,
 				u32 *result, unsigned timeout)
@@ -173,7 +192,7 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 	ulong timeout_us = timeout * 100000;
 
 	cmd->common.command_id = nvme_get_cmd_id();
-	nvme_submit_cmd(nvmeq, cmd);
+	nvme_submit_cmd(nvmeq, cmd, true);
 
 	start_time = timer_get_us();
 
@@ -236,7 +255,7 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
 		return NULL;
 	memset(nvmeq, 0, sizeof(*nvmeq));
 
-	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION);
+	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_ALLOCATION(depth));
 	if (!nvmeq->cqes)
 		goto free_nvmeq;
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(depth));
@@ -347,7 +366,8 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(nvmeq->q_depth));
 	flush_dcache_range((ulong)nvmeq->cqes,
-			   (ulong)nvmeq->cqes + NVME_CQ_ALLOCATION);
+			   (ulong)nvmeq->cqes +
+			   NVME_CQ_ALLOCATION(nvmeq->q_depth));
 	dev->online_queues++;
 }
 
@@ -670,6 +690,50 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 	return 0;
 }
 
+/**
+ * nvme_alloc_io_slots() - allocate the I/O slots and their PRP lists
+ *
+ * One command fewer than the queue depth can be outstanding, since a full
+ * queue cannot be told apart from an empty one. Controllers with their own
+ * submit_cmd() method track submission-queue slots themselves and only
+ * handle one command at a time.
+ *
+ * @dev:	NVMe device
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+static int nvme_alloc_io_slots(struct nvme_dev *dev)
+{
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	u32 page_size = dev->page_size;
+	u32 prps_per_page = page_size >> 3;
+	u32 nprps, pool_size;
+	u8 *pool;
+	int i;
+
+	dev->io_depth = dev->queues[NVME_IO_Q]->q_depth - 1;
+	if (ops && ops->submit_cmd)
+		dev->io_depth = 1;
+
+	/* Keep the PRP lists, and the block count of a command, bounded */
+	dev->max_transfer_shift = min_t(u32, dev->max_transfer_shift,
+					NVME_MAX_XFER_SHIFT);
+	nprps = (1 << dev->max_transfer_shift) / page_size;
+	pool_size = max_t(u32, DIV_ROUND_UP(nprps - 1, prps_per_page - 1), 1) *
+		page_size;
+
+	dev->io_slots = calloc(dev->io_depth, sizeof(*dev->io_slots));
+	pool = memalign(page_size, dev->io_depth * pool_size);
+	if (!dev->io_slots || !pool) {
+		free(dev->io_slots);
+		free(pool);
+		return -ENOMEM;
+	}
+	for (i = 0; i < dev->io_depth; i++)
+		dev->io_slots[i].prp_list = (u64 *)(pool + i * pool_size);
+
+	return 0;
+}
+
 int nvme_get_namespace_id(struct udevice *udev, u32 *ns_id, u8 *eui64)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
@@ -744,65 +808,171 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
+/**
+ * nvme_get_io_slot() - find an I/O slot which is not in use
+ *
+ * @dev:	NVMe device
+ * Return: slot number, or -ENOSPC if all are waiting for completions
+ */
+static int nvme_get_io_slot(struct nvme_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->io_depth; i++) {
+		if (!dev->io_slots[i].busy)
+			return i;
+	}
+
+	return -ENOSPC;
+}
+
+/**
+ * nvme_reap_io() - handle the I/O completions which have arrived
+ *
+ * Completions can arrive in any order. The completion-queue doorbell is
+ * written once for the whole batch.
+ *
+ * @nvmeq:	I/O queue
+ * @err_lba:	Updated with the first block of any failed command
+ * Return: number of commands completed
+ */
+static int nvme_reap_io(struct nvme_queue *nvmeq, u64 *err_lba)
+{
+	struct nvme_dev *dev = nvmeq->dev;
+	struct nvme_ops *ops;
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	int count = 0;
+	bool seen = false;
+
+	ops = (struct nvme_ops *)dev->udev->driver->ops;
+	for (;;) {
+		struct nvme_io_slot *slot;
+		u16 status, id;
+
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase)
+			break;
+		seen = true;
+
+		id = readw(&nvmeq->cqes[head].command_id);
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+
+		/* ignore anything left over from a timed-out transfer */
+		if (id >= dev->io_depth || !dev->io_slots[id].busy)
+			continue;
+		slot = &dev->io_slots[id];
+
+		if (ops && ops->complete_cmd)
+			ops->complete_cmd(nvmeq, &nvmeq->sq_cmds[slot->sq_index]);
+
+		status >>= 1;
+		if (status) {
+			printf("ERROR: status = %x, lba = %llx\n", status,
+			       (unsigned long long)slot->slba);
+			*err_lba = min(*err_lba, slot->slba);
+		}
+		slot->busy = false;
+		count++;
+	}
+
+	if (seen) {
+		writel(head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+	}
+
+	return count;
+}
+
 static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 			 lbaint_t blkcnt, void *buffer, bool read)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
 	struct nvme_command c;
 	struct blk_desc *desc = dev_get_uclass_plat(udev);
-	int status;
 	u64 prp2;
 	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
 	uintptr_t temp_buffer = (uintptr_t)buffer;
-
 	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
+	u64 end = blknr + blkcnt;
+	u64 err_lba = end;
+	u32 max_lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	ulong timeout_us = IO_TIMEOUT * 100000;
+	ulong start_time;
+	int inflight = 0;
+	int i;
 
 	flush_dcache_range((unsigned long)buffer,
 			   (unsigned long)buffer + total_len);
 
+	memset(&c, 0, sizeof(c));
 	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
 	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+
+	start_time = timer_get_us();
+	for (;;) {
+		bool queued = false;
+
+		/* fill the queue, then ring the doorbell once */
+		while (slba < end && err_lba == end) {
+			struct nvme_io_slot *slot;
+			u32 lbas = min_t(u64, max_lbas, end - slba);
+			int id;
+
+			id = nvme_get_io_slot(dev);
+			if (id < 0)
+				break;
+			slot = &dev->io_slots[id];
+
+			nvme_setup_prps(dev, slot->prp_list, &prp2,
+					lbas << ns->lba_shift, temp_buffer);
+			c.rw.command_id = cpu_to_le16(id);
+			c.rw.slba = cpu_to_le64(slba);
+			c.rw.length = cpu_to_le16(lbas - 1);
+			c.rw.prp1 = cpu_to_le64(temp_buffer);
+			c.rw.prp2 = cpu_to_le64(prp2);
+			slot->slba = slba;
+			slot->sq_index = nvmeq->sq_tail;
+			slot->busy = true;
+			nvme_submit_cmd(nvmeq, &c, false);
+			queued = true;
+			inflight++;
+
+			slba += lbas;
+			temp_buffer += lbas << ns->lba_shift;
 		}
+		if (queued)
+			nvme_ring_sq(nvmeq);
+		if (!inflight)
+			break;
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64(temp_buffer);
-		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+		i = nvme_reap_io(nvmeq, &err_lba);
+		if (i) {
+			inflight -= i;
+			start_time = timer_get_us();
+		} else if (timer_get_us() - start_time >= timeout_us) {
+			printf("ERROR: %s: I/O timed out\n", udev->name);
+			for (i = 0; i < dev->io_depth; i++) {
+				if (dev->io_slots[i].busy)
+					err_lba = min(err_lba,
+						      dev->io_slots[i].slba);
+				dev->io_slots[i].busy = false;
+			}
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		temp_buffer += lbas << ns->lba_shift;
+		}
 	}
 
 	if (read)
 		invalidate_dcache_range((unsigned long)buffer,
 					(unsigned long)buffer + total_len);
 
-	return (total_len - temp_len) >> desc->log2blksz;
+	return err_lba - blknr;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -863,15 +1033,6 @@ int nvme_init(struct udevice *udev)
 		goto free_queue;
 	}
 
-	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ret = nvme_setup_io_queues(ndev);
 	if (ret) {
 		log_debug("Unable to setup I/O queues(err=%dE)\n", ret);
@@ -880,6 +1041,13 @@ int nvme_init(struct udevice *udev)
 
 	nvme_get_info_from_identify(ndev);
 
+	/* Allocate after the page and maximum transfer sizes are known */
+	ret = nvme_alloc_io_slots(ndev);
+	if (ret) {
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
+
 	/* Create a blk device for each namespace */
 
 	id = memalign(ndev->page_size, sizeof(struct nvme_id_ns));
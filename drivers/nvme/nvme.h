@@ -594,6 +594,25 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+/**
+ * struct nvme_io_slot - A read/write command which may be outstanding
+ *
+ * Each slot has its own PRP list, allocated once for the maximum transfer
+ * size, so that several commands can be in flight at once without any
+ * allocation in the I/O path. The slot number is used as the command ID.
+ *
+ * @prp_list:	PRP list for the command
+ * @slba:	First logical block of the command
+ * @sq_index:	Submission queue entry used by the command
+ * @busy:	true if the command is waiting for a completion
+ */
+struct nvme_io_slot {
+	u64 *prp_list;
+	u64 slba;
+	u16 sq_index;
+	bool busy;
+};
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct udevice *udev;
@@ -618,8 +637,8 @@ struct nvme_dev {
 	u32 stripe_size;
 	u32 page_size;
 	u8 vwc;
-	u64 *prp_pool;
-	u32 prp_entry_num;
+	struct nvme_io_slot *io_slots;
+	int io_depth;
 	u32 nn;
 };
 
@@ -14,28 +14,75 @@
 #include <virtio_ring.h>
 #include <linux/log2.h>
 #include <linux/err.h>
+#include <linux/sizes.h>
 #include "virtio_blk.h"
 #include <malloc.h>
 
+/*
+ * Largest transfer sent as one request. Longer transfers are split so that
+ * the device can work on several requests at once.
+ */
+#define VIRTIO_BLK_REQ_MAX_SECTORS	(SZ_256K / 512)
+
+/* Most requests in flight at once, across all virtqueues */
+#define VIRTIO_BLK_MAX_INFLIGHT		32
+
+/* Most virtqueues used when the device offers several */
+#define VIRTIO_BLK_MAX_VQS		4
+
+/**
+ * struct virtio_blk_req - a request in flight
+ */
+struct virtio_blk_req {
+	/** @out_hdr - request header */
+	struct virtio_blk_outhdr out_hdr;
+	/** @wz_hdr - range for VIRTIO_BLK_T_WRITE_ZEROES */
+	struct virtio_blk_discard_write_zeroes wz_hdr;
+	/** @status - completion status written by the device */
+	u8 status;
+	/** @sg - header, data segments and status */
+	struct virtio_sg *sg;
+	/** @sgs - pointers to each of @sg, as virtqueue_add() wants them */
+	struct virtio_sg **sgs;
+	/** @blkcnt - blocks of an asynchronous request, 0 if the slot is free */
+	lbaint_t blkcnt;
+};
+
 /**
  * struct virtio_blk_priv - private data for virtio block device
  */
 struct virtio_blk_priv {
-	/** @virtqueue - virtqueue to process */
-	struct virtqueue *vq;
+	/** @vqs - virtqueues to process, requests are spread across them */
+	struct virtqueue *vqs[VIRTIO_BLK_MAX_VQS];
+	/** @num_vqs - number of virtqueues in use */
+	u32 num_vqs;
 	/** @blksz_shift - log2 of block size divided by 512 */
 	u32 blksz_shift;
 	/** @size_max - maximum segment size */
 	u32 size_max;
 	/** @seg_max - maximum segment count */
 	u32 seg_max;
+	/** @seg_sectors - most sectors in one data segment */
+	u32 seg_sectors;
+	/** @req_sectors - most sectors in one request */
+	u32 req_sectors;
+	/** @req_segs - most data segments in one request */
+	u32 req_segs;
+	/** @max_inflight - most requests which fit in the virtqueues */
+	u32 max_inflight;
+	/** @reqs - slots for requests in flight */
+	struct virtio_blk_req *reqs;
+	/** @async_err - first error in the asynchronous request */
+	int async_err;
 };
 
 static const u32 feature[] = {
 	VIRTIO_BLK_F_BLK_SIZE,
 	VIRTIO_BLK_F_SIZE_MAX,
 	VIRTIO_BLK_F_SEG_MAX,
-	VIRTIO_BLK_F_WRITE_ZEROES
+	VIRTIO_BLK_F_MQ,
+	VIRTIO_BLK_F_WRITE_ZEROES,
+	VIRTIO_RING_F_INDIRECT_DESC,
 };
 
 static void virtio_blk_init_header_sg(struct udevice *dev, u64 sector, u32 type,
@@ -76,115 +123,118 @@ static void virtio_blk_init_data_sg(void *buffer, lbaint_t blkcnt, struct virtio
 }
 
 /*
- * Create, execute and wait for one single virtio request. On success the
- * transferred block count is returned and in the error case -EIO.
+ * Build one request and add it to a virtqueue, without telling the device.
+ * Returns -ENOSPC if the virtqueue is full.
  */
-static ulong virtio_blk_do_single_req(struct udevice *dev, u64 sector,
-				      lbaint_t blkcnt, char *buffer, u32 type)
+static int virtio_blk_add_req(struct udevice *dev, struct virtio_blk_req *req,
+			      struct virtqueue *vq, u64 sector,
+			      lbaint_t blkcnt, char *buffer, u32 type)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	/*
-	* The virtio device may have constrains on the maximum segment size.
-	* Calculate how many segments we need.
-	*/
-	u32 seg_cnt = (blkcnt * 512) / priv->size_max + 1;
-	lbaint_t seg_sec_cnt = priv->size_max / 512;
-	struct virtio_blk_outhdr out_hdr;
-	struct virtio_blk_discard_write_zeroes wz_hdr;
-	unsigned int num_out = 0, num_in = 0;
-	struct virtio_sg **sgs;
-	u8 status = VIRTIO_BLK_S_IOERR;
-	int ret;
-	u32 i;
+	unsigned int n = 0, num_out;
+	lbaint_t i, blk_per_seg;
 
-	/*
-	* +2 is header and status descriptor; seg_cnt is the number of data segments
-	* required. Needs to be dynamically allocated.
-	*/
-	sgs = calloc(seg_cnt + 2, sizeof(struct virtio_sg *));
-	if (!sgs)
-		return -ENOMEM;
-
-	for (i = 0; i < seg_cnt + 2; ++i) {
-		sgs[i] = malloc(sizeof(struct virtio_sg));
-		if (!sgs[i])
-			goto err_free;
-	}
-
-	virtio_blk_init_header_sg(dev, sector, type, &out_hdr, sgs[num_out++]);
+	virtio_blk_init_header_sg(dev, sector, type, &req->out_hdr,
+				  &req->sg[n++]);
 
 	switch (type) {
 	case VIRTIO_BLK_T_IN:
-	case VIRTIO_BLK_T_OUT: {
-		i = 0;
-		while (i < blkcnt) {
-			u32 blk_per_seg = min(blkcnt - i, seg_sec_cnt);
-
-			if (type & VIRTIO_BLK_T_OUT)
-				virtio_blk_init_data_sg(buffer + i * 512, blk_per_seg,
-							sgs[num_out++]);
-			else
-				virtio_blk_init_data_sg(buffer + i * 512, blk_per_seg,
-							sgs[num_out + num_in++]);
-			i += blk_per_seg;
+	case VIRTIO_BLK_T_OUT:
+		for (i = 0; i < blkcnt; i += blk_per_seg) {
+			blk_per_seg = min_t(lbaint_t, blkcnt - i,
+					    priv->seg_sectors);
+			virtio_blk_init_data_sg(buffer + i * 512, blk_per_seg,
+						&req->sg[n++]);
 		}
 		break;
-	}
 	case VIRTIO_BLK_T_WRITE_ZEROES:
-		virtio_blk_init_write_zeroes_sg(dev, sector, blkcnt, &wz_hdr,
-						sgs[num_out++]);
+		virtio_blk_init_write_zeroes_sg(dev, sector, blkcnt,
+						&req->wz_hdr, &req->sg[n++]);
 		break;
-
 	default:
-		goto err_free;
+		return -EINVAL;
 	}
 
-	virtio_blk_init_status_sg(&status, sgs[num_out + num_in++]);
-	log_debug("dev=%s, active=%d, priv=%p, priv->vq=%p\n", dev->name,
-		  device_active(dev), priv, priv->vq);
+	/* the device writes the data of a read, and always the status */
+	num_out = type == VIRTIO_BLK_T_IN ? 1 : n;
+	req->status = VIRTIO_BLK_S_IOERR;
+	virtio_blk_init_status_sg(&req->status, &req->sg[n++]);
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
-	if (ret)
-		goto err_free;
+	return virtqueue_add(vq, req->sgs, num_out, n - num_out);
+}
 
-	virtqueue_kick(priv->vq);
+/*
+ * Queue as many requests as there is room for, spread across the virtqueues,
+ * then notify the device once per virtqueue and wait for all of them. The
+ * number of sectors handled is returned, or -EIO on error.
+ */
+static long virtio_blk_do_batch(struct udevice *dev, u64 sector,
+				lbaint_t blkcnt, char *buffer, u32 type)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	unsigned int nreq, pending, q;
+	lbaint_t done = 0, cnt;
+	int ret, err = 0;
+
+	for (nreq = 0; nreq < priv->max_inflight && done < blkcnt; nreq++) {
+		cnt = min_t(lbaint_t, blkcnt - done, priv->req_sectors);
+		ret = virtio_blk_add_req(dev, &priv->reqs[nreq],
+					 priv->vqs[nreq % priv->num_vqs],
+					 sector + done, cnt,
+					 buffer ? buffer + done * 512 : NULL,
+					 type);
+		if (ret == -ENOSPC && nreq)
+			break;
+		if (ret) {
+			/*
+			 * The requests already queued belong to the device,
+			 * so let them finish before giving up
+			 */
+			err = -EIO;
+			break;
+		}
+		done += cnt;
+	}
 
-	log_debug("wait...");
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
+	for (q = 0; q < min(nreq, priv->num_vqs); q++)
+		virtqueue_kick(priv->vqs[q]);
+
+	log_debug("wait for %u requests...", nreq);
+	for (pending = nreq; pending; ) {
+		for (q = 0; q < priv->num_vqs; q++) {
+			while (pending && virtqueue_get_buf(priv->vqs[q], NULL))
+				pending--;
+		}
+	}
 	log_debug("done\n");
+	if (err)
+		return err;
 
-err_free:
-	for (i = 0; i < seg_cnt + 2; ++i)
-		free(sgs[i]);
-	free(sgs);
+	while (nreq--) {
+		if (priv->reqs[nreq].status != VIRTIO_BLK_S_OK)
+			return -EIO;
+	}
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt : -EIO;
+	return done;
 }
 
 static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
 			       lbaint_t blkcnt, char *buffer, u32 type)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	lbaint_t seg_sec_cnt = priv->size_max / 512;
-	u32 i = 0;
-	ulong ret;
+	lbaint_t i = 0;
+	long ret;
 
 	sector <<= priv->blksz_shift;
 	blkcnt <<= priv->blksz_shift;
 
-	/*
-	* The virtio device may have constrains on the maximum segment count. So
-	* send multiple virtio requests one after each other, if so.
-	*/
 	while (i < blkcnt) {
-		u32 blk_per_sg = min(blkcnt - i, seg_sec_cnt * priv->seg_max);
-
-		ret = virtio_blk_do_single_req(dev, sector + i, blk_per_sg,
-					       buffer + i * 512, type);
-		if (IS_ERR_VALUE(ret))
+		ret = virtio_blk_do_batch(dev, sector + i, blkcnt - i,
+					  buffer ? buffer + i * 512 : NULL,
+					  type);
+		if (ret < 0)
 			return ret;
-		i += blk_per_sg;
+		i += ret;
 	}
 
 	return blkcnt >> priv->blksz_shift;
@@ -214,6 +264,96 @@ static ulong virtio_blk_erase(struct udevice *dev, lbaint_t start,
 	return virtio_blk_do_req(dev, start, blkcnt, NULL, VIRTIO_BLK_T_WRITE_ZEROES);
 }
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+/*
+ * Put as many pieces of a block request as there are free slots into the
+ * virtqueues and notify the device. Slot i always uses the same virtqueue, so
+ * the virtqueues cannot overflow.
+ */
+static int virtio_blk_async_fill(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	u32 type = req->op == BLK_REQ_READ ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT;
+	lbaint_t max = priv->req_sectors >> priv->blksz_shift;
+	bool kick[VIRTIO_BLK_MAX_VQS] = {};
+	unsigned int i, q;
+	int ret = 0;
+
+	for (i = 0; i < priv->max_inflight; i++) {
+		struct virtio_blk_req *vreq = &priv->reqs[i];
+		lbaint_t start, cnt;
+		void *buf;
+
+		if (vreq->blkcnt)
+			continue;
+		cnt = blk_req_next(req, max, &start, &buf);
+		if (!cnt)
+			break;
+		q = i % priv->num_vqs;
+		if (virtio_blk_add_req(dev, vreq, priv->vqs[q],
+				       start << priv->blksz_shift,
+				       cnt << priv->blksz_shift, buf, type)) {
+			ret = -EIO;
+			break;
+		}
+		vreq->blkcnt = cnt;
+		kick[q] = true;
+	}
+
+	for (q = 0; q < priv->num_vqs; q++) {
+		if (kick[q])
+			virtqueue_kick(priv->vqs[q]);
+	}
+
+	return ret;
+}
+
+static int virtio_blk_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+
+	/* each piece of the request must fit in one virtio request */
+	if (priv->req_sectors >> priv->blksz_shift == 0)
+		return -ENOSYS;
+
+	/* any error is reported once the pieces in flight are back */
+	priv->async_err = virtio_blk_async_fill(dev, req);
+
+	return 0;
+}
+
+static void virtio_blk_poll(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_outhdr *out_hdr;
+	unsigned int i, q, inflight = 0;
+
+	for (q = 0; q < priv->num_vqs; q++) {
+		while ((out_hdr = virtqueue_get_buf(priv->vqs[q], NULL))) {
+			struct virtio_blk_req *vreq;
+
+			vreq = container_of(out_hdr, struct virtio_blk_req,
+					    out_hdr);
+			if (vreq->status != VIRTIO_BLK_S_OK)
+				priv->async_err = -EIO;
+			req->done += vreq->blkcnt;
+			vreq->blkcnt = 0;
+		}
+	}
+
+	if (!priv->async_err)
+		priv->async_err = virtio_blk_async_fill(dev, req);
+
+	/* the buffers belong to the device until all pieces are back */
+	for (i = 0; i < priv->max_inflight; i++) {
+		if (priv->reqs[i].blkcnt)
+			inflight++;
+	}
+	if (!inflight)
+		blk_req_complete(req, priv->async_err);
+}
+#endif
+
 static int virtio_blk_bind(struct udevice *dev)
 {
 	struct virtio_dev_priv *uc_priv = dev_get_uclass_priv(dev->parent);
@@ -249,6 +389,64 @@ static int virtio_blk_bind(struct udevice *dev)
 	return 0;
 }
 
+/*
+ * Work out how requests are split up and set aside room for the most that can
+ * be in flight. A request may not use more descriptors than the virtqueue
+ * holds, even when they are in an indirect table.
+ */
+static int virtio_blk_alloc_reqs(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	u32 ring = virtqueue_get_vring_size(priv->vqs[0]);
+	struct virtio_sg *sg;
+	struct virtio_sg **sgs;
+	u32 i, nsg, per_vq;
+
+	if (ring < 3)
+		return -EINVAL;
+
+	priv->seg_sectors = clamp_t(u32, priv->size_max / 512, 1,
+				    VIRTIO_BLK_REQ_MAX_SECTORS);
+	priv->req_segs = DIV_ROUND_UP(VIRTIO_BLK_REQ_MAX_SECTORS,
+				      priv->seg_sectors);
+	priv->req_segs = clamp_t(u32, priv->req_segs, 1,
+				 max(priv->seg_max, 1U));
+	priv->req_segs = min(priv->req_segs, ring - 2);
+	priv->req_sectors = min_t(u32, priv->req_segs * priv->seg_sectors,
+				  VIRTIO_BLK_REQ_MAX_SECTORS);
+
+	/* with indirect descriptors each request takes a single ring slot */
+	per_vq = ring / (priv->req_segs + 2);
+	if (priv->vqs[0]->indirect && !priv->vqs[0]->vring.bouncebufs)
+		per_vq = ring;
+	priv->max_inflight = min(per_vq * priv->num_vqs,
+				 (u32)VIRTIO_BLK_MAX_INFLIGHT);
+	log_debug("%s: %u sectors/segment, %u segments/request, %u vqs, %u in flight\n",
+		  dev->name, priv->seg_sectors, priv->req_segs, priv->num_vqs,
+		  priv->max_inflight);
+
+	nsg = priv->req_segs + 2;
+	priv->reqs = calloc(priv->max_inflight, sizeof(*priv->reqs));
+	sg = calloc(priv->max_inflight * nsg, sizeof(*sg));
+	sgs = calloc(priv->max_inflight * nsg, sizeof(*sgs));
+	if (!priv->reqs || !sg || !sgs) {
+		free(sgs);
+		free(sg);
+		free(priv->reqs);
+		priv->reqs = NULL;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < priv->max_inflight * nsg; i++)
+		sgs[i] = &sg[i];
+	for (i = 0; i < priv->max_inflight; i++) {
+		priv->reqs[i].sg = &sg[i * nsg];
+		priv->reqs[i].sgs = &sgs[i * nsg];
+	}
+
+	return 0;
+}
+
 static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
@@ -256,8 +454,15 @@ static int virtio_blk_probe(struct udevice *dev)
 	u64 cap;
 	int ret;
 	u32 blk_size;
+	u16 num_queues;
 
-	ret = virtio_find_vqs(dev, 1, &priv->vq);
+	priv->num_vqs = 1;
+	if (virtio_has_feature(dev, VIRTIO_BLK_F_MQ)) {
+		virtio_cread(dev, struct virtio_blk_config, num_queues,
+			     &num_queues);
+		priv->num_vqs = clamp_t(u32, num_queues, 1, VIRTIO_BLK_MAX_VQS);
+	}
+	ret = virtio_find_vqs(dev, priv->num_vqs, priv->vqs);
 	if (ret)
 		return ret;
 
@@ -284,13 +489,31 @@ static int virtio_blk_probe(struct udevice *dev)
 	else
 		priv->seg_max = -1U;
 
-	return 0;
+	return virtio_blk_alloc_reqs(dev);
+}
+
+static int virtio_blk_remove(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+
+	if (priv->reqs) {
+		free(priv->reqs[0].sg);
+		free(priv->reqs[0].sgs);
+		free(priv->reqs);
+		priv->reqs = NULL;
+	}
+
+	return virtio_reset(dev);
 }
 
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
 	.erase	= virtio_blk_erase,
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	.submit	= virtio_blk_submit,
+	.poll	= virtio_blk_poll,
+#endif
 };
 
 U_BOOT_DRIVER(virtio_blk) = {
@@ -299,7 +522,7 @@ U_BOOT_DRIVER(virtio_blk) = {
 	.ops	= &virtio_blk_ops,
 	.bind	= virtio_blk_bind,
 	.probe	= virtio_blk_probe,
-	.remove	= virtio_reset,
+	.remove	= virtio_blk_remove,
 	.priv_auto	= sizeof(struct virtio_blk_priv),
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
@@ -97,16 +97,76 @@ static void virtqueue_detach_desc(struct virtqueue *vq, unsigned int idx)
 	desc->addr = cpu_to_virtio64(vq->vdev, (u64)(uintptr_t)bb->user_buffer);
 }
 
+/*
+ * Put the whole buffer in a separately allocated table, which the ring refers
+ * to with a single descriptor. The shadow keeps the address of the first
+ * scatterlist, since that is what virtqueue_get_buf() hands back.
+ */
+static struct vring_desc *virtqueue_alloc_indirect(struct virtqueue *vq,
+						   struct virtio_sg *sgs[],
+						   unsigned int out_sgs,
+						   unsigned int in_sgs)
+{
+	unsigned int n, total = out_sgs + in_sgs;
+	struct vring_desc *indir;
+
+	indir = memalign(VRING_DESC_ALIGN_SIZE, total * sizeof(*indir));
+	if (!indir)
+		return NULL;
+
+	for (n = 0; n < total; n++) {
+		u16 flags = n + 1 < total ? VRING_DESC_F_NEXT : 0;
+
+		if (n >= out_sgs)
+			flags |= VRING_DESC_F_WRITE;
+		indir[n].addr = cpu_to_virtio64(vq->vdev,
+						(u64)(uintptr_t)sgs[n]->addr);
+		indir[n].len = cpu_to_virtio32(vq->vdev, sgs[n]->length);
+		indir[n].flags = cpu_to_virtio16(vq->vdev, flags);
+		indir[n].next = cpu_to_virtio16(vq->vdev, n + 1);
+	}
+
+	return indir;
+}
+
+static unsigned int virtqueue_attach_indirect(struct virtqueue *vq,
+					      unsigned int i,
+					      struct vring_desc *indir,
+					      unsigned int total, void *addr)
+{
+	struct vring_desc_shadow *desc_shadow = &vq->vring_desc_shadow[i];
+	struct vring_desc *desc = &vq->vring.desc[i];
+
+	desc_shadow->addr = (u64)(uintptr_t)addr;
+	desc_shadow->len = total * sizeof(*indir);
+	desc_shadow->flags = VRING_DESC_F_INDIRECT;
+	desc_shadow->indir = indir;
+
+	desc->addr = cpu_to_virtio64(vq->vdev, (u64)(uintptr_t)indir);
+	desc->len = cpu_to_virtio32(vq->vdev, desc_shadow->len);
+	desc->flags = cpu_to_virtio16(vq->vdev, desc_shadow->flags);
+	desc->next = cpu_to_virtio16(vq->vdev, desc_shadow->next);
+
+	return desc_shadow->next;
+}
+
 int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		  unsigned int out_sgs, unsigned int in_sgs)
 {
-	struct vring_desc *desc;
+	struct vring_desc *desc, *indir = NULL;
 	unsigned int descs_used = out_sgs + in_sgs;
 	unsigned int i, n, avail, uninitialized_var(prev);
 	int head;
 
 	WARN_ON(descs_used == 0);
 
+	/* bounce buffers are per ring slot, so cannot be used indirectly */
+	if (vq->indirect && descs_used > 1 && !vq->vring.bouncebufs) {
+		indir = virtqueue_alloc_indirect(vq, sgs, out_sgs, in_sgs);
+		if (indir)
+			descs_used = 1;
+	}
+
 	head = vq->free_head;
 
 	desc = vq->vring.desc;
@@ -122,20 +182,27 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		 */
 		if (out_sgs)
 			virtio_notify(vq->vdev, vq);
+		free(indir);
 		return -ENOSPC;
 	}
 
-	for (n = 0; n < descs_used; n++) {
-		u16 flags = VRING_DESC_F_NEXT;
+	if (indir) {
+		i = virtqueue_attach_indirect(vq, i, indir, out_sgs + in_sgs,
+					      sgs[0]->addr);
+	} else {
+		for (n = 0; n < descs_used; n++) {
+			u16 flags = VRING_DESC_F_NEXT;
 
-		if (n >= out_sgs)
-			flags |= VRING_DESC_F_WRITE;
-		prev = i;
-		i = virtqueue_attach_desc(vq, i, sgs[n], flags);
+			if (n >= out_sgs)
+				flags |= VRING_DESC_F_WRITE;
+			prev = i;
+			i = virtqueue_attach_desc(vq, i, sgs[n], flags);
+		}
+		/* Last one doesn't continue */
+		vq->vring_desc_shadow[prev].flags &= ~VRING_DESC_F_NEXT;
+		desc[prev].flags = cpu_to_virtio16(vq->vdev,
+						   vq->vring_desc_shadow[prev].flags);
 	}
-	/* Last one doesn't continue */
-	vq->vring_desc_shadow[prev].flags &= ~VRING_DESC_F_NEXT;
-	desc[prev].flags = cpu_to_virtio16(vq->vdev, vq->vring_desc_shadow[prev].flags);
 
 	/* We're using some buffers from the free list. */
 	vq->num_free -= descs_used;
@@ -221,6 +288,10 @@ static void detach_buf(struct virtqueue *vq, unsigned int head)
 	}
 
 	virtqueue_detach_desc(vq, i);
+	if (vq->vring_desc_shadow[i].flags & VRING_DESC_F_INDIRECT) {
+		free(vq->vring_desc_shadow[i].indir);
+		vq->vring_desc_shadow[i].indir = NULL;
+	}
 	vq->vring_desc_shadow[i].next = vq->free_head;
 	vq->free_head = head;
 
@@ -315,6 +386,7 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	list_add_tail(&vq->list, &uc_priv->vqs);
 
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC);
 
 	/* Tell other side not to bother us */
 	vq->avail_flags_shadow |= VRING_AVAIL_F_NO_INTERRUPT;
@@ -396,6 +468,11 @@ err_free_queue:
 
 void vring_del_virtqueue(struct virtqueue *vq)
 {
+	unsigned int i;
+
+	/* drop the tables of any buffers the device never gave back */
+	for (i = 0; i < vq->vring.num; i++)
+		free(vq->vring_desc_shadow[i].indir);
 	virtio_free_pages(vq->vdev, vq->vring.desc,
 			  DIV_ROUND_UP(vq->vring.size, PAGE_SIZE));
 	free(vq->vring_desc_shadow);
@@ -6,13 +6,26 @@
  */
 
 #include <dm.h>
+#include <malloc.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
+#include <asm/test.h>
 #include <linux/bug.h>
 #include <linux/compat.h>
 #include <linux/err.h>
 #include <linux/io.h>
+#include <linux/sizes.h>
+#include "virtio_blk.h"
+
+/* Geometry of the emulated block device */
+#define SANDBOX_BLK_SECTORS	2048
+#define SANDBOX_BLK_SIZE_MAX	SZ_4K
+#define SANDBOX_BLK_SEG_MAX	2
+#define SANDBOX_BLK_QUEUES	2
+
+/* Most descriptors in one emulated block request */
+#define SANDBOX_BLK_MAX_DESCS	16
 
 struct virtio_sandbox_priv {
 	u8 id;
@@ -22,11 +35,22 @@ struct virtio_sandbox_priv {
 	ulong queue_desc;
 	ulong queue_available;
 	ulong queue_used;
+	/* block device emulation */
+	struct virtio_blk_config blk_config;
+	u8 *disk;
+	u16 last_avail[SANDBOX_BLK_QUEUES];
+	uint notifies;
+	uint max_batch;
 };
 
 static int virtio_sandbox_get_config(struct udevice *udev, unsigned int offset,
 				     void *buf, unsigned int len)
 {
+	struct virtio_sandbox_priv *priv = dev_get_priv(udev);
+
+	if (priv->disk && offset + len <= sizeof(priv->blk_config))
+		memcpy(buf, (u8 *)&priv->blk_config + offset, len);
+
 	return 0;
 }
 
@@ -110,6 +134,9 @@ static struct virtqueue *virtio_sandbox_setup_vq(struct udevice *udev,
 	addr = virtqueue_get_used_addr(vq);
 	priv->queue_used = addr;
 
+	if (index < SANDBOX_BLK_QUEUES)
+		priv->last_avail[index] = 0;
+
 	return vq;
 
 error_new_virtqueue:
@@ -148,8 +175,144 @@ static int virtio_sandbox_find_vqs(struct udevice *udev, unsigned int nvqs,
 	return 0;
 }
 
+/*
+ * Carry out one block request, given as a chain of descriptors: the request
+ * header, the data buffers and finally the status byte. Returns the number of
+ * bytes written to the driver's buffers.
+ */
+static u32 virtio_sandbox_blk_req(struct virtio_sandbox_priv *priv,
+				  struct vring_desc *table, uint num, uint head)
+{
+	struct vring_desc *descs[SANDBOX_BLK_MAX_DESCS];
+	struct virtio_blk_outhdr *hdr;
+	u8 status = VIRTIO_BLK_S_OK;
+	uint i, count = 0;
+	u64 sector;
+	u32 written = 0;
+	u8 *status_p;
+
+	if (le16_to_cpu(table[head].flags) & VRING_DESC_F_INDIRECT) {
+		num = le32_to_cpu(table[head].len) / sizeof(*table);
+		table = (struct vring_desc *)(uintptr_t)
+			le64_to_cpu(table[head].addr);
+		head = 0;
+	}
+
+	for (i = head; count < SANDBOX_BLK_MAX_DESCS && i < num;
+	     i = le16_to_cpu(table[i].next)) {
+		descs[count++] = &table[i];
+		if (!(le16_to_cpu(table[i].flags) & VRING_DESC_F_NEXT))
+			break;
+	}
+	if (count < 2)
+		return 0;
+
+	hdr = (void *)(uintptr_t)le64_to_cpu(descs[0]->addr);
+	status_p = (void *)(uintptr_t)le64_to_cpu(descs[count - 1]->addr);
+	sector = le64_to_cpu(hdr->sector);
+
+	for (i = 1; i < count - 1; i++) {
+		void *buf = (void *)(uintptr_t)le64_to_cpu(descs[i]->addr);
+		u32 len = le32_to_cpu(descs[i]->len);
+
+		if (sector * 512 + len > SANDBOX_BLK_SECTORS * 512) {
+			status = VIRTIO_BLK_S_IOERR;
+			break;
+		}
+		switch (le32_to_cpu(hdr->type)) {
+		case VIRTIO_BLK_T_IN:
+			memcpy(buf, priv->disk + sector * 512, len);
+			written += len;
+			break;
+		case VIRTIO_BLK_T_OUT:
+			memcpy(priv->disk + sector * 512, buf, len);
+			break;
+		default:
+			status = VIRTIO_BLK_S_UNSUPP;
+			break;
+		}
+		sector += len / 512;
+	}
+	*status_p = status;
+
+	return written + 1;
+}
+
+/* Complete everything the driver has made available since the last kick */
+static void virtio_sandbox_blk_process(struct virtio_sandbox_priv *priv,
+				       struct virtqueue *vq)
+{
+	struct vring *vring = &vq->vring;
+	u16 *last = &priv->last_avail[vq->index];
+	u16 used_idx = le16_to_cpu(vring->used->idx);
+	uint batch = 0;
+
+	while (*last != le16_to_cpu(vring->avail->idx)) {
+		uint head = le16_to_cpu(vring->avail->ring[*last %
+							    vring->num]);
+		struct vring_used_elem *elem;
+
+		elem = &vring->used->ring[used_idx % vring->num];
+		elem->len = cpu_to_le32(virtio_sandbox_blk_req(priv,
+							       vring->desc,
+							       vring->num,
+							       head));
+		elem->id = cpu_to_le32(head);
+		used_idx++;
+		(*last)++;
+		batch++;
+	}
+	vring->used->idx = cpu_to_le16(used_idx);
+
+	priv->notifies++;
+	priv->max_batch = max(priv->max_batch, batch);
+}
+
 static int virtio_sandbox_notify(struct udevice *udev, struct virtqueue *vq)
 {
+	struct virtio_sandbox_priv *priv = dev_get_priv(udev);
+
+	if (priv->disk && vq->index < SANDBOX_BLK_QUEUES)
+		virtio_sandbox_blk_process(priv, vq);
+
+	return 0;
+}
+
+void sandbox_virtio_blk_get_stats(struct udevice *dev, uint *notifiesp,
+				  uint *max_batchp)
+{
+	struct virtio_sandbox_priv *priv = dev_get_priv(dev);
+
+	*notifiesp = priv->notifies;
+	*max_batchp = priv->max_batch;
+	priv->notifies = 0;
+	priv->max_batch = 0;
+}
+
+void *sandbox_virtio_blk_get_disk(struct udevice *dev)
+{
+	struct virtio_sandbox_priv *priv = dev_get_priv(dev);
+
+	return priv->disk;
+}
+
+static int virtio_sandbox_blk_init(struct virtio_sandbox_priv *priv)
+{
+	struct virtio_blk_config *config = &priv->blk_config;
+
+	priv->disk = calloc(SANDBOX_BLK_SECTORS, 512);
+	if (!priv->disk)
+		return -ENOMEM;
+
+	config->capacity = cpu_to_le64(SANDBOX_BLK_SECTORS);
+	config->size_max = cpu_to_le32(SANDBOX_BLK_SIZE_MAX);
+	config->seg_max = cpu_to_le32(SANDBOX_BLK_SEG_MAX);
+	config->num_queues = cpu_to_le16(SANDBOX_BLK_QUEUES);
+	priv->device_features |= BIT_ULL(VIRTIO_BLK_F_SIZE_MAX) |
+				 BIT_ULL(VIRTIO_BLK_F_SEG_MAX) |
+				 BIT_ULL(VIRTIO_BLK_F_MQ) |
+				 BIT_ULL(VIRTIO_RING_F_INDIRECT_DESC);
+
 	return 0;
 }
 
@@ -164,6 +327,19 @@ static int virtio_sandbox_probe(struct udevice *udev)
 					       VIRTIO_ID_RNG);
 	uc_priv->vendor = ('u' << 24) | ('b' << 16) | ('o' << 8) | 't';
 
+	if (uc_priv->device == VIRTIO_ID_BLOCK)
+		return virtio_sandbox_blk_init(priv);
+
+	return 0;
+}
+
+static int virtio_sandbox_remove(struct udevice *udev)
+{
+	struct virtio_sandbox_priv *priv = dev_get_priv(udev);
+
+	free(priv->disk);
+	priv->disk = NULL;
+
 	return 0;
 }
 
@@ -191,6 +367,7 @@ U_BOOT_DRIVER(virtio_sandbox1) = {
 	.of_match = virtio_sandbox1_ids,
 	.ops	= &virtio_sandbox1_ops,
 	.probe	= virtio_sandbox_probe,
+	.remove	= virtio_sandbox_remove,
 	.priv_auto	= sizeof(struct virtio_sandbox_priv),
 };
 
@@ -29,6 +29,7 @@
 #include <memalign.h>
 #include <search.h>
 #include <errno.h>
+#include <fs.h>
 #include <ext4fs.h>
 #include <mmc.h>
 #include <nvme.h>
@@ -77,6 +78,8 @@ static int env_ext4_save_buffer(env_t *env_new)
 		return 1;
 
 	dev = dev_desc->devnum;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close_all();
 	ext4fs_set_blk_dev(dev_desc, &info);
 
 	if (!ext4fs_mount()) {
@@ -172,6 +175,8 @@ static int env_ext4_load(void)
 		goto err_env_relocate;
 
 	dev = dev_desc->devnum;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close_all();
 	ext4fs_set_blk_dev(dev_desc, &info);
 
 	if (!ext4fs_mount()) {
@@ -14,6 +14,7 @@
 #include <memalign.h>
 #include <search.h>
 #include <errno.h>
+#include <fs.h>
 #include <init.h>
 #include <fat.h>
 #include <mmc.h>
@@ -79,6 +80,8 @@ static int env_fat_save(void)
 		return 1;
 
 	dev = dev_desc->devnum;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close_all();
 	if (fat_set_blk_dev(dev_desc, &info) != 0) {
 		/*
 		 * This printf is embedded in the messages from env_save that
@@ -153,6 +156,8 @@ static int env_fat_load(void)
 		goto err_env_relocate;
 
 	dev = dev_desc->devnum;
+	if (CONFIG_IS_ENABLED(FS_MOUNT_CACHE))
+		fs_close_all();
 	if (fat_set_blk_dev(dev_desc, &info) != 0) {
 		/*
 		 * This printf is embedded in the messages from env_save that
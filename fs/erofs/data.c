@@ -1,4 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0+
+#include <blk.h>
+#include <memalign.h>
+#include <linux/sizes.h>
 #include "internal.h"
 #include "decompress.h"
 
@@ -216,11 +219,99 @@ static int erofs_read_raw_data(struct erofs_inode *inode, char *buffer,
 	return 0;
 }
 
+/* Most compressed data to read from the disk at once */
+#define Z_EROFS_READ_BATCH_SIZE	SZ_1M
+
+/* Most extents to decompress from one read */
+#define Z_EROFS_READ_BATCH	16
+
+/**
+ * struct z_erofs_extent - a compressed extent of a file being read
+ *
+ * @la:		Logical address of the start of the extent
+ * @pa:		Address of the compressed data on its device
+ * @plen:	Length of the compressed data
+ * @deviceid:	Device holding the compressed data
+ * @flags:	EROFS_MAP_... flags of the extent
+ * @alg:	Decompression algorithm
+ * @out:	Where to put the decompressed data
+ * @skip:	Number of decompressed bytes to skip before @out
+ * @length:	Number of bytes to decompress, including @skip
+ * @trimmed:	true if the extent is only partly needed
+ */
+struct z_erofs_extent {
+	erofs_off_t la, pa;
+	u64 plen;
+	unsigned int deviceid;
+	unsigned int flags;
+	char alg;
+	char *out;
+	erofs_off_t skip, length;
+	bool trimmed;
+};
+
+static int z_erofs_decompress_extent(struct z_erofs_extent *ext, char *raw)
+{
+	int ret;
+
+	ret = z_erofs_decompress(&(struct z_erofs_decompress_req) {
+			.in = raw,
+			.out = ext->out,
+			.decodedskip = ext->skip,
+			.interlaced_offset =
+				ext->alg == Z_EROFS_COMPRESSION_INTERLACED ?
+					erofs_blkoff(ext->la) : 0,
+			.inputsize = ext->plen,
+			.decodedlength = ext->length,
+			.alg = ext->alg,
+			.partial_decoding = ext->trimmed ? true :
+				!(ext->flags & EROFS_MAP_FULL_MAPPED) ||
+					(ext->flags & EROFS_MAP_PARTIAL_REF),
+			 });
+	if (ret < 0)
+		return ret;
+	return 0;
+}
+
+/* Set up an extent from a mapping, finding where its data is */
+static int z_erofs_setup_extent(struct z_erofs_extent *ext,
+				struct erofs_map_blocks *map, char *buffer,
+				erofs_off_t skip, erofs_off_t length,
+				bool trimmed)
+{
+	/* no device id here, thus it will always succeed */
+	struct erofs_map_dev mdev = {
+		.m_pa = map->m_pa,
+	};
+	int ret;
+
+	ret = erofs_map_dev(&mdev);
+	if (ret) {
+		DBG_BUGON(1);
+		return ret;
+	}
+
+	*ext = (struct z_erofs_extent) {
+		.la = map->m_la,
+		.pa = mdev.m_pa,
+		.plen = map->m_plen,
+		.deviceid = mdev.m_deviceid,
+		.flags = map->m_flags,
+		.alg = map->m_algorithmformat,
+		.out = buffer,
+		.skip = skip,
+		.length = length,
+		.trimmed = trimmed,
+	};
+
+	return 0;
+}
+
 int z_erofs_read_one_data(struct erofs_inode *inode,
 			  struct erofs_map_blocks *map, char *raw, char *buffer,
 			  erofs_off_t skip, erofs_off_t length, bool trimmed)
 {
-	struct erofs_map_dev mdev;
+	struct z_erofs_extent ext;
 	int ret = 0;
 
 	if (map->m_flags & EROFS_MAP_FRAGMENT) {
@@ -238,49 +329,157 @@ int z_erofs_read_one_data(struct erofs_inode *inode,
 				   inode->fragmentoff + skip);
 	}
 
-	/* no device id here, thus it will always succeed */
-	mdev = (struct erofs_map_dev) {
-		.m_pa = map->m_pa,
-	};
-	ret = erofs_map_dev(&mdev);
-	if (ret) {
-		DBG_BUGON(1);
+	ret = z_erofs_setup_extent(&ext, map, buffer, skip, length, trimmed);
+	if (ret)
 		return ret;
-	}
 
-	ret = erofs_dev_read(mdev.m_deviceid, raw, mdev.m_pa, map->m_plen);
+	ret = erofs_dev_read(ext.deviceid, raw, ext.pa, ext.plen);
 	if (ret < 0)
 		return ret;
 
-	ret = z_erofs_decompress(&(struct z_erofs_decompress_req) {
-			.in = raw,
-			.out = buffer,
-			.decodedskip = skip,
-			.interlaced_offset =
-				map->m_algorithmformat == Z_EROFS_COMPRESSION_INTERLACED ?
-					erofs_blkoff(map->m_la) : 0,
-			.inputsize = map->m_plen,
-			.decodedlength = length,
-			.alg = map->m_algorithmformat,
-			.partial_decoding = trimmed ? true :
-				!(map->m_flags & EROFS_MAP_FULL_MAPPED) ||
-					(map->m_flags & EROFS_MAP_PARTIAL_REF),
-			 });
+	return z_erofs_decompress_extent(&ext, raw);
+}
+
+/**
+ * struct z_erofs_batch - extents whose compressed data is read at once
+ *
+ * @ext:	Extents, in descending order of logical address, with the
+ *		compressed data of each one immediately before that of the one
+ *		preceding it
+ * @count:	Number of extents in @ext
+ * @raw:	Buffer for the compressed data
+ * @bufsize:	Size of @raw
+ * @data:	Offset of the compressed data within @raw
+ * @busy:	true if the read has been submitted and not waited for
+ * @req:	Request reading the data
+ * @sg:		Buffer list of @req
+ */
+struct z_erofs_batch {
+	struct z_erofs_extent ext[Z_EROFS_READ_BATCH];
+	int count;
+	char *raw;
+	unsigned int bufsize;
+	unsigned int data;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	bool busy;
+	struct blk_req req;
+	struct blk_sg sg;
+#endif
+};
+
+/**
+ * z_erofs_batch_start() - start reading the compressed data of a batch
+ *
+ * When the device supports asynchronous requests, this returns as soon as the
+ * read is queued, so that the previous batch can be decompressed meanwhile.
+ *
+ * @batch:	Batch to read, whose buffer must not be in use
+ * Return: 0 if OK, -ve on error
+ */
+static int z_erofs_batch_start(struct z_erofs_batch *batch)
+{
+	struct z_erofs_extent *ext = batch->ext;
+	erofs_off_t start = ext[batch->count - 1].pa;
+	u64 size = ext[0].pa + ext[0].plen - start;
+	int ret;
+
+	/* leave room for reading whole device blocks */
+	if (size + 2 * EROFS_MAX_BLOCK_SIZE > batch->bufsize) {
+		free(batch->raw);
+		batch->bufsize = size + 2 * EROFS_MAX_BLOCK_SIZE;
+		batch->raw = malloc_cache_aligned(batch->bufsize);
+		if (!batch->raw) {
+			batch->bufsize = 0;
+			return -ENOMEM;
+		}
+	}
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	ret = erofs_dev_submit(&batch->req, &batch->sg, batch->raw, start,
+			       size);
+	if (ret >= 0) {
+		batch->data = ret;
+		batch->busy = true;
+		return 0;
+	}
+#endif
+	batch->data = 0;
+	ret = erofs_dev_read(ext[0].deviceid, batch->raw, start, size);
 	if (ret < 0)
 		return ret;
+
+	return 0;
+}
+
+/**
+ * z_erofs_batch_wait() - wait for the compressed data of a batch to be read
+ *
+ * @batch:	Batch being read
+ * Return: 0 if OK, -EIO on error
+ */
+static int z_erofs_batch_wait(struct z_erofs_batch *batch)
+{
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	if (batch->busy) {
+		batch->busy = false;
+		if (blk_req_wait(&batch->req))
+			return -EIO;
+	}
+#endif
+
+	return 0;
+}
+
+/**
+ * z_erofs_batch_finish() - decompress a batch of extents which has been read
+ *
+ * The device is polled after each extent, so that the read of the next batch
+ * moves along while this one is decompressed.
+ *
+ * @batch:	Batch to decompress, which is emptied
+ * @next:	Batch being read meanwhile
+ * Return: 0 if OK, -ve on error
+ */
+static int z_erofs_batch_finish(struct z_erofs_batch *batch,
+				struct z_erofs_batch *next)
+{
+	erofs_off_t start;
+	int ret, i;
+
+	if (!batch->count)
+		return 0;
+	start = batch->ext[batch->count - 1].pa;
+	ret = z_erofs_batch_wait(batch);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < batch->count; i++) {
+		struct z_erofs_extent *ext = &batch->ext[i];
+
+		ret = z_erofs_decompress_extent(ext, batch->raw + batch->data +
+						ext->pa - start);
+		if (ret)
+			return ret;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+		if (next->busy)
+			blk_req_poll(next->req.dev);
+#endif
+	}
+	batch->count = 0;
+
 	return 0;
 }
 
 static int z_erofs_read_data(struct erofs_inode *inode, char *buffer,
 			     erofs_off_t size, erofs_off_t offset)
 {
+	struct z_erofs_batch batch[2] = {}, *cur = &batch[0], *prev = &batch[1];
 	erofs_off_t end, length, skip;
 	struct erofs_map_blocks map = {
 		.index = UINT_MAX,
 	};
+	struct z_erofs_extent ext;
 	bool trimmed;
-	unsigned int bufsize = 0;
-	char *raw = NULL;
 	int ret = 0;
 
 	end = offset + size;
@@ -318,26 +517,53 @@ static int z_erofs_read_data(struct erofs_inode *inode, char *buffer,
 			continue;
 		}
 
-		if (map.m_plen > bufsize) {
-			char *tmp;
-
-			bufsize = map.m_plen;
-			tmp = realloc(raw, bufsize);
-			if (!tmp) {
-				ret = -ENOMEM;
+		if (map.m_flags & EROFS_MAP_FRAGMENT) {
+			ret = z_erofs_read_one_data(inode, &map, NULL,
+						    buffer + end - offset,
+						    skip, length, trimmed);
+			if (ret < 0)
 				break;
-			}
-			raw = tmp;
+			continue;
 		}
 
-		ret = z_erofs_read_one_data(inode, &map, raw,
-					    buffer + end - offset, skip, length,
-					    trimmed);
-		if (ret < 0)
+		/*
+		 * Files are usually written in order, so the compressed data
+		 * of this extent is likely to come just before that of the
+		 * last one. If so, read them together; otherwise start reading
+		 * the waiting extents and decompress the batch before them
+		 * meanwhile.
+		 */
+		ret = z_erofs_setup_extent(&ext, &map, buffer + end - offset,
+					   skip, length, trimmed);
+		if (ret)
 			break;
+		if (cur->count &&
+		    (cur->count == Z_EROFS_READ_BATCH ||
+		     ext.deviceid != cur->ext[0].deviceid ||
+		     ext.pa + ext.plen != cur->ext[cur->count - 1].pa ||
+		     cur->ext[0].pa + cur->ext[0].plen - ext.pa >
+				Z_EROFS_READ_BATCH_SIZE)) {
+			ret = z_erofs_batch_start(cur);
+			if (!ret)
+				ret = z_erofs_batch_finish(prev, cur);
+			if (ret)
+				break;
+			swap(cur, prev);
+		}
+		cur->ext[cur->count++] = ext;
 	}
-	if (raw)
-		free(raw);
+	if (!ret && cur->count)
+		ret = z_erofs_batch_start(cur);
+	if (!ret)
+		ret = z_erofs_batch_finish(prev, cur);
+	if (!ret)
+		ret = z_erofs_batch_finish(cur, prev);
+
+	/* the buffers must not be in use once they are freed */
+	z_erofs_batch_wait(&batch[0]);
+	z_erofs_batch_wait(&batch[1]);
+	free(batch[0].raw);
+	free(batch[1].raw);
 	return ret < 0 ? ret : 0;
 }
 
@@ -26,6 +26,34 @@ int erofs_dev_read(int device_id, void *buf, u64 offset, size_t len)
 	return -EIO;
 }
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+int erofs_dev_submit(struct blk_req *req, struct blk_sg *sg, void *buf,
+		     u64 offset, size_t len)
+{
+	struct blk_desc *desc = ctxt.cur_dev;
+	lbaint_t sect;
+	int off, ret;
+
+	if (!desc || desc->blksz > EROFS_MAX_BLOCK_SIZE)
+		return -ENOSYS;
+
+	sect = offset >> desc->log2blksz;
+	off = offset & (desc->blksz - 1);
+	sg->buf = buf;
+	sg->blkcnt = DIV_ROUND_UP(off + len, desc->blksz);
+	if (sect + sg->blkcnt > ctxt.cur_part_info.size)
+		return -EINVAL;
+
+	blk_req_init(req, desc->bdev, BLK_REQ_READ,
+		     ctxt.cur_part_info.start + sect, sg, 1);
+	ret = blk_req_submit(req);
+	if (ret)
+		return ret;
+
+	return off;
+}
+#endif
+
 int erofs_blk_read(void *buf, erofs_blk_t start, u32 nblocks)
 {
 	return erofs_dev_read(0, buf, erofs_pos(start),
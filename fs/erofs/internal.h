@@ -321,9 +321,29 @@ struct erofs_map_dev {
 };
 
 /* fs.c */
+struct blk_req;
+struct blk_sg;
+
 int erofs_blk_read(void *buf, erofs_blk_t start, u32 nblocks);
 int erofs_dev_read(int device_id, void *buf, u64 offset, size_t len);
 
+/**
+ * erofs_dev_submit() - start reading from the device without waiting
+ *
+ * Whole device blocks are read, so @buf needs room for @len plus
+ * 2 * EROFS_MAX_BLOCK_SIZE bytes, and must be suitably aligned for DMA.
+ *
+ * @req:	Request to set up and submit
+ * @sg:		Buffer list to set up for @req
+ * @buf:	Buffer to read into
+ * @offset:	Offset of the data on the device
+ * @len:	Number of bytes wanted
+ * Return: offset of the data within @buf, or -ve if it cannot be read this
+ * way, in which case @req is not used
+ */
+int erofs_dev_submit(struct blk_req *req, struct blk_sg *sg, void *buf,
+		     u64 offset, size_t len);
+
 /* super.c */
 int erofs_read_superblock(void);
 void erofs_put_super(void);
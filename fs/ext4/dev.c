@@ -29,12 +29,116 @@
 #include <ext_common.h>
 #include "ext4_common.h"
 #include <log.h>
+#include <malloc.h>
+#include <asm/cache.h>
+#include <linux/err.h>
 
 lbaint_t part_offset;
 
 static struct blk_desc *ext4fs_blk_desc;
 static struct disk_partition *part_info;
 
+#if CONFIG_IS_ENABLED(EXT4_CACHE)
+/**
+ * struct ext4_cache_entry - a filesystem block held by the metadata cache
+ *
+ * @buf:	Contents of the block, or NULL if the entry is unused
+ * @block:	Filesystem block number
+ * @used:	Value of ext4_cache_tick when the block was last used
+ */
+struct ext4_cache_entry {
+	char *buf;
+	u64 block;
+	uint used;
+};
+
+static struct ext4_cache_entry ext4_cache[CONFIG_EXT4_CACHE_BLOCKS];
+static uint ext4_cache_tick;
+static int ext4_cache_blksz;
+
+void ext4fs_cache_drop(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ext4_cache); i++)
+		free(ext4_cache[i].buf);
+	memset(ext4_cache, '\0', sizeof(ext4_cache));
+	ext4_cache_blksz = 0;
+}
+
+/**
+ * ext4fs_cache_get() - find a filesystem block in the cache, reading it if
+ * needed
+ *
+ * @block:	Filesystem block number
+ * @blksz:	Filesystem block size in bytes
+ * Return: cache entry holding the block, NULL if there is no memory for it,
+ * or ERR_PTR(-EIO) if it cannot be read
+ */
+static struct ext4_cache_entry *ext4fs_cache_get(u64 block, int blksz)
+{
+	struct ext4_cache_entry *entry, *victim = ext4_cache;
+	int log2_fs_blksz = ffs(blksz) - 1 - get_fs()->dev_desc->log2blksz;
+	int i;
+
+	if (blksz != ext4_cache_blksz) {
+		ext4fs_cache_drop();
+		ext4_cache_blksz = blksz;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ext4_cache); i++) {
+		entry = &ext4_cache[i];
+		if (entry->buf && entry->block == block) {
+			entry->used = ++ext4_cache_tick;
+			return entry;
+		}
+		if (victim->buf && (!entry->buf || entry->used < victim->used))
+			victim = entry;
+	}
+
+	if (!victim->buf) {
+		victim->buf = memalign(ARCH_DMA_MINALIGN, blksz);
+		if (!victim->buf)
+			return NULL;
+	}
+	if (!ext4fs_devread((lbaint_t)block << log2_fs_blksz, 0, blksz,
+			    victim->buf)) {
+		free(victim->buf);
+		victim->buf = NULL;
+		return ERR_PTR(-EIO);
+	}
+	victim->block = block;
+	victim->used = ++ext4_cache_tick;
+
+	return victim;
+}
+
+int ext4fs_devread_cached(lbaint_t sector, int byte_offset, int byte_len,
+			  char *buf)
+{
+	struct ext4_cache_entry *entry;
+	u64 pos;
+	int blksz;
+
+	if (!ext4fs_root)
+		return ext4fs_devread(sector, byte_offset, byte_len, buf);
+
+	blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	pos = ((u64)sector << get_fs()->dev_desc->log2blksz) + byte_offset;
+	if ((pos & (blksz - 1)) + byte_len > blksz)
+		return ext4fs_devread(sector, byte_offset, byte_len, buf);
+
+	entry = ext4fs_cache_get(pos >> LOG2_BLOCK_SIZE(ext4fs_root), blksz);
+	if (!entry)
+		return ext4fs_devread(sector, byte_offset, byte_len, buf);
+	if (IS_ERR(entry))
+		return 0;
+	memcpy(buf, entry->buf + (pos & (blksz - 1)), byte_len);
+
+	return 1;
+}
+#endif
+
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info)
 {
 	assert(rbdd->blksz == (1 << rbdd->log2blksz));
@@ -42,6 +146,7 @@ void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info)
 	get_fs()->dev_desc = rbdd;
 	part_info = info;
 	part_offset = info->start;
+	ext4fs_cache_drop();
 	get_fs()->total_sect = ((uint64_t)info->size * info->blksz) >>
 		get_fs()->dev_desc->log2blksz;
 }
@@ -203,6 +203,7 @@ void put_ext4(uint64_t off, const void *buf, uint32_t size)
 	if (!fs->dev_desc)
 		return;
 
+	ext4fs_cache_drop();
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, sec_buf, fs->dev_desc->blksz);
 
 	log2blksz = fs->dev_desc->log2blksz;
@@ -1591,9 +1592,9 @@ static int ext4fs_blockgroup
 	debug("ext4fs read %d group descriptor (blkno %ld blkoff %u)\n",
 	      group, blkno, blkoff);
 
-	return ext4fs_devread((lbaint_t)blkno <<
-			      (LOG2_BLOCK_SIZE(data) - log2blksz),
-			      blkoff, desc_size, (char *)blkgrp);
+	return ext4fs_devread_cached((lbaint_t)blkno <<
+				     (LOG2_BLOCK_SIZE(data) - log2blksz),
+				     blkoff, desc_size, (char *)blkgrp);
 }
 
 int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
@@ -1637,15 +1638,96 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	free(blkgrp);
 
 	/* Read the inode. */
-	status = ext4fs_devread((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
-				log2blksz), blkoff,
-				sizeof(struct ext2_inode), (char *)inode);
+	status = ext4fs_devread_cached((lbaint_t)blkno <<
+				       (LOG2_BLOCK_SIZE(data) - log2blksz),
+				       blkoff, sizeof(struct ext2_inode),
+				       (char *)inode);
 	if (status == 0)
 		return 0;
 
 	return 1;
 }
 
+/**
+ * read_extent_run() - look up a file block in the extent tree of an inode
+ *
+ * @inode:	Inode of the file, which uses extents
+ * @fileblock:	File block to look up
+ * @count:	Returns the number of blocks from @fileblock on which are
+ *		either stored one after another on the disk, or all holes
+ * @cache:	Cache for extent tree blocks, or NULL
+ * Return: disk block holding @fileblock, 0 for a hole, or -ve on error
+ */
+static long int read_extent_run(struct ext2_inode *inode, int fileblock,
+				int *count, struct ext_block_cache *cache)
+{
+	long int startblock, endblock;
+	struct ext_block_cache *c, cd;
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	unsigned long long start;
+	long int blknr = 0;
+	int log2_blksz;
+	int i;
+
+	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
+		- get_fs()->dev_desc->log2blksz;
+	*count = 1;
+
+	if (cache) {
+		c = cache;
+	} else {
+		c = &cd;
+		ext_cache_init(c);
+	}
+	ext_block = ext4fs_get_extent_block(ext4fs_root, c,
+					    (struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock, log2_blksz);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		if (!cache)
+			ext_cache_fini(c);
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		endblock = startblock + le16_to_cpu(extent[i].ee_len);
+
+		if (startblock > fileblock) {
+			/* Sparse file */
+			*count = startblock - fileblock;
+			break;
+		} else if (fileblock < endblock) {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			*count = endblock - fileblock;
+			blknr = (fileblock - startblock) + start;
+			break;
+		}
+	}
+
+	if (!cache)
+		ext_cache_fini(c);
+
+	return blknr;
+}
+
+long int read_allocated_run(struct ext2_inode *inode, int fileblock,
+			    int *count, struct ext_block_cache *cache)
+{
+	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)
+		return read_extent_run(inode, fileblock, count, cache);
+
+	*count = 1;
+
+	return read_allocated_block(inode, fileblock, cache);
+}
+
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache)
 {
@@ -1656,62 +1738,15 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	long int rblock;
 	long int perblock_parent;
 	long int perblock_child;
-	unsigned long long start;
 	/* get the blocksize of the filesystem */
 	blksz = EXT2_BLOCK_SIZE(ext4fs_root);
 	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
 		- get_fs()->dev_desc->log2blksz;
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
-		long int startblock, endblock;
-		struct ext_block_cache *c, cd;
-		struct ext4_extent_header *ext_block;
-		struct ext4_extent *extent;
-		int i;
-
-		if (cache) {
-			c = cache;
-		} else {
-			c = &cd;
-			ext_cache_init(c);
-		}
-		ext_block =
-			ext4fs_get_extent_block(ext4fs_root, c,
-						(struct ext4_extent_header *)
-						inode->b.blocks.dir_blocks,
-						fileblock, log2_blksz);
-		if (!ext_block) {
-			printf("invalid extent block\n");
-			if (!cache)
-				ext_cache_fini(c);
-			return -EINVAL;
-		}
-
-		extent = (struct ext4_extent *)(ext_block + 1);
-
-		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
-			startblock = le32_to_cpu(extent[i].ee_block);
-			endblock = startblock + le16_to_cpu(extent[i].ee_len);
-
-			if (startblock > fileblock) {
-				/* Sparse file */
-				if (!cache)
-					ext_cache_fini(c);
-				return 0;
-
-			} else if (fileblock < endblock) {
-				start = le16_to_cpu(extent[i].ee_start_hi);
-				start = (start << 32) +
-					le32_to_cpu(extent[i].ee_start_lo);
-				if (!cache)
-					ext_cache_fini(c);
-				return (fileblock - startblock) + start;
-			}
-		}
+		int count;
 
-		if (!cache)
-			ext_cache_fini(c);
-		return 0;
+		return read_extent_run(inode, fileblock, &count, cache);
 	}
 
 	/* Direct blocks. */
@@ -2044,111 +2079,369 @@ void ext4fs_close(void)
 	}
 
 	ext4fs_reinit_global();
+	ext4fs_cache_drop();
 }
 
-int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
-				struct ext2fs_node **fnode, int *ftype)
+/* Most index levels above the leaf blocks of an htree directory */
+#define EXT4_HTREE_LEVEL	3
+
+/* Start of the first block of a directory with an htree index */
+struct ext4_dx_root {
+	struct ext2_dirent dot;
+	char dot_name[4];
+	struct ext2_dirent dotdot;
+	char dotdot_name[4];
+	__le32 reserved_zero;
+	u8 hash_version;
+	u8 info_length;
+	u8 indirect_levels;
+	u8 unused_flags;
+};
+
+/* Index entry; the first one in a block holds the limit and count instead */
+struct ext4_dx_entry {
+	__le32 hash;
+	__le32 block;
+};
+
+struct ext4_dx_countlimit {
+	__le16 limit;
+	__le16 count;
+};
+
+/**
+ * struct ext4_dx_frame - position in one index block of an htree
+ *
+ * @entries:	Index entries in the block
+ * @count:	Number of entries
+ * @at:		Entry being followed
+ */
+struct ext4_dx_frame {
+	struct ext4_dx_entry *entries;
+	int count;
+	int at;
+};
+
+/*
+ * Read block @blk of a directory into @buf
+ * Return: 1 if OK, 0 for a hole, -1 on error
+ */
+static int ext4fs_read_dir_block(struct ext2fs_node *dir, uint blk, char *buf,
+				 struct ext_block_cache *cache)
 {
-	unsigned int fpos = 0;
+	int log2_blksz = LOG2_BLOCK_SIZE(dir->data) -
+		get_fs()->dev_desc->log2blksz;
+	long int blknr;
+
+	blknr = read_allocated_block(&dir->inode, blk, cache);
+	if (blknr < 0)
+		return -1;
+	if (!blknr)
+		return 0;
+	if (!ext4fs_devread_cached((lbaint_t)blknr << log2_blksz, 0,
+				   EXT2_BLOCK_SIZE(dir->data), buf))
+		return -1;
+
+	return 1;
+}
+
+/* Make a node for a directory entry which was looked up */
+static int ext4fs_dir_node(struct ext2fs_node *dir,
+			   const struct ext2_dirent *dirent,
+			   struct ext2fs_node **fnode, int *ftype)
+{
+	struct ext2fs_node *fdiro;
+	int type = FILETYPE_UNKNOWN;
 	int status;
-	loff_t actread;
 
+	fdiro = zalloc(sizeof(struct ext2fs_node));
+	if (!fdiro)
+		return -1;
+
+	fdiro->data = dir->data;
+	fdiro->ino = le32_to_cpu(dirent->inode);
+
+	if (dirent->filetype != FILETYPE_UNKNOWN) {
+		fdiro->inode_read = 0;
+
+		if (dirent->filetype == FILETYPE_DIRECTORY)
+			type = FILETYPE_DIRECTORY;
+		else if (dirent->filetype == FILETYPE_SYMLINK)
+			type = FILETYPE_SYMLINK;
+		else if (dirent->filetype == FILETYPE_REG)
+			type = FILETYPE_REG;
+	} else {
+		status = ext4fs_read_inode(dir->data, le32_to_cpu(dirent->inode),
+					   &fdiro->inode);
+		if (status == 0) {
+			free(fdiro);
+			return -1;
+		}
+		fdiro->inode_read = 1;
+
+		if ((le16_to_cpu(fdiro->inode.mode) &
+		     FILETYPE_INO_MASK) == FILETYPE_INO_DIRECTORY) {
+			type = FILETYPE_DIRECTORY;
+		} else if ((le16_to_cpu(fdiro->inode.mode)
+			    & FILETYPE_INO_MASK) == FILETYPE_INO_SYMLINK) {
+			type = FILETYPE_SYMLINK;
+		} else if ((le16_to_cpu(fdiro->inode.mode)
+			    & FILETYPE_INO_MASK) == FILETYPE_INO_REG) {
+			type = FILETYPE_REG;
+		}
+	}
+	*ftype = type;
+	*fnode = fdiro;
+
+	return 1;
+}
+
+/*
+ * Look for @name among the entries in a directory block
+ * Return: 1 if found, 0 if not, -1 if the block is corrupt or on error
+ */
+static int ext4fs_search_dir_block(struct ext2fs_node *dir, const char *block,
+				   int size, const char *name,
+				   struct ext2fs_node **fnode, int *ftype)
+{
+	int namelen = strlen(name);
+	int pos = 0;
+
+	while (pos + (int)sizeof(struct ext2_dirent) <= size) {
+		const struct ext2_dirent *dirent = (void *)block + pos;
+		int direntlen = le16_to_cpu(dirent->direntlen);
+
+		if (direntlen < sizeof(*dirent) || pos + direntlen > size ||
+		    dirent->namelen > direntlen - sizeof(*dirent))
+			return -1;
 #ifdef DEBUG
-	if (name != NULL)
-		printf("Iterate dir %s\n", name);
+		printf("iterate >%.*s<\n", dirent->namelen,
+		       (char *)(dirent + 1));
 #endif /* of DEBUG */
-	if (!dir->inode_read) {
-		status = ext4fs_read_inode(dir->data, dir->ino, &dir->inode);
-		if (status == 0)
-			return 0;
+		if (dirent->inode && dirent->namelen == namelen &&
+		    !memcmp(dirent + 1, name, namelen))
+			return ext4fs_dir_node(dir, dirent, fnode, ftype);
+		pos += direntlen;
 	}
-	/* Search the file.  */
-	while (fpos < le32_to_cpu(dir->inode.size)) {
-		struct ext2_dirent dirent;
-
-		status = ext4fs_read_file(dir, fpos,
-					  sizeof(struct ext2_dirent),
-					  (char *)&dirent, &actread);
-		if (status < 0)
-			return 0;
 
-		if (dirent.direntlen == 0) {
-			printf("Failed to iterate over directory %s\n", name);
-			return 0;
+	return 0;
+}
+
+/*
+ * Set up @frame for the index entries at @entries, which must lie within
+ * @end. Return: 0 if OK, -1 if they are corrupt
+ */
+static int ext4fs_dx_frame(struct ext4_dx_frame *frame, void *entries,
+			   const char *end)
+{
+	struct ext4_dx_countlimit *cl = entries;
+
+	frame->entries = entries;
+	frame->count = le16_to_cpu(cl->count);
+	frame->at = 0;
+	if (!frame->count || frame->count > le16_to_cpu(cl->limit) ||
+	    (char *)(frame->entries + frame->count) > end)
+		return -1;
+
+	return 0;
+}
+
+/* Get the directory block which an index entry points to */
+static int ext4fs_dx_block(struct ext2fs_node *dir, struct ext4_dx_frame *frame,
+			   uint *blkp)
+{
+	uint blksz = EXT2_BLOCK_SIZE(dir->data);
+	uint blk;
+
+	blk = le32_to_cpu(frame->entries[frame->at].block) & 0x0fffffff;
+	if (blk >= le32_to_cpu(dir->inode.size) / blksz)
+		return -1;
+	*blkp = blk;
+
+	return 0;
+}
+
+/*
+ * Look @name up using the htree index of a directory, following it from
+ * the root block down to the one leaf block which can hold the name (or
+ * more than one, if other names have the same hash).
+ *
+ * @buf must have room for EXT4_HTREE_LEVEL + 1 blocks.
+ * Return: 1 if found, 0 if not, -1 if the index cannot be used
+ */
+static int ext4fs_dx_find(struct ext2fs_node *dir, const char *name,
+			  struct ext2fs_node **fnode, int *ftype, char *buf,
+			  struct ext_block_cache *cache)
+{
+	struct ext4_dx_frame frames[EXT4_HTREE_LEVEL], *frame;
+	struct ext2_sblock *sblock = &dir->data->sblock;
+	struct ext4_dx_root *root = (void *)buf;
+	uint blksz = EXT2_BLOCK_SIZE(dir->data);
+	char *leaf = buf + EXT4_HTREE_LEVEL * blksz;
+	int version, levels, level, lo, hi, ret;
+	u32 hash;
+	uint blk;
+
+	if (!(le32_to_cpu(sblock->feature_compatibility) &
+	      EXT4_FEATURE_COMPAT_DIR_INDEX) ||
+	    !(le32_to_cpu(dir->inode.flags) & EXT4_INDEX_FL) ||
+	    le32_to_cpu(dir->inode.flags) & (EXT4_ENCRYPT_FL | EXT4_CASEFOLD_FL))
+		return -1;
+
+	if (ext4fs_read_dir_block(dir, 0, buf, cache) != 1)
+		return -1;
+	levels = root->indirect_levels;
+	version = root->hash_version;
+	if (root->reserved_zero || root->info_length != 8 ||
+	    levels >= EXT4_HTREE_LEVEL || version > DX_HASH_TEA)
+		return -1;
+	if (le32_to_cpu(sblock->flags) & EXT2_FLAGS_UNSIGNED_HASH)
+		version += DX_HASH_LEGACY_UNSIGNED;
+	else if (!(le32_to_cpu(sblock->flags) & EXT2_FLAGS_SIGNED_HASH))
+		return -1;
+	if (ext4fs_dirhash(version, sblock->hash_seed, name, strlen(name),
+			   &hash))
+		return -1;
+
+	/* Go down the tree, taking the last entry whose hash is not above */
+	if (ext4fs_dx_frame(&frames[0], root + 1, buf + blksz))
+		return -1;
+	for (level = 0; ; level++) {
+		frame = &frames[level];
+		lo = 1;
+		hi = frame->count - 1;
+		while (lo <= hi) {
+			int mid = (lo + hi) / 2;
+
+			if (le32_to_cpu(frame->entries[mid].hash) > hash)
+				hi = mid - 1;
+			else
+				lo = mid + 1;
 		}
+		frame->at = lo - 1;
+		if (ext4fs_dx_block(dir, frame, &blk))
+			return -1;
+		if (level == levels)
+			break;
 
-		if (dirent.namelen != 0) {
-			char filename[dirent.namelen + 1];
-			struct ext2fs_node *fdiro;
-			int type = FILETYPE_UNKNOWN;
+		/* Index blocks start with an empty entry covering the block */
+		if (ext4fs_read_dir_block(dir, blk, buf + (level + 1) * blksz,
+					  cache) != 1 ||
+		    ext4fs_dx_frame(&frames[level + 1],
+				    buf + (level + 1) * blksz +
+				    sizeof(struct ext2_dirent),
+				    buf + (level + 2) * blksz))
+			return -1;
+	}
 
-			status = ext4fs_read_file(dir,
-						  fpos +
-						  sizeof(struct ext2_dirent),
-						  dirent.namelen, filename,
-						  &actread);
-			if (status < 0)
-				return 0;
+	while (1) {
+		ret = ext4fs_read_dir_block(dir, blk, leaf, cache);
+		if (ret < 0)
+			return -1;
+		if (ret) {
+			ret = ext4fs_search_dir_block(dir, leaf, blksz, name,
+						      fnode, ftype);
+			if (ret)
+				return ret;
+		}
 
-			fdiro = zalloc(sizeof(struct ext2fs_node));
-			if (!fdiro)
-				return 0;
+		/*
+		 * Names with the same hash can carry on into the next leaf
+		 * block, in which case the hash of the entry for that block
+		 * matches ours
+		 */
+		for (level = levels; level >= 0; level--) {
+			if (frames[level].at + 1 < frames[level].count)
+				break;
+		}
+		if (level < 0)
+			return 0;
+		frame = &frames[level];
+		frame->at++;
+		if ((le32_to_cpu(frame->entries[frame->at].hash) & ~1) != hash)
+			return 0;
+		if (ext4fs_dx_block(dir, frame, &blk))
+			return -1;
+		for (; level < levels; level++) {
+			char *node = buf + (level + 1) * blksz;
+
+			if (ext4fs_read_dir_block(dir, blk, node, cache) != 1 ||
+			    ext4fs_dx_frame(&frames[level + 1],
+					    node + sizeof(struct ext2_dirent),
+					    node + blksz) ||
+			    ext4fs_dx_block(dir, &frames[level + 1], &blk))
+				return -1;
+		}
+	}
+}
 
-			fdiro->data = dir->data;
-			fdiro->ino = le32_to_cpu(dirent.inode);
+/*
+ * Look @name up by reading through each block of a directory
+ * Return: 1 if found, 0 if not or on error
+ */
+static int ext4fs_linear_find(struct ext2fs_node *dir, const char *name,
+			      struct ext2fs_node **fnode, int *ftype,
+			      char *buf, struct ext_block_cache *cache)
+{
+	uint blksz = EXT2_BLOCK_SIZE(dir->data);
+	uint size = le32_to_cpu(dir->inode.size);
+	uint blk;
+	int ret;
+
+	for (blk = 0; blk < DIV_ROUND_UP(size, blksz); blk++) {
+		ret = ext4fs_read_dir_block(dir, blk, buf, cache);
+		if (ret < 0)
+			return 0;
+		if (!ret)
+			continue;
+		ret = ext4fs_search_dir_block(dir, buf,
+					      min(blksz, size - blk * blksz),
+					      name, fnode, ftype);
+		if (ret < 0) {
+			printf("Failed to iterate over directory %s\n", name);
+			return 0;
+		}
+		if (ret)
+			return 1;
+	}
 
-			filename[dirent.namelen] = '\0';
+	return 0;
+}
 
-			if (dirent.filetype != FILETYPE_UNKNOWN) {
-				fdiro->inode_read = 0;
+int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
+				struct ext2fs_node **fnode, int *ftype)
+{
+	struct ext_block_cache cache;
+	char *buf;
+	int status;
+	int ret = -1;
 
-				if (dirent.filetype == FILETYPE_DIRECTORY)
-					type = FILETYPE_DIRECTORY;
-				else if (dirent.filetype == FILETYPE_SYMLINK)
-					type = FILETYPE_SYMLINK;
-				else if (dirent.filetype == FILETYPE_REG)
-					type = FILETYPE_REG;
-			} else {
-				status = ext4fs_read_inode(dir->data,
-							   le32_to_cpu
-							   (dirent.inode),
-							   &fdiro->inode);
-				if (status == 0) {
-					free(fdiro);
-					return 0;
-				}
-				fdiro->inode_read = 1;
-
-				if ((le16_to_cpu(fdiro->inode.mode) &
-				     FILETYPE_INO_MASK) ==
-				    FILETYPE_INO_DIRECTORY) {
-					type = FILETYPE_DIRECTORY;
-				} else if ((le16_to_cpu(fdiro->inode.mode)
-					    & FILETYPE_INO_MASK) ==
-					   FILETYPE_INO_SYMLINK) {
-					type = FILETYPE_SYMLINK;
-				} else if ((le16_to_cpu(fdiro->inode.mode)
-					    & FILETYPE_INO_MASK) ==
-					   FILETYPE_INO_REG) {
-					type = FILETYPE_REG;
-				}
-			}
 #ifdef DEBUG
-			printf("iterate >%s<\n", filename);
+	if (name != NULL)
+		printf("Iterate dir %s\n", name);
 #endif /* of DEBUG */
-			if ((name != NULL) && (fnode != NULL)
-			    && (ftype != NULL)) {
-				if (strcmp(filename, name) == 0) {
-					*ftype = type;
-					*fnode = fdiro;
-					return 1;
-				}
-			}
-			free(fdiro);
-		}
-		fpos += le16_to_cpu(dirent.direntlen);
+	if (!dir->inode_read) {
+		status = ext4fs_read_inode(dir->data, dir->ino, &dir->inode);
+		if (status == 0)
+			return 0;
 	}
-	return 0;
+	if (!name || !fnode || !ftype)
+		return 0;
+
+	buf = malloc((EXT4_HTREE_LEVEL + 1) * EXT2_BLOCK_SIZE(dir->data));
+	if (!buf)
+		return 0;
+	ext_cache_init(&cache);
+
+	if (CONFIG_IS_ENABLED(EXT4_DIR_INDEX))
+		ret = ext4fs_dx_find(dir, name, fnode, ftype, buf, &cache);
+	if (ret < 0)
+		ret = ext4fs_linear_find(dir, name, fnode, ftype, buf, &cache);
+
+	ext_cache_fini(&cache);
+	free(buf);
+
+	return ret;
 }
 
 static char *ext4fs_read_symlink(struct ext2fs_node *node)
@@ -2319,7 +2612,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* the filesystem may have been kept mounted since the last open */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
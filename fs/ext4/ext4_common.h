@@ -58,6 +58,29 @@ int ext4fs_find_file1(const char *currpath, struct ext2fs_node *currroot,
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
 
+/* Hash versions used by the htree directory index */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+
+#define EXT4_HTREE_EOF_32BIT		((1UL << (32 - 1)) - 1)
+
+/**
+ * ext4fs_dirhash() - work out the htree hash of a file name
+ *
+ * @version:	Hash version (DX_HASH_...)
+ * @seed:	Hash seed from the superblock
+ * @name:	File name, which need not be nul-terminated
+ * @len:	Length of @name
+ * @hashp:	Returns the hash, with the lowest bit clear
+ * Return: 0 if OK, -EINVAL if @version is not supported
+ */
+int ext4fs_dirhash(int version, const __le32 seed[4], const char *name,
+		   int len, u32 *hashp);
+
 #if defined(CONFIG_EXT4_WRITE)
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
 uint16_t ext4fs_checksum_update(unsigned int i);
@@ -63,147 +63,129 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 		free(node);
 }
 
+/* Largest single device read, a multiple of any block size which fits an int */
+#define EXT4_MAX_READ	(1 << 30)
+
+/*
+ * Read @len bytes starting @skip bytes into @sector, splitting it into
+ * reads which ext4fs_devread() can handle
+ */
+static int ext4fs_read_run(lbaint_t sector, int skip, loff_t len, char *buf)
+{
+	int log2blksz = get_fs()->dev_desc->log2blksz;
+
+	while (len) {
+		int now = min_t(loff_t, len, EXT4_MAX_READ - skip);
+
+		if (!ext4fs_devread(sector, skip, now, buf))
+			return 0;
+		sector += (lbaint_t)(skip + now) >> log2blksz;
+		skip = 0;
+		len -= now;
+		buf += now;
+	}
+
+	return 1;
+}
+
 /*
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
  * reads into one potentially more efficient larger sequential read action
+ *
+ * Each extent is looked up once rather than block by block, and blocks
+ * which follow on from each other on the disk are read together, even
+ * across extents.
  */
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
+	lbaint_t i;
 	lbaint_t blockcnt;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
 	unsigned int filesize = le32_to_cpu(node->inode.size);
-	lbaint_t previous_block_number = -1;
 	lbaint_t delayed_start = 0;
-	lbaint_t delayed_extent = 0;
-	lbaint_t delayed_skipfirst = 0;
+	loff_t delayed_extent = 0;
+	int delayed_skipfirst = 0;
 	lbaint_t delayed_next = 0;
 	char *delayed_buf = NULL;
-	char *start_buf = buf;
-	short status;
 	struct ext_block_cache cache;
-
-	ext_cache_init(&cache);
+	int skipfirst;
+	int ret = -1;
 
 	/* Adjust len so it we can't read past the end of the file. */
 	if (len + pos > filesize)
 		len = (filesize - pos);
 
-	if (blocksize <= 0 || len <= 0) {
-		ext_cache_fini(&cache);
+	if (blocksize <= 0 || len <= 0)
 		return -1;
-	}
 
+	ext_cache_init(&cache);
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
+	i = lldiv(pos, blocksize);
+	skipfirst = pos - (loff_t)blocksize * i;
 
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
+	while (i < blockcnt) {
 		lbaint_t blknr;
 		long blknr_and_status;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
-		int skipfirst = 0;
-		blknr_and_status = read_allocated_block(&node->inode, i, &cache);
-		if (blknr_and_status < 0) {
-			ext_cache_fini(&cache);
-			return -1;
-		}
+		loff_t n;
+		int count;
+
+		blknr_and_status = read_allocated_run(&node->inode, i, &count,
+						      &cache);
+		if (blknr_and_status < 0)
+			goto out;
+		if (count > blockcnt - i)
+			count = blockcnt - i;
+
+		/* Bytes wanted from these blocks */
+		n = ((loff_t)count << (log2_fs_blocksize + log2blksz)) -
+			skipfirst;
+		if (i + count == blockcnt)
+			n -= (loff_t)blockcnt * blocksize - (pos + len);
 
 		/* Block number could becomes very large when CONFIG_SYS_64BIT_LBA is enabled
 		 * and wrap around at max long int
 		 */
 		blknr = (lbaint_t)blknr_and_status << log2_fs_blocksize;
 
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
-
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
-
-		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
-		if (blknr) {
-			int status;
-
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
-					status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-					if (status == 0) {
-						ext_cache_fini(&cache);
-						return -1;
-					}
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr +
-						(blockend >> log2blksz);
-				}
-			} else {
-				previous_block_number = blknr;
+		if (blknr && delayed_extent && blknr == delayed_next) {
+			delayed_extent += n;
+		} else {
+			/* spill */
+			if (delayed_extent &&
+			    !ext4fs_read_run(delayed_start, delayed_skipfirst,
+					     delayed_extent, delayed_buf))
+				goto out;
+			delayed_extent = 0;
+			if (blknr) {
 				delayed_start = blknr;
-				delayed_extent = blockend;
 				delayed_skipfirst = skipfirst;
+				delayed_extent = n;
 				delayed_buf = buf;
-				delayed_next = blknr +
-					(blockend >> log2blksz);
-			}
-		} else {
-			int n;
-			int n_left;
-			if (previous_block_number != -1) {
-				/* spill */
-				status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-				if (status == 0) {
-					ext_cache_fini(&cache);
-					return -1;
-				}
-				previous_block_number = -1;
+			} else {
+				memset(buf, '\0', n);
 			}
-			/* Zero no more than `len' bytes. */
-			n = blocksize - skipfirst;
-			n_left = len - ( buf - start_buf );
-			if (n > n_left)
-				n = n_left;
-			memset(buf, 0, n);
-		}
-		buf += blocksize - skipfirst;
-	}
-	if (previous_block_number != -1) {
-		/* spill */
-		status = ext4fs_devread(delayed_start,
-					delayed_skipfirst, delayed_extent,
-					delayed_buf);
-		if (status == 0) {
-			ext_cache_fini(&cache);
-			return -1;
 		}
-		previous_block_number = -1;
+		delayed_next = blknr + ((lbaint_t)count << log2_fs_blocksize);
+		buf += n;
+		i += count;
+		skipfirst = 0;
 	}
+	if (delayed_extent &&
+	    !ext4fs_read_run(delayed_start, delayed_skipfirst, delayed_extent,
+			     delayed_buf))
+		goto out;
 
 	*actread  = len;
+	ret = 0;
+out:
 	ext_cache_fini(&cache);
-	return 0;
+
+	return ret;
 }
 
 int ext4fs_opendir(const char *dirname, struct fs_dir_stream **dirsp)
@@ -442,7 +424,7 @@ int ext_cache_read(struct ext_block_cache *cache, lbaint_t block, int size)
 	cache->buf = memalign(ARCH_DMA_MINALIGN, size);
 	if (!cache->buf)
 		return 0;
-	if (!ext4fs_devread(block, 0, size, cache->buf)) {
+	if (!ext4fs_devread_cached(block, 0, size, cache->buf)) {
 		ext_cache_fini(cache);
 		return 0;
 	}
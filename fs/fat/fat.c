@@ -23,6 +23,7 @@
 #include <memalign.h>
 #include <rtc.h>
 #include <asm/cache.h>
+#include <div64.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
 #include <linux/log2.h>
@@ -450,6 +451,177 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/**
+ * struct fat_extent - A run of contiguous clusters in a file
+ *
+ * @index:	Position of the first cluster within the file, in clusters
+ * @clust:	First cluster
+ * @count:	Number of clusters
+ */
+struct fat_extent {
+	u32 index;
+	u32 clust;
+	u32 count;
+};
+
+/**
+ * struct fat_cache - The file which was used last
+ *
+ * This is kept between calls, so that finding the size of a file and then
+ * reading it, or reading it a piece at a time, does not walk the directories
+ * and the cluster chain each time. The file is identified by its directory
+ * entry. Everything is dropped when the filesystem is written, or when a
+ * different filesystem is used.
+ *
+ * @desc:	Block device holding the filesystem
+ * @part_start:	First sector of the partition
+ * @volume_id:	Volume ID from the boot sector
+ * @dent:	Directory entry of the file
+ * @path:	Path which the file was found by, or NULL if not known
+ * @dent_sect:	Sector holding the directory entry, if @path is set
+ * @dent_off:	Offset of the directory entry within @dent_sect
+ * @ext:	Extents of the file found so far, in order
+ * @count:	Number of extents in @ext
+ * @max:	Number of extents which @ext has room for
+ * @scanned:	Number of clusters covered by @ext
+ */
+static struct fat_cache {
+	struct blk_desc *desc;
+	lbaint_t part_start;
+	u8 volume_id[4];
+	dir_entry dent;
+	char *path;
+	u32 dent_sect;
+	u32 dent_off;
+	struct fat_extent *ext;
+	int count;
+	int max;
+	u32 scanned;
+} fat_cache;
+
+static void fat_cache_drop(void)
+{
+	free(fat_cache.path);
+	free(fat_cache.ext);
+	memset(&fat_cache, '\0', sizeof(fat_cache));
+}
+
+/**
+ * fat_cache_check() - drop the cache if it belongs to another filesystem
+ *
+ * @volinfo:	Volume information from the boot sector being used
+ */
+static void fat_cache_check(const volume_info *volinfo)
+{
+	struct fat_cache *fc = &fat_cache;
+
+	if (fc->desc == cur_dev && fc->part_start == cur_part_info.start &&
+	    !memcmp(fc->volume_id, volinfo->volume_id, sizeof(fc->volume_id)))
+		return;
+	fat_cache_drop();
+	fc->desc = cur_dev;
+	fc->part_start = cur_part_info.start;
+	memcpy(fc->volume_id, volinfo->volume_id, sizeof(fc->volume_id));
+}
+
+/**
+ * fat_cache_file() - get the cache for a file
+ *
+ * @dent:	Directory entry of the file
+ * Return: cache, emptied first if it was for a different file
+ */
+static struct fat_cache *fat_cache_file(const dir_entry *dent)
+{
+	struct fat_cache *fc = &fat_cache;
+
+	if (memcmp(&fc->dent, dent, sizeof(*dent))) {
+		free(fc->path);
+		fc->path = NULL;
+		fc->count = 0;
+		fc->scanned = 0;
+		fc->dent = *dent;
+	}
+
+	return fc;
+}
+
+/**
+ * fat_cache_scan() - follow a file's cluster chain far enough
+ *
+ * Clusters which follow on from the previous one are added to the same
+ * extent, so that they can be read with one call to disk_read().
+ *
+ * @mydata:	Filesystem description
+ * @fc:		Cache for the file
+ * @want:	Number of clusters from the start of the file which are needed
+ * Return: 0 if OK, -1 on error
+ */
+static int fat_cache_scan(fsdata *mydata, struct fat_cache *fc, u32 want)
+{
+	struct fat_extent *ext;
+	u32 clust;
+
+	while (fc->scanned < want) {
+		if (!fc->count) {
+			clust = START(&fc->dent);
+		} else {
+			ext = &fc->ext[fc->count - 1];
+			clust = get_fatent(mydata, ext->clust + ext->count - 1);
+			if (CHECK_CLUST(clust, mydata->fatsize)) {
+				debug("curclust: 0x%x\n", clust);
+				printf("Invalid FAT entry\n");
+				return -1;
+			}
+			if (clust == ext->clust + ext->count) {
+				ext->count++;
+				fc->scanned++;
+				continue;
+			}
+		}
+
+		if (fc->count == fc->max) {
+			int max = fc->max ? fc->max * 2 : 16;
+
+			ext = realloc(fc->ext, max * sizeof(*ext));
+			if (!ext) {
+				debug("Error: allocating extents\n");
+				return -1;
+			}
+			fc->ext = ext;
+			fc->max = max;
+		}
+		ext = &fc->ext[fc->count++];
+		ext->index = fc->scanned++;
+		ext->clust = clust;
+		ext->count = 1;
+	}
+
+	return 0;
+}
+
+/**
+ * fat_cache_find() - find the extent holding a cluster of a file
+ *
+ * @fc:		Cache for the file, which must cover @index
+ * @index:	Position of the cluster within the file, in clusters
+ * Return: extent
+ */
+static struct fat_extent *fat_cache_find(struct fat_cache *fc, u32 index)
+{
+	int lo = 0, hi = fc->count - 1;
+
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+
+		if (fc->ext[mid].index <= index)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return &fc->ext[lo];
+}
+
 /**
  * get_contents() - read from file
  *
@@ -470,9 +642,9 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
-	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	loff_t actsize;
+	__u8 *tmp_buffer = NULL;
+	struct fat_cache *fc;
+	int ret = 0;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -487,101 +659,50 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize += bytesperclust;
-	}
-
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
-
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		__u8 *tmp_buffer;
+	/* find the clusters first, so each run of them is read in one go */
+	fc = fat_cache_file(dentptr);
+	if (fat_cache_scan(mydata, fc,
+			   lldiv(filesize + bytesperclust - 1, bytesperclust)))
+		return -1;
 
-		actsize = min(filesize, (loff_t)bytesperclust);
-		tmp_buffer = malloc_cache_aligned(actsize);
-		if (!tmp_buffer) {
-			debug("Error: allocating buffer\n");
-			return -1;
+	while (pos < filesize) {
+		u32 index = lldiv(pos, bytesperclust);
+		u32 offset = pos - (loff_t)index * bytesperclust;
+		struct fat_extent *ext = fat_cache_find(fc, index);
+		__u32 clust = ext->clust + index - ext->index;
+		loff_t size;
+
+		size = (loff_t)(ext->index + ext->count - index) *
+			bytesperclust - offset;
+		size = min(size, filesize - pos);
+		if (offset) {
+			/* only the end of the first cluster is wanted */
+			size = min(size, (loff_t)(bytesperclust - offset));
+			if (!tmp_buffer) {
+				tmp_buffer = malloc_cache_aligned(bytesperclust);
+				if (!tmp_buffer) {
+					debug("Error: allocating buffer\n");
+					return -1;
+				}
+			}
+			ret = get_cluster(mydata, clust, tmp_buffer,
+					  offset + size);
+			if (!ret)
+				memcpy(buffer, tmp_buffer + offset, size);
+		} else {
+			ret = get_cluster(mydata, clust, buffer, size);
 		}
-
-		if (get_cluster(mydata, curclust, tmp_buffer, actsize) != 0) {
+		if (ret) {
 			printf("Error reading cluster\n");
-			free(tmp_buffer);
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, tmp_buffer + pos, actsize);
-		free(tmp_buffer);
-		*gotsize += actsize;
-		if (!filesize)
-			return 0;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
+			break;
 		}
+		*gotsize += size;
+		buffer += size;
+		pos += size;
 	}
+	free(tmp_buffer);
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
-				return -1;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return ret;
 }
 
 /*
@@ -769,6 +890,7 @@ static int get_fs_info(fsdata *mydata)
 		debug("Error: reading boot sector\n");
 		return ret;
 	}
+	fat_cache_check(&volinfo);
 
 	if (mydata->fatsize == 32) {
 		mydata->fatlength = bs.fat32_length;
@@ -831,6 +953,8 @@ static int get_fs_info(fsdata *mydata)
 		mydata->root_cluster = 0;
 	}
 
+	/* FAT12 entries are 1.5 bytes, so must not cross the buffer end */
+	BUILD_BUG_ON(FATBUFBLOCKS % 3);
 	mydata->fatbufnum = -1;
 	fat_mark_clean(mydata);
 	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
@@ -1340,6 +1464,53 @@ static int fat_itr_resolve(fat_itr *itr, const char *path, unsigned type)
 	return -ENOENT;
 }
 
+/**
+ * fat_itr_resolve_cached() - find a path, unless it was the last file found
+ *
+ * This is like fat_itr_resolve(), but when the path is that of the last file
+ * found, the sector holding its directory entry is read back to check that
+ * the entry has not changed, instead of walking the directories again. The
+ * iterator is only good for looking at @itr->dent afterwards.
+ *
+ * @itr:	iterator initialized to root
+ * @path:	the requested path
+ * @type:	bitmask of allowable file types
+ * Return:	0 on success or -errno
+ */
+static int fat_itr_resolve_cached(fat_itr *itr, const char *path,
+				  unsigned int type)
+{
+	struct fat_cache *fc = &fat_cache;
+	fsdata *mydata = itr->fsdata;
+	u32 sect, off;
+	int ret;
+
+	if ((type & TYPE_FILE) && fc->path && !strcmp(fc->path, path) &&
+	    disk_read(fc->dent_sect, 1, itr->block) == 1 &&
+	    !memcmp(itr->block + fc->dent_off, &fc->dent, sizeof(fc->dent))) {
+		itr->dent = (dir_entry *)(itr->block + fc->dent_off);
+		return 0;
+	}
+
+	ret = fat_itr_resolve(itr, path, type);
+	if (ret || !itr->dent || fat_itr_isdir(itr))
+		return ret;
+
+	/* remember where the entry is, so that it can be checked next time */
+	if (itr->is_root && mydata->fatsize != 32)
+		sect = mydata->rootdir_sect + itr->clust * mydata->clust_size;
+	else
+		sect = clust_to_sect(mydata, itr->clust);
+	off = (u8 *)itr->dent - itr->block;
+	fc = fat_cache_file(itr->dent);
+	free(fc->path);
+	fc->path = strdup(path);
+	fc->dent_sect = sect + off / mydata->sect_size;
+	fc->dent_off = off % mydata->sect_size;
+
+	return 0;
+}
+
 int file_fat_detectfs(void)
 {
 	boot_sector bs;
@@ -1384,7 +1555,7 @@ int fat_exists(const char *filename)
 	if (ret)
 		goto out;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_ANY);
+	ret = fat_itr_resolve_cached(itr, filename, TYPE_ANY);
 	free(fsdata.fatbuf);
 out:
 	free(itr);
@@ -1426,7 +1597,7 @@ int fat_size(const char *filename, loff_t *size)
 	if (ret)
 		goto out_free_itr;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
+	ret = fat_itr_resolve_cached(itr, filename, TYPE_FILE);
 	if (ret) {
 		/*
 		 * Directories don't have size, but fs_size() is not
@@ -1464,7 +1635,7 @@ int fat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 	if (ret)
 		goto out_free_itr;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
+	ret = fat_itr_resolve_cached(itr, filename, TYPE_FILE);
 	if (ret)
 		goto out_free_both;
 
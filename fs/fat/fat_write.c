@@ -1482,6 +1482,8 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 
 	debug("writing %s\n", filename);
 
+	/* the cached file may be about to change */
+	fat_cache_drop();
 	filename_copy = strdup(filename);
 	if (!filename_copy)
 		return -ENOMEM;
@@ -1728,6 +1730,7 @@ int fat_unlink(const char *filename)
 	int n_entries, ret;
 	char *filename_copy, *dirname, *basename;
 
+	fat_cache_drop();
 	filename_copy = strdup(filename);
 	itr = malloc_cache_aligned(sizeof(fat_itr));
 	if (!itr || !filename_copy) {
@@ -1799,6 +1802,7 @@ int fat_mkdir(const char *dirname)
 	unsigned int bytesperclust;
 	dir_entry *dotdent = NULL;
 
+	fat_cache_drop();
 	dirname_copy = strdup(dirname);
 	if (!dirname_copy)
 		goto exit;
@@ -2000,6 +2004,7 @@ int fat_rename(const char *old_path, const char *new_path)
 	/* only set if found_existing != NULL */
 	__u32 new_clust;
 
+	fat_cache_drop();
 	old_path_copy = strdup(old_path);
 	new_path_copy = strdup(new_path);
 	old_itr = malloc_cache_aligned(sizeof(fat_itr));
@@ -433,6 +433,178 @@ static struct fstype_info *fs_get_info(int fstype)
 	return info;
 }
 
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/**
+ * struct fs_mount - A filesystem which is kept mounted for reuse
+ *
+ * Each filesystem driver keeps the state of one mounted filesystem, so there
+ * is one of these for each entry in fstypes[]. When the filesystem is closed
+ * the driver is left as it is, so that the next access to the same partition
+ * can skip probing and reading the superblock again.
+ *
+ * @desc:	Block device, or NULL if the driver has nothing mounted
+ * @part:	Partition number
+ * @hwpart:	Hardware partition which was selected
+ * @seq:	Value of @desc->seq when the filesystem was probed
+ * @info:	Partition information
+ */
+struct fs_mount {
+	struct blk_desc *desc;
+	int part;
+	int hwpart;
+	uint seq;
+	struct disk_partition info;
+};
+
+static struct fs_mount fs_mounts[ARRAY_SIZE(fstypes)];
+static ulong fs_mount_hits, fs_mount_probes;
+
+/**
+ * fs_mount_drop() - really close a filesystem which was kept mounted
+ *
+ * @info:	Filesystem driver whose mount is closed
+ */
+static void fs_mount_drop(struct fstype_info *info)
+{
+	struct fs_mount *mnt = &fs_mounts[info - fstypes];
+
+	if (mnt->desc) {
+		info->close();
+		mnt->desc = NULL;
+	}
+}
+
+void fs_close_all(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fstypes); i++)
+		fs_mount_drop(&fstypes[i]);
+}
+
+/**
+ * fs_mount_find() - look for a filesystem which is still mounted
+ *
+ * A filesystem on a device which has been written to since it was probed is
+ * closed instead of being returned.
+ *
+ * @desc:	Block device
+ * @part:	Partition number
+ * @pinfo:	Partition information to check against, or NULL for any
+ * @fstype:	Filesystem type wanted, or FS_TYPE_ANY
+ * Return: filesystem driver, or NULL if there is no such filesystem
+ */
+static struct fstype_info *fs_mount_find(struct blk_desc *desc, int part,
+					 struct disk_partition *pinfo,
+					 int fstype)
+{
+	int i;
+
+	if (!desc)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(fstypes); i++) {
+		struct fs_mount *mnt = &fs_mounts[i];
+
+		if (mnt->desc != desc || mnt->part != part ||
+		    mnt->hwpart != desc->hwpart ||
+		    (fstype != FS_TYPE_ANY && fstype != fstypes[i].fstype))
+			continue;
+		if (mnt->seq != desc->seq ||
+		    (pinfo && (pinfo->start != mnt->info.start ||
+			       pinfo->size != mnt->info.size))) {
+			fs_mount_drop(&fstypes[i]);
+			continue;
+		}
+		fs_mount_hits++;
+
+		return &fstypes[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * fs_probe() - probe a filesystem driver on the current partition
+ *
+ * Anything the driver has kept mounted is closed first, since probing
+ * replaces the driver's state. If the probe succeeds, the filesystem is
+ * remembered so that it can be used again after it is closed.
+ *
+ * @info:	Filesystem driver
+ * @part:	Partition number
+ * Return: 0 if the filesystem was found, non-zero if not
+ */
+static int fs_probe(struct fstype_info *info, int part)
+{
+	struct fs_mount *mnt = &fs_mounts[info - fstypes];
+	int ret;
+
+	fs_mount_drop(info);
+	fs_mount_probes++;
+	ret = info->probe(fs_dev_desc, &fs_partition);
+	if (!ret && fs_dev_desc && !info->null_dev_desc_ok) {
+		mnt->desc = fs_dev_desc;
+		mnt->part = part;
+		mnt->hwpart = fs_dev_desc->hwpart;
+		mnt->seq = fs_dev_desc->seq;
+		mnt->info = fs_partition;
+	}
+
+	return ret;
+}
+
+int fs_mount_stats(ulong *hits, ulong *probes)
+{
+	int i, count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(fstypes); i++)
+		count += !!fs_mounts[i].desc;
+	*hits = fs_mount_hits;
+	*probes = fs_mount_probes;
+
+	return count;
+}
+
+/* Check whether a filesystem driver is being kept mounted */
+static bool fs_mount_kept(struct fstype_info *info)
+{
+	return fs_mounts[info - fstypes].desc;
+}
+
+/* Get the partition information for a filesystem kept mounted */
+static struct disk_partition *fs_mount_info(struct fstype_info *info)
+{
+	return &fs_mounts[info - fstypes].info;
+}
+#else
+void fs_close_all(void)
+{
+}
+
+static struct fstype_info *fs_mount_find(struct blk_desc *desc, int part,
+					 struct disk_partition *pinfo,
+					 int fstype)
+{
+	return NULL;
+}
+
+static int fs_probe(struct fstype_info *info, int part)
+{
+	return info->probe(fs_dev_desc, &fs_partition);
+}
+
+static bool fs_mount_kept(struct fstype_info *info)
+{
+	return false;
+}
+
+static struct disk_partition *fs_mount_info(struct fstype_info *info)
+{
+	return NULL;
+}
+#endif
+
 /**
  * fs_get_type() - Get type of current filesystem
  *
@@ -469,6 +641,13 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	info = fs_mount_find(fs_dev_desc, part, &fs_partition, fstype);
+	if (info) {
+		fs_type = info->fstype;
+		fs_dev_part = part;
+		return 0;
+	}
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -477,7 +656,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 		if (!fs_dev_desc && !info->null_dev_desc_ok)
 			continue;
 
-		if (!info->probe(fs_dev_desc, &fs_partition)) {
+		if (!fs_probe(info, part)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
 			return 0;
@@ -493,6 +672,16 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 	struct fstype_info *info;
 	int ret, i;
 
+	/* the partition table cannot have changed if the device has not */
+	info = fs_mount_find(desc, part, NULL, FS_TYPE_ANY);
+	if (info) {
+		fs_partition = *fs_mount_info(info);
+		fs_dev_desc = desc;
+		fs_type = info->fstype;
+		fs_dev_part = part;
+		return 0;
+	}
+
 	if (part >= 1)
 		ret = part_get_info(desc, part, &fs_partition);
 	else
@@ -502,7 +691,7 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 	fs_dev_desc = desc;
 
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
-		if (!info->probe(fs_dev_desc, &fs_partition)) {
+		if (!fs_probe(info, part)) {
 			fs_type = info->fstype;
 			fs_dev_part = part;
 			return 0;
@@ -516,7 +705,9 @@ void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	info->close();
+	/* leave the filesystem mounted if it can be used again */
+	if (!fs_mount_kept(info))
+		info->close();
 
 	fs_type = FS_TYPE_ANY;
 }
@@ -14,6 +14,7 @@
 #include <linux/types.h>
 #include <asm/byteorder.h>
 #include <linux/compat.h>
+#include <linux/sizes.h>
 #include <memalign.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +26,8 @@
 #include "sqfs_utils.h"
 
 #define MAX_SYMLINK_NEST 8
+/* Most data to read from the disk at once when loading a file */
+#define SQFS_READ_BATCH_SIZE SZ_1M
 
 static struct squashfs_ctxt ctxt;
 static int symlinknest;
@@ -98,27 +101,38 @@ static int sqfs_calc_n_blks(__le64 start, __le64 end, u64 *offset)
 	return DIV_ROUND_UP(table_size + *offset, ctxt.cur_dev->blksz);
 }
 
+/* Frees the fragment table and fragment blocks read from the filesystem */
+static void sqfs_frag_drop(void)
+{
+	int i, count;
+
+	if (ctxt.frag_entries) {
+		count = DIV_ROUND_UP(get_unaligned_le32(&ctxt.sblk->fragments),
+				     SQFS_MAX_ENTRIES);
+		for (i = 0; i < count; i++)
+			free(ctxt.frag_entries[i]);
+	}
+	free(ctxt.frag_entries);
+	ctxt.frag_entries = NULL;
+	free(ctxt.frag_index);
+	ctxt.frag_index = NULL;
+
+	for (i = 0; i < SQFS_FRAG_SLOTS; i++) {
+		free(ctxt.frag_slots[i].data);
+		ctxt.frag_slots[i].data = NULL;
+	}
+}
+
 /*
- * Retrieves fragment block entry and returns true if the fragment block is
- * compressed
+ * Reads the fragment index, which holds the position of each metadata block
+ * of fragment block entries
  */
-static int sqfs_frag_lookup(u32 inode_fragment_index,
-			    struct squashfs_fragment_block_entry *e)
+static int sqfs_read_frag_index(void)
 {
-	u64 start, end, exp_tbl, n_blks, src_len, table_offset, start_block;
-	unsigned char *metadata_buffer, *metadata, *table;
-	struct squashfs_fragment_block_entry *entries;
+	u64 start, end, exp_tbl, n_blks, table_offset;
 	struct squashfs_super_block *sblk = ctxt.sblk;
-	unsigned long dest_len;
-	int block, offset, ret;
-	u16 header;
-
-	metadata_buffer = NULL;
-	entries = NULL;
-	table = NULL;
-
-	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
-		return -EINVAL;
+	unsigned char *table;
+	int i, count, ret;
 
 	start = get_unaligned_le64(&sblk->fragment_table_start);
 	end = get_unaligned_le64(&sblk->id_table_start);
@@ -127,6 +141,11 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	if (exp_tbl > start && exp_tbl < end)
 		end = exp_tbl;
 
+	count = DIV_ROUND_UP(get_unaligned_le32(&sblk->fragments),
+			     SQFS_MAX_ENTRIES);
+	if (end < start || count * sizeof(u64) > end - start)
+		return -EINVAL;
+
 	n_blks = sqfs_calc_n_blks(sblk->fragment_table_start,
 				  cpu_to_le64(end), &table_offset);
 
@@ -134,81 +153,197 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 
 	/* Allocate a proper sized buffer to store the fragment index table */
 	table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!table) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	if (!table)
+		return -ENOMEM;
 
 	if (sqfs_disk_read(start, n_blks, table) < 0) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
-	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
+	ctxt.frag_index = malloc(count * sizeof(u64));
+	ctxt.frag_entries = calloc(count, sizeof(*ctxt.frag_entries));
+	if (!ctxt.frag_index || !ctxt.frag_entries) {
+		sqfs_frag_drop();
+		ret = -ENOMEM;
+		goto out;
+	}
 
-	/*
-	 * Get the start offset of the metadata block that contains the right
-	 * fragment block entry
-	 */
-	start_block = get_unaligned_le64(table + table_offset + block *
-					 sizeof(u64));
+	for (i = 0; i < count; i++)
+		ctxt.frag_index[i] = get_unaligned_le64(table + table_offset +
+							i * sizeof(u64));
+	ret = 0;
+
+out:
+	free(table);
+
+	return ret;
+}
+
+/* Reads and decompresses a metadata block of fragment block entries */
+static struct squashfs_fragment_block_entry *sqfs_read_frag_entries(u64 start_block)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct squashfs_fragment_block_entry *entries;
+	unsigned char *metadata_buffer, *metadata;
+	u64 start, n_blks, src_len, table_offset;
+	unsigned long dest_len;
+	u16 header;
 
+	entries = NULL;
 	start = start_block / ctxt.cur_dev->blksz;
 	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
 				  sblk->fragment_table_start, &table_offset);
 
 	metadata_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!metadata_buffer) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	if (!metadata_buffer)
+		return NULL;
 
-	if (sqfs_disk_read(start, n_blks, metadata_buffer) < 0) {
-		ret = -EINVAL;
+	if (sqfs_disk_read(start, n_blks, metadata_buffer) < 0)
 		goto out;
-	}
 
 	/* Every metadata block starts with a 16-bit header */
 	header = get_unaligned_le16(metadata_buffer + table_offset);
 	metadata = metadata_buffer + table_offset + SQFS_HEADER_SIZE;
 
-	if (!metadata || !header) {
-		ret = -ENOMEM;
+	if (!header || SQFS_METADATA_SIZE(header) > SQFS_METADATA_BLOCK_SIZE)
 		goto out;
-	}
 
-	if (SQFS_METADATA_SIZE(header) > SQFS_METADATA_BLOCK_SIZE) {
-		ret = -EINVAL;
+	entries = malloc(SQFS_METADATA_BLOCK_SIZE);
+	if (!entries)
 		goto out;
+
+	if (SQFS_COMPRESSED_METADATA(header)) {
+		src_len = SQFS_METADATA_SIZE(header);
+		dest_len = SQFS_METADATA_BLOCK_SIZE;
+		if (sqfs_decompress(&ctxt, entries, &dest_len, metadata,
+				    src_len)) {
+			free(entries);
+			entries = NULL;
+		}
+	} else {
+		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
 	}
 
-	entries = malloc(SQFS_METADATA_BLOCK_SIZE);
+out:
+	free(metadata_buffer);
+
+	return entries;
+}
+
+/*
+ * Retrieves fragment block entry and returns true if the fragment block is
+ * compressed. The fragment table is only read the first time, and then only
+ * the metadata block holding the entry.
+ */
+static int sqfs_frag_lookup(u32 inode_fragment_index,
+			    struct squashfs_fragment_block_entry *e)
+{
+	struct squashfs_fragment_block_entry *entries;
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	int block, offset, ret;
+
+	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
+		return -EINVAL;
+
+	if (!ctxt.frag_index) {
+		ret = sqfs_read_frag_index();
+		if (ret)
+			return ret;
+	}
+
+	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
+	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
+
+	entries = ctxt.frag_entries[block];
 	if (!entries) {
-		ret = -ENOMEM;
+		entries = sqfs_read_frag_entries(ctxt.frag_index[block]);
+		if (!entries)
+			return -EINVAL;
+		ctxt.frag_entries[block] = entries;
+	}
+
+	*e = entries[offset];
+
+	return SQFS_COMPRESSED_BLOCK(e->size);
+}
+
+/*
+ * Returns in 'blockp' the decompressed fragment block described by 'e'. The
+ * most recently used blocks are kept, since a fragment block holds the ends
+ * of several files which are often loaded one after the other.
+ */
+static int sqfs_frag_block(struct squashfs_fragment_block_entry *e,
+			   unsigned char **blockp)
+{
+	u64 start, n_blks, table_size, table_offset;
+	struct squashfs_frag_slot *slot = NULL;
+	unsigned long dest_len;
+	unsigned char *fragment;
+	size_t buf_size;
+	u32 block_size;
+	int i, ret;
+
+	block_size = get_unaligned_le32(&ctxt.sblk->block_size);
+	for (i = 0; i < SQFS_FRAG_SLOTS; i++) {
+		struct squashfs_frag_slot *cur = &ctxt.frag_slots[i];
+
+		if (cur->data && cur->start == e->start) {
+			cur->used = ++ctxt.frag_tick;
+			*blockp = cur->data;
+			return 0;
+		}
+		if (!slot || !cur->data || (slot->data && cur->used < slot->used))
+			slot = cur;
+	}
+
+	start = lldiv(e->start, ctxt.cur_dev->blksz);
+	table_size = SQFS_BLOCK_SIZE(e->size);
+	table_offset = e->start - (start * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
+
+	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
+		return -EINVAL;
+
+	if (!SQFS_COMPRESSED_BLOCK(e->size) && table_size > block_size)
+		return -EINVAL;
+
+	fragment = malloc_cache_aligned(buf_size);
+	if (!fragment)
+		return -ENOMEM;
+
+	ret = sqfs_disk_read(start, n_blks, fragment);
+	if (ret < 0)
 		goto out;
+
+	if (!slot->data) {
+		slot->data = malloc(block_size);
+		if (!slot->data) {
+			ret = -ENOMEM;
+			goto out;
+		}
 	}
 
-	if (SQFS_COMPRESSED_METADATA(header)) {
-		src_len = SQFS_METADATA_SIZE(header);
-		dest_len = SQFS_METADATA_BLOCK_SIZE;
-		ret = sqfs_decompress(&ctxt, entries, &dest_len, metadata,
-				      src_len);
+	if (SQFS_COMPRESSED_BLOCK(e->size)) {
+		dest_len = block_size;
+		ret = sqfs_decompress(&ctxt, slot->data, &dest_len,
+				      fragment + table_offset, table_size);
 		if (ret) {
-			ret = -EINVAL;
+			free(slot->data);
+			slot->data = NULL;
 			goto out;
 		}
 	} else {
-		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
+		memcpy(slot->data, fragment + table_offset, table_size);
 	}
 
-	*e = entries[offset];
-	ret = SQFS_COMPRESSED_BLOCK(e->size);
+	slot->start = e->start;
+	slot->used = ++ctxt.frag_tick;
+	*blockp = slot->data;
+	ret = 0;
 
 out:
-	free(entries);
-	free(metadata_buffer);
-	free(table);
+	free(fragment);
 
 	return ret;
 }
@@ -460,16 +595,246 @@ static char *sqfs_resolve_symlink(struct squashfs_symlink_inode *sym,
 }
 
 /*
- * m_list contains each metadata block's position, and m_count is the number of
- * elements of m_list. Those metadata blocks come from the compressed directory
- * table.
+ * Inode and directory tables are stored as a series of metadata blocks, and
+ * given the compressed size of this table, we can calculate how much metadata
+ * blocks are needed to store the result of the decompression, since a
+ * decompressed metadata block should have a size of 8KiB.
+ */
+static int sqfs_count_metablks(void *table, u32 offset, int table_size)
+{
+	int count = 0, cur_size = 0, ret;
+	u32 data_size;
+	bool comp;
+
+	do {
+		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
+					  &data_size);
+		if (ret)
+			return -EINVAL;
+		cur_size += data_size + SQFS_HEADER_SIZE;
+		count++;
+	} while (cur_size < table_size);
+
+	return count;
+}
+
+static void sqfs_table_put(struct squashfs_table *tbl)
+{
+	if (!tbl || --tbl->refs)
+		return;
+
+	free(tbl->disk);
+	free(tbl->pos);
+	free(tbl->loaded);
+	free(tbl->data);
+	free(tbl);
+}
+
+/*
+ * Reads the compressed metadata table which lies between 'start' and 'end' on
+ * the disk and finds the position of each of its metadata blocks. The table
+ * is returned with one reference held, and nothing is decompressed yet.
+ */
+static struct squashfs_table *sqfs_table_read(__le64 start, __le64 end)
+{
+	u64 n_blks, table_offset, table_size;
+	struct squashfs_table *tbl;
+	u32 cur_size, data_size;
+	size_t buf_size;
+	int j, count;
+	bool comp;
+
+	table_size = get_unaligned_le64(&end) - get_unaligned_le64(&start);
+	n_blks = sqfs_calc_n_blks(start, end, &table_offset);
+
+	/* Allocate a proper sized buffer to store the table */
+	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
+		return NULL;
+
+	tbl = calloc(1, sizeof(*tbl));
+	if (!tbl)
+		return NULL;
+	tbl->refs = 1;
+
+	tbl->disk = malloc_cache_aligned(buf_size);
+	if (!tbl->disk)
+		goto err;
+
+	if (sqfs_disk_read(get_unaligned_le64(&start) / ctxt.cur_dev->blksz,
+			   n_blks, tbl->disk) < 0)
+		goto err;
+
+	/* Calculate size to store the whole decompressed table */
+	tbl->src = tbl->disk + table_offset;
+	count = sqfs_count_metablks(tbl->disk, table_offset, table_size);
+	if (count < 1)
+		goto err;
+
+	tbl->pos = malloc(count * sizeof(u32));
+	tbl->loaded = calloc(count, sizeof(bool));
+	tbl->data = kcalloc(count, SQFS_METADATA_BLOCK_SIZE, GFP_KERNEL);
+	if (!tbl->pos || !tbl->loaded || !tbl->data) {
+		printf("Error: failed to allocate squashfs table of size %i, increasing CONFIG_SYS_MALLOC_LEN could help\n",
+		       count * SQFS_METADATA_BLOCK_SIZE);
+		goto err;
+	}
+
+	/*
+	 * Storing the metadata blocks header's positions will be useful while
+	 * looking for an entry, using the reference (index and offset) given
+	 * by its inode.
+	 */
+	for (j = 0, cur_size = 0; j < count; j++) {
+		if (sqfs_read_metablock(tbl->src, cur_size, &comp, &data_size))
+			goto err;
+		tbl->pos[j] = cur_size;
+		cur_size += data_size + SQFS_HEADER_SIZE;
+	}
+	tbl->count = count;
+
+	return tbl;
+
+err:
+	sqfs_table_put(tbl);
+
+	return NULL;
+}
+
+/*
+ * Returns a pointer to 'len' bytes at 'offset' in the decompressed table,
+ * decompressing the metadata blocks they span if that was not done before
  */
+static void *sqfs_table_get(struct squashfs_table *tbl, u32 offset, u32 len)
+{
+	u32 size = tbl->count * SQFS_METADATA_BLOCK_SIZE;
+	unsigned long dest_len;
+	int j, first, last;
+	u32 src_len;
+	bool comp;
+
+	if (offset >= size || len > size - offset)
+		return NULL;
+
+	first = offset / SQFS_METADATA_BLOCK_SIZE;
+	last = (offset + max(len, 1U) - 1) / SQFS_METADATA_BLOCK_SIZE;
+	for (j = first; j <= last; j++) {
+		unsigned char *dest = tbl->data + j * SQFS_METADATA_BLOCK_SIZE;
+		unsigned char *src = tbl->src + tbl->pos[j] + SQFS_HEADER_SIZE;
+
+		if (tbl->loaded[j])
+			continue;
+
+		if (sqfs_read_metablock(tbl->src, tbl->pos[j], &comp, &src_len))
+			return NULL;
+
+		if (comp) {
+			dest_len = SQFS_METADATA_BLOCK_SIZE;
+			if (sqfs_decompress(&ctxt, dest, &dest_len, src,
+					    src_len))
+				return NULL;
+		} else {
+			memcpy(dest, src, src_len);
+		}
+		tbl->loaded[j] = true;
+	}
+
+	return tbl->data + offset;
+}
+
+/*
+ * Returns a pointer to the inode found at 'offset' in the metadata block
+ * starting at 'block' in the inode table, decompressing as much of the table
+ * as needed to hold all of it
+ */
+static void *sqfs_get_inode(struct squashfs_table *itb, u32 block, u32 offset)
+{
+	struct squashfs_base_inode *base;
+	int j, pos, size;
+
+	if (offset >= SQFS_METADATA_BLOCK_SIZE)
+		return NULL;
+
+	for (j = 0; j < itb->count && itb->pos[j] != block; j++)
+		;
+	if (j == itb->count) {
+		printf("Error: invalid inode reference to inode table.\n");
+		return NULL;
+	}
+	pos = j * SQFS_METADATA_BLOCK_SIZE + offset;
+
+	base = sqfs_table_get(itb, pos, sizeof(*base));
+	if (!base)
+		return NULL;
+
+	/* Get the fixed part first, which gives the size of the rest */
+	switch (get_unaligned_le16(&base->inode_type)) {
+	case SQFS_REG_TYPE:
+		size = sizeof(struct squashfs_reg_inode);
+		break;
+	case SQFS_LREG_TYPE:
+		size = sizeof(struct squashfs_lreg_inode);
+		break;
+	case SQFS_SYMLINK_TYPE:
+	case SQFS_LSYMLINK_TYPE:
+		size = sizeof(struct squashfs_symlink_inode);
+		break;
+	case SQFS_LDIR_TYPE:
+		/* the directory index is not used */
+		return sqfs_table_get(itb, pos, sizeof(struct squashfs_ldir_inode));
+	default:
+		size = 0;
+		break;
+	}
+
+	if (size && !sqfs_table_get(itb, pos, size))
+		return NULL;
+
+	size = sqfs_inode_size(base, get_unaligned_le32(&ctxt.sblk->block_size));
+	if (size < 0)
+		return NULL;
+
+	return sqfs_table_get(itb, pos, size);
+}
+
+/*
+ * Returns a pointer to the listing of a directory in the directory table,
+ * decompressing the metadata blocks it spans
+ */
+static unsigned char *sqfs_get_dir_listing(struct squashfs_table *dtb,
+					   void *dir_i)
+{
+	struct squashfs_base_inode *base = dir_i;
+	struct squashfs_ldir_inode *ldir;
+	struct squashfs_dir_inode *dir;
+	int offset;
+	u32 size;
+
+	offset = sqfs_dir_offset(dir_i, dtb->pos, dtb->count);
+	if (offset < 0)
+		return NULL;
+
+	if (get_unaligned_le16(&base->inode_type) == SQFS_DIR_TYPE) {
+		dir = dir_i;
+		size = get_unaligned_le16(&dir->file_size);
+	} else {
+		ldir = dir_i;
+		size = get_unaligned_le32(&ldir->file_size);
+	}
+
+	/* The size counts three bytes which are not in the listing */
+	size = max_t(u32, size, SQFS_EMPTY_FILE_SIZE + SQFS_DIR_HEADER_SIZE);
+
+	return sqfs_table_get(dtb, offset, size - SQFS_EMPTY_FILE_SIZE);
+}
+
 static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
-			   int token_count, u32 *m_list, int m_count)
+			   int token_count)
 {
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	char *path, *target, **sym_tokens, *res, *rem;
-	int j, ret = 0, new_inode_number, offset;
+	unsigned char *listing;
+	int j, ret = 0;
+	u64 root;
 	struct squashfs_symlink_inode *sym;
 	struct squashfs_ldir_inode *ldir;
 	struct squashfs_dir_inode *dir;
@@ -486,17 +851,20 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 	dirsp = (struct fs_dir_stream *)dirs;
 
 	/* Start by root inode */
-	table = sqfs_find_inode(dirs->inode_table, le32_to_cpu(sblk->inodes),
-				sblk->inodes, sblk->block_size);
+	root = get_unaligned_le64(&sblk->root_inode);
+	table = sqfs_get_inode(dirs->inode_table, SQFS_INODE_BLOCK(root),
+			       SQFS_INODE_OFFSET(root));
 	if (!table)
 		return -EINVAL;
 
 	dir = (struct squashfs_dir_inode *)table;
 	ldir = (struct squashfs_ldir_inode *)table;
 
-	/* get directory offset in directory table */
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
+	/* get directory listing in directory table */
+	listing = sqfs_get_dir_listing(dirs->dir_table, table);
+	if (!listing)
+		return -EINVAL;
+	dirs->table = listing;
 
 	/* Setup directory header */
 	dirs->dir_header = malloc(SQFS_DIR_HEADER_SIZE);
@@ -512,7 +880,7 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 
 	/* No path given -> root directory */
 	if (!strcmp(token_list[0], "/")) {
-		dirs->table = &dirs->dir_table[offset];
+		dirs->table = listing;
 		memcpy(&dirs->i_dir, dir, sizeof(*dir));
 		return 0;
 	}
@@ -538,13 +906,10 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 			goto out;
 		}
 
-		/* Redefine inode as the found token */
-		new_inode_number = dirs->entry->inode_offset +
-			dirs->dir_header->inode_number;
-
 		/* Get reference to inode in the inode table */
-		table = sqfs_find_inode(dirs->inode_table, new_inode_number,
-					sblk->inodes, sblk->block_size);
+		table = sqfs_get_inode(dirs->inode_table,
+				       dirs->dir_header->start,
+				       dirs->entry->offset);
 		if (!table)
 			return -EINVAL;
 		dir = (struct squashfs_dir_inode *)table;
@@ -610,8 +975,7 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 			free(dirs->entry);
 			dirs->entry = NULL;
 
-			ret = sqfs_search_dir(dirs, sym_tokens, token_count,
-					      m_list, m_count);
+			ret = sqfs_search_dir(dirs, sym_tokens, token_count);
 			goto out;
 		} else if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type))) {
 			printf("** Cannot find directory. **\n");
@@ -625,13 +989,16 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 		if (get_unaligned_le16(&dir->inode_type) == SQFS_LDIR_TYPE)
 			ldir = (struct squashfs_ldir_inode *)table;
 
-		/* Get dir. offset into the directory table */
-		offset = sqfs_dir_offset(table, m_list, m_count);
-		dirs->table = &dirs->dir_table[offset];
+		/* Get dir. listing in the directory table */
+		listing = sqfs_get_dir_listing(dirs->dir_table, table);
+		if (!listing) {
+			ret = -EINVAL;
+			goto out;
+		}
+		dirs->table = listing;
 
 		/* Copy directory header */
-		memcpy(dirs->dir_header, &dirs->dir_table[offset],
-		       SQFS_DIR_HEADER_SIZE);
+		memcpy(dirs->dir_header, listing, SQFS_DIR_HEADER_SIZE);
 
 		/* Check for empty directory */
 		if (sqfs_is_empty_dir(table)) {
@@ -650,8 +1017,7 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 		dirs->entry = NULL;
 	}
 
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
+	dirs->table = listing;
 
 	if (get_unaligned_le16(&dir->inode_type) == SQFS_DIR_TYPE)
 		memcpy(&dirs->i_dir, dir, sizeof(*dir));
@@ -668,259 +1034,57 @@ out:
 }
 
 /*
- * Inode and directory tables are stored as a series of metadata blocks, and
- * given the compressed size of this table, we can calculate how much metadata
- * blocks are needed to store the result of the decompression, since a
- * decompressed metadata block should have a size of 8KiB.
- */
-static int sqfs_count_metablks(void *table, u32 offset, int table_size)
-{
-	int count = 0, cur_size = 0, ret;
-	u32 data_size;
-	bool comp;
-
-	do {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		count++;
-	} while (cur_size < table_size);
-
-	return count;
-}
-
-/*
- * Storing the metadata blocks header's positions will be useful while looking
- * for an entry in the directory table, using the reference (index and offset)
- * given by its inode.
+ * Gets a reference to the inode and directory tables for a directory stream,
+ * reading them if they are not kept from a previous access
  */
-static int sqfs_get_metablk_pos(u32 *pos_list, void *table, u32 offset,
-				int metablks_count)
-{
-	u32 data_size, cur_size = 0;
-	int j, ret = 0;
-	bool comp;
-
-	if (!metablks_count)
-		return -EINVAL;
-
-	for (j = 0; j < metablks_count; j++) {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		pos_list[j] = cur_size;
-	}
-
-	return ret;
-}
-
-static int sqfs_read_inode_table(unsigned char **inode_table)
+static int sqfs_get_tables(struct squashfs_dir_stream *dirs)
 {
 	struct squashfs_super_block *sblk = ctxt.sblk;
-	u64 start, n_blks, table_offset, table_size;
-	int j, ret = 0, metablks_count;
-	unsigned char *src_table, *itb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-	size_t buf_size;
-
-	table_size = get_unaligned_le64(&sblk->directory_table_start) -
-		get_unaligned_le64(&sblk->inode_table_start);
-	start = get_unaligned_le64(&sblk->inode_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->inode_table_start,
-				  sblk->directory_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (itb) to store the inode table */
-	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
-		return -EINVAL;
-
-	itb = malloc_cache_aligned(buf_size);
-	if (!itb)
-		return -ENOMEM;
 
-	if (sqfs_disk_read(start, n_blks, itb) < 0) {
-		ret = -EINVAL;
-		goto free_itb;
+	if (!ctxt.inode_table) {
+		ctxt.inode_table = sqfs_table_read(sblk->inode_table_start,
+						   sblk->directory_table_start);
+		if (!ctxt.inode_table)
+			return -EINVAL;
 	}
 
-	/* Parse inode table (metadata block) header */
-	ret = sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-	if (ret) {
-		ret = -EINVAL;
-		goto free_itb;
+	if (!ctxt.dir_table) {
+		ctxt.dir_table = sqfs_table_read(sblk->directory_table_start,
+						 sblk->fragment_table_start);
+		if (!ctxt.dir_table)
+			return -EINVAL;
 	}
 
-	/* Calculate size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(itb, table_offset, table_size);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
+	dirs->inode_table = ctxt.inode_table;
+	dirs->inode_table->refs++;
+	dirs->dir_table = ctxt.dir_table;
+	dirs->dir_table->refs++;
 
-	*inode_table = kcalloc(metablks_count, SQFS_METADATA_BLOCK_SIZE,
-			       GFP_KERNEL);
-	if (!*inode_table) {
-		ret = -ENOMEM;
-		printf("Error: failed to allocate squashfs inode_table of size %i, increasing CONFIG_SYS_MALLOC_LEN could help\n",
-		       metablks_count * SQFS_METADATA_BLOCK_SIZE);
-		goto free_itb;
+	if (!CONFIG_IS_ENABLED(SQUASHFS_CACHE)) {
+		sqfs_table_put(ctxt.inode_table);
+		ctxt.inode_table = NULL;
+		sqfs_table_put(ctxt.dir_table);
+		ctxt.dir_table = NULL;
 	}
 
-	src_table = itb + table_offset + SQFS_HEADER_SIZE;
-
-	/* Extract compressed Inode table */
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *inode_table +
-					      dest_offset, &dest_len,
-					      src_table, src_len);
-			if (ret) {
-				free(*inode_table);
-				*inode_table = NULL;
-				goto free_itb;
-			}
-
-			dest_offset += dest_len;
-		} else {
-			memcpy(*inode_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
-		}
-
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'itb' and to the decompression source, respectively.
-		 */
-
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
-	}
-
-free_itb:
-	free(itb);
-
-	return ret;
+	return 0;
 }
 
-static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
+/* Frees everything kept from the filesystem */
+static void sqfs_cache_drop(void)
 {
-	u64 start, n_blks, table_offset, table_size;
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	int j, ret = 0, metablks_count = -1;
-	unsigned char *src_table, *dtb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-	size_t buf_size;
-
-	*dir_table = NULL;
-	*pos_list = NULL;
-	/* DIRECTORY TABLE */
-	table_size = get_unaligned_le64(&sblk->fragment_table_start) -
-		get_unaligned_le64(&sblk->directory_table_start);
-	start = get_unaligned_le64(&sblk->directory_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->directory_table_start,
-				  sblk->fragment_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (dtb) to store the directory table */
-	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
-		return -EINVAL;
-
-	dtb = malloc_cache_aligned(buf_size);
-	if (!dtb)
-		return -ENOMEM;
-
-	if (sqfs_disk_read(start, n_blks, dtb) < 0)
-		goto out;
-
-	/* Parse directory table (metadata block) header */
-	ret = sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-	if (ret)
-		goto out;
-
-	/* Calculate total size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(dtb, table_offset, table_size);
-	if (metablks_count < 1)
-		goto out;
-
-	*dir_table = malloc(metablks_count * SQFS_METADATA_BLOCK_SIZE);
-	if (!*dir_table)
-		goto out;
-
-	*pos_list = malloc(metablks_count * sizeof(u32));
-	if (!*pos_list)
-		goto out;
-
-	ret = sqfs_get_metablk_pos(*pos_list, dtb, table_offset,
-				   metablks_count);
-	if (ret) {
-		metablks_count = -1;
-		goto out;
-	}
-
-	src_table = dtb + table_offset + SQFS_HEADER_SIZE;
-
-	/* Extract compressed Directory table */
-	dest_offset = 0;
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *dir_table +
-					      (j * SQFS_METADATA_BLOCK_SIZE),
-					      &dest_len, src_table, src_len);
-			if (ret) {
-				metablks_count = -1;
-				goto out;
-			}
-
-			if (dest_len < SQFS_METADATA_BLOCK_SIZE) {
-				dest_offset += dest_len;
-				break;
-			}
-
-			dest_offset += dest_len;
-		} else {
-			memcpy(*dir_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
-		}
-
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'dtb' and to the decompression source, respectively.
-		 */
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
-	}
-
-out:
-	if (metablks_count < 1) {
-		free(*dir_table);
-		free(*pos_list);
-		*dir_table = NULL;
-		*pos_list = NULL;
-	}
-	free(dtb);
-
-	return metablks_count;
+	sqfs_table_put(ctxt.inode_table);
+	ctxt.inode_table = NULL;
+	sqfs_table_put(ctxt.dir_table);
+	ctxt.dir_table = NULL;
+	sqfs_frag_drop();
 }
 
 static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
+	int j, token_count = 0, ret = 0;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -933,17 +1097,9 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
-	if (ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
+	ret = sqfs_get_tables(dirs);
+	if (ret)
 		goto out;
-	}
 
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
@@ -972,10 +1128,7 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	ret = sqfs_search_dir(dirs, token_list, token_count);
 	if (ret)
 		goto out;
 
@@ -1001,12 +1154,9 @@ out:
 			free(token_list[j]);
 		free(token_list);
 	}
-	free(pos_list);
 	free(path);
-	if (ret) {
-		free(inode_table);
-		free(dirs);
-	}
+	if (ret)
+		sqfs_closedir((struct fs_dir_stream *)dirs);
 
 	return ret;
 }
@@ -1025,12 +1175,11 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 
 static int sqfs_readdir_nest(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_dir_stream *dirs;
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
-	int i_number, offset = 0, ret;
+	int offset = 0, ret;
 	struct fs_dirent *dent;
 	unsigned char *ipos;
 	u16 name_size;
@@ -1070,9 +1219,8 @@ static int sqfs_readdir_nest(struct fs_dir_stream *fs_dirs, struct fs_dirent **d
 			return -SQFS_STOP_READDIR;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
+	ipos = sqfs_get_inode(dirs->inode_table, dirs->dir_header->start,
+			      dirs->entry->offset);
 	if (!ipos)
 		return -SQFS_STOP_READDIR;
 
@@ -1145,6 +1293,7 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 	struct squashfs_super_block *sblk;
 	int ret;
 
+	sqfs_cache_drop();
 	ctxt.cur_dev = fs_dev_desc;
 	ctxt.cur_part_info = *fs_partition;
 
@@ -1369,14 +1518,210 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 	return datablk_count;
 }
 
+/**
+ * struct sqfs_batch - Data blocks of a file which are read from the disk at once
+ *
+ * @end:	Data block after the last one in the batch
+ * @offset:	Position of the first block's data within @raw
+ * @raw:	Whole disk blocks holding the data
+ * @raw_size:	Size of @raw
+ * @busy:	true if the read has been submitted and not waited for
+ * @req:	Request reading the data
+ * @sg:		Buffer list of @req
+ */
+struct sqfs_batch {
+	int end;
+	u64 offset;
+	char *raw;
+	size_t raw_size;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	bool busy;
+	struct blk_req req;
+	struct blk_sg sg;
+#endif
+};
+
+static int sqfs_batch_read_error(void)
+{
+	/*
+	 * Possible causes: too many data blocks or too large SquashFS block
+	 * size. Tip: re-compile the SquashFS image with mksquashfs's
+	 * -b <block_size> option.
+	 */
+	printf("Error: too many data blocks to be read.\n");
+
+	return -EIO;
+}
+
+/**
+ * sqfs_batch_start() - Start reading a batch of data blocks
+ *
+ * When the device supports asynchronous requests, this returns as soon as the
+ * read is queued, so that the previous batch can be decompressed meanwhile.
+ *
+ * @batch:	Batch to read, whose buffer must not be in use
+ * @finfo:	File being read
+ * @first:	First data block of the batch
+ * @count:	Number of data blocks to read from the file
+ * @data_offsetp:	Disk offset of the data of block @first, updated to
+ *		that of the block after the batch
+ * Return: 0 if OK, -ve on error
+ */
+static int sqfs_batch_start(struct sqfs_batch *batch,
+			    struct squashfs_file_info *finfo, int first,
+			    int count, u64 *data_offsetp)
+{
+	struct blk_desc *desc = ctxt.cur_dev;
+	u64 start, n_blks, size = 0;
+	int k;
+
+	/*
+	 * The blocks follow each other on the disk and sparse blocks take no
+	 * space, so read as many as fit in SQFS_READ_BATCH_SIZE at once
+	 */
+	for (k = first; k < count; k++) {
+		u64 blk_size = SQFS_BLOCK_SIZE(finfo->blk_sizes[k]);
+
+		if (k > first && size + blk_size > SQFS_READ_BATCH_SIZE)
+			break;
+		size += blk_size;
+	}
+	batch->end = k;
+	if (!size)
+		return 0;
+
+	start = lldiv(*data_offsetp, desc->blksz);
+	batch->offset = *data_offsetp - start * desc->blksz;
+	n_blks = DIV_ROUND_UP(size + batch->offset, desc->blksz);
+	*data_offsetp += size;
+
+	if (n_blks * desc->blksz > batch->raw_size) {
+		free(batch->raw);
+		batch->raw_size = n_blks * desc->blksz;
+		batch->raw = malloc_cache_aligned(batch->raw_size);
+		if (!batch->raw) {
+			batch->raw_size = 0;
+			return -ENOMEM;
+		}
+	}
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	batch->sg.buf = batch->raw;
+	batch->sg.blkcnt = n_blks;
+	blk_req_init(&batch->req, desc->bdev, BLK_REQ_READ,
+		     ctxt.cur_part_info.start + start, &batch->sg, 1);
+	if (!blk_req_submit(&batch->req)) {
+		batch->busy = true;
+		return 0;
+	}
+#endif
+	if (sqfs_disk_read(start, n_blks, batch->raw) < 0)
+		return sqfs_batch_read_error();
+
+	return 0;
+}
+
+/**
+ * sqfs_batch_wait() - Wait for a batch of data blocks to be read
+ *
+ * @batch:	Batch being read
+ * Return: 0 if OK, -EIO on error
+ */
+static int sqfs_batch_wait(struct sqfs_batch *batch)
+{
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	if (batch->busy) {
+		batch->busy = false;
+		if (blk_req_wait(&batch->req))
+			return sqfs_batch_read_error();
+	}
+#endif
+
+	return 0;
+}
+
+/**
+ * sqfs_batch_unpack() - Copy the data of a batch of blocks into a file buffer
+ *
+ * The device is polled after each block, so that the read of the next batch
+ * moves along while this one is decompressed.
+ *
+ * @batch:	Batch which has been read
+ * @next:	Batch being read meanwhile
+ * @finfo:	File being read
+ * @first:	First data block of @batch
+ * @datablock:	Bounce buffer for a block which may not fit in @buf
+ * @buf:	File buffer
+ * @len:	Number of bytes to read from the file
+ * @actread:	Number of bytes put in @buf so far, updated
+ * Return: 0 if OK, -ve on error
+ */
+static int sqfs_batch_unpack(struct sqfs_batch *batch, struct sqfs_batch *next,
+			     struct squashfs_file_info *finfo, int first,
+			     char *datablock, void *buf, loff_t len,
+			     loff_t *actread)
+{
+	u32 block_size = get_unaligned_le32(&ctxt.sblk->block_size);
+	char *data = batch->raw + batch->offset;
+	unsigned long dest_len;
+	int i, ret;
+
+	for (i = first; i < batch->end; i++) {
+		u64 table_size = SQFS_BLOCK_SIZE(finfo->blk_sizes[i]);
+
+		if (!table_size) {
+			/* Don't load any data for sparse blocks */
+			dest_len = min_t(u64, block_size, len - *actread);
+			memset(buf + *actread, 0, dest_len);
+			*actread += dest_len;
+		} else if (SQFS_COMPRESSED_BLOCK(finfo->blk_sizes[i])) {
+			bool direct = len - *actread >= block_size;
+
+			/*
+			 * Decompress straight into the buffer, unless the
+			 * block may not fit
+			 */
+			dest_len = block_size;
+			ret = sqfs_decompress(&ctxt, direct ?
+					      buf + *actread : datablock,
+					      &dest_len, data, table_size);
+			if (ret)
+				return ret;
+
+			if ((*actread + dest_len) > len)
+				dest_len = len - *actread;
+			if (!direct)
+				memcpy(buf + *actread, datablock, dest_len);
+			*actread += dest_len;
+		} else {
+			u64 copy = table_size;
+
+			if ((*actread + copy) > len)
+				copy = len - *actread;
+			memcpy(buf + *actread, data, copy);
+			*actread += copy;
+		}
+
+		data += table_size;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+		if (next->busy)
+			blk_req_poll(next->req.dev);
+#endif
+	}
+
+	return 0;
+}
+
 static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 			  loff_t len, loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
-	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
-	int ret, j, i_number, datablk_count = 0;
+	char *dir = NULL, *datablock = NULL, *file = NULL, *resolved;
 	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct sqfs_batch batch[2] = {};
+	int ret, j, idx, datablk_count = 0;
+	unsigned char *fragment_block;
+	u64 data_offset;
+	u32 block_size;
 	struct squashfs_fragment_block_entry frag_entry;
 	struct squashfs_file_info finfo = {0};
 	struct squashfs_symlink_inode *symlink;
@@ -1385,12 +1730,11 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
-	unsigned long dest_len;
 	struct fs_dirent *dent;
 	unsigned char *ipos;
-	size_t buf_size;
 
 	*actread = 0;
+	block_size = get_unaligned_le32(&sblk->block_size);
 
 	if (offset) {
 		/*
@@ -1429,9 +1773,8 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 		goto out;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
+	ipos = sqfs_get_inode(dirs->inode_table, dirs->dir_header->start,
+			      dirs->entry->offset);
 	if (!ipos) {
 		ret = -EINVAL;
 		goto out;
@@ -1502,144 +1845,68 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 
 	if (datablk_count) {
 		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
+		datablock = malloc(block_size);
 		if (!datablock) {
 			ret = -ENOMEM;
 			goto out;
 		}
 	}
 
-	for (j = 0; j < datablk_count; j++) {
-		char *data_buffer;
-
-		start = lldiv(data_offset, ctxt.cur_dev->blksz);
-		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
-		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
-		n_blks = DIV_ROUND_UP(table_size + table_offset,
-				      ctxt.cur_dev->blksz);
-
-		/* Don't load any data for sparse blocks */
-		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
-		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-			if (!data_buffer) {
-				ret = -ENOMEM;
-				goto out;
-			}
-
-			ret = sqfs_disk_read(start, n_blks, data_buffer);
-			if (ret < 0) {
-				/*
-				 * Possible causes: too many data blocks or too large
-				 * SquashFS block size. Tip: re-compile the SquashFS
-				 * image with mksquashfs's -b <block_size> option.
-				 */
-				printf("Error: too many data blocks to be read.\n");
-				goto out;
-			}
-
-			data = data_buffer + table_offset;
-		}
-
-		/* Load the data */
-		if (finfo.blk_sizes[j] == 0) {
-			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
-			if ((*actread + sparse_size) > len)
-				sparse_size = len - *actread;
-			memset(buf + *actread, 0, sparse_size);
-			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
-			if (ret)
-				goto out;
-
-			if ((*actread + dest_len) > len)
-				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
-			*actread += dest_len;
-		} else {
-			if ((*actread + table_size) > len)
-				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
-			*actread += table_size;
-		}
+	/* Blocks past the requested length are not needed */
+	datablk_count = min_t(u64, datablk_count,
+			      lldiv(len + block_size - 1, block_size));
 
-		data_offset += table_size;
-		free(data_buffer);
-		if (*actread >= len)
-			break;
+	/*
+	 * Read the blocks in batches, decompressing each batch while the next
+	 * one is read
+	 */
+	ret = 0;
+	if (datablk_count)
+		ret = sqfs_batch_start(&batch[0], &finfo, 0, datablk_count,
+				       &data_offset);
+	for (j = 0, idx = 0; !ret && j < datablk_count; idx ^= 1) {
+		struct sqfs_batch *cur = &batch[idx], *next = &batch[idx ^ 1];
+
+		ret = sqfs_batch_wait(cur);
+		if (!ret && cur->end < datablk_count)
+			ret = sqfs_batch_start(next, &finfo, cur->end,
+					       datablk_count, &data_offset);
+		if (!ret)
+			ret = sqfs_batch_unpack(cur, next, &finfo, j, datablock,
+						buf, len, actread);
+		j = cur->end;
 	}
+	if (ret)
+		goto out;
 
 	/*
 	 * There is no need to continue if the file is not fragmented.
 	 */
-	if (!finfo.frag) {
+	if (!finfo.frag || *actread >= len) {
 		ret = 0;
 		goto out;
 	}
 
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size)) {
+	if (finfo.offset + finfo.size - *actread > block_size) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	fragment = malloc_cache_aligned(buf_size);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	ret = sqfs_frag_block(&frag_entry, &fragment_block);
+	if (ret)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
-		goto out;
-
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-	}
-
-	ret = 0;
+	memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
+	*actread = finfo.size;
 
 out:
-	free(fragment);
+	/* the buffers must not be in use once they are freed */
+	sqfs_batch_wait(&batch[0]);
+	sqfs_batch_wait(&batch[1]);
+	if (!CONFIG_IS_ENABLED(SQUASHFS_CACHE))
+		sqfs_frag_drop();
+	free(batch[0].raw);
+	free(batch[1].raw);
 	free(datablock);
 	free(file);
 	free(dir);
@@ -1658,7 +1925,6 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 
 static int sqfs_size_nest(const char *filename, loff_t *size)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_symlink_inode *symlink;
 	struct fs_dir_stream *dirsp = NULL;
 	struct squashfs_base_inode *base;
@@ -1668,7 +1934,7 @@ static int sqfs_size_nest(const char *filename, loff_t *size)
 	char *dir, *file, *resolved;
 	struct fs_dirent *dent;
 	unsigned char *ipos;
-	int ret, i_number;
+	int ret;
 
 	sqfs_split_path(&file, &dir, filename);
 	/*
@@ -1698,9 +1964,8 @@ static int sqfs_size_nest(const char *filename, loff_t *size)
 		goto free_strings;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
+	ipos = sqfs_get_inode(dirs->inode_table, dirs->dir_header->start,
+			      dirs->entry->offset);
 
 	if (!ipos) {
 		*size = 0;
@@ -1805,6 +2070,7 @@ int sqfs_size(const char *filename, loff_t *size)
 
 void sqfs_close(void)
 {
+	sqfs_cache_drop();
 	sqfs_decompressor_cleanup(&ctxt);
 	free(ctxt.sblk);
 	ctxt.sblk = NULL;
@@ -1819,8 +2085,9 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	sqfs_table_put(sqfs_dirs->inode_table);
+	sqfs_table_put(sqfs_dirs->dir_table);
 	free(sqfs_dirs->dir_header);
+	free(sqfs_dirs->entry);
 	free(sqfs_dirs);
 }
@@ -23,9 +23,9 @@ bool sqfs_is_dir(u16 type)
 /*
  * Receives a pointer (void *) to a position in the inode table containing the
  * directory's inode. Returns directory inode offset into the directory table.
- * m_list contains each metadata block's position, and m_count is the number of
- * elements of m_list. Those metadata blocks come from the compressed directory
- * table.
+ * m_list contains the position of each metadata block in the compressed
+ * directory table, starting with the first one at 0, and m_count is the number
+ * of elements of m_list.
  */
 int sqfs_dir_offset(void *dir_i, u32 *m_list, int m_count)
 {
@@ -51,17 +51,14 @@ int sqfs_dir_offset(void *dir_i, u32 *m_list, int m_count)
 		return -EINVAL;
 	}
 
-	if (offset < 0)
+	if (offset >= SQFS_METADATA_BLOCK_SIZE)
 		return -EINVAL;
 
 	for (j = 0; j < m_count; j++) {
 		if (m_list[j] == start_block)
-			return (++j * SQFS_METADATA_BLOCK_SIZE) + offset;
+			return (j * SQFS_METADATA_BLOCK_SIZE) + offset;
 	}
 
-	if (start_block == 0)
-		return offset;
-
 	printf("Error: invalid inode reference to directory table.\n");
 
 	return -EINVAL;
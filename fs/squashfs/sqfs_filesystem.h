@@ -71,6 +71,45 @@ struct squashfs_super_block {
 	__le64 export_table_start;
 };
 
+#if CONFIG_IS_ENABLED(SQUASHFS_CACHE)
+#define SQFS_FRAG_SLOTS CONFIG_SQUASHFS_CACHE_FRAGMENTS
+#else
+#define SQFS_FRAG_SLOTS 1
+#endif
+
+/*
+ * A metadata table (inode or directory table) read from the disk. Each
+ * metadata block is decompressed into 'data' the first time it is used, so
+ * only the parts of the table which are actually looked at are decompressed.
+ * The table is shared by the filesystem context and the directory streams
+ * using it, and freed when the last reference is dropped.
+ */
+struct squashfs_table {
+	/* disk blocks holding the compressed table */
+	unsigned char *disk;
+	/* start of the compressed table in 'disk' */
+	unsigned char *src;
+	/* offset of each metadata block from the start of the table */
+	u32 *pos;
+	/* which metadata blocks have been decompressed */
+	bool *loaded;
+	/* decompressed table, SQFS_METADATA_BLOCK_SIZE bytes per block */
+	unsigned char *data;
+	/* number of metadata blocks */
+	int count;
+	int refs;
+};
+
+/* A decompressed fragment block, kept for reuse */
+struct squashfs_frag_slot {
+	/* position of the fragment block on the disk */
+	u64 start;
+	/* decompressed block, or NULL if the slot is unused */
+	unsigned char *data;
+	/* time of the last use, to find the least recently used slot */
+	ulong used;
+};
+
 struct squashfs_ctxt {
 	struct disk_partition cur_part_info;
 	struct blk_desc *cur_dev;
@@ -78,6 +117,15 @@ struct squashfs_ctxt {
 #if IS_ENABLED(CONFIG_ZSTD)
 	void *zstd_workspace;
 #endif
+	/* tables kept while the filesystem is mounted (SQUASHFS_CACHE) */
+	struct squashfs_table *inode_table;
+	struct squashfs_table *dir_table;
+	/* position of each metadata block of the fragment table */
+	u64 *frag_index;
+	/* those metadata blocks, decompressed as they are used */
+	struct squashfs_fragment_block_entry **frag_entries;
+	struct squashfs_frag_slot frag_slots[SQFS_FRAG_SLOTS];
+	ulong frag_tick;
 };
 
 struct squashfs_directory_index {
@@ -271,11 +319,11 @@ struct squashfs_dir_stream {
 	struct squashfs_dir_inode i_dir;
 	struct squashfs_ldir_inode i_ldir;
 	/*
-	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * References to the tables. They are taken in sqfs_opendir() and
+	 * dropped in sqfs_closedir().
 	 */
-	unsigned char *inode_table;
-	unsigned char *dir_table;
+	struct squashfs_table *inode_table;
+	struct squashfs_table *dir_table;
 };
 
 struct squashfs_file_info {
@@ -293,8 +341,7 @@ struct squashfs_file_info {
 	bool comp;
 };
 
-void *sqfs_find_inode(void *inode_table, int inode_number, __le32 inode_count,
-		      __le32 block_size);
+int sqfs_inode_size(struct squashfs_base_inode *inode, u32 blk_size);
 
 int sqfs_dir_offset(void *dir_i, u32 *m_list, int m_count);
 
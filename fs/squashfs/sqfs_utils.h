@@ -24,5 +24,12 @@
  */
 #define SQFS_COMPRESSED_METADATA(A) (!((A) & BIT(15)))
 #define SQFS_METADATA_SIZE(A) ((A) & GENMASK(14, 0))
+/*
+ * An inode reference gives the position of the metadata block holding the
+ * inode in the inode table and the inode's offset in that block, once
+ * decompressed
+ */
+#define SQFS_INODE_BLOCK(A) ((u32)((A) >> 16))
+#define SQFS_INODE_OFFSET(A) ((A) & GENMASK(15, 0))
 
 #endif /* SQFS_UTILS_H  */
@@ -15,6 +15,7 @@
 #include <gzip.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <memalign.h>
 #include "ubifs.h"
 #include <part.h>
@@ -735,23 +736,13 @@ static inline void *kmap(struct page *page)
 	return page->addr;
 }
 
-static int read_block(struct inode *inode, void *addr, unsigned int block,
-		      struct ubifs_data_node *dn)
+static int decode_block(struct ubifs_info *c, struct inode *inode,
+			void *addr, unsigned int block,
+			struct ubifs_data_node *dn)
 {
-	struct ubifs_info *c = inode->i_sb->s_fs_info;
 	int err, len, out_len;
-	union ubifs_key key;
 	unsigned int dlen;
 
-	data_key_init(c, &key, inode->i_ino, block);
-	err = ubifs_tnc_lookup(c, &key, dn);
-	if (err) {
-		if (err == -ENOENT)
-			/* Not found, so it must be a hole */
-			memset(addr, 0, UBIFS_BLOCK_SIZE);
-		return err;
-	}
-
 	ubifs_assert(le64_to_cpu(dn->ch.sqnum) > ubifs_inode(inode)->creat_sqnum);
 
 	len = le32_to_cpu(dn->size);
@@ -782,6 +773,71 @@ dump:
 	return -EINVAL;
 }
 
+static int read_block(struct inode *inode, void *addr, unsigned int block,
+		      struct ubifs_data_node *dn)
+{
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	union ubifs_key key;
+	int err;
+
+	data_key_init(c, &key, inode->i_ino, block);
+	err = ubifs_tnc_lookup(c, &key, dn);
+	if (err) {
+		if (err == -ENOENT)
+			/* Not found, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		return err;
+	}
+
+	return decode_block(c, inode, addr, block, dn);
+}
+
+/*
+ * Read up to @count whole blocks starting at @block straight into @addr. The
+ * data nodes which follow each other in the same LEB are read in one go into
+ * the bulk-read buffer and then decompressed one after another. This returns
+ * the number of blocks read, 0 if @block cannot be bulk-read (e.g. it is a
+ * hole) or a negative error code.
+ */
+static int read_bulk(struct ubifs_info *c, struct inode *inode, void *addr,
+		     unsigned int block, unsigned int count)
+{
+	struct bu_info *bu = &c->bu;
+	struct ubifs_data_node *dn;
+	unsigned int i;
+	int err, n;
+
+	bu->buf_len = c->max_bu_buf_len;
+	data_key_init(c, &bu->key, inode->i_ino, block);
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err)
+		return err;
+	if (!bu->cnt || key_block(c, &bu->zbranch[0].key) != block)
+		return 0;
+
+	err = ubifs_tnc_bulk_read(c, bu);
+	if (err)
+		return err;
+
+	count = min_t(unsigned int, count, bu->blk_cnt);
+	for (i = 0, n = 0; i < count; i++, addr += UBIFS_BLOCK_SIZE) {
+		if (n >= bu->cnt ||
+		    key_block(c, &bu->zbranch[n].key) != block + i) {
+			/* A hole between the data nodes */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+			continue;
+		}
+
+		dn = bu->buf + bu->zbranch[n].offs - bu->zbranch[0].offs;
+		err = decode_block(c, inode, addr, block + i, dn);
+		if (err)
+			return err;
+		n++;
+	}
+
+	return count;
+}
+
 static int do_readpage(struct ubifs_info *c, struct inode *inode,
 		       struct page *page, int last_block_size)
 {
@@ -903,8 +959,8 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	struct inode *inode;
 	struct page page;
 	int err = 0;
-	int i;
-	int count;
+	int i, n;
+	int count, full;
 	int last_block_size = 0;
 
 	if (!ubifs_is_mounted()) {
@@ -953,23 +1009,38 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 		size = inode->i_size - offset;
 
 	count = (size + UBIFS_BLOCK_SIZE - 1) >> UBIFS_BLOCK_SHIFT;
+	full = size >> UBIFS_BLOCK_SHIFT;
 
 	page.addr = buf;
 	page.index = offset / PAGE_SIZE;
 	page.inode = inode;
-	for (i = 0; i < count; i++) {
-		/*
-		 * Make sure to not read beyond the requested size
-		 */
-		if (((i + 1) == count) && (size < inode->i_size))
-			last_block_size = size - (i * PAGE_SIZE);
+	for (i = 0; i < count; i += n) {
+		/* Whole blocks can be bulk-read straight into the buffer */
+		n = 0;
+		if (c->bu.buf && i < full) {
+			n = read_bulk(c, inode, page.addr, page.index,
+				      full - i);
+			if (n < 0) {
+				err = n;
+				break;
+			}
+		}
 
-		err = do_readpage(c, inode, &page, last_block_size);
-		if (err)
-			break;
+		if (!n) {
+			/*
+			 * Make sure to not read beyond the requested size
+			 */
+			if (((i + 1) == count) && (size < inode->i_size))
+				last_block_size = size - (i * PAGE_SIZE);
+
+			err = do_readpage(c, inode, &page, last_block_size);
+			if (err)
+				break;
+			n = 1;
+		}
 
-		page.addr += PAGE_SIZE;
-		page.index++;
+		page.addr += n * PAGE_SIZE;
+		page.index += n;
 	}
 
 	if (err) {
@@ -994,11 +1065,14 @@ void ubifs_close(void)
 int ubifs_load(char *filename, unsigned long addr, u32 size)
 {
 	loff_t actread;
+	void *buf;
 	int err;
 
 	printf("Loading file '%s' to addr 0x%08lx...\n", filename, addr);
 
-	err = ubifs_read(filename, (void *)(uintptr_t)addr, 0, size, &actread);
+	buf = map_sysmem(addr, size);
+	err = ubifs_read(filename, buf, 0, size, &actread);
+	unmap_sysmem(buf);
 	if (err == 0) {
 		env_set_hex("filesize", actread);
 		printf("Done\n");
@@ -242,6 +242,29 @@ struct global_data {
 	 * @uclass_root_s.
 	 */
 	struct list_head *uclass_root;
+# if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/**
+	 * @dm_compat_index: index of the compatible strings of all drivers,
+	 * built when first needed
+	 */
+	struct dm_compat_index *dm_compat_index;
+# endif
+# if CONFIG_IS_ENABLED(OFNODE_CACHE)
+	/**
+	 * @ofnode_cache: nodes recently looked up in the control FDT, set up
+	 * when first needed
+	 */
+	struct ofnode_cache *ofnode_cache;
+	/**
+	 * @ofnode_cache_hits: number of lookups answered from @ofnode_cache
+	 */
+	uint ofnode_cache_hits;
+	/**
+	 * @ofnode_cache_misses: number of lookups which scanned the control
+	 * FDT
+	 */
+	uint ofnode_cache_misses;
+# endif
 # if CONFIG_IS_ENABLED(OF_PLATDATA_DRIVER_RT)
 	/** @dm_driver_rt: Dynamic info about the driver */
 	struct driver_rt *dm_driver_rt;
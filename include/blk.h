@@ -10,6 +10,7 @@
 #include <bouncebuf.h>
 #include <dm/uclass-id.h>
 #include <efi.h>
+#include <linux/list.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -80,6 +81,7 @@ struct blk_desc {
 		uint32_t mbr_sig;	/* MBR integer signature */
 		efi_guid_t guid_sig;	/* GPT GUID Signature */
 	};
+	uint		seq;		/* changes with contents, see blk_changed() */
 #if CONFIG_IS_ENABLED(BLK)
 	/*
 	 * For now we have a few functions which take struct blk_desc as a
@@ -140,6 +142,39 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_readahead() - get a buffer for reading ahead of a sequential stream
+ *
+ * This must be called after blkcache_read() has missed on the same request.
+ * When the device is being read sequentially in small pieces, the caller
+ * should read *@cntp blocks starting at @start into the returned buffer and
+ * then report the outcome with blkcache_readahead_done(), so that following
+ * reads can be served from memory.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number of the request that missed
+ * @param blkcnt - number of blocks in the request that missed
+ * @param blksz - size in bytes of each block
+ * @param cntp - returns the number of blocks to read ahead
+ *
+ * Return: DMA-aligned buffer to read into, or NULL if no readahead is wanted
+ */
+void *blkcache_readahead(int iftype, int dev,
+			 lbaint_t start, lbaint_t blkcnt,
+			 unsigned long blksz, lbaint_t *cntp);
+
+/**
+ * blkcache_readahead_done() - record the result of a readahead
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number that was read ahead
+ * @param cnt - number of blocks actually read, 0 on error
+ */
+void blkcache_readahead_done(int iftype, int dev, lbaint_t start,
+			     lbaint_t cnt);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
@@ -157,15 +192,28 @@ void blkcache_invalidate(int iftype, int dev);
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
+/**
+ * blkcache_configure_size() - configure block cache memory use
+ *
+ * @param max_size - maximum number of bytes held in cache entries
+ * @param ra_blocks - readahead window in blocks, 0 to disable readahead
+ */
+void blkcache_configure_size(unsigned long max_size, unsigned ra_blocks);
+
 /*
  * statistics of the block cache
  */
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
+	unsigned ra_hits; /* hits served from a readahead window */
+	unsigned readaheads; /* number of readahead transfers */
 	unsigned entries; /* current entry count */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
+	unsigned long size; /* bytes held in entries */
+	unsigned long max_size;
+	unsigned ra_blocks;
 };
 
 /**
@@ -191,6 +239,16 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline void *blkcache_readahead(int iftype, int dev,
+				       lbaint_t start, lbaint_t blkcnt,
+				       unsigned long blksz, lbaint_t *cntp)
+{
+	return NULL;
+}
+
+static inline void blkcache_readahead_done(int iftype, int dev,
+					   lbaint_t start, lbaint_t cnt) {}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 static inline void blkcache_free(void) {}
@@ -199,6 +257,71 @@ static inline void blkcache_free(void) {}
 
 struct udevice;
 
+/**
+ * enum blk_req_op - Operation carried out by a block request
+ *
+ * @BLK_REQ_READ: Read blocks into the buffers
+ * @BLK_REQ_WRITE: Write the buffers to the blocks
+ */
+enum blk_req_op {
+	BLK_REQ_READ,
+	BLK_REQ_WRITE,
+};
+
+/**
+ * struct blk_sg - One buffer of a block request
+ *
+ * @buf: Buffer
+ * @blkcnt: Number of blocks transferred to or from @buf
+ */
+struct blk_sg {
+	void *buf;
+	lbaint_t blkcnt;
+};
+
+/**
+ * struct blk_req - An asynchronous block request
+ *
+ * A request transfers consecutive blocks, starting at @start, to or from a
+ * list of buffers. It is set up with blk_req_init() and handed to
+ * blk_req_submit(), after which it belongs to the block device until @status
+ * is no longer -EINPROGRESS. Requests to the same device are carried out in
+ * the order they were submitted.
+ *
+ * @dev: Block device
+ * @op: Operation to carry out
+ * @start: First block to transfer
+ * @sg: Buffers, which are used in turn
+ * @sg_count: Number of entries in @sg
+ * @complete: Called once the request has finished, or NULL. This may submit
+ *	further requests.
+ * @priv: For use by the submitter
+ * @status: -EINPROGRESS until the request finishes, then 0 if all blocks were
+ *	transferred, else a -ve error
+ * @done: Number of blocks transferred so far
+ * @queued: Number of blocks handed to the driver so far (private to
+ *	blk_req_next())
+ * @sg_idx: Entry of @sg holding block @queued (private to blk_req_next())
+ * @sg_off: Position of block @queued within that entry, in blocks (private to
+ *	blk_req_next())
+ * @sibling: Node in the device's list of requests (private to the uclass)
+ */
+struct blk_req {
+	struct udevice *dev;
+	enum blk_req_op op;
+	lbaint_t start;
+	struct blk_sg *sg;
+	int sg_count;
+	void (*complete)(struct blk_req *req);
+	void *priv;
+	int status;
+	lbaint_t done;
+	lbaint_t queued;
+	int sg_idx;
+	lbaint_t sg_off;
+	struct list_head sibling;
+};
+
 /* Operations on block devices */
 struct blk_ops {
 	/**
@@ -258,6 +381,37 @@ struct blk_ops {
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	/**
+	 * submit() - start an asynchronous request
+	 *
+	 * This is optional. A device is given one request at a time. The
+	 * driver starts the transfer and returns without waiting for it. It
+	 * then moves the request along each time poll() is called, using
+	 * blk_req_next() to find the next piece to transfer, and calls
+	 * blk_req_complete() once the request has finished.
+	 *
+	 * @dev:	Block device
+	 * @req:	Request to start
+	 * @return 0 if started, -EAGAIN if the device cannot take a request
+	 * now and submit() should be tried again later, -ENOSYS if this
+	 * request must be carried out with read() or write() instead, or
+	 * other -ve on error
+	 */
+	int (*submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * poll() - move the current request along
+	 *
+	 * This must not wait for the hardware. It is required if submit() is
+	 * provided.
+	 *
+	 * @dev:	Block device
+	 * @req:	Request started by submit()
+	 */
+	void (*poll)(struct udevice *dev, struct blk_req *req);
+#endif
+
 #if IS_ENABLED(CONFIG_BOUNCE_BUFFER)
 	/**
 	 * buffer_aligned() - test memory alignment of block operation buffer
@@ -331,6 +485,112 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
  */
 long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt);
 
+/**
+ * blk_changed() - Note that the contents of a block device may have changed
+ *
+ * This gives @desc->seq a new value, so that anything which keeps state read
+ * from the device can tell that it may be out of date. It is called for every
+ * write and erase, and when a device is probed.
+ *
+ * @desc: Block device descriptor
+ */
+void blk_changed(struct blk_desc *desc);
+
+/**
+ * blk_req_init() - Set up an asynchronous block request
+ *
+ * The caller may set @req->complete and @req->priv afterwards.
+ *
+ * @req: Request to set up
+ * @dev: Block device to use
+ * @op: Operation to carry out
+ * @start: First block to transfer
+ * @sg: Buffers to transfer to or from, which must remain valid until the
+ *	request has finished
+ * @sg_count: Number of entries in @sg
+ */
+void blk_req_init(struct blk_req *req, struct udevice *dev,
+		  enum blk_req_op op, lbaint_t start, struct blk_sg *sg,
+		  int sg_count);
+
+/**
+ * blk_req_blkcnt() - Get the number of blocks in a request
+ *
+ * @req: Request
+ * Return: total number of blocks in the buffers of @req
+ */
+lbaint_t blk_req_blkcnt(const struct blk_req *req);
+
+/**
+ * blk_req_submit() - Queue an asynchronous block request
+ *
+ * The request is started as soon as the device is free. Devices which
+ * cannot carry out requests asynchronously run it to completion straight
+ * away, in which case @req->complete is called before this returns.
+ *
+ * @req: Request, set up by blk_req_init()
+ * Return: 0 if queued, or -ve on error, in which case @req is not used
+ */
+int blk_req_submit(struct blk_req *req);
+
+/**
+ * blk_req_poll() - Move the requests on a block device along
+ *
+ * This does not wait for the hardware, so can be called between other work,
+ * such as decompressing or hashing data which has already arrived.
+ *
+ * @dev: Block device
+ * Return: number of requests which have not finished yet, or -ENOSYS if a
+ * request is in progress but the driver does not provide poll()
+ */
+int blk_req_poll(struct udevice *dev);
+
+/**
+ * blk_req_wait() - Wait for a request to finish
+ *
+ * @req: Request which has been submitted
+ * Return: 0 if all its blocks were transferred, else -ve error
+ */
+int blk_req_wait(struct blk_req *req);
+
+/**
+ * blk_req_flush() - Wait for all requests on a device to finish
+ *
+ * This is done before each synchronous transfer, so that it is carried out
+ * after any requests submitted earlier. If the requests cannot be moved
+ * along, e.g. because the driver has no poll() method, they are completed
+ * with the error from blk_req_poll().
+ *
+ * @dev: Block device
+ */
+void blk_req_flush(struct udevice *dev);
+
+/**
+ * blk_req_next() - Take the next piece of a request, for use by drivers
+ *
+ * This returns the blocks which follow those taken by the previous call, as
+ * long as they are in the same buffer.
+ *
+ * @req: Request being carried out
+ * @max: Most blocks wanted
+ * @startp: Returns the first block of the piece
+ * @bufp: Returns the buffer for the piece
+ * Return: number of blocks in the piece, or 0 if all have been taken
+ */
+lbaint_t blk_req_next(struct blk_req *req, lbaint_t max, lbaint_t *startp,
+		      void **bufp);
+
+/**
+ * blk_req_complete() - Finish a request, for use by drivers
+ *
+ * This calls the request's completion function and starts the next request
+ * on the device, if any.
+ *
+ * @req: Request which has finished
+ * @status: 0 if all blocks were transferred, else -ve error
+ */
+void blk_req_complete(struct blk_req *req, int status);
+
 /**
  * blk_find_device() - Find a block device
  *
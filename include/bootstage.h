@@ -213,6 +213,12 @@ enum bootstage_id {
 	BOOTSTAGE_ID_ACCUM_FSP_M,
 	BOOTSTAGE_ID_ACCUM_FSP_S,
 	BOOTSTAGE_ID_ACCUM_MMAP_SPI,
+	BOOTSTAGE_ID_ACCUM_DM_COMPAT,
+	BOOTSTAGE_ID_ACCUM_SPL_FIT_READ,
+	BOOTSTAGE_ID_ACCUM_SPL_FIT_DECOMP,
+	BOOTSTAGE_ID_ACCUM_SPL_FIT_VERIFY,
+	BOOTSTAGE_ID_ACCUM_OF_INDEX,
+	BOOTSTAGE_ID_ACCUM_UBI_ATTACH,
 
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Streaming decompression into a fixed output buffer
+ */
+
+#ifndef __DECOMP_STREAM_H
+#define __DECOMP_STREAM_H
+
+#include <linux/types.h>
+
+struct decomp_stream_ops;
+
+/**
+ * struct decomp_stream - State of a decompression which is fed in pieces
+ *
+ * The compressed data is passed in with decomp_stream_write() as it arrives,
+ * in pieces of any size, and is unpacked straight into the output buffer. The
+ * output buffer serves as the decompressor's window, so the only extra memory
+ * needed is the algorithm's own state and, for block-based formats, one block.
+ *
+ * @comp:	Compression type (IH_COMP_...)
+ * @dst:	Output buffer
+ * @dst_size:	Size of output buffer in bytes
+ * @out:	Number of bytes written to @dst so far
+ * @done:	true once the end of the compressed data has been seen; any
+ *		data written after that is ignored
+ * @ops:	Operations for this compression type
+ * @priv:	Private state for this compression type
+ */
+struct decomp_stream {
+	int comp;
+	u8 *dst;
+	ulong dst_size;
+	ulong out;
+	bool done;
+	const struct decomp_stream_ops *ops;
+	void *priv;
+};
+
+/**
+ * decomp_stream_supported() - check whether a compression type can be streamed
+ *
+ * @comp:	Compression type (IH_COMP_...)
+ * Return: true if decomp_stream_init() can handle @comp
+ */
+bool decomp_stream_supported(int comp);
+
+/**
+ * decomp_stream_init() - start decompressing into a buffer
+ *
+ * Once this returns 0, decomp_stream_finish() must be called to release the
+ * state, whether or not the data turns out to be valid.
+ *
+ * @ds:		Stream to set up
+ * @comp:	Compression type (IH_COMP_...)
+ * @dst:	Output buffer
+ * @dst_size:	Size of output buffer in bytes
+ * Return: 0 if OK, -EPROTONOSUPPORT if @comp cannot be streamed, -ENOMEM if
+ *	out of memory
+ */
+int decomp_stream_init(struct decomp_stream *ds, int comp, void *dst,
+		       ulong dst_size);
+
+/**
+ * decomp_stream_write() - pass the next piece of compressed data
+ *
+ * @ds:		Stream to write to
+ * @src:	Compressed data
+ * @len:	Number of bytes at @src
+ * Return: 0 if OK, -ENOSPC if the output buffer is full, -EINVAL if the data
+ *	is corrupt, -EPROTONOSUPPORT if it uses a feature which is not supported
+ */
+int decomp_stream_write(struct decomp_stream *ds, const void *src, ulong len);
+
+/**
+ * decomp_stream_finish() - finish decompressing and release the state
+ *
+ * @ds:		Stream to finish
+ * @lenp:	Returns the number of bytes written to the output buffer, if
+ *		not NULL
+ * Return: 0 if the whole of the compressed data was seen, -ENOSPC if it stopped
+ *	because the output buffer was full, -EINVAL if it was truncated
+ */
+int decomp_stream_finish(struct decomp_stream *ds, ulong *lenp);
+
+#endif
@@ -23,6 +23,18 @@
  */
 void print_size(uint64_t size, const char *suffix);
 
+/**
+ * print_rate() - Print a transfer rate with a suffix
+ *
+ * Print the number of bytes moved per second in the same form as print_size(),
+ * e.g. "12.5 MiB/s", followed by an optional trailing string (like "\n")
+ *
+ * @bytes:	Number of bytes transferred
+ * @us:		Time taken in microseconds
+ * @suffix:	String to print after the rate
+ */
+void print_rate(uint64_t bytes, unsigned long us, const char *suffix);
+
 /**
  * print_freq() - Print a frequency with a suffix
  *
@@ -192,6 +192,42 @@ int device_of_to_plat(struct udevice *dev);
  */
 int device_probe(struct udevice *dev);
 
+#if CONFIG_IS_ENABLED(DM_ASYNC_PROBE)
+/**
+ * device_probe_async() - Probe a device, in the background if possible
+ *
+ * If the device's uclass has DM_UC_FLAG_ASYNC_PROBE set, the probe is run in
+ * a separate uthread, so that time spent waiting on hardware (e.g. in
+ * udelay()) can be used to probe other devices. Otherwise the device is
+ * probed immediately, as with device_probe().
+ *
+ * A later device_probe() on the same device waits for the background probe
+ * to complete. Use dm_probe_join() to wait for all of them.
+ *
+ * @dev: Pointer to device to probe
+ * Return: 0 if OK or the probe was started in the background, -ve on error
+ */
+int device_probe_async(struct udevice *dev);
+
+/**
+ * dm_probe_join() - Wait for all background probes to complete
+ *
+ * Return: 0 if OK, else the error from the first background probe which
+ * failed since the last call
+ */
+int dm_probe_join(void);
+#else
+static inline int device_probe_async(struct udevice *dev)
+{
+	return device_probe(dev);
+}
+
+static inline int dm_probe_join(void)
+{
+	return 0;
+}
+#endif
+
 /**
  * device_remove() - Remove a device, de-activating it
  *
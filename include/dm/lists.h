@@ -12,6 +12,8 @@
 #include <dm/ofnode.h>
 #include <dm/uclass-id.h>
 
+struct udevice_id;
+
 /**
  * lists_driver_lookup_name() - Return u_boot_driver corresponding to name
  *
@@ -64,6 +66,22 @@ int lists_bind_drivers(struct udevice *parent, bool pre_reloc_only);
 int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		   struct driver *drv, bool pre_reloc_only);
 
+/**
+ * lists_driver_lookup_compat() - find the next driver for a compatible string
+ *
+ * Drivers are returned in the order of the driver linker list, which is the
+ * order in which lists_bind_fdt() tries them. With CONFIG_DM_COMPAT_INDEX an
+ * index of all compatible strings is used, rather than checking each driver.
+ *
+ * @compat:	Compatible string to look up
+ * @drvp:	On entry, the driver to search after, or a pointer to NULL to
+ *		start at the beginning. Returns the driver found
+ * @idp:	Returns the matching entry in the driver's of_match table
+ * Return: 0 if found, -ENOENT if there are no more drivers which match
+ */
+int lists_driver_lookup_compat(const char *compat, struct driver **drvp,
+			       const struct udevice_id **idp);
+
 /**
  * device_bind_driver() - bind a device to a driver
  *
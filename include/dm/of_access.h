@@ -266,6 +266,29 @@ struct device_node *of_find_node_by_prop_value(struct device_node *from,
 struct device_node *of_find_node_by_phandle(struct device_node *root,
 					    phandle handle);
 
+/**
+ * of_index_build() - Build the lookup tables for a live tree
+ *
+ * This records every node in the tree which has a phandle, so that
+ * of_find_node_by_phandle() does not have to walk the tree, and sets up an
+ * empty cache for of_find_node_opts_by_path(). A few trees can be indexed at
+ * once; when there is no room, the index of another tree is dropped, but
+ * never that of the control tree.
+ *
+ * @root:	Root node of the tree
+ * Return: 0 if OK, -EINVAL if @root is NULL, -ENOMEM if out of memory
+ */
+int of_index_build(struct device_node *root);
+
+/**
+ * of_index_drop() - Drop the lookup tables for a live tree
+ *
+ * This must be called before a tree which has been indexed is freed.
+ *
+ * @root:	Root node of the tree (NULL does nothing)
+ */
+void of_index_drop(struct device_node *root);
+
 /**
  * of_read_u8() - Find and read a 8-bit integer from a property
  *
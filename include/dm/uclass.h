@@ -47,6 +47,9 @@ struct udevice;
 /* Members of this uclass without aliases don't get a sequence number */
 #define DM_UC_FLAG_NO_AUTO_SEQ			(1 << 1)
 
+/* Members of this uclass may be probed in the background, see DM_ASYNC_PROBE */
+#define DM_UC_FLAG_ASYNC_PROBE			(1 << 2)
+
 /* Same as DM_FLAG_ALLOC_PRIV_DMA */
 #define DM_UC_FLAG_ALLOC_PRIV_DMA		(1 << 5)
 
@@ -31,11 +31,15 @@
 
 struct disk_partition;
 
+#define EXT4_ENCRYPT_FL		0x00000800 /* Encrypted inode */
 #define EXT4_INDEX_FL		0x00001000 /* Inode uses hash tree index */
 #define EXT4_TOPDIR_FL		0x00020000 /* Top of directory hierarchies*/
 #define EXT4_EXTENTS_FL		0x00080000 /* Inode uses extents */
+#define EXT4_CASEFOLD_FL	0x40000000 /* Casefolded directory */
 #define EXT4_EXT_MAGIC			0xf30a
 
+#define EXT4_FEATURE_COMPAT_DIR_INDEX	0x0020
+
 #define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER  0x0001
 #define EXT4_FEATURE_RO_COMPAT_LARGE_FILE    0x0002
 #define EXT4_FEATURE_RO_COMPAT_BTREE_DIR     0x0004
@@ -56,6 +60,10 @@ struct disk_partition;
 #define EXT4_FEATURE_INCOMPAT_CSUM_SEED 0x2000
 #define EXT4_FEATURE_INCOMPAT_ENCRYPT   0x10000
 
+/* Superblock flags */
+#define EXT2_FLAGS_SIGNED_HASH		0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
 #define EXT4_INDIRECT_BLOCKS		12
 
 /*
@@ -207,9 +215,63 @@ int ext4fs_exists(const char *filename);
 int ext4fs_size(const char *filename, loff_t *size);
 void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot);
 int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf);
+
+#if CONFIG_IS_ENABLED(EXT4_CACHE)
+/**
+ * ext4fs_devread_cached() - read filesystem metadata through the block cache
+ *
+ * This behaves like ext4fs_devread(), but reads which lie within one
+ * filesystem block are served from the metadata cache, reading the whole
+ * block into it first if needed. Other reads go straight to the device.
+ *
+ * @sector:	Sector to read from, relative to the partition
+ * @byte_offset: Byte offset to start at within the sector
+ * @byte_len:	Number of bytes to read
+ * @buf:	Buffer to read into
+ * Return: 1 if OK, 0 on error
+ */
+int ext4fs_devread_cached(lbaint_t sector, int byte_offset, int byte_len,
+			  char *buf);
+
+/**
+ * ext4fs_cache_drop() - empty the metadata block cache
+ *
+ * This must be called whenever the filesystem is written or another
+ * filesystem is used.
+ */
+void ext4fs_cache_drop(void);
+#else
+static inline int ext4fs_devread_cached(lbaint_t sector, int byte_offset,
+					int byte_len, char *buf)
+{
+	return ext4fs_devread(sector, byte_offset, byte_len, buf);
+}
+
+static inline void ext4fs_cache_drop(void)
+{
+}
+#endif
+
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info);
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache);
+
+/**
+ * read_allocated_run() - find where a run of file blocks is stored
+ *
+ * For files using extents this also reports how many of the following
+ * blocks are stored straight after @fileblock (or are holes, like it), so
+ * that the caller can read them in one go. Other files give one block at a
+ * time.
+ *
+ * @inode:	Inode of the file
+ * @fileblock:	File block to look up
+ * @count:	Returns the number of blocks in the run, at least 1
+ * @cache:	Cache for extent tree blocks, or NULL
+ * Return: disk block holding @fileblock, 0 for a hole, or -ve on error
+ */
+long int read_allocated_run(struct ext2_inode *inode, int fileblock,
+			    int *count, struct ext_block_cache *cache);
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 struct disk_partition *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
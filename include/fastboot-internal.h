@@ -18,6 +18,13 @@ extern u32 fastboot_buf_size;
  */
 extern void (*fastboot_progress_callback)(const char *msg);
 
+struct sparse_stats;
+
+/**
+ * fastboot_sparse_stats - time spent writing the last sparse image
+ */
+extern struct sparse_stats fastboot_sparse_stats;
+
 /**
  * fastboot_getvar_all() - Writes current variable being listed from "all" to response.
  *
@@ -40,4 +47,71 @@ void fastboot_getvar_all(char *response);
  */
 void fastboot_getvar(char *cmd_parameter, char *response);
 
+/**
+ * FASTBOOT_STREAM_MAX_SIZE - largest download which can be written as it
+ * arrives
+ */
+#define FASTBOOT_STREAM_MAX_SIZE	0xfffff000
+
+/**
+ * fastboot_stream_select() - Choose a partition to write downloads to as they
+ * arrive
+ *
+ * @part_name: Name of partition, or NULL or "" to go back to collecting
+ *	       downloads in the download buffer
+ * @response: Pointer to fastboot response buffer
+ */
+void fastboot_stream_select(const char *part_name, char *response);
+
+/**
+ * fastboot_stream_selected() - Check whether downloads are to be streamed
+ *
+ * Return: true if a partition has been chosen with fastboot_stream_select()
+ */
+bool fastboot_stream_selected(void);
+
+/**
+ * fastboot_stream_active() - Check whether a download is being streamed
+ *
+ * Return: true between fastboot_stream_start() and fastboot_stream_complete()
+ */
+bool fastboot_stream_active(void);
+
+/**
+ * fastboot_stream_start() - Start writing a download to the chosen partition
+ *
+ * @size: Size of the download in bytes
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_stream_start(u32 size, char *response);
+
+/**
+ * fastboot_stream_data() - Add the next piece of a streamed download
+ *
+ * The data is copied into the ring of slots in the download buffer. If all
+ * the slots are full, the oldest is written out first.
+ *
+ * @data: Received data
+ * @len: Number of bytes at @data
+ */
+void fastboot_stream_data(const void *data, u32 len);
+
+/**
+ * fastboot_stream_complete() - Write the rest of a streamed download
+ *
+ * The result is kept for fastboot_stream_flash()
+ */
+void fastboot_stream_complete(void);
+
+/**
+ * fastboot_stream_flash() - Report the result of a streamed download
+ *
+ * @part_name: Partition named in the 'flash' command
+ * @response: Pointer to fastboot response buffer
+ * Return: true if the last download was streamed, in which case @response
+ *	   holds its result, false if the download buffer should be flashed
+ */
+bool fastboot_stream_flash(const char *part_name, char *response);
+
 #endif
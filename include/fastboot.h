@@ -51,6 +51,7 @@ enum {
 	FASTBOOT_COMMAND_OEM_RUN,
 	FASTBOOT_COMMAND_OEM_CONSOLE,
 	FASTBOOT_COMMAND_OEM_BOARD,
+	FASTBOOT_COMMAND_OEM_STREAM,
 	FASTBOOT_COMMAND_ACMD,
 	FASTBOOT_COMMAND_UCMD,
 	FASTBOOT_COMMAND_COUNT
@@ -186,6 +187,15 @@ void fastboot_data_download(const void *fastboot_data,
  */
 void fastboot_data_complete(char *response);
 
+/**
+ * fastboot_stream_poll() - Write out some of a download which is streamed
+ *
+ * Transports call this between transfers, so that writing the download to
+ * flash overlaps with receiving it. It does nothing unless a download is
+ * being streamed and has a full slot waiting.
+ */
+void fastboot_stream_poll(void);
+
 /**
  * fastboot_handle_multiresponse() - Called for each response to send
  *
@@ -102,4 +102,41 @@ void fastboot_block_write_sparse_image(struct blk_desc *dev_desc, struct disk_pa
 void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 				u32 download_bytes, char *response);
 
+/**
+ * fastboot_block_stream_open() - Start writing an image to a partition as it
+ * is downloaded
+ *
+ * The image is passed in with fastboot_block_stream_write() and may be raw or
+ * sparse, which is decided from its first bytes.
+ *
+ * @dev_desc: Block device we're going write to
+ * @info: Partition we're going write to
+ * @part_name: Name of partition we're going write to
+ * @size: Size of the image in bytes
+ */
+void fastboot_block_stream_open(struct blk_desc *dev_desc, struct disk_partition *info,
+				const char *part_name, u32 size);
+
+/**
+ * fastboot_block_stream_write() - Write the next piece of a streamed image
+ *
+ * Each piece must be a whole number of blocks long, except the last.
+ *
+ * @data: Next piece of the image
+ * @len: Number of bytes at @data
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_block_stream_write(const void *data, u32 len, char *response);
+
+/**
+ * fastboot_block_stream_close() - Finish writing a streamed image
+ *
+ * This must be called once the image is complete, even if a write failed.
+ *
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 if the whole image was written, -ve on error
+ */
+int fastboot_block_stream_close(char *response);
+
 #endif // _FB_BLOCK_H_
@@ -22,6 +22,19 @@ int fastboot_mmc_get_part_info(const char *part_name,
 			       struct disk_partition *part_info,
 			       char *response);
 
+/**
+ * fastboot_mmc_zero_erase_align() - Check whether erasing clears MMC to zero
+ *
+ * Erased blocks read back as zeroes on SD cards with the SCR
+ * DATA_STAT_AFTER_ERASE bit clear and on eMMC with ERASED_MEM_CONT clear.
+ *
+ * @dev_desc: Block device of the SD card or eMMC
+ * Return: number of blocks which an erase must be aligned to, so as not to
+ *	   touch the blocks around it, or 0 if erased blocks do not read back
+ *	   as zeroes
+ */
+u32 fastboot_mmc_zero_erase_align(struct blk_desc *dev_desc);
+
 /**
  * fastboot_mmc_flash_write() - Write image to eMMC for fastboot
  *
@@ -88,9 +88,32 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  * Many file functions implicitly call fs_close(), e.g. fs_closedir(),
  * fs_exist(), fs_ln(), fs_ls(), fs_mkdir(), fs_read(), fs_size(), fs_write(),
  * fs_unlink(), fs_rename().
+ *
+ * With CONFIG_FS_MOUNT_CACHE, a filesystem on a block device is left mounted,
+ * so that the next fs_set_blk_dev() for the same partition does not need to
+ * probe it again. It is closed when the device is written to or removed, or
+ * when the same filesystem driver is probed on another partition.
  */
 void fs_close(void);
 
+/**
+ * fs_close_all() - Close any filesystems which fs_close() left mounted
+ *
+ * This must be called before using a filesystem driver directly instead of
+ * through fs_set_blk_dev(), e.g. by calling fat_set_blk_dev(), since that
+ * replaces the driver's state.
+ */
+void fs_close_all(void);
+
+/**
+ * fs_mount_stats() - Get statistics for filesystems left mounted
+ *
+ * @hits: Returns the number of times a filesystem was used without probing
+ * @probes: Returns the number of times a filesystem driver was probed
+ * Return: number of filesystems which are mounted now
+ */
+int fs_mount_stats(ulong *hits, ulong *probes);
+
 /**
  * fs_get_type() - Get type of current filesystem
  *
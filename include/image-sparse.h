@@ -7,10 +7,60 @@
 #include <part.h>
 #include <sparse_format.h>
 
-#define FASTBOOT_MAX_BLK_WRITE 16384
-
 #define ROUNDUP(x, y)	(((x) + ((y) - 1)) & ~((y) - 1))
 
+/* Types of work counted in struct sparse_stats */
+enum sparse_stat_type {
+	SPARSE_STAT_RAW,
+	SPARSE_STAT_FILL,
+	SPARSE_STAT_ZERO,
+	SPARSE_STAT_DONT_CARE,
+
+	SPARSE_STAT_COUNT,
+};
+
+/**
+ * struct sparse_stat - Time spent on one type of sparse chunk
+ *
+ * @chunks:	Number of chunks
+ * @bytes:	Number of bytes covered by those chunks
+ * @us:		Time spent writing them, in microseconds
+ */
+struct sparse_stat {
+	uint chunks;
+	u64 bytes;
+	ulong us;
+};
+
+/**
+ * struct sparse_stats - Where the time went when writing a sparse image
+ *
+ * Fill chunks with a value of zero are counted separately, as they may be
+ * erased rather than written.
+ *
+ * @stat:	Statistics for each enum sparse_stat_type
+ */
+struct sparse_stats {
+	struct sparse_stat stat[SPARSE_STAT_COUNT];
+};
+
+/**
+ * struct sparse_storage - Storage which a sparse image is written to
+ *
+ * @blksz:	Block size of the storage
+ * @start:	First block to write
+ * @size:	Number of blocks available
+ * @priv:	Private data for the callbacks
+ * @write:	Write blocks, returning the number of blocks used
+ * @reserve:	Skip blocks, returning the number of blocks used
+ * @erase:	Clear blocks so that they read back as zeroes, without
+ *		sending the data, returning the number of blocks cleared. This
+ *		is optional and is used for fill chunks with a value of zero.
+ *		The range is always aligned to @erase_align.
+ * @erase_align: Number of blocks which @erase works in, or 0 to disable it
+ * @mssg:	Report an error
+ * @stats:	Statistics to add to, or NULL
+ */
 struct sparse_storage {
 	lbaint_t	blksz;
 	lbaint_t	start;
@@ -26,7 +76,14 @@ struct sparse_storage {
 				 lbaint_t blk,
 				 lbaint_t blkcnt);
 
+	lbaint_t	(*erase)(struct sparse_storage *info,
+				 lbaint_t blk,
+				 lbaint_t blkcnt);
+	u32		erase_align;
+
 	void		(*mssg)(const char *str, char *response);
+
+	struct sparse_stats *stats;
 };
 
 static inline int is_sparse_image(void *buf)
@@ -40,5 +97,93 @@ static inline int is_sparse_image(void *buf)
 	return 0;
 }
 
+/**
+ * struct sparse_stream - State of a sparse image which is written in pieces
+ *
+ * The image is passed in with sparse_stream_write() as it arrives, in pieces
+ * of any size, so it never needs to be held in memory as a whole. Raw data is
+ * gathered into a buffer of CONFIG_IMAGE_SPARSE_WRITE_SIZE bytes, so that
+ * small pieces and adjacent raw chunks are written in large requests.
+ *
+ * @info:	Storage to write to
+ * @state:	What the next bytes of the image hold (enum sparse_stream_state)
+ * @header:	Sparse image header
+ * @chunk:	Header of the current chunk
+ * @hdr_len:	Number of bytes of the current header or value seen so far
+ * @chunk_num:	Number of the current chunk
+ * @remain:	Number of raw data bytes left in the current chunk
+ * @blk:	Next storage block to write
+ * @blkcnt:	Number of storage blocks in the current chunk
+ * @fill_val:	Fill value of the current chunk
+ * @total_blocks: Number of sparse blocks covered so far
+ * @bytes_written: Number of bytes written to the storage so far
+ * @raw_buf:	Raw data waiting to be written, starting at block @blk
+ * @raw_size:	Size of @raw_buf in bytes
+ * @raw_len:	Number of bytes in @raw_buf
+ * @fill_buf:	Pattern buffer for fill chunks
+ * @fill_blks:	Size of @fill_buf in blocks
+ * @fill_buf_val: Value which @fill_buf holds
+ * @no_erase:	true if the storage's erase() has failed, so is not used again
+ * @err:	Error which stopped the write, or 0
+ */
+struct sparse_stream {
+	struct sparse_storage *info;
+	int state;
+	sparse_header_t header;
+	chunk_header_t chunk;
+	uint hdr_len;
+	uint chunk_num;
+	u64 remain;
+	lbaint_t blk;
+	lbaint_t blkcnt;
+	u32 fill_val;
+	u32 total_blocks;
+	u64 bytes_written;
+	u8 *raw_buf;
+	ulong raw_size;
+	ulong raw_len;
+	uint32_t *fill_buf;
+	int fill_blks;
+	u32 fill_buf_val;
+	bool no_erase;
+	int err;
+};
+
+/**
+ * sparse_stream_init() - start writing a sparse image which arrives in pieces
+ *
+ * sparse_stream_finish() must be called at the end, whether or not the write
+ * works, to release the state.
+ *
+ * @ss:		Stream to set up
+ * @info:	Storage to write to
+ */
+void sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info);
+
+/**
+ * sparse_stream_write() - pass the next piece of a sparse image
+ *
+ * Any data after the last chunk of the image is ignored.
+ *
+ * @ss:		Stream to write to
+ * @data:	Next piece of the image
+ * @len:	Number of bytes at @data
+ * @response:	Message buffer passed to the storage's mssg() on error
+ * Return: 0 if OK, -ve on error, in which case all later writes fail too
+ */
+int sparse_stream_write(struct sparse_stream *ss, const void *data, ulong len,
+			char *response);
+
+/**
+ * sparse_stream_finish() - finish writing a sparse image
+ *
+ * @ss:		Stream to finish
+ * @part_name:	Name of the partition, for messages
+ * @response:	Message buffer passed to the storage's mssg() on error
+ * Return: 0 if the whole image was written, -ve on error
+ */
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response);
+
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
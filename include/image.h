@@ -1262,6 +1262,7 @@ int fit_get_data_conf_prop(const void *fit, const char *prop_name,
 int fit_image_hash_get_algo(const void *fit, int noffset, const char **algo);
 int fit_image_hash_get_value(const void *fit, int noffset, uint8_t **value,
 				int *value_len);
+int fit_image_hash_get_ignore(const void *fit, int noffset, int *ignore);
 
 int fit_set_timestamp(void *fit, int noffset, time_t timestamp);
 
@@ -1355,6 +1356,136 @@ static inline int fit_config_verify(const void *fit, int conf_noffset)
 }
 #endif
 int fit_all_image_verify(const void *fit);
+
+/**
+ * struct fit_stream - Source of an external-data FIT which is not in memory
+ *
+ * @read:	Read part of the FIT
+ *		@stream: This stream
+ *		@offset: Byte offset from the start of the FIT
+ *		@size: Number of bytes to read
+ *		@buf: Buffer for the data
+ *		Returns: number of bytes read, or -ve on error
+ * @priv:	Private data for @read
+ * @chunk_size:	Number of bytes to read and hash at a time, or 0 for the
+ *		default (CONFIG_FIT_STREAM_CHUNK_SIZE)
+ */
+struct fit_stream {
+	long (*read)(struct fit_stream *stream, ulong offset, ulong size,
+		     void *buf);
+	void *priv;
+	ulong chunk_size;
+};
+
+/**
+ * fit_stream_read_header() - Read the FDT part of a FIT from a stream
+ *
+ * @stream:	Source of the FIT
+ * @fitp:	Returns the FIT header, allocated with malloc()
+ * Return: 0 if OK, -EINVAL if this is not a FIT, other -ve on error
+ */
+int fit_stream_read_header(struct fit_stream *stream, void **fitp);
+
+/**
+ * fit_image_load_stream() - Read, verify and unpack an external-data image
+ *
+ * The image data is read from @stream in chunks, each of which is added to
+ * the image's hashes as soon as it arrives, so the data is only read once.
+ * Uncompressed data is read straight into @dst. With CONFIG_DECOMP_STREAM,
+ * compressed data is unpacked into @dst a chunk at a time, unless the image
+ * is signed: signatures are checked before anything is decompressed, so a
+ * signed image is collected in memory first. If this fails, the contents of
+ * @dst are undefined.
+ *
+ * @stream:	Source of the FIT
+ * @fit:	FIT header, as read by fit_stream_read_header()
+ * @noffset:	Image node to load
+ * @dst:	Where to put the image
+ * @dst_size:	Space available at @dst
+ * @lenp:	Returns the number of bytes written to @dst
+ * Return: 0 if OK, -ENOENT if the image does not have external data,
+ *	-EBADMSG if a hash is wrong, -EPERM if a required signature does not
+ *	verify, other -ve on error
+ */
+int fit_image_load_stream(struct fit_stream *stream, const void *fit,
+			  int noffset, void *dst, ulong dst_size, ulong *lenp);
+
+/* Most images have one or two hashes */
+#define FIT_STREAM_MAX_HASHES	4
+
+/**
+ * struct fit_stream_hash - A hash being calculated for an image
+ *
+ * @noffset:	Offset of the hash node
+ * @algo:	Hash algorithm
+ * @ctx:	Context for progressive hashing
+ */
+struct fit_stream_hash {
+	int noffset;
+	struct hash_algo *algo;
+	void *ctx;
+};
+
+/**
+ * fit_stream_start_hashes() - Set up the hashes for an image
+ *
+ * This is for loaders which read an image in pieces themselves, rather than
+ * through fit_image_load_stream().
+ *
+ * @fit:	FIT header
+ * @noffset:	Image node
+ * @hashes:	Hashes to set up, FIT_STREAM_MAX_HASHES of them
+ * Return: number of hashes, or -ve on error
+ */
+int fit_stream_start_hashes(const void *fit, int noffset,
+			    struct fit_stream_hash *hashes);
+
+/**
+ * fit_stream_update_hashes() - Add the next piece of an image to its hashes
+ *
+ * @hashes:	Hashes to update
+ * @count:	Number of hashes
+ * @buf:	Image data
+ * @len:	Number of bytes at @buf
+ * @last:	true if this is the last piece of the image
+ * Return: 0 if OK, -EINVAL on error
+ */
+int fit_stream_update_hashes(struct fit_stream_hash *hashes, int count,
+			     const void *buf, ulong len, bool last);
+
+/**
+ * fit_stream_check_hashes() - Finish the hashes and check them
+ *
+ * This prints each hash algorithm followed by '+' or '-'.
+ *
+ * @fit:	FIT header
+ * @hashes:	Hashes to check
+ * @count:	Number of hashes
+ * Return: 0 if all are correct, -EBADMSG if not
+ */
+int fit_stream_check_hashes(const void *fit, struct fit_stream_hash *hashes,
+			    int count);
+
+/**
+ * fit_stream_abort_hashes() - Free the contexts of hashes which are not needed
+ *
+ * @hashes:	Hashes to drop
+ * @count:	Number of hashes
+ */
+void fit_stream_abort_hashes(struct fit_stream_hash *hashes, int count);
+
+/**
+ * fit_stream_has_sigs() - Check whether an image is signed
+ *
+ * Image signatures cover the compressed data, so a signed image must be
+ * collected in full and checked before it is decompressed.
+ *
+ * @fit:	FIT header
+ * @noffset:	Image node
+ * Return: true if the image has signatures which will be checked
+ */
+bool fit_stream_has_sigs(const void *fit, int noffset);
+
 int fit_config_decrypt(const void *fit, int conf_noffset);
 int fit_image_check_os(const void *fit, int noffset, uint8_t os);
 int fit_image_check_arch(const void *fit, int noffset, uint8_t arch);
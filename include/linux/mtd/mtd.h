@@ -469,6 +469,7 @@ int mtd_unlock(struct mtd_info *mtd, loff_t ofs, uint64_t len);
 int mtd_is_locked(struct mtd_info *mtd, loff_t ofs, uint64_t len);
 int mtd_block_isreserved(struct mtd_info *mtd, loff_t ofs);
 int mtd_block_isbad(struct mtd_info *mtd, loff_t ofs);
+int mtd_block_good_run(struct mtd_info *mtd, loff_t *ofs, u64 len, u64 *run);
 int mtd_block_markbad(struct mtd_info *mtd, loff_t ofs);
 
 #ifndef __UBOOT__
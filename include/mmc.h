@@ -74,6 +74,7 @@ struct bd_info;
 #define MMC_MODE_SPI		BIT(27)
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_DATA_STAT_AFTER_ERASE	0x00800000
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -228,6 +229,7 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define EXT_CSD_ERASE_GROUP_DEF		175	/* R/W */
 #define EXT_CSD_BOOT_BUS_WIDTH		177
 #define EXT_CSD_PART_CONF		179	/* R/W */
+#define EXT_CSD_ERASED_MEM_CONT		181	/* RO */
 #define EXT_CSD_BUS_WIDTH		183	/* R/W */
 #define EXT_CSD_STROBE_SUPPORT		184	/* R/W */
 #define EXT_CSD_HS_TIMING		185	/* R/W */
@@ -573,6 +575,38 @@ struct dm_mmc_ops {
 	 * @return 0 if success, -ve on error
 	 */
 	int (*hs400_prepare_ddr)(struct udevice *dev);
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	/**
+	 * start_data() - Send a command which transfers data, without waiting
+	 *		  for the data
+	 *
+	 * This is optional. The command is sent and its response checked as
+	 * with send_cmd(), but the data is moved in the background, after
+	 * which poll_data() is called until the transfer has finished. No
+	 * other command is sent in the meantime.
+	 *
+	 * @dev:	Device to receive the command
+	 * @cmd:	Command to send
+	 * @data:	Data to send/receive
+	 * @return 0 if OK, -ENOSYS if the transfer must be made with
+	 * send_cmd() instead (nothing has been sent), other -ve on error
+	 */
+	int (*start_data)(struct udevice *dev, struct mmc_cmd *cmd,
+			  struct mmc_data *data);
+
+	/**
+	 * poll_data() - Check on a transfer started by start_data()
+	 *
+	 * This must not wait for the transfer.
+	 *
+	 * @dev:	Device making the transfer
+	 * @data:	Data being transferred
+	 * @return 0 if finished, -EBUSY if still in progress, other -ve on
+	 * error
+	 */
+	int (*poll_data)(struct udevice *dev, struct mmc_data *data);
+#endif
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -773,6 +807,10 @@ struct mmc {
 	u32 quirks;
 	bool tuning:1;
 	bool hs400_tuning:1;
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	struct mmc_data async_data;	/* piece of the block request in flight */
+	uint async_b_max;	/* most blocks in each piece of the request */
+#endif
 
 	enum bus_mode user_speed_mode; /* input speed mode from user */
 
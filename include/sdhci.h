@@ -365,6 +365,10 @@ struct sdhci_host {
 #if CONFIG_IS_ENABLED(MMC_SDHCI_ADMA)
 	struct sdhci_adma_desc *adma_desc_table;
 #endif
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	bool defer_data;	/* leave the data transfer to poll_data() */
+	ulong data_start;	/* time the deferred transfer started */
+#endif
 };
 
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
@@ -325,6 +325,7 @@ static inline void *spl_image_fdt_addr(struct spl_image_info *info)
 #endif
 }
 
+struct blk_desc;
 struct spl_load_info;
 
 /**
@@ -349,6 +350,10 @@ typedef ulong (*spl_load_reader)(struct spl_load_info *load, ulong sector,
  * @bl_len: Block length for reading in bytes
  * @phase: Image phase to load
  * @no_fdt_update: true to update the FDT with any loadables that are loaded
+ * @blk_desc: Block device which @read reads from, with offsets counted in
+ *	      bytes from the start of the device, or NULL. When set, reads may
+ *	      be submitted as asynchronous block requests, so that they overlap
+ *	      with decompressing data which has already arrived
  */
 struct spl_load_info {
 	spl_load_reader read;
@@ -360,6 +365,9 @@ struct spl_load_info {
 	u8 phase;
 	u8 fdt_update;
 #endif
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	struct blk_desc *blk_desc;
+#endif
 };
 
 static inline int spl_get_bl_len(struct spl_load_info *info)
@@ -415,6 +423,23 @@ static inline enum image_phase_t xpl_get_fdt_update(struct spl_load_info *info)
 #endif
 }
 
+static inline void spl_load_set_blk_desc(struct spl_load_info *info,
+					 struct blk_desc *blk_desc)
+{
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	info->blk_desc = blk_desc;
+#endif
+}
+
+static inline struct blk_desc *spl_load_get_blk_desc(struct spl_load_info *info)
+{
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	return info->blk_desc;
+#else
+	return NULL;
+#endif
+}
+
 /**
  * spl_load_init() - Set up a new spl_load_info structure
  */
@@ -427,6 +452,7 @@ static inline void spl_load_init(struct spl_load_info *load,
 	spl_set_bl_len(load, bl_len);
 	xpl_set_phase(load, IH_PHASE_NONE);
 	xpl_set_fdt_update(load, true);
+	spl_load_set_blk_desc(load, NULL);
 }
 
 /*
@@ -0,0 +1,644 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Streaming decompression into a fixed output buffer
+ *
+ * Each algorithm is given the compressed data in whatever pieces the caller
+ * has to hand and writes straight into the output buffer, which also serves as
+ * its history window. This avoids holding the whole of the compressed data in
+ * memory next to the output, as image_decomp() requires.
+ */
+
+#define LOG_CATEGORY LOGC_BOOT
+
+#include <bzlib.h>
+#include <decomp_stream.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/unaligned.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <linux/zstd.h>
+#include <u-boot/lz4.h>
+#include <u-boot/zlib.h>
+
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+
+/**
+ * struct decomp_stream_ops - Operations for one compression type
+ *
+ * @comp:	Compression type (IH_COMP_...)
+ * @init:	Set up @ds->priv, returning 0 or -ve error
+ * @write:	Decompress as much of @src as possible, updating @ds->out and
+ *		@ds->done. Returns the number of bytes of @src consumed, or -ve
+ *		error
+ * @release:	Release @ds->priv
+ */
+struct decomp_stream_ops {
+	int comp;
+	int (*init)(struct decomp_stream *ds);
+	long (*write)(struct decomp_stream *ds, const u8 *src, ulong len);
+	void (*release)(struct decomp_stream *ds);
+};
+
+/* Space left in the output buffer, limited for APIs with 32-bit counts */
+static __maybe_unused uint decomp_stream_space(struct decomp_stream *ds)
+{
+	return min(ds->dst_size - ds->out, (ulong)UINT_MAX);
+}
+
+#if CONFIG_IS_ENABLED(GZIP)
+static int gzip_stream_init(struct decomp_stream *ds)
+{
+	z_stream *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+	s->zalloc = gzalloc;
+	s->zfree = gzfree;
+
+	/* let zlib deal with the gzip header and trailer */
+	if (inflateInit2(s, 16 + MAX_WBITS) != Z_OK) {
+		free(s);
+		return -ENOMEM;
+	}
+	ds->priv = s;
+
+	return 0;
+}
+
+static long gzip_stream_write(struct decomp_stream *ds, const u8 *src,
+			      ulong len)
+{
+	z_stream *s = ds->priv;
+	int ret;
+
+	s->next_in = (u8 *)src;
+	s->avail_in = min(len, (ulong)UINT_MAX);
+	s->next_out = ds->dst + ds->out;
+	s->avail_out = decomp_stream_space(ds);
+	ret = inflate(s, Z_NO_FLUSH);
+	ds->out = s->next_out - ds->dst;
+	if (ret == Z_STREAM_END)
+		ds->done = true;
+	else if (ret != Z_OK && ret != Z_BUF_ERROR)
+		return log_msg_ret("inf", -EINVAL);
+
+	return s->next_in - src;
+}
+
+static void gzip_stream_free(struct decomp_stream *ds)
+{
+	inflateEnd(ds->priv);
+	free(ds->priv);
+}
+#endif
+
+#if CONFIG_IS_ENABLED(BZIP2)
+static int bzip2_stream_init(struct decomp_stream *ds)
+{
+	bz_stream *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+
+	/* use the slower, smaller decoder if malloc() space is tight */
+	if (BZ2_bzDecompressInit(s, 0,
+				 CONFIG_SYS_MALLOC_LEN < 4096 * 1024) != BZ_OK) {
+		free(s);
+		return -ENOMEM;
+	}
+	ds->priv = s;
+
+	return 0;
+}
+
+static long bzip2_stream_write(struct decomp_stream *ds, const u8 *src,
+			       ulong len)
+{
+	bz_stream *s = ds->priv;
+	int ret;
+
+	s->next_in = (char *)src;
+	s->avail_in = min(len, (ulong)UINT_MAX);
+	s->next_out = (char *)ds->dst + ds->out;
+	s->avail_out = decomp_stream_space(ds);
+	ret = BZ2_bzDecompress(s);
+	ds->out = (u8 *)s->next_out - ds->dst;
+	if (ret == BZ_STREAM_END)
+		ds->done = true;
+	else if (ret != BZ_OK)
+		return log_msg_ret("bz", -EINVAL);
+
+	return (u8 *)s->next_in - src;
+}
+
+static void bzip2_stream_free(struct decomp_stream *ds)
+{
+	BZ2_bzDecompressEnd(ds->priv);
+	free(ds->priv);
+}
+#endif
+
+#if CONFIG_IS_ENABLED(LZMA)
+/* Properties followed by the 64-bit uncompressed size, which may be all ones */
+#define LZMA_STREAM_HDR_SIZE	(LZMA_PROPS_SIZE + sizeof(u64))
+
+/**
+ * struct lzma_stream_priv - State of an LZMA stream
+ *
+ * @dec:	Decoder, using the output buffer as its dictionary
+ * @hdr:	Header, collected before decoding starts
+ * @hdr_len:	Number of bytes in @hdr
+ * @sized:	true if the header gives the uncompressed size
+ */
+struct lzma_stream_priv {
+	CLzmaDec dec;
+	u8 hdr[LZMA_STREAM_HDR_SIZE];
+	uint hdr_len;
+	bool sized;
+};
+
+static void *lzma_stream_alloc(ISzAllocPtr p, size_t size)
+{
+	return malloc(size);
+}
+
+static void lzma_stream_dealloc(ISzAllocPtr p, void *address)
+{
+	free(address);
+}
+
+static const ISzAlloc lzma_stream_allocator = {
+	.Alloc	= lzma_stream_alloc,
+	.Free	= lzma_stream_dealloc,
+};
+
+static int lzma_stream_init(struct decomp_stream *ds)
+{
+	struct lzma_stream_priv *priv;
+
+	priv = calloc(1, sizeof(*priv));
+	if (!priv)
+		return -ENOMEM;
+	LzmaDec_CONSTRUCT(&priv->dec);
+	ds->priv = priv;
+
+	return 0;
+}
+
+/* Set up the decoder once the header is complete */
+static int lzma_stream_start(struct decomp_stream *ds)
+{
+	struct lzma_stream_priv *priv = ds->priv;
+	SizeT limit = ds->dst_size;
+	u64 size;
+
+	if (LzmaDec_AllocateProbs(&priv->dec, priv->hdr, LZMA_PROPS_SIZE,
+				  &lzma_stream_allocator))
+		return log_msg_ret("prp", -EINVAL);
+
+	size = get_unaligned_le64(priv->hdr + LZMA_PROPS_SIZE);
+	if (size != (u64)-1) {
+		if (size > ds->dst_size)
+			return log_msg_ret("lsz", -ENOSPC);
+		limit = size;
+		priv->sized = true;
+	}
+	priv->dec.dic = ds->dst;
+	priv->dec.dicBufSize = limit;
+	LzmaDec_Init(&priv->dec);
+	if (!limit)
+		ds->done = true;
+
+	return 0;
+}
+
+static long lzma_stream_write(struct decomp_stream *ds, const u8 *src,
+			      ulong len)
+{
+	struct lzma_stream_priv *priv = ds->priv;
+	ELzmaStatus status;
+	SizeT in_len;
+	bool full;
+	int ret;
+
+	if (priv->hdr_len < LZMA_STREAM_HDR_SIZE) {
+		in_len = min(len, (ulong)(LZMA_STREAM_HDR_SIZE - priv->hdr_len));
+		memcpy(priv->hdr + priv->hdr_len, src, in_len);
+		priv->hdr_len += in_len;
+		if (priv->hdr_len == LZMA_STREAM_HDR_SIZE) {
+			ret = lzma_stream_start(ds);
+			if (ret)
+				return ret;
+		}
+
+		return in_len;
+	}
+
+	/*
+	 * Once the output is full, only an end mark may follow; anything else
+	 * means the output buffer is too small
+	 */
+	full = priv->dec.dicPos == priv->dec.dicBufSize;
+	in_len = len;
+	ret = LzmaDec_DecodeToDic(&priv->dec, priv->dec.dicBufSize, src,
+				  &in_len, full ? LZMA_FINISH_END : LZMA_FINISH_ANY,
+				  &status);
+	ds->out = priv->dec.dicPos;
+	if (ret != SZ_OK) {
+		if (full && status == LZMA_STATUS_NOT_FINISHED)
+			return log_msg_ret("lzs", -ENOSPC);
+		return log_msg_ret("lzd", -EINVAL);
+	}
+	if (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+	    (priv->sized && ds->out == priv->dec.dicBufSize))
+		ds->done = true;
+
+	return in_len;
+}
+
+static void lzma_stream_free(struct decomp_stream *ds)
+{
+	struct lzma_stream_priv *priv = ds->priv;
+
+	LzmaDec_FreeProbs(&priv->dec, &lzma_stream_allocator);
+	free(priv);
+}
+#endif
+
+#if CONFIG_IS_ENABLED(LZ4)
+#define LZ4_STREAM_MAGIC		0x184d2204
+#define LZ4_STREAM_UNCOMPRESSED		BIT(31)
+#define LZ4_STREAM_HDR_MIN		7
+#define LZ4_STREAM_HDR_MAX		(LZ4_STREAM_HDR_MIN + sizeof(u64))
+
+enum lz4_stream_stage {
+	LZ4S_HEADER,
+	LZ4S_BLOCK_SIZE,
+	LZ4S_BLOCK,
+	LZ4S_BLOCK_CHECKSUM,
+};
+
+/**
+ * struct lz4_stream_priv - State of an LZ4 frame
+ *
+ * Only frames with independent blocks are supported, as with ulz4fn(), so each
+ * block can be decoded on its own once it is complete. Blocks which arrive in
+ * one piece are decoded from the caller's buffer; others are collected in
+ * @block first.
+ *
+ * @stage:	What is being read
+ * @need:	Number of bytes needed to complete this stage
+ * @have:	Number of bytes received in this stage
+ * @hdr:	Frame header or block size
+ * @block_checksum: true if each block is followed by a checksum
+ * @raw:	true if the current block is stored uncompressed
+ * @block_max:	Maximum size of a block
+ * @block:	Buffer for a block which arrives in pieces
+ */
+struct lz4_stream_priv {
+	enum lz4_stream_stage stage;
+	uint need;
+	uint have;
+	u8 hdr[LZ4_STREAM_HDR_MAX];
+	bool block_checksum;
+	bool raw;
+	uint block_max;
+	u8 *block;
+};
+
+static int lz4_stream_init(struct decomp_stream *ds)
+{
+	struct lz4_stream_priv *priv;
+
+	priv = calloc(1, sizeof(*priv));
+	if (!priv)
+		return -ENOMEM;
+	priv->stage = LZ4S_HEADER;
+	priv->need = LZ4_STREAM_HDR_MIN;
+	ds->priv = priv;
+
+	return 0;
+}
+
+/* Collect up to the rest of this stage's bytes into @buf */
+static ulong lz4_stream_gather(struct lz4_stream_priv *priv, void *buf,
+			       const u8 *src, ulong len)
+{
+	ulong n = min(len, (ulong)(priv->need - priv->have));
+
+	memcpy(buf + priv->have, src, n);
+	priv->have += n;
+
+	return n;
+}
+
+static void lz4_stream_next(struct lz4_stream_priv *priv,
+			    enum lz4_stream_stage stage, uint need)
+{
+	priv->stage = stage;
+	priv->need = need;
+	priv->have = 0;
+}
+
+static int lz4_stream_header(struct lz4_stream_priv *priv)
+{
+	u8 flags = priv->hdr[4];
+	u8 block_desc = priv->hdr[5];
+
+	if (get_unaligned_le32(priv->hdr) != LZ4_STREAM_MAGIC ||
+	    (flags >> 6) != 1)
+		return log_msg_ret("lzm", -EPROTONOSUPPORT);
+	if ((flags & 0x03) || (block_desc & 0x8f))
+		return log_msg_ret("lzr", -EINVAL);
+	if (!(flags & BIT(5)))
+		return log_msg_ret("lzi", -EPROTONOSUPPORT);
+
+	/* the content size comes before the header checksum */
+	if ((flags & BIT(3)) && priv->need == LZ4_STREAM_HDR_MIN) {
+		priv->need = LZ4_STREAM_HDR_MAX;
+		return 0;
+	}
+	priv->block_checksum = flags & BIT(4);
+
+	/* 64KiB, 256KiB, 1MiB or 4MiB */
+	priv->block_max = 1 << (8 + 2 * ((block_desc >> 4) & 7));
+	if (priv->block_max < SZ_64K)
+		return log_msg_ret("lzb", -EINVAL);
+	priv->block = malloc(priv->block_max);
+	if (!priv->block)
+		return log_msg_ret("lzb", -ENOMEM);
+	lz4_stream_next(priv, LZ4S_BLOCK_SIZE, sizeof(u32));
+
+	return 0;
+}
+
+static int lz4_stream_block(struct decomp_stream *ds, const u8 *src, uint size)
+{
+	struct lz4_stream_priv *priv = ds->priv;
+	int ret;
+
+	ret = LZ4_decompress_safe((const char *)src,
+				  (char *)ds->dst + ds->out, size,
+				  min(ds->dst_size - ds->out, (ulong)INT_MAX));
+	if (ret < 0) {
+		/* the decoder does not say whether it ran out of space */
+		if (ds->dst_size - ds->out < priv->block_max)
+			return log_msg_ret("lzs", -ENOSPC);
+		return log_msg_ret("lzd", -EINVAL);
+	}
+	ds->out += ret;
+
+	return 0;
+}
+
+static long lz4_stream_write(struct decomp_stream *ds, const u8 *src,
+			     ulong len)
+{
+	struct lz4_stream_priv *priv = ds->priv;
+	ulong n;
+	u32 size;
+	int ret;
+
+	switch (priv->stage) {
+	case LZ4S_HEADER:
+		n = lz4_stream_gather(priv, priv->hdr, src, len);
+		if (priv->have == priv->need) {
+			ret = lz4_stream_header(priv);
+			if (ret)
+				return ret;
+		}
+		break;
+	case LZ4S_BLOCK_SIZE:
+		n = lz4_stream_gather(priv, priv->hdr, src, len);
+		if (priv->have < priv->need)
+			break;
+		size = get_unaligned_le32(priv->hdr);
+		if (!size) {
+			/* end mark; any content checksum is ignored */
+			ds->done = true;
+			break;
+		}
+		priv->raw = size & LZ4_STREAM_UNCOMPRESSED;
+		size &= ~LZ4_STREAM_UNCOMPRESSED;
+		if (size > priv->block_max)
+			return log_msg_ret("lzl", -EINVAL);
+		lz4_stream_next(priv, LZ4S_BLOCK, size);
+		break;
+	case LZ4S_BLOCK:
+		if (priv->raw) {
+			n = min(len, (ulong)(priv->need - priv->have));
+			if (n > ds->dst_size - ds->out)
+				return log_msg_ret("lzs", -ENOSPC);
+			memcpy(ds->dst + ds->out, src, n);
+			ds->out += n;
+			priv->have += n;
+		} else if (!priv->have && len >= priv->need) {
+			ret = lz4_stream_block(ds, src, priv->need);
+			if (ret)
+				return ret;
+			n = priv->need;
+			priv->have = n;
+		} else {
+			n = lz4_stream_gather(priv, priv->block, src, len);
+			if (priv->have == priv->need) {
+				ret = lz4_stream_block(ds, priv->block,
+						       priv->need);
+				if (ret)
+					return ret;
+			}
+		}
+		if (priv->have == priv->need) {
+			if (priv->block_checksum)
+				lz4_stream_next(priv, LZ4S_BLOCK_CHECKSUM,
+						sizeof(u32));
+			else
+				lz4_stream_next(priv, LZ4S_BLOCK_SIZE,
+						sizeof(u32));
+		}
+		break;
+	case LZ4S_BLOCK_CHECKSUM:
+		n = min(len, (ulong)(priv->need - priv->have));
+		priv->have += n;
+		if (priv->have == priv->need)
+			lz4_stream_next(priv, LZ4S_BLOCK_SIZE, sizeof(u32));
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return n;
+}
+
+static void lz4_stream_free(struct decomp_stream *ds)
+{
+	struct lz4_stream_priv *priv = ds->priv;
+
+	free(priv->block);
+	free(priv);
+}
+#endif
+
+#if CONFIG_IS_ENABLED(ZSTD)
+/**
+ * struct zstd_stream_priv - State of a Zstandard stream
+ *
+ * @dstream:	Decoder, which is told to use @out as its window
+ * @out:	Output buffer, which must not change between calls
+ */
+struct zstd_stream_priv {
+	zstd_dstream *dstream;
+	zstd_out_buffer out;
+};
+
+static int zstd_stream_init(struct decomp_stream *ds)
+{
+	struct zstd_stream_priv *priv;
+	size_t wsize;
+
+	/*
+	 * With a stable output buffer the decoder needs no window of its own,
+	 * only space to collect one block of input
+	 */
+	wsize = zstd_dctx_workspace_bound() + ZSTD_BLOCKSIZE_MAX;
+	priv = malloc(sizeof(*priv) + wsize);
+	if (!priv)
+		return -ENOMEM;
+	priv->dstream = zstd_init_dstream(0, priv + 1, wsize);
+	if (!priv->dstream ||
+	    zstd_is_error(ZSTD_DCtx_setParameter(priv->dstream,
+						 ZSTD_d_stableOutBuffer, 1))) {
+		free(priv);
+		return log_msg_ret("zsi", -EINVAL);
+	}
+	priv->out.dst = ds->dst;
+	priv->out.size = ds->dst_size;
+	priv->out.pos = 0;
+	ds->priv = priv;
+
+	return 0;
+}
+
+static long zstd_stream_write(struct decomp_stream *ds, const u8 *src,
+			      ulong len)
+{
+	struct zstd_stream_priv *priv = ds->priv;
+	zstd_in_buffer in = {
+		.src	= src,
+		.size	= len,
+	};
+	size_t ret;
+
+	ret = zstd_decompress_stream(priv->dstream, &priv->out, &in);
+	ds->out = priv->out.pos;
+	if (zstd_is_error(ret)) {
+		log_debug("zstd error %d\n", zstd_get_error_code(ret));
+		if (zstd_get_error_code(ret) == ZSTD_error_dstSize_tooSmall)
+			return -ENOSPC;
+		return -EINVAL;
+	}
+	if (!ret)
+		ds->done = true;
+
+	return in.pos;
+}
+
+static void zstd_stream_free(struct decomp_stream *ds)
+{
+	free(ds->priv);
+}
+#endif
+
+static const struct decomp_stream_ops decomp_stream_ops[] = {
+#if CONFIG_IS_ENABLED(GZIP)
+	{ IH_COMP_GZIP, gzip_stream_init, gzip_stream_write, gzip_stream_free },
+#endif
+#if CONFIG_IS_ENABLED(BZIP2)
+	{ IH_COMP_BZIP2, bzip2_stream_init, bzip2_stream_write,
+	  bzip2_stream_free },
+#endif
+#if CONFIG_IS_ENABLED(LZMA)
+	{ IH_COMP_LZMA, lzma_stream_init, lzma_stream_write, lzma_stream_free },
+#endif
+#if CONFIG_IS_ENABLED(LZ4)
+	{ IH_COMP_LZ4, lz4_stream_init, lz4_stream_write, lz4_stream_free },
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	{ IH_COMP_ZSTD, zstd_stream_init, zstd_stream_write, zstd_stream_free },
+#endif
+};
+
+static const struct decomp_stream_ops *decomp_stream_find(int comp)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(decomp_stream_ops); i++) {
+		if (decomp_stream_ops[i].comp == comp)
+			return &decomp_stream_ops[i];
+	}
+
+	return NULL;
+}
+
+bool decomp_stream_supported(int comp)
+{
+	return decomp_stream_find(comp);
+}
+
+int decomp_stream_init(struct decomp_stream *ds, int comp, void *dst,
+		       ulong dst_size)
+{
+	const struct decomp_stream_ops *ops;
+
+	ops = decomp_stream_find(comp);
+	if (!ops)
+		return log_msg_ret("cmp", -EPROTONOSUPPORT);
+
+	memset(ds, '\0', sizeof(*ds));
+	ds->comp = comp;
+	ds->dst = dst;
+	ds->dst_size = dst_size;
+	ds->ops = ops;
+
+	return ops->init(ds);
+}
+
+int decomp_stream_write(struct decomp_stream *ds, const void *src, ulong len)
+{
+	const u8 *ptr = src;
+
+	while (len && !ds->done) {
+		ulong out = ds->out;
+		long ret;
+
+		ret = ds->ops->write(ds, ptr, len);
+		if (ret < 0)
+			return ret;
+
+		/* no progress means the output is full or the data is bad */
+		if (!ret && ds->out == out && !ds->done)
+			return ds->out == ds->dst_size ? -ENOSPC : -EINVAL;
+		ptr += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+int decomp_stream_finish(struct decomp_stream *ds, ulong *lenp)
+{
+	if (lenp)
+		*lenp = ds->out;
+	if (ds->priv)
+		ds->ops->release(ds);
+	ds->priv = NULL;
+
+	if (ds->done)
+		return 0;
+
+	return ds->out == ds->dst_size ? -ENOSPC : -EINVAL;
+}
@@ -11,6 +11,7 @@
 #include <version_string.h>
 #include <linux/ctype.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
 #include <asm/io.h>
 #include <stdio.h>
 #include <vsprintf.h>
@@ -145,6 +146,13 @@ void print_size(uint64_t size, const char *s)
 	printf (" %ciB%s", c, s);
 }
 
+void print_rate(uint64_t bytes, unsigned long us, const char *s)
+{
+	/* a transfer too quick to time is counted as taking 1us */
+	print_size(div_u64(bytes * 1000000, us ?: 1), "/s");
+	puts(s);
+}
+
 #define MAX_LINE_LENGTH_BYTES		64
 #define DEFAULT_LINE_LENGTH_BYTES	16
 
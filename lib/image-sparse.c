@@ -42,105 +42,287 @@
 #include <malloc.h>
 #include <part.h>
 #include <sparse_format.h>
+#include <time.h>
 #include <asm/cache.h>
 
 #include <linux/math64.h>
 #include <linux/err.h>
 
+/* What the next bytes of a sparse image hold */
+enum sparse_stream_state {
+	SPARSE_STREAM_HEADER,
+	SPARSE_STREAM_CHUNK,
+	SPARSE_STREAM_RAW,
+	SPARSE_STREAM_FILL,
+	SPARSE_STREAM_CRC32,
+	SPARSE_STREAM_DONE,
+};
+
 static void default_log(const char *ignored, char *response) {}
 
-static lbaint_t write_sparse_chunk_raw(struct sparse_storage *info,
-				       lbaint_t blk, lbaint_t blkcnt,
-				       void *data,
-				       char *response)
+/**
+ * sparse_stream_fail() - stop a stream because of an error
+ *
+ * @ss:		Stream which failed
+ * @msg:	Message for the storage's mssg(), or NULL if it has been sent
+ * @err:	Error number
+ * @response:	Message buffer
+ * Return: @err
+ */
+static int sparse_stream_fail(struct sparse_stream *ss, const char *msg,
+			      int err, char *response)
 {
-	lbaint_t n = blkcnt, write_blks, blks = 0;
-	lbaint_t aligned_buf_blks = FASTBOOT_MAX_BLK_WRITE;
-	uint32_t *aligned_buf = NULL;
+	if (msg)
+		ss->info->mssg(msg, response);
+	ss->err = err;
 
-	if (CONFIG_IS_ENABLED(SYS_DCACHE_OFF)) {
-		write_blks = info->write(info, blk, n, data);
-		if (write_blks < n)
-			goto write_fail;
+	return err;
+}
 
-		return write_blks;
-	}
+/* Count a chunk of the given type in the storage's statistics */
+static void sparse_stream_count(struct sparse_stream *ss, int type, u64 bytes)
+{
+	struct sparse_stats *stats = ss->info->stats;
 
-	aligned_buf = memalign(ARCH_DMA_MINALIGN, info->blksz * aligned_buf_blks);
-	if (!aligned_buf) {
-		info->mssg("Malloc failed for: CHUNK_TYPE_RAW", response);
-		return -ENOMEM;
+	if (stats) {
+		stats->stat[type].chunks++;
+		stats->stat[type].bytes += bytes;
 	}
+}
 
-	while (blkcnt > 0) {
-		n = min(aligned_buf_blks, blkcnt);
-		memcpy(aligned_buf, data, n * info->blksz);
-
-		/* write_blks might be > n due to NAND bad-blocks */
-		write_blks = info->write(info, blk + blks, n, aligned_buf);
-		if (write_blks < n) {
-			free(aligned_buf);
-			goto write_fail;
-		}
+/* Add the time since @start to the given type in the storage's statistics */
+static void sparse_stream_time(struct sparse_stream *ss, int type,
+			       ulong start)
+{
+	struct sparse_stats *stats = ss->info->stats;
 
-		blks += write_blks;
-		data += n * info->blksz;
-		blkcnt -= n;
-	}
+	if (stats)
+		stats->stat[type].us += timer_get_us() - start;
+}
 
-	free(aligned_buf);
-	return blks;
+/**
+ * sparse_stream_pos() - get the block which the next chunk starts at
+ *
+ * @ss:		Stream being written
+ * Return: block number, counting raw data which is waiting to be written
+ */
+static lbaint_t sparse_stream_pos(struct sparse_stream *ss)
+{
+	return ss->blk + lldiv(ss->raw_len, ss->info->blksz);
+}
 
-write_fail:
+/**
+ * sparse_stream_flush() - write out the raw data which has been gathered
+ *
+ * Raw data is held back until the buffer is full or something other than raw
+ * data is to be written, so that adjacent raw chunks are written together.
+ *
+ * @ss:		Stream being written
+ * @response:	Message buffer
+ * Return: 0 if OK, -ve on error
+ */
+static int sparse_stream_flush(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t blkcnt = lldiv(ss->raw_len, info->blksz);
+	lbaint_t write_blks;
+	ulong start;
+
+	if (!blkcnt)
+		return 0;
+
+	start = timer_get_us();
+	/* write_blks might be > blkcnt due to NAND bad-blocks */
+	write_blks = info->write(info, ss->blk, blkcnt, ss->raw_buf);
+	sparse_stream_time(ss, SPARSE_STAT_RAW, start);
 	if (IS_ERR_VALUE(write_blks)) {
 		printf("%s: Write failed, block #" LBAFU " [" LBAFU "] (%lld)\n",
-		       __func__, blk + blks, n, (long long)write_blks);
-		info->mssg("flash write failure", response);
-		return write_blks;
+		       __func__, ss->blk, blkcnt, (long long)write_blks);
+		return sparse_stream_fail(ss, "flash write failure", -EIO,
+					  response);
+	}
+	if (write_blks < blkcnt) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
+		       __func__, ss->blk, blkcnt);
+		return sparse_stream_fail(ss, "flash write failure(incomplete)",
+					  -EIO, response);
 	}
+	ss->blk += write_blks;
+	ss->raw_len = 0;
 
-	/* write_blks < n */
-	printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
-	       __func__, blk + blks, n);
-	info->mssg("flash write failure(incomplete)", response);
-	return -1;
+	return 0;
 }
 
-int write_sparse_image(struct sparse_storage *info,
-		       const char *part_name, void *data, char *response)
+/**
+ * sparse_stream_write_fill() - write blocks filled with a 32-bit value
+ *
+ * The pattern buffer is kept for the whole image and only refilled when the
+ * value changes.
+ *
+ * @ss:		Stream being written
+ * @blkcnt:	Number of blocks to write, starting at @ss->blk
+ * @fill_val:	Value to fill them with
+ * @response:	Message buffer
+ * Return: 0 if OK, -ve on error
+ */
+static int sparse_stream_write_fill(struct sparse_stream *ss, lbaint_t blkcnt,
+				    uint32_t fill_val, char *response)
 {
-	lbaint_t blk;
-	lbaint_t blkcnt;
+	struct sparse_storage *info = ss->info;
 	lbaint_t blks;
-	uint64_t bytes_written = 0;
-	unsigned int chunk;
-	unsigned int offset;
-	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
-	uint32_t fill_val;
-	sparse_header_t *sparse_header;
-	chunk_header_t *chunk_header;
-	uint32_t total_blocks = 0;
-	int fill_buf_num_blks;
 	int i;
 	int j;
 
-	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	if (!ss->fill_buf) {
+		ss->fill_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+		ss->fill_buf = memalign(ARCH_DMA_MINALIGN,
+					ROUNDUP(info->blksz * ss->fill_blks,
+						ARCH_DMA_MINALIGN));
+		if (!ss->fill_buf)
+			return sparse_stream_fail(ss,
+					"Malloc failed for: CHUNK_TYPE_FILL",
+					-ENOMEM, response);
+		ss->fill_buf_val = ~fill_val;
+	}
+	if (ss->fill_buf_val != fill_val) {
+		for (i = 0;
+		     i < (info->blksz * ss->fill_blks / sizeof(fill_val)); i++)
+			ss->fill_buf[i] = fill_val;
+		ss->fill_buf_val = fill_val;
+	}
+
+	for (i = 0; i < blkcnt;) {
+		j = blkcnt - i;
+		if (j > ss->fill_blks)
+			j = ss->fill_blks;
+		blks = info->write(info, ss->blk, j, ss->fill_buf);
+		/* blks might be > j (eg. NAND bad-blocks) */
+		if (blks < j) {
+			printf("%s: %s " LBAFU " [%d]\n", __func__,
+			       "Write failed, block #", ss->blk, j);
+			return sparse_stream_fail(ss, "flash write failure",
+						  -EIO, response);
+		}
+		ss->blk += blks;
+		i += j;
+	}
 
-	/* Read and skip over sparse image header */
-	sparse_header = (sparse_header_t *)data;
+	return 0;
+}
 
-	data += sparse_header->file_hdr_sz;
-	if (sparse_header->file_hdr_sz > sizeof(sparse_header_t)) {
-		/*
-		 * Skip the remaining bytes in a header that is longer than
-		 * we expected.
-		 */
-		data += (sparse_header->file_hdr_sz - sizeof(sparse_header_t));
+/**
+ * sparse_stream_erase_zero() - clear blocks to zero by erasing them
+ *
+ * Only the part of the range which is aligned to the storage's erase size is
+ * erased. The blocks before and after it are written with zeroes.
+ *
+ * @ss:		Stream being written
+ * @response:	Message buffer
+ * Return: 0 if the chunk was cleared, 1 if erasing is not possible, so the
+ *	zeroes must be written, -ve on error
+ */
+static int sparse_stream_erase_zero(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t blk = ss->blk, end = ss->blk + ss->blkcnt;
+	lbaint_t first, last, erased;
+	u32 rem;
+	int ret;
+
+	if (!info->erase || !info->erase_align || ss->no_erase)
+		return 1;
+
+	div_u64_rem(blk, info->erase_align, &rem);
+	first = rem ? blk + info->erase_align - rem : blk;
+	div_u64_rem(end, info->erase_align, &rem);
+	last = end - rem;
+	if (last <= first)
+		return 1;
+
+	ret = sparse_stream_write_fill(ss, first - blk, 0, response);
+	if (ret)
+		return ret;
+	erased = info->erase(info, first, last - first);
+	if (erased != last - first) {
+		/* write the zeroes after all and stop trying to erase */
+		debug("%s: Erase failed, block #" LBAFU " (%lld)\n", __func__,
+		      first, (long long)erased);
+		ss->no_erase = true;
+		return sparse_stream_write_fill(ss, end - first, 0, response);
 	}
+	ss->blk = last;
 
-	if (!info->mssg)
-		info->mssg = default_log;
+	return sparse_stream_write_fill(ss, end - last, 0, response);
+}
+
+/* Write a fill chunk once its value has arrived */
+static int sparse_stream_fill(struct sparse_stream *ss, char *response)
+{
+	int type = ss->fill_val ? SPARSE_STAT_FILL : SPARSE_STAT_ZERO;
+	ulong start;
+	int ret;
+
+	ret = sparse_stream_flush(ss, response);
+	if (ret)
+		return ret;
+
+	start = timer_get_us();
+	ret = 1;
+	if (!ss->fill_val)
+		ret = sparse_stream_erase_zero(ss, response);
+	if (ret > 0)
+		ret = sparse_stream_write_fill(ss, ss->blkcnt, ss->fill_val,
+					       response);
+	sparse_stream_time(ss, type, start);
+
+	return ret;
+}
+
+/**
+ * sparse_stream_collect() - collect the bytes of a header
+ *
+ * Only the first @keep bytes are stored, so that headers which are longer
+ * than expected are skipped over.
+ *
+ * @ss:		Stream being written
+ * @dst:	Where to store the header
+ * @keep:	Number of bytes to store at @dst
+ * @size:	Number of bytes in the header
+ * @datap:	Next byte of the image; updated to skip what is used
+ * @lenp:	Number of bytes at @datap; updated likewise
+ * Return: true if the header is complete
+ */
+static bool sparse_stream_collect(struct sparse_stream *ss, void *dst,
+				  uint keep, uint size, const u8 **datap,
+				  ulong *lenp)
+{
+	ulong n = min_t(ulong, *lenp, size - ss->hdr_len);
+
+	if (ss->hdr_len < keep)
+		memcpy(dst + ss->hdr_len, *datap,
+		       min_t(ulong, n, keep - ss->hdr_len));
+	ss->hdr_len += n;
+	*datap += n;
+	*lenp -= n;
+
+	return ss->hdr_len == size;
+}
+
+/* Move on to the next chunk, or to the end of the image */
+static void sparse_stream_next_chunk(struct sparse_stream *ss)
+{
+	ss->hdr_len = 0;
+	if (++ss->chunk_num == ss->header.total_chunks)
+		ss->state = SPARSE_STREAM_DONE;
+	else
+		ss->state = SPARSE_STREAM_CHUNK;
+}
+
+/* Check the sparse image header once it has all arrived */
+static int sparse_stream_start(struct sparse_stream *ss, char *response)
+{
+	sparse_header_t *sparse_header = &ss->header;
+	unsigned int offset;
 
 	debug("=== Sparse Image Header ===\n");
 	debug("magic: 0x%x\n", sparse_header->magic);
@@ -156,163 +338,272 @@ int write_sparse_image(struct sparse_storage *info,
 	 * Verify that the sparse block size is a multiple of our
 	 * storage backend block size
 	 */
-	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
+	div_u64_rem(sparse_header->blk_sz, ss->info->blksz, &offset);
 	if (offset) {
 		printf("%s: Sparse image block size issue [%u]\n",
 		       __func__, sparse_header->blk_sz);
-		info->mssg("sparse image block size issue", response);
-		return -1;
+		return sparse_stream_fail(ss, "sparse image block size issue",
+					  -EINVAL, response);
 	}
 
 	puts("Flashing Sparse Image\n");
+	ss->blk = ss->info->start;
+	ss->chunk_num = -1;
+	sparse_stream_next_chunk(ss);
 
-	/* Start processing chunks */
-	blk = info->start;
-	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++) {
-		/* Read and skip over chunk header */
-		chunk_header = (chunk_header_t *)data;
-		data += sizeof(chunk_header_t);
-
-		if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
-			debug("=== Chunk Header ===\n");
-			debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
-			debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
-			debug("total_size: 0x%x\n", chunk_header->total_sz);
-		}
+	return 0;
+}
 
-		if (sparse_header->chunk_hdr_sz > sizeof(chunk_header_t)) {
-			/*
-			 * Skip the remaining bytes in a header that is longer
-			 * than we expected.
-			 */
-			data += (sparse_header->chunk_hdr_sz -
-				 sizeof(chunk_header_t));
-		}
+/* Deal with a chunk header once it has all arrived */
+static int sparse_stream_chunk(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	chunk_header_t *chunk_header = &ss->chunk;
+	uint64_t chunk_data_sz;
+	ulong start;
+	int ret;
+
+	if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
+		debug("=== Chunk Header ===\n");
+		debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
+		debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
+		debug("total_size: 0x%x\n", chunk_header->total_sz);
+	}
 
-		chunk_data_sz = ((u64)sparse_header->blk_sz) * chunk_header->chunk_sz;
-		blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
-		switch (chunk_header->chunk_type) {
-		case CHUNK_TYPE_RAW:
-			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + chunk_data_sz)) {
-				info->mssg("Bogus chunk size for chunk type Raw",
-					   response);
-				return -1;
-			}
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
-				return -1;
-			}
-
-			blks = write_sparse_chunk_raw(info, blk, blkcnt,
-						      data, response);
-			if (IS_ERR_VALUE(blks))
-				return -1;
-
-			blk += blks;
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
+	chunk_data_sz = ((u64)ss->header.blk_sz) * chunk_header->chunk_sz;
+	ss->blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+	ss->hdr_len = 0;
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (chunk_header->total_sz !=
+		    (ss->header.chunk_hdr_sz + chunk_data_sz))
+			return sparse_stream_fail(ss,
+					"Bogus chunk size for chunk type Raw",
+					-EINVAL, response);
+		if (sparse_stream_pos(ss) + ss->blkcnt >
+		    info->start + info->size)
 			break;
-
-		case CHUNK_TYPE_FILL:
-			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
-				info->mssg("Bogus chunk size for chunk type FILL", response);
-				return -1;
-			}
-
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
-					   response);
-				return -1;
-			}
-
-			fill_val = *(uint32_t *)data;
-			data = (char *)data + sizeof(uint32_t);
-
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
-				return -1;
-			}
-
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
-							 sparse_header->blk_sz);
-			free(fill_buf);
+		sparse_stream_count(ss, SPARSE_STAT_RAW, chunk_data_sz);
+		ss->bytes_written += ((u64)ss->blkcnt) * info->blksz;
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->remain = chunk_data_sz;
+		ss->state = SPARSE_STREAM_RAW;
+		if (!ss->remain)
+			sparse_stream_next_chunk(ss);
+		return 0;
+
+	case CHUNK_TYPE_FILL:
+		if (chunk_header->total_sz !=
+		    (ss->header.chunk_hdr_sz + sizeof(uint32_t)))
+			return sparse_stream_fail(ss,
+					"Bogus chunk size for chunk type FILL",
+					-EINVAL, response);
+		if (sparse_stream_pos(ss) + ss->blkcnt >
+		    info->start + info->size)
 			break;
+		ss->state = SPARSE_STREAM_FILL;
+		return 0;
+
+	case CHUNK_TYPE_DONT_CARE:
+		ret = sparse_stream_flush(ss, response);
+		if (ret)
+			return ret;
+		sparse_stream_count(ss, SPARSE_STAT_DONT_CARE, chunk_data_sz);
+		start = timer_get_us();
+		ss->blk += info->reserve(info, ss->blk, ss->blkcnt);
+		sparse_stream_time(ss, SPARSE_STAT_DONT_CARE, start);
+		ss->total_blocks += chunk_header->chunk_sz;
+		sparse_stream_next_chunk(ss);
+		return 0;
+
+	case CHUNK_TYPE_CRC32:
+		if (chunk_header->total_sz !=
+		    ss->header.chunk_hdr_sz + sizeof(uint32_t))
+			return sparse_stream_fail(ss,
+					"Bogus chunk size for chunk type CRC32",
+					-EINVAL, response);
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->state = SPARSE_STREAM_CRC32;
+		return 0;
+
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk_header->chunk_type);
+		return sparse_stream_fail(ss, "Unknown chunk type", -EINVAL,
+					  response);
+	}
 
-		case CHUNK_TYPE_DONT_CARE:
-			blk += info->reserve(info, blk, blkcnt);
-			total_blocks += chunk_header->chunk_sz;
-			break;
+	printf("%s: Request would exceed partition size!\n", __func__);
+	return sparse_stream_fail(ss, "Request would exceed partition size!",
+				  -ENOSPC, response);
+}
 
-		case CHUNK_TYPE_CRC32:
-			if (chunk_header->total_sz !=
-			    sparse_header->chunk_hdr_sz + sizeof(uint32_t)) {
-				info->mssg("Bogus chunk size for chunk type CRC32",
-					   response);
-				return -1;
-			}
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
-			break;
+/* Gather as much of the current raw chunk as has arrived */
+static int sparse_stream_raw(struct sparse_stream *ss, const u8 **datap,
+			     ulong *lenp, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	ulong len = min_t(u64, *lenp, ss->remain);
+	const u8 *data = *datap;
+	ulong n;
+	int ret;
+
+	*datap += len;
+	*lenp -= len;
+	ss->remain -= len;
+
+	if (!ss->raw_buf) {
+		/* a whole number of blocks, at least one */
+		ss->raw_size = max_t(ulong, lldiv(CONFIG_IMAGE_SPARSE_WRITE_SIZE,
+						  info->blksz), 1) * info->blksz;
+		ss->raw_buf = memalign(ARCH_DMA_MINALIGN, ss->raw_size);
+		if (!ss->raw_buf)
+			return sparse_stream_fail(ss,
+					"Malloc failed for: CHUNK_TYPE_RAW",
+					-ENOMEM, response);
+	}
 
-		default:
-			printf("%s: Unknown chunk type: %x\n", __func__,
-			       chunk_header->chunk_type);
-			info->mssg("Unknown chunk type", response);
-			return -1;
+	while (len) {
+		n = min_t(ulong, len, ss->raw_size - ss->raw_len);
+		memcpy(ss->raw_buf + ss->raw_len, data, n);
+		ss->raw_len += n;
+		data += n;
+		len -= n;
+		if (ss->raw_len == ss->raw_size) {
+			ret = sparse_stream_flush(ss, response);
+			if (ret)
+				return ret;
 		}
 	}
+	if (!ss->remain)
+		sparse_stream_next_chunk(ss);
+
+	return 0;
+}
+
+void sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info)
+{
+	memset(ss, '\0', sizeof(*ss));
+	ss->info = info;
+	ss->state = SPARSE_STREAM_HEADER;
+	if (!info->mssg)
+		info->mssg = default_log;
+}
+
+int sparse_stream_write(struct sparse_stream *ss, const void *data, ulong len,
+			char *response)
+{
+	const u8 *ptr = data;
+	uint size;
+	int ret;
+
+	while (len && !ss->err && ss->state != SPARSE_STREAM_DONE) {
+		switch (ss->state) {
+		case SPARSE_STREAM_HEADER:
+			/* the header says how long it is, once it is here */
+			size = sizeof(sparse_header_t);
+			if (ss->hdr_len >= size)
+				size = max_t(uint, size,
+					     ss->header.file_hdr_sz);
+			if (!sparse_stream_collect(ss, &ss->header,
+						   sizeof(sparse_header_t),
+						   size, &ptr, &len) ||
+			    ss->hdr_len < ss->header.file_hdr_sz)
+				break;
+			ret = sparse_stream_start(ss, response);
+			if (ret)
+				return ret;
+			break;
+		case SPARSE_STREAM_CHUNK:
+			size = max_t(uint, sizeof(chunk_header_t),
+				     ss->header.chunk_hdr_sz);
+			if (!sparse_stream_collect(ss, &ss->chunk,
+						   sizeof(chunk_header_t),
+						   size, &ptr, &len))
+				break;
+			ret = sparse_stream_chunk(ss, response);
+			if (ret)
+				return ret;
+			break;
+		case SPARSE_STREAM_RAW:
+			ret = sparse_stream_raw(ss, &ptr, &len, response);
+			if (ret)
+				return ret;
+			break;
+		case SPARSE_STREAM_FILL:
+			if (!sparse_stream_collect(ss, &ss->fill_val,
+						   sizeof(uint32_t),
+						   sizeof(uint32_t), &ptr,
+						   &len))
+				break;
+			sparse_stream_count(ss, ss->fill_val ?
+					    SPARSE_STAT_FILL : SPARSE_STAT_ZERO,
+					    ((u64)ss->blkcnt) *
+					    ss->info->blksz);
+			ret = sparse_stream_fill(ss, response);
+			if (ret)
+				return ret;
+			ss->bytes_written += ((u64)ss->blkcnt) *
+					     ss->info->blksz;
+			ss->total_blocks += ss->chunk.chunk_sz;
+			sparse_stream_next_chunk(ss);
+			break;
+		case SPARSE_STREAM_CRC32:
+			/* the checksum is not checked */
+			if (sparse_stream_collect(ss, NULL, 0,
+						  sizeof(uint32_t), &ptr,
+						  &len))
+				sparse_stream_next_chunk(ss);
+			break;
+		}
+	}
+
+	return ss->err;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response)
+{
+	struct sparse_storage *info = ss->info;
+
+	if (!ss->err && ss->state == SPARSE_STREAM_DONE)
+		sparse_stream_flush(ss, response);
+	free(ss->raw_buf);
+	free(ss->fill_buf);
+	ss->raw_buf = NULL;
+	ss->fill_buf = NULL;
+	if (ss->err)
+		return ss->err;
+	if (ss->state != SPARSE_STREAM_DONE) {
+		printf("%s: Sparse image is truncated\n", __func__);
+		info->mssg("sparse image is truncated", response);
+		return -EINVAL;
+	}
 
 	debug("Wrote %d blocks, expected to write %d blocks\n",
-	      total_blocks, sparse_header->total_blks);
-	printf("........ wrote %llu bytes to '%s'\n", bytes_written, part_name);
+	      ss->total_blocks, ss->header.total_blks);
+	printf("........ wrote %llu bytes to '%s'\n", ss->bytes_written,
+	       part_name);
 
-	if (total_blocks != sparse_header->total_blks) {
+	if (ss->total_blocks != ss->header.total_blks) {
 		info->mssg("sparse image write failure", response);
-		return -1;
+		return -EINVAL;
 	}
 
 	return 0;
 }
+
+int write_sparse_image(struct sparse_storage *info,
+		       const char *part_name, void *data, char *response)
+{
+	struct sparse_stream ss;
+
+	/*
+	 * The whole image is in memory and its chunk headers say where it
+	 * ends, so it can be passed in as a single piece of unbounded size
+	 */
+	sparse_stream_init(&ss, info);
+	sparse_stream_write(&ss, data, ULONG_MAX, response);
+
+	return sparse_stream_finish(&ss, part_name, response);
+}
@@ -316,6 +316,10 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 
 	debug(" <- unflatten_device_tree()\n");
 
+	/* the tables only speed things up, so carry on without them */
+	if (CONFIG_IS_ENABLED(OF_LIVE_INDEX) && of_index_build(*mynodes))
+		debug("Failed to index live tree\n");
+
 	return 0;
 }
 
@@ -351,6 +355,8 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp)
 
 void of_live_free(struct device_node *root)
 {
+	if (CONFIG_IS_ENABLED(OF_LIVE_INDEX))
+		of_index_drop(root);
 	/* the tree is stored as a contiguous block of memory */
 	free(root);
 }
@@ -369,6 +375,9 @@ int of_live_create_empty(struct device_node **rootp)
 	}
 	root->type = "<NULL>";
 	root->full_name = "";
+	/* a tree which used the same memory may still be indexed */
+	if (CONFIG_IS_ENABLED(OF_LIVE_INDEX))
+		of_index_drop(root);
 	*rootp = root;
 
 	return 0;
@@ -17,6 +17,8 @@
 #include <net.h>
 #include <net6.h>
 #include <net/tftp.h>
+#include <time.h>
+#include <linux/bitops.h>
 #include "bootp.h"
 
 /*
@@ -34,6 +36,12 @@
 #define TIMEOUT		5000UL
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
+/* Number of blocks we can keep when they arrive ahead of the one expected */
+#define TFTP_RX_MAP_BITS	64
+/* Blocks seen beyond a gap before it is taken as a loss, not reordering */
+#define TFTP_REORDER_LIMIT	3
+/* Shortest wait before asking again for the rest of a window, in ms */
+#define TFTP_MIN_RTO		20UL
 
 /*
  *	TFTP operations.
@@ -101,6 +109,21 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Blocks after tftp_cur_block which are already in place, by block number */
+static u64	tftp_rx_map;
+/* Number of the final block, if it arrived before the ones leading to it */
+static ushort	tftp_final_block;
+static bool	tftp_final_seen;
+/* Time the last window was acknowledged (us), or 0 if not timing it */
+static ulong	tftp_ack_us;
+/* Smoothed round-trip time in microseconds, times 8 */
+static ulong	tftp_srtt;
+/* true if the timeout is a short one, for the tail of a window */
+static bool	tftp_fast_timeout;
+/* Blocks received out of order and kept */
+static uint	tftp_reordered;
+/* Number of times we asked for blocks again */
+static uint	tftp_resends;
 #ifdef CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -155,11 +178,21 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 static unsigned short tftp_window_size_option = TFTP_WINDOWSIZE;
+/* The window size we ask for, which may be adapted to the loss seen */
+static unsigned short tftp_window_request;
 
-static inline int store_block(int block, uchar *src, unsigned int len)
+/*
+ * Offset within the file of a block in the current wrap. Blocks numbered
+ * beyond the end of the wrap follow on from it.
+ */
+static ulong block_offset(ulong block)
+{
+	return block * tftp_block_size + tftp_block_wrap_offset -
+		tftp_block_size;
+}
+
+static inline int store_block(ulong offset, uchar *src, unsigned int len)
 {
-	ulong offset = block * tftp_block_size + tftp_block_wrap_offset -
-			tftp_block_size;
 	ulong newsize = offset + len;
 	ulong store_addr = tftp_load_addr + offset;
 	void *ptr;
@@ -207,8 +240,7 @@ static void new_transfer(void)
 static int load_block(unsigned block, uchar *dst, unsigned len)
 {
 	/* We may want to get the final block from the previous set */
-	ulong offset = block * tftp_block_size + tftp_block_wrap_offset -
-		       tftp_block_size;
+	ulong offset = block_offset(block);
 	ulong tosend = len;
 
 	tosend = min(net_boot_file_size - offset, tosend);
@@ -283,6 +315,126 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/*
+ * Move past any blocks following the current one which arrived early and are
+ * already in place
+ */
+static void tftp_rx_advance(void)
+{
+	u64 bit;
+
+	for (;;) {
+		bit = BIT_ULL((ushort)(tftp_cur_block + 1) % TFTP_RX_MAP_BITS);
+		if (!(tftp_rx_map & bit))
+			break;
+		tftp_rx_map &= ~bit;
+		tftp_prev_block = tftp_cur_block;
+		tftp_cur_block = (tftp_cur_block + 1) % TFTP_SEQUENCE_SIZE;
+		update_block_number();
+	}
+	tftp_prev_block = tftp_cur_block;
+}
+
+/**
+ * tftp_rx_early() - keep a block which arrived ahead of the one expected
+ *
+ * The block can go straight into place, since its offset is known, so all
+ * that is needed is to remember that we have it.
+ *
+ * @block:	Block number
+ * @ahead:	Number of blocks between the expected one and this one
+ * @src:	Block data
+ * @len:	Length of block data
+ * Return: 0 if the block is kept, 1 if it is outside the window, -ve if it
+ *	cannot be stored
+ */
+static int tftp_rx_early(ushort block, ushort ahead, uchar *src,
+			 unsigned int len)
+{
+	u64 bit = BIT_ULL(block % TFTP_RX_MAP_BITS);
+
+	if ((tftp_state != STATE_DATA && tftp_state != STATE_OACK) ||
+	    ahead >= min_t(uint, tftp_windowsize, TFTP_RX_MAP_BITS))
+		return 1;
+	if (tftp_rx_map & bit)
+		return 0;
+	if (store_block(block_offset(tftp_cur_block + 1 + ahead), src, len))
+		return -EIO;
+	tftp_rx_map |= bit;
+	if (len < tftp_block_size) {
+		tftp_final_block = block;
+		tftp_final_seen = true;
+	}
+	tftp_reordered++;
+
+	return 0;
+}
+
+/* Ask the server to send again, starting after the current block */
+static void tftp_resend_from_gap(void)
+{
+	tftp_send();
+	tftp_last_nack = tftp_cur_block;
+	tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
+	/* the reply cannot be matched with a single ACK, so don't time it */
+	tftp_ack_us = 0;
+	tftp_resends++;
+}
+
+/* Note the time between acknowledging a window and the next block arriving */
+static void tftp_rtt_sample(void)
+{
+	ulong rtt;
+
+	if (!tftp_ack_us)
+		return;
+	rtt = timer_get_us() - tftp_ack_us;
+	tftp_ack_us = 0;
+	if (tftp_srtt)
+		tftp_srtt += rtt - (tftp_srtt >> 3);
+	else
+		tftp_srtt = max(rtt, 1UL) << 3;
+}
+
+/*
+ * Wait for the next block. Once the round-trip time is known, the rest of a
+ * window which stops short is asked for again after a few round trips rather
+ * than after the full timeout. This is done once for each block, since a slow
+ * server only costs one extra window.
+ */
+static void tftp_set_timeout(void)
+{
+	ulong ms = timeout_ms;
+
+	tftp_fast_timeout = tftp_windowsize > 1 && tftp_srtt &&
+			    tftp_last_nack != tftp_cur_block;
+	if (tftp_fast_timeout) {
+		/* four times the average round trip, which is tftp_srtt / 8 */
+		ms = max(DIV_ROUND_UP(tftp_srtt >> 1, 1000), TFTP_MIN_RTO);
+		ms = min(ms, timeout_ms);
+	}
+	net_set_timeout_handler(ms, tftp_timeout_handler);
+}
+
+/*
+ * Pick the window size to ask for next time. It is halved if more than one
+ * window in eight had to be sent again, and doubled, up to the configured
+ * size, if none did.
+ */
+static void tftp_adapt_window(void)
+{
+	ulong blocks = tftp_block_wrap * TFTP_SEQUENCE_SIZE + tftp_cur_block;
+	ulong windows = blocks / tftp_windowsize;
+
+	if (tftp_resends * 8 > windows)
+		tftp_window_request = max(tftp_windowsize / 2, 1);
+	else if (!tftp_resends)
+		tftp_window_request = min(tftp_windowsize * 2,
+					  (int)tftp_window_size_option);
+	debug("TFTP: %u resends in %lu windows, next window %d\n",
+	      tftp_resends, windows, tftp_window_request);
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -300,8 +452,18 @@ static void tftp_complete(void)
 		puts("\n\t ");	/* Line up with "Loading: " */
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
+		if (tftp_windowsize > 1)
+			printf(", window %d", tftp_windowsize);
+		if (tftp_reordered || tftp_resends)
+			printf(", %u out of order, %u resent", tftp_reordered,
+			       tftp_resends);
 	}
 	puts("\ndone\n");
+	debug("TFTP: round trip %lu us\n", tftp_srtt >> 3);
+
+	if (IS_ENABLED(CONFIG_TFTP_WINDOW_ADAPT) && !tftp_put_active &&
+	    tftp_window_size_option > 1)
+		tftp_adapt_window();
 
 	led_activity_off();
 
@@ -363,9 +525,9 @@ static void tftp_send(void)
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_request > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_request, 0);
 		len = pkt - xp;
 		break;
 
@@ -460,8 +622,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 {
 	__be16 proto;
 	__be16 *s;
-	int i;
+	int i, ret;
 	u16 timeout_val_rcvd;
+	ushort block, ahead;
 
 	if (dest != tftp_our_port) {
 			return;
@@ -598,30 +761,37 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			return;
 		len -= 2;
 
-		if (ntohs(*(__be16 *)pkt) != (ushort)(tftp_cur_block + 1)) {
+		tftp_rtt_sample();
+		block = ntohs(*(__be16 *)pkt);
+		if (block != (ushort)(tftp_cur_block + 1)) {
 			debug("Received unexpected block: %d, expected: %d\n",
-			      ntohs(*(__be16 *)pkt),
-			      (ushort)(tftp_cur_block + 1));
+			      block, (ushort)(tftp_cur_block + 1));
 			/*
 			 * Only ACK if the block count received is greater than
 			 * the expected block count, otherwise skip ACK.
 			 * (required to properly handle the server retransmitting
 			 *  the window)
 			 */
-			if ((ushort)(tftp_cur_block + 1) - (short)(ntohs(*(__be16 *)pkt)) > 0)
+			ahead = block - (ushort)(tftp_cur_block + 1);
+			if ((short)ahead < 0)
 				break;
+			ret = tftp_rx_early(block, ahead, pkt + 2, len);
+			if (ret < 0) {
+				eth_halt_state_only();
+				net_set_state(NETLOOP_FAIL);
+				break;
+			}
 			/*
 			 * If one packet is dropped most likely
 			 * all other buffers in the window
 			 * that will arrive will cause a sending NACK.
 			 * This just overwellms the server, let's just send one.
+			 * Blocks which are only slightly out of order are
+			 * kept, so wait to see whether the gap fills first.
 			 */
-			if (tftp_last_nack != tftp_cur_block) {
-				tftp_send();
-				tftp_last_nack = tftp_cur_block;
-				tftp_next_ack = (ushort)(tftp_cur_block +
-							 tftp_windowsize);
-			}
+			if (tftp_last_nack != tftp_cur_block &&
+			    (ret || ahead >= TFTP_REORDER_LIMIT))
+				tftp_resend_from_gap();
 			break;
 		}
 
@@ -658,9 +828,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		update_block_number();
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-		if (store_block(tftp_cur_block, pkt + 2, len)) {
+		if (store_block(block_offset(tftp_cur_block), pkt + 2, len)) {
 			eth_halt_state_only();
 			net_set_state(NETLOOP_FAIL);
 			break;
@@ -673,13 +842,24 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			break;
 		}
 
+		/* Blocks which arrived early may fill the gap after this one */
+		tftp_rx_advance();
+		if (tftp_final_seen && tftp_cur_block == tftp_final_block) {
+			tftp_send();
+			tftp_complete();
+			break;
+		}
+		tftp_set_timeout();
+
 		/*
 		 *	Acknowledge the block just received, which will prompt
 		 *	the remote for the next one.
 		 */
-		if (tftp_cur_block == tftp_next_ack) {
+		if ((short)(tftp_cur_block - tftp_next_ack) >= 0) {
 			tftp_send();
-			tftp_next_ack += tftp_windowsize;
+			tftp_ack_us = timer_get_us();
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
 		}
 		break;
 
@@ -710,6 +890,17 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	if (tftp_fast_timeout) {
+		/* the rest of the window is most likely lost */
+		debug("TFTP: window stopped at block %ld\n", tftp_cur_block);
+		tftp_fast_timeout = false;
+		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		tftp_resend_from_gap();
+		return;
+	}
+	tftp_ack_us = 0;
+	if (tftp_state == STATE_DATA)
+		tftp_resends++;
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
@@ -811,8 +1002,12 @@ void tftp_start(enum proto_t protocol)
 
 	sanitize_tftp_block_size_option(protocol);
 
+	if (!IS_ENABLED(CONFIG_TFTP_WINDOW_ADAPT) || !tftp_window_request ||
+	    tftp_window_request > tftp_window_size_option)
+		tftp_window_request = tftp_window_size_option;
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
-	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+	      tftp_block_size_option, tftp_window_request, timeout_ms);
 
 	if (IS_ENABLED(CONFIG_IPV6))
 		tftp_remote_ip6 = net_server_ip6;
@@ -935,6 +1130,16 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
+	/* blocks may be kept before the first one arrives */
+	tftp_block_wrap = 0;
+	tftp_block_wrap_offset = 0;
+	tftp_rx_map = 0;
+	tftp_final_seen = false;
+	tftp_ack_us = 0;
+	tftp_srtt = 0;
+	tftp_fast_timeout = false;
+	tftp_reordered = 0;
+	tftp_resends = 0;
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
@@ -970,6 +1175,11 @@ void tftp_start_server(void)
 	tftp_our_port = WELL_KNOWN_PORT;
 	tftp_windowsize = 1;
 	tftp_next_ack = tftp_windowsize;
+	tftp_rx_map = 0;
+	tftp_final_seen = false;
+	tftp_fast_timeout = false;
+	tftp_reordered = 0;
+	tftp_resends = 0;
 
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
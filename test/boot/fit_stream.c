@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for loading images from an external-data FIT through a stream
+ */
+
+#include <command.h>
+#include <gzip.h>
+#include <image.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <os.h>
+#include <linux/libfdt.h>
+#include <linux/sizes.h>
+#include <test/ut.h>
+#include <u-boot/crc.h>
+#include <u-boot/sha256.h>
+#include "bootstd_common.h"
+
+#define STREAM_DATA_SIZE	(SZ_64K + 123)
+#define STREAM_FIT_SIZE		(SZ_256K)
+#define STREAM_CHUNK_SIZE	SZ_16K
+
+/**
+ * struct test_stream_src - A FIT held in memory, read through a stream
+ *
+ * @buf:	FIT, with its external data after the FDT part
+ * @size:	Total size of the FIT
+ * @reads:	Number of calls to the read function
+ * @bytes:	Number of bytes read
+ */
+struct test_stream_src {
+	u8 *buf;
+	ulong size;
+	int reads;
+	ulong bytes;
+};
+
+static long test_stream_read(struct fit_stream *stream, ulong offset,
+			     ulong size, void *buf)
+{
+	struct test_stream_src *src = stream->priv;
+
+	if (offset >= src->size)
+		return 0;
+	size = min(size, src->size - offset);
+	memcpy(buf, src->buf + offset, size);
+	src->reads++;
+	src->bytes += size;
+
+	return size;
+}
+
+/* Add an image with external data at @data_ofs to the FIT being built */
+static int test_stream_add_image(struct unit_test_state *uts, void *fit,
+				 const char *name, const char *comp,
+				 const void *data, int size, int data_ofs)
+{
+	u8 value[SHA256_SUM_LEN];
+	int images, node, hash;
+
+	images = fdt_path_offset(fit, FIT_IMAGES_PATH);
+	ut_assert(images >= 0);
+	node = fdt_add_subnode(fit, images, name);
+	ut_assert(node >= 0);
+	ut_assertok(fdt_setprop_string(fit, node, FIT_DESC_PROP, name));
+	ut_assertok(fdt_setprop_string(fit, node, FIT_TYPE_PROP, "kernel"));
+	ut_assertok(fdt_setprop_string(fit, node, FIT_COMP_PROP, comp));
+	ut_assertok(fdt_setprop_u32(fit, node, FIT_DATA_OFFSET_PROP,
+				    data_ofs));
+	ut_assertok(fdt_setprop_u32(fit, node, FIT_DATA_SIZE_PROP, size));
+
+	hash = fdt_add_subnode(fit, node, "hash-1");
+	ut_assert(hash >= 0);
+	sha256_csum_wd(data, size, value, CHUNKSZ_SHA256);
+	ut_assertok(fdt_setprop_string(fit, hash, FIT_ALGO_PROP, "sha256"));
+	ut_assertok(fdt_setprop(fit, hash, FIT_VALUE_PROP, value,
+				sizeof(value)));
+
+	/* a checksum too, which is stored big-endian */
+	hash = fdt_add_subnode(fit, node, "hash-2");
+	ut_assert(hash >= 0);
+	crc32_wd_buf(data, size, value, CHUNKSZ_CRC32);
+	ut_assertok(fdt_setprop_string(fit, hash, FIT_ALGO_PROP, "crc32"));
+	ut_assertok(fdt_setprop(fit, hash, FIT_VALUE_PROP, value, 4));
+
+	return 0;
+}
+
+/*
+ * Build a FIT with an uncompressed and a gzipped copy of @data, with the
+ * data after the FDT part, and a configuration which uses both
+ */
+static int test_stream_make_fit(struct unit_test_state *uts,
+				struct test_stream_src *src, const u8 *data)
+{
+	ulong gz_size = STREAM_DATA_SIZE;
+	void *fit = src->buf;
+	int base, confs, conf;
+	u8 *gz;
+
+	gz = malloc(gz_size);
+	ut_assertnonnull(gz);
+	ut_assertok(gzip(gz, &gz_size, (u8 *)data, STREAM_DATA_SIZE));
+
+	ut_assertok(fdt_create_empty_tree(fit, SZ_4K));
+	ut_assertok(fdt_setprop_string(fit, 0, FIT_DESC_PROP, "stream test"));
+	ut_assertok(fdt_setprop_u32(fit, 0, FIT_TIMESTAMP_PROP, 0));
+	ut_assert(fdt_add_subnode(fit, 0, "images") >= 0);
+	ut_assertok(test_stream_add_image(uts, fit, "plain", "none", data,
+					  STREAM_DATA_SIZE, 0));
+	ut_assertok(test_stream_add_image(uts, fit, "packed", "gzip", gz,
+					  gz_size, STREAM_DATA_SIZE));
+	confs = fdt_add_subnode(fit, 0, "configurations");
+	ut_assert(confs >= 0);
+	ut_assertok(fdt_setprop_string(fit, confs, FIT_DEFAULT_PROP,
+				       "conf-1"));
+	conf = fdt_add_subnode(fit, confs, "conf-1");
+	ut_assert(conf >= 0);
+	ut_assertok(fdt_setprop_string(fit, conf, FIT_KERNEL_PROP, "plain"));
+	ut_assertok(fdt_setprop_string(fit, conf, FIT_LOADABLE_PROP,
+				       "packed"));
+	ut_assertok(fdt_pack(fit));
+
+	base = ALIGN(fdt_totalsize(fit), 4);
+	ut_assert(base + STREAM_DATA_SIZE + gz_size <= STREAM_FIT_SIZE);
+	memcpy(src->buf + base, data, STREAM_DATA_SIZE);
+	memcpy(src->buf + base + STREAM_DATA_SIZE, gz, gz_size);
+	src->size = base + STREAM_DATA_SIZE + gz_size;
+	free(gz);
+
+	return 0;
+}
+
+/* Test loading plain and compressed images, a bad hash and a short buffer */
+static int test_fit_stream(struct unit_test_state *uts)
+{
+	struct test_stream_src src = {};
+	struct fit_stream stream = {
+		.read		= test_stream_read,
+		.priv		= &src,
+		.chunk_size	= STREAM_CHUNK_SIZE,
+	};
+	u8 *data, *dst;
+	void *fit;
+	ulong len;
+	int node, i;
+
+	data = malloc(STREAM_DATA_SIZE);
+	dst = malloc(STREAM_DATA_SIZE);
+	src.buf = malloc(STREAM_FIT_SIZE);
+	ut_assertnonnull(data);
+	ut_assertnonnull(dst);
+	ut_assertnonnull(src.buf);
+	for (i = 0; i < STREAM_DATA_SIZE; i++)
+		data[i] = i % 251 + (i >> 12);
+	ut_assertok(test_stream_make_fit(uts, &src, data));
+
+	ut_assertok(fit_stream_read_header(&stream, &fit));
+	ut_asserteq(fdt_totalsize(src.buf), fdt_totalsize(fit));
+
+	/* the uncompressed image arrives in chunks and is read once */
+	src.reads = 0;
+	src.bytes = 0;
+	node = fit_image_get_node(fit, "plain");
+	ut_assert(node >= 0);
+	ut_assertok(fit_image_load_stream(&stream, fit, node, dst,
+					  STREAM_DATA_SIZE, &len));
+	ut_asserteq(STREAM_DATA_SIZE, len);
+	ut_asserteq_mem(data, dst, STREAM_DATA_SIZE);
+	ut_asserteq(DIV_ROUND_UP(STREAM_DATA_SIZE, STREAM_CHUNK_SIZE),
+		    src.reads);
+	ut_asserteq(STREAM_DATA_SIZE, src.bytes);
+
+	/* the compressed one is unpacked into place */
+	memset(dst, '\0', STREAM_DATA_SIZE);
+	node = fit_image_get_node(fit, "packed");
+	ut_assert(node >= 0);
+	ut_assertok(fit_image_load_stream(&stream, fit, node, dst,
+					  STREAM_DATA_SIZE, &len));
+	ut_asserteq(STREAM_DATA_SIZE, len);
+	ut_asserteq_mem(data, dst, STREAM_DATA_SIZE);
+
+	/* not enough space */
+	node = fit_image_get_node(fit, "plain");
+	ut_asserteq(-ENOSPC, fit_image_load_stream(&stream, fit, node, dst,
+						   STREAM_DATA_SIZE - 1, &len));
+
+	/* corrupt the data */
+	src.buf[ALIGN(fdt_totalsize(fit), 4) + 1000] ^= 1;
+	ut_asserteq(-EBADMSG, fit_image_load_stream(&stream, fit, node, dst,
+						    STREAM_DATA_SIZE, &len));
+
+	free(fit);
+	free(src.buf);
+	free(dst);
+	free(data);
+
+	return 0;
+}
+BOOTSTD_TEST(test_fit_stream, 0);
+
+/* Test the fitload command, which picks the image through a configuration */
+static int test_fit_stream_cmd(struct unit_test_state *uts)
+{
+	struct test_stream_src src = {};
+	const char *fname = "fit_stream.fit";
+	u8 *data, *dst;
+	ulong addr;
+	int i;
+
+	data = malloc(STREAM_DATA_SIZE);
+	dst = malloc(STREAM_DATA_SIZE);
+	src.buf = malloc(STREAM_FIT_SIZE);
+	ut_assertnonnull(data);
+	ut_assertnonnull(dst);
+	ut_assertnonnull(src.buf);
+	for (i = 0; i < STREAM_DATA_SIZE; i++)
+		data[i] = i % 251 + (i >> 12);
+	ut_assertok(test_stream_make_fit(uts, &src, data));
+	ut_assertok(os_write_file(fname, src.buf, src.size));
+	addr = map_to_sysmem(dst);
+
+	/* the default configuration is checked before the kernel is read */
+	ut_assertok(run_commandf("fitload hostfs - %lx %s - kernel", addr,
+				 fname));
+	ut_assert_nextline("   Using 'conf-1' configuration");
+	if (IS_ENABLED(CONFIG_FIT_SIGNATURE))
+		ut_assert_nextline("   Verifying Hash Integrity ... OK");
+	ut_assert_nextline("   Loading 'plain' crc32+ sha256+ OK");
+	ut_assert_nextline("%d bytes loaded to %lx", STREAM_DATA_SIZE, addr);
+	ut_assert_console_end();
+	ut_asserteq_mem(data, dst, STREAM_DATA_SIZE);
+
+	/* a named configuration and another of its images */
+	memset(dst, '\0', STREAM_DATA_SIZE);
+	ut_assertok(run_commandf("fitload hostfs - %lx %s conf-1 loadables",
+				 addr, fname));
+	ut_assert_skip_to_line("   Loading 'packed' crc32+ sha256+ OK");
+	ut_assert_nextline("%d bytes loaded to %lx", STREAM_DATA_SIZE, addr);
+	ut_assert_console_end();
+	ut_asserteq_mem(data, dst, STREAM_DATA_SIZE);
+
+	ut_asserteq(1, run_commandf("fitload hostfs - %lx %s conf-2 kernel",
+				    addr, fname));
+	ut_assert_nextline("Cannot find configuration 'conf-2'");
+	ut_assert_nextline("Failed to load 'kernel' image (err=%d)", -ENOENT);
+	ut_assert_console_end();
+
+	ut_asserteq(1, run_commandf("fitload hostfs - %lx %s - fdt", addr,
+				    fname));
+	ut_assert_skip_to_line("Cannot find 'fdt' image in configuration");
+	ut_assert_nextline("Failed to load 'fdt' image (err=%d)", -ENOENT);
+	ut_assert_console_end();
+
+	os_unlink(fname);
+	free(src.buf);
+	free(dst);
+	free(data);
+
+	return 0;
+}
+BOOTSTD_TEST(test_fit_stream_cmd, UTF_CONSOLE);
@@ -4,11 +4,15 @@
  */
 
 #include <blk.h>
+#include <blkmap.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <sandbox_host.h>
 #include <usb.h>
 #include <asm/state.h>
+#include <dm/device-internal.h>
+#include <dm/root.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -291,3 +295,249 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Test the block cache, including readahead of sequential reads */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct udevice *dev, *blk;
+	char buf[DEFAULT_BLKSZ];
+	char *disk;
+	int i;
+
+	if (!IS_ENABLED(CONFIG_BLKMAP))
+		return -EAGAIN;
+
+	disk = malloc(1024 * DEFAULT_BLKSZ);
+	ut_assertnonnull(disk);
+	for (i = 0; i < 1024; i++)
+		memset(disk + i * DEFAULT_BLKSZ, i & 0xff, DEFAULT_BLKSZ);
+
+	ut_assertok(blkmap_create("cachetest", &dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(blkmap_map_mem(dev, 0, 1024, disk));
+
+	blkcache_configure(8, 32);
+	blkcache_configure_size(0x1000, 64);
+	blkcache_stats(&stats);
+
+	/* a repeated read is served from the cache */
+	ut_asserteq(1, blk_read(blk, 10, 1, buf));
+	ut_asserteq(1, blk_read(blk, 10, 1, buf));
+	ut_asserteq(10, buf[0]);
+
+	/* the third sequential read triggers a readahead of 64 blocks */
+	for (i = 100; i < 166; i++) {
+		ut_asserteq(1, blk_read(blk, i, 1, buf));
+		ut_asserteq(i & 0xff, (u8)buf[DEFAULT_BLKSZ - 1]);
+	}
+
+	blkcache_stats(&stats);
+	ut_asserteq(64, stats.hits);
+	ut_asserteq(4, stats.misses);
+	ut_asserteq(63, stats.ra_hits);
+	ut_asserteq(1, stats.readaheads);
+	ut_asserteq(3, stats.entries);
+	ut_asserteq(3 * DEFAULT_BLKSZ, stats.size);
+
+	/* entries are evicted to stay within the memory budget */
+	for (i = 200; i < 240; i += 2)
+		ut_asserteq(1, blk_read(blk, i, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0x1000 / DEFAULT_BLKSZ, stats.entries);
+	ut_asserteq(0x1000, stats.size);
+
+	/* a write drops the cached data, including the readahead window */
+	memset(buf, 0xaa, DEFAULT_BLKSZ);
+	ut_asserteq(1, blk_write(blk, 120, 1, buf));
+	ut_asserteq(1, blk_read(blk, 120, 1, buf));
+	ut_asserteq(0xaa, (u8)buf[0]);
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+
+	blkcache_configure(8, 128);
+	blkcache_configure_size(CONFIG_BLOCK_CACHE_SIZE,
+				CONFIG_BLOCK_CACHE_READAHEAD);
+	ut_assertok(blkmap_destroy(dev));
+	free(disk);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+static void dm_test_blk_async_done(struct blk_req *req)
+{
+	int *count = req->priv;
+
+	(*count)++;
+}
+
+/* Test asynchronous block requests */
+static int dm_test_blk_async(struct unit_test_state *uts)
+{
+	struct blk_sg sg[3], sg2;
+	struct blk_req req, req2;
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	char *disk, *buf;
+	int i, count = 0;
+
+	disk = malloc(64 * DEFAULT_BLKSZ);
+	ut_assertnonnull(disk);
+	for (i = 0; i < 64; i++)
+		memset(disk + i * DEFAULT_BLKSZ, i, DEFAULT_BLKSZ);
+	buf = calloc(64, DEFAULT_BLKSZ);
+	ut_assertnonnull(buf);
+
+	/* blocks 4-5, 6-8 and 9 go to three separate buffers */
+	sg[0].buf = buf + 10 * DEFAULT_BLKSZ;
+	sg[0].blkcnt = 2;
+	sg[1].buf = buf;
+	sg[1].blkcnt = 3;
+	sg[2].buf = buf + 20 * DEFAULT_BLKSZ;
+	sg[2].blkcnt = 1;
+
+	/* a device which cannot work in the background finishes straight away */
+	ut_assertok(blkmap_create("asynctest", &dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(blkmap_map_mem(dev, 0, 64, disk));
+	blk_req_init(&req, blk, BLK_REQ_READ, 4, sg, ARRAY_SIZE(sg));
+	req.complete = dm_test_blk_async_done;
+	req.priv = &count;
+	ut_asserteq(6, blk_req_blkcnt(&req));
+	ut_assertok(blk_req_submit(&req));
+	ut_asserteq(0, req.status);
+	ut_asserteq(6, req.done);
+	ut_asserteq(1, count);
+	ut_asserteq(0, blk_req_poll(blk));
+	ut_asserteq_mem(disk + 4 * DEFAULT_BLKSZ, buf + 10 * DEFAULT_BLKSZ,
+			2 * DEFAULT_BLKSZ);
+	ut_asserteq_mem(disk + 6 * DEFAULT_BLKSZ, buf, 3 * DEFAULT_BLKSZ);
+	ut_asserteq_mem(disk + 9 * DEFAULT_BLKSZ, buf + 20 * DEFAULT_BLKSZ,
+			DEFAULT_BLKSZ);
+	ut_assertok(blkmap_destroy(dev));
+
+	/* MMC reads move along, one piece at a time, as the device is polled */
+	ut_assertok(blk_get_device(UCLASS_MMC, 0, &blk));
+	ut_asserteq(64, blk_write(blk, 0, 64, disk));
+	memset(buf, '\0', 64 * DEFAULT_BLKSZ);
+	blk_req_init(&req, blk, BLK_REQ_READ, 4, sg, ARRAY_SIZE(sg));
+	req.complete = dm_test_blk_async_done;
+	req.priv = &count;
+	sg2.buf = buf + 30 * DEFAULT_BLKSZ;
+	sg2.blkcnt = 16;
+	blk_req_init(&req2, blk, BLK_REQ_READ, 40, &sg2, 1);
+	req2.complete = dm_test_blk_async_done;
+	req2.priv = &count;
+
+	count = 0;
+	ut_assertok(blk_req_submit(&req));
+	ut_assertok(blk_req_submit(&req2));
+	ut_asserteq(-EINPROGRESS, req.status);
+	ut_asserteq(-EINPROGRESS, req2.status);
+	ut_asserteq(0, buf[10 * DEFAULT_BLKSZ]);
+
+	ut_asserteq(2, blk_req_poll(blk));
+	ut_asserteq(2, req.done);
+	ut_asserteq(4, buf[10 * DEFAULT_BLKSZ]);
+	ut_asserteq(0, buf[0]);
+
+	/* requests finish in order */
+	ut_assertok(blk_req_wait(&req2));
+	ut_asserteq(0, req.status);
+	ut_asserteq(6, req.done);
+	ut_asserteq(16, req2.done);
+	ut_asserteq(2, count);
+	ut_asserteq(0, blk_req_poll(blk));
+	ut_asserteq_mem(disk + 4 * DEFAULT_BLKSZ, buf + 10 * DEFAULT_BLKSZ,
+			2 * DEFAULT_BLKSZ);
+	ut_asserteq_mem(disk + 6 * DEFAULT_BLKSZ, buf, 3 * DEFAULT_BLKSZ);
+	ut_asserteq_mem(disk + 9 * DEFAULT_BLKSZ, buf + 20 * DEFAULT_BLKSZ,
+			DEFAULT_BLKSZ);
+	ut_asserteq_mem(disk + 40 * DEFAULT_BLKSZ, buf + 30 * DEFAULT_BLKSZ,
+			16 * DEFAULT_BLKSZ);
+
+	/* a synchronous transfer waits for the requests before it */
+	memset(buf, '\0', 64 * DEFAULT_BLKSZ);
+	ut_assertok(blk_req_submit(&req));
+	ut_asserteq(-EINPROGRESS, req.status);
+	ut_asserteq(1, blk_read(blk, 63, 1, buf + 63 * DEFAULT_BLKSZ));
+	ut_asserteq(0, req.status);
+	ut_asserteq_mem(disk + 6 * DEFAULT_BLKSZ, buf, 3 * DEFAULT_BLKSZ);
+
+	/* MMC writes are made synchronously */
+	blk_req_init(&req, blk, BLK_REQ_WRITE, 50, sg, 1);
+	ut_assertok(blk_req_submit(&req));
+	ut_asserteq(0, req.status);
+	ut_asserteq(1, blk_read(blk, 51, 1, buf));
+	ut_asserteq_mem(disk + 5 * DEFAULT_BLKSZ, buf, DEFAULT_BLKSZ);
+
+	/* requests past the end of the device fail */
+	desc = dev_get_uclass_plat(blk);
+	blk_req_init(&req, blk, BLK_REQ_READ, desc->lba, sg, 1);
+	ut_assertok(blk_req_submit(&req));
+	ut_asserteq(-EINVAL, req.status);
+
+	free(buf);
+	free(disk);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+static ulong blk_test_nopoll_read(struct udevice *dev, lbaint_t start,
+				  lbaint_t blkcnt, void *buf)
+{
+	return blkcnt;
+}
+
+/* accept requests in the background, but never move them along */
+static int blk_test_nopoll_submit(struct udevice *dev, struct blk_req *req)
+{
+	return 0;
+}
+
+static const struct blk_ops blk_test_nopoll_ops = {
+	.read	= blk_test_nopoll_read,
+	.submit	= blk_test_nopoll_submit,
+};
+
+U_BOOT_DRIVER(blk_test_nopoll) = {
+	.name		= "blk_test_nopoll",
+	.id		= UCLASS_BLK,
+	.ops		= &blk_test_nopoll_ops,
+};
+
+/* Test that requests which cannot finish do not hold up other transfers */
+static int dm_test_blk_async_nopoll(struct unit_test_state *uts)
+{
+	struct udevice *blk;
+	struct blk_req req;
+	struct blk_sg sg;
+	char buf[DEFAULT_BLKSZ];
+
+	ut_assertok(blk_create_devicef(dm_root(), "blk_test_nopoll", "blk",
+				       UCLASS_ROOT, -1, DEFAULT_BLKSZ, 16,
+				       &blk));
+	ut_assertok(device_probe(blk));
+
+	sg.buf = buf;
+	sg.blkcnt = 1;
+	blk_req_init(&req, blk, BLK_REQ_READ, 0, &sg, 1);
+	ut_assertok(blk_req_submit(&req));
+	ut_asserteq(-EINPROGRESS, req.status);
+	ut_asserteq(-ENOSYS, blk_req_poll(blk));
+
+	/* the request is failed, rather than waited for forever */
+	ut_asserteq(1, blk_read(blk, 0, 1, buf));
+	ut_asserteq(-ENOSYS, req.status);
+	ut_asserteq(0, blk_req_poll(blk));
+
+	ut_assertok(device_remove(blk, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(blk));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async_nopoll, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+#endif
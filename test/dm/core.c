@@ -12,6 +12,7 @@
 #include <malloc.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
@@ -1425,3 +1426,52 @@ static int dm_test_multimatch(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_multimatch, UTF_SCAN_FDT);
+
+/* Test that drivers are found by compatible string in linker-list order */
+static int dm_test_lists_compat(struct unit_test_state *uts)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match, *ref, *id;
+	struct driver *drv;
+	int i, j, count = 0;
+
+	for (i = 0; i < n_ents; i++) {
+		for (of_match = driver[i].of_match;
+		     of_match && of_match->compatible; of_match++) {
+			const char *compat = of_match->compatible;
+
+			/* every driver with this string is found, in order */
+			drv = NULL;
+			for (j = 0; j < n_ents; j++) {
+				for (ref = driver[j].of_match;
+				     ref && ref->compatible; ref++) {
+					if (!strcmp(ref->compatible, compat))
+						break;
+				}
+				if (!ref || !ref->compatible)
+					continue;
+				ut_assertok(lists_driver_lookup_compat(compat,
+								       &drv,
+								       &id));
+				ut_asserteq_ptr(&driver[j], drv);
+				ut_asserteq_ptr(ref, id);
+			}
+			ut_asserteq(-ENOENT,
+				    lists_driver_lookup_compat(compat, &drv,
+							       &id));
+			count++;
+		}
+	}
+	ut_assert(count > 0);
+
+	drv = NULL;
+	ut_asserteq(-ENOENT, lists_driver_lookup_compat("u-boot,no-driver",
+							&drv, &id));
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	ut_assertnonnull(gd->dm_compat_index);
+#endif
+
+	return 0;
+}
+DM_TEST(dm_test_lists_compat, UTF_SCAN_FDT);
@@ -9,8 +9,10 @@
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
+#include <image.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <net6.h>
 #include <asm/eth.h>
@@ -623,6 +625,176 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 DM_TEST(dm_test_eth_async_ping_reply, UTF_SCAN_FDT);
 #endif
 
+#if CONFIG_IS_ENABLED(NET_LEGACY) && IS_ENABLED(CONFIG_CMD_TFTPBOOT)
+/* Well known TFTP port # */
+#define SB_TFTP_PORT		69
+/* Transaction ID, chosen at random */
+#define SB_TFTP_TID		21313
+#define SB_TFTP_BLOCK_SIZE	512
+/* One receive buffer is in use while the client sends its ACK */
+#define SB_TFTP_WINDOW		(PKTBUFSRX - 1)
+#define SB_TFTP_BLOCKS		40
+#define SB_TFTP_SIZE		(SB_TFTP_BLOCKS * SB_TFTP_BLOCK_SIZE - 100)
+
+/**
+ * struct sb_tftp_server - A TFTP server which sends each window out of order
+ *
+ * @img:	File to send
+ * @drop:	Block to drop the first time it is sent, or 0 for none
+ * @sent:	Number of data blocks sent
+ */
+struct sb_tftp_server {
+	const u8 *img;
+	int drop;
+	int sent;
+};
+
+/* Inject a TFTP packet from the server, in reply to @packet */
+static void sb_tftp_reply(struct udevice *dev, void *packet, const void *data,
+			  int size)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	ipr->ip_hl_v = 0x45;
+	ipr->ip_tos = 0;
+	ipr->ip_len = htons(IP_UDP_HDR_SIZE + size);
+	ipr->ip_id = 0;
+	ipr->ip_off = htons(IP_FLAGS_DFRAG);
+	ipr->ip_ttl = 255;
+	ipr->ip_p = IPPROTO_UDP;
+	ipr->ip_sum = 0;
+	net_copy_ip(&ipr->ip_dst, &ip->ip_src);
+	net_copy_ip(&ipr->ip_src, &ip->ip_dst);
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+	ipr->udp_src = htons(SB_TFTP_TID);
+	ipr->udp_dst = ip->udp_src;
+	ipr->udp_len = htons(UDP_HDR_SIZE + size);
+	ipr->udp_xsum = 0;
+	memcpy((void *)ipr + IP_UDP_HDR_SIZE, data, size);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + size;
+	++priv->recv_packets;
+}
+
+/* Send the window after block @acked, swapping each pair of blocks */
+static void sb_tftp_send_window(struct udevice *dev, void *packet, int acked)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_tftp_server *srv = priv->priv;
+	__be16 data[2 + SB_TFTP_BLOCK_SIZE / 2];
+	int order[SB_TFTP_WINDOW];
+	int i, count;
+
+	count = min(SB_TFTP_WINDOW, SB_TFTP_BLOCKS - acked);
+	for (i = 0; i < count; i++)
+		order[i] = acked + 1 + (i ^ 1);
+	if (count & 1)
+		order[count - 1] = acked + count;
+
+	for (i = 0; i < count; i++) {
+		int block = order[i];
+		int ofs = (block - 1) * SB_TFTP_BLOCK_SIZE;
+		int size = min(SB_TFTP_BLOCK_SIZE, SB_TFTP_SIZE - ofs);
+
+		srv->sent++;
+		if (block == srv->drop) {
+			srv->drop = 0;
+			continue;
+		}
+		data[0] = htons(3);
+		data[1] = htons(block);
+		memcpy(data + 2, srv->img + ofs, size);
+		sb_tftp_reply(dev, packet, data, 4 + size);
+	}
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	static const char oack[] = "\0\6blksize\0" "512\0" "windowsize\0" "3";
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth = packet;
+	__be16 *tftp = (void *)ip + IP_UDP_HDR_SIZE;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	if (ntohs(ip->udp_dst) == SB_TFTP_PORT && ntohs(tftp[0]) == 1)
+		sb_tftp_reply(dev, packet, oack, sizeof(oack));
+	else if (ntohs(ip->udp_dst) == SB_TFTP_TID && ntohs(tftp[0]) == 4)
+		sb_tftp_send_window(dev, packet, ntohs(tftp[1]));
+
+	return 0;
+}
+
+/* Load a file from a server which reorders and drops blocks */
+static int dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	struct in_addr server_ip = net_server_ip;
+	struct sb_tftp_server srv = {};
+	u8 *img, *buf;
+	int i;
+
+	img = malloc(SB_TFTP_SIZE);
+	ut_assertnonnull(img);
+	for (i = 0; i < SB_TFTP_SIZE; i++)
+		img[i] = i % 253;
+	srv.img = img;
+	buf = map_sysmem(0x1000000, SB_TFTP_SIZE);
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, &srv);
+	env_set("ethact", "eth@10002000");
+	env_set("tftpwindowsize", "3");
+	net_server_ip = string_to_ip("1.1.2.4");
+	strcpy(net_boot_file_name, "window.bin");
+	image_load_addr = 0x1000000;
+
+	/* blocks which are only swapped are used as they are */
+	memset(buf, '\0', SB_TFTP_SIZE);
+	ut_asserteq(1, net_loop(TFTPGET));
+	ut_asserteq(SB_TFTP_SIZE, net_boot_file_size);
+	ut_asserteq_mem(img, buf, SB_TFTP_SIZE);
+	ut_asserteq(SB_TFTP_BLOCKS, srv.sent);
+
+	/* a lost block is asked for again, without waiting for the timeout */
+	memset(buf, '\0', SB_TFTP_SIZE);
+	srv.sent = 0;
+	srv.drop = 20;
+	ut_asserteq(1, net_loop(TFTPGET));
+	ut_asserteq(SB_TFTP_SIZE, net_boot_file_size);
+	ut_asserteq_mem(img, buf, SB_TFTP_SIZE);
+	ut_assert(srv.sent <= SB_TFTP_BLOCKS + SB_TFTP_WINDOW);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	net_server_ip = server_ip;
+	unmap_sysmem(buf);
+	free(img);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_tftp_window, UTF_SCAN_FDT);
+#endif
+
 #if IS_ENABLED(CONFIG_IPV6_ROUTER_DISCOVERY)
 
 static u8 ip6_ra_buf[] = {0x60, 0xf, 0xc5, 0x4a, 0x0, 0x38, 0x3a, 0xff, 0xfe,
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the hashes used by the ext4 directory index
+ */
+
+#include <dm.h>
+#include <ext4fs.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../fs/ext4/ext4_common.h"
+
+/**
+ * struct ext4_hash_test - expected hashes of one name
+ *
+ * The values are from 'debugfs -R "dx_hash -h <version> -s <seed> <name>"'
+ *
+ * @name:	File name
+ * @zero:	Hash for each version (DX_HASH_...) with an all-zero seed
+ * @seeded:	Hash for each version with ext4_hash_seed
+ */
+struct ext4_hash_test {
+	const char *name;
+	u32 zero[6];
+	u32 seeded[6];
+};
+
+/* 1b9e3a7c-5d2f-4e81-9c04-6a7b8c9d0e1f, as stored in the superblock */
+static const u8 ext4_hash_seed[16] = {
+	0x1b, 0x9e, 0x3a, 0x7c, 0x5d, 0x2f, 0x4e, 0x81,
+	0x9c, 0x04, 0x6a, 0x7b, 0x8c, 0x9d, 0x0e, 0x1f,
+};
+
+static const struct ext4_hash_test ext4_hash_tests[] = {
+	{
+		"file00001.txt",
+		{ 0x8874c858, 0x877c4e6a, 0xa19c58da,
+		  0x8874c858, 0x877c4e6a, 0xa19c58da },
+		{ 0x8874c858, 0x73394f32, 0x71229b36,
+		  0x8874c858, 0x73394f32, 0x71229b36 },
+	},
+	/* the top bit is set in some bytes, so signedness matters */
+	{
+		"caf\xc3\xa9",
+		{ 0x96ca5a2c, 0xfb9c5e5c, 0x105842ea,
+		  0x6dde4230, 0x9d72aed6, 0x6621f032 },
+		{ 0x96ca5a2c, 0xfb2aaf0c, 0xf798da64,
+		  0x6dde4230, 0x63b2d216, 0xbd6d495a },
+	},
+	/* longer than one block of both half-MD4 (32 bytes) and TEA (16) */
+	{
+		"a-name-which-is-longer-than-thirty-two-bytes.txt",
+		{ 0x77edaaca, 0xb10e51fa, 0xd8f47336,
+		  0x77edaaca, 0xb10e51fa, 0xd8f47336 },
+		{ 0x77edaaca, 0xb9745b5c, 0xcecbefae,
+		  0x77edaaca, 0xb9745b5c, 0xcecbefae },
+	},
+};
+
+/* Check the directory hashes against those worked out by e2fsprogs */
+static int dm_test_ext4_dirhash(struct unit_test_state *uts)
+{
+	const __le32 zero[4] = {};
+	__le32 seed[4];
+	int i, version;
+	u32 hash;
+
+	memcpy(seed, ext4_hash_seed, sizeof(seed));
+	for (i = 0; i < ARRAY_SIZE(ext4_hash_tests); i++) {
+		const struct ext4_hash_test *test = &ext4_hash_tests[i];
+		int len = strlen(test->name);
+
+		for (version = DX_HASH_LEGACY; version <= DX_HASH_TEA_UNSIGNED;
+		     version++) {
+			ut_assertok(ext4fs_dirhash(version, zero, test->name,
+						   len, &hash));
+			ut_asserteq(test->zero[version], hash);
+			ut_assertok(ext4fs_dirhash(version, seed, test->name,
+						   len, &hash));
+			ut_asserteq(test->seeded[version], hash);
+		}
+	}
+	ut_asserteq(-EINVAL, ext4fs_dirhash(DX_HASH_TEA_UNSIGNED + 1, zero,
+					    "name", 4, &hash));
+
+	return 0;
+}
+DM_TEST(dm_test_ext4_dirhash, 0);
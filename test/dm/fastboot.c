@@ -7,11 +7,14 @@
 #include <env.h>
 #include <fastboot.h>
 #include <fb_mmc.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
+#include <sparse_format.h>
 #include <dm/test.h>
 #include <test/ut.h>
+#include <linux/sizes.h>
 #include <linux/stringify.h>
 
 #define FB_ALIAS_PREFIX "fastboot_partition_alias_"
@@ -93,3 +96,242 @@ static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_fastboot_mmc_part, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/* Send a fastboot command and check that the response starts with @expect */
+static int fb_stream_cmd(struct unit_test_state *uts, const char *cmd,
+			 const char *expect)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char buf[FASTBOOT_COMMAND_LEN];
+
+	strlcpy(buf, cmd, sizeof(buf));
+	fastboot_handle_command(buf, response);
+	ut_asserteq_strn(expect, response);
+
+	return 0;
+}
+
+/*
+ * Send a flash command and check its result, collecting the INFO messages
+ * sent ahead of it in @info
+ */
+static int fb_stream_flash(struct unit_test_state *uts, const char *cmd,
+			   const char *expect, char *info, int size)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char buf[FASTBOOT_COMMAND_LEN];
+
+	strlcpy(buf, cmd, sizeof(buf));
+	*info = '\0';
+	ut_asserteq(FASTBOOT_COMMAND_FLASH,
+		    fastboot_handle_command(buf, response));
+	if (!strncmp(response, "MORE", 4)) {
+		fastboot_multiresponse(FASTBOOT_COMMAND_FLASH, response);
+		while (!strncmp(response, "INFO", 4)) {
+			strlcat(info, response + 4, size);
+			strlcat(info, "\n", size);
+			fastboot_multiresponse(FASTBOOT_COMMAND_FLASH,
+					       response);
+		}
+	}
+	ut_asserteq_strn(expect, response);
+
+	return 0;
+}
+
+/* Download @size bytes from @data in pieces of @piece bytes */
+static int fb_stream_download(struct unit_test_state *uts, const u8 *data,
+			      u32 size, u32 piece)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char cmd[FASTBOOT_COMMAND_LEN];
+	u32 done, n;
+
+	snprintf(cmd, sizeof(cmd), "download:%08x", size);
+	ut_assertok(fb_stream_cmd(uts, cmd, "DATA"));
+	for (done = 0; done < size; done += n) {
+		n = min(piece, size - done);
+		fastboot_data_download(data + done, n, response);
+		ut_asserteq_str("", response);
+		/* let the transport get ahead of the writes sometimes */
+		if (done % (3 * piece))
+			fastboot_stream_poll();
+	}
+	fastboot_data_complete(response);
+	ut_asserteq_str("OKAY", response);
+
+	return 0;
+}
+
+/* Add a chunk header to a sparse image, returning a pointer to its data */
+static u8 *fb_stream_add_chunk(u8 *ptr, int type, u32 blocks, u32 data_size)
+{
+	chunk_header_t *chunk = (chunk_header_t *)ptr;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = blocks;
+	chunk->total_sz = sizeof(*chunk) + data_size;
+
+	return ptr + sizeof(*chunk);
+}
+
+static int dm_test_fastboot_stream(struct unit_test_state *uts)
+{
+	const u32 blk_sz = SZ_4K, part_blks = 16;
+	const u32 part_size = part_blks * blk_sz;
+	char str_disk_guid[UUID_STR_LEN + 1];
+	char info[256];
+	struct disk_partition parts[1] = {
+		{
+			.start = 48,
+			.size = part_size / 512,
+			.name = "stream",
+		},
+	};
+	struct blk_desc *mmc_dev_desc;
+	sparse_header_t *hdr;
+	u8 *img, *ptr, *buf, *expect, *out;
+	u32 fill = 0x5a5aa5a5;
+	u32 img_size, i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+
+	/* a 16KB buffer gives a ring of two 8KB slots */
+	buf = malloc(SZ_16K);
+	img = malloc(part_size + SZ_4K);
+	expect = malloc(part_size);
+	out = malloc(part_size);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(img);
+	ut_assertnonnull(expect);
+	ut_assertnonnull(out);
+	fastboot_init(buf, SZ_16K);
+
+	/* start with a partition full of 0xff, to check skipped blocks */
+	memset(expect, 0xff, part_size);
+	ut_asserteq(part_size / 512, blk_dwrite(mmc_dev_desc, 48,
+						part_size / 512, expect));
+
+	/*
+	 * A sparse image with three raw blocks, two filled blocks, one
+	 * skipped block, a checksum, five more raw blocks and three blocks
+	 * of zeroes
+	 */
+	hdr = (sparse_header_t *)img;
+	memset(hdr, '\0', sizeof(*hdr));
+	hdr->magic = SPARSE_HEADER_MAGIC;
+	hdr->major_version = 1;
+	hdr->file_hdr_sz = sizeof(*hdr);
+	hdr->chunk_hdr_sz = sizeof(chunk_header_t);
+	hdr->blk_sz = blk_sz;
+	hdr->total_blks = 14;
+	hdr->total_chunks = 6;
+	ptr = img + sizeof(*hdr);
+
+	ptr = fb_stream_add_chunk(ptr, CHUNK_TYPE_RAW, 3, 3 * blk_sz);
+	for (i = 0; i < 3 * blk_sz; i++)
+		ptr[i] = i % 253;
+	memcpy(expect, ptr, 3 * blk_sz);
+	ptr += 3 * blk_sz;
+	ptr = fb_stream_add_chunk(ptr, CHUNK_TYPE_FILL, 2, sizeof(fill));
+	memcpy(ptr, &fill, sizeof(fill));
+	for (i = 3 * blk_sz; i < 5 * blk_sz; i += sizeof(fill))
+		memcpy(expect + i, &fill, sizeof(fill));
+	ptr += sizeof(fill);
+	ptr = fb_stream_add_chunk(ptr, CHUNK_TYPE_DONT_CARE, 1, 0);
+	ptr = fb_stream_add_chunk(ptr, CHUNK_TYPE_CRC32, 0, sizeof(u32));
+	memset(ptr, '\0', sizeof(u32));
+	ptr += sizeof(u32);
+	ptr = fb_stream_add_chunk(ptr, CHUNK_TYPE_RAW, 5, 5 * blk_sz);
+	for (i = 0; i < 5 * blk_sz; i++)
+		ptr[i] = i % 247 + 1;
+	memcpy(expect + 6 * blk_sz, ptr, 5 * blk_sz);
+	ptr += 5 * blk_sz;
+	ptr = fb_stream_add_chunk(ptr, CHUNK_TYPE_FILL, 3, sizeof(u32));
+	memset(ptr, '\0', sizeof(u32));
+	memset(expect + 11 * blk_sz, '\0', 3 * blk_sz);
+	ptr += sizeof(u32);
+	img_size = ptr - img;
+
+	/* the image is bigger than the buffer, so it must be streamed */
+	ut_assert(img_size > SZ_16K);
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0x00004000"));
+	ut_assertok(fb_stream_cmd(uts, "oem stream:nosuchpart", "FAIL"));
+	ut_assertok(fb_stream_cmd(uts, "oem stream:stream", "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0xfffff000"));
+
+	/* odd-sized pieces split headers and blocks between them */
+	ut_assertok(fb_stream_download(uts, img, img_size, 1000));
+	ut_assertok(fb_stream_flash(uts, "flash:stream", "OKAY", info,
+				    sizeof(info)));
+	ut_asserteq(part_size / 512, blk_dread(mmc_dev_desc, 48,
+					       part_size / 512, out));
+	ut_asserteq_mem(expect, out, part_size);
+
+	/* the time spent on each type of chunk is reported first */
+	ut_assertnonnull(strstr(info, "raw: 32 KiB in "));
+	ut_assertnonnull(strstr(info, " ms, 2 chunks\n"));
+	ut_assertnonnull(strstr(info, "fill: 8 KiB in "));
+	ut_assertnonnull(strstr(info, "zero: 12 KiB in "));
+	ut_assertnonnull(strstr(info, "skip: 4 KiB in "));
+
+	/* a truncated sparse image is reported by the flash command */
+	ut_assertok(fb_stream_download(uts, img, img_size - 100, 1000));
+	ut_assertok(fb_stream_flash(uts, "flash:stream",
+				    "FAILsparse image is truncated", info,
+				    sizeof(info)));
+
+	/* a raw image which ends part-way through a block is padded */
+	for (i = 0; i < part_size - 100; i++)
+		img[i] = i % 239;
+	memcpy(expect, img, part_size - 100);
+	memset(expect + part_size - 100, '\0', 100);
+	ut_assertok(fb_stream_download(uts, img, part_size - 100, 4096));
+	ut_assertok(fb_stream_flash(uts, "flash:stream", "OKAY", info,
+				    sizeof(info)));
+	ut_asserteq(part_size / 512, blk_dread(mmc_dev_desc, 48,
+					       part_size / 512, out));
+	ut_asserteq_mem(expect, out, part_size);
+
+	/* a raw image which does not fit is refused when it arrives */
+	ut_assertok(fb_stream_download(uts, img, part_size + 1, 4096));
+	ut_assertok(fb_stream_flash(uts, "flash:stream",
+				    "FAILtoo large for partition", info,
+				    sizeof(info)));
+
+	/* the image must be flashed to the partition it was written to */
+	ut_assertok(env_set("filesize", NULL));
+	ut_assertok(fb_stream_download(uts, img, SZ_4K, SZ_4K));
+	ut_assertok(fb_stream_flash(uts, "flash:other", "FAIL", info,
+				    sizeof(info)));
+
+	/* the download buffer does not hold the streamed image */
+	ut_assertnull(env_get("filesize"));
+	ut_assertok(fb_stream_flash(uts, "flash:other",
+				    "FAILno image downloaded", info,
+				    sizeof(info)));
+
+	ut_assertok(fb_stream_cmd(uts, "oem stream", "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0x00004000"));
+
+	fastboot_init(NULL, 0);
+	free(out);
+	free(expect);
+	free(img);
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_stream, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+#endif
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for reading files from a FAT filesystem
+ */
+
+#include <blk.h>
+#include <blkmap.h>
+#include <dm.h>
+#include <fat.h>
+#include <fs.h>
+#include <mapmem.h>
+#include <asm/unaligned.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define FAT_TEST_SECT		512
+#define FAT_TEST_SECTS		64
+#define FAT_TEST_DATA		3	/* first data sector, for cluster 2 */
+#define FAT_TEST_SIZE		(10 * FAT_TEST_SECT - 100)
+
+/* clusters of the file, in order, in four runs */
+static const u16 fat_test_chain[] = { 2, 3, 4, 10, 11, 12, 13, 6, 7, 20 };
+
+static u8 fat_test_image[FAT_TEST_SECTS * FAT_TEST_SECT];
+
+/**
+ * fat_test_set_entry() - set an entry in a FAT12 table
+ *
+ * @fat:	Table
+ * @clust:	Cluster whose entry is set
+ * @val:	New value
+ */
+static void fat_test_set_entry(u8 *fat, uint clust, uint val)
+{
+	u8 *p = fat + clust * 3 / 2;
+
+	if (clust & 1) {
+		p[0] = (p[0] & 0x0f) | (val & 0xf) << 4;
+		p[1] = val >> 4;
+	} else {
+		p[0] = val;
+		p[1] = (p[1] & 0xf0) | (val >> 8 & 0xf);
+	}
+}
+
+/**
+ * fat_test_create() - create a FAT12 filesystem holding a fragmented file
+ *
+ * There is one FAT and a one-sector root directory, with one cluster per
+ * sector. The file is DATA.BIN, and byte i of it is (i * 7 + i / 512) & 0xff.
+ *
+ * @img:	Image to fill in
+ * @data:	Returns the contents of the file
+ */
+static void fat_test_create(u8 *img, u8 *data)
+{
+	struct boot_sector *bs = (void *)img;
+	struct volume_info *vi = (void *)&bs->fat32_length;
+	struct dir_entry *dent = (void *)img + 2 * FAT_TEST_SECT;
+	u8 *fat = img + FAT_TEST_SECT;
+	int i;
+
+	memset(img, '\0', FAT_TEST_SECTS * FAT_TEST_SECT);
+	put_unaligned_le16(FAT_TEST_SECT, bs->sector_size);
+	bs->cluster_size = 1;
+	bs->reserved = cpu_to_le16(1);
+	bs->fats = 1;
+	put_unaligned_le16(FAT_TEST_SECT / sizeof(*dent), bs->dir_entries);
+	put_unaligned_le16(FAT_TEST_SECTS, bs->sectors);
+	bs->media = 0xf8;
+	bs->fat_length = cpu_to_le16(1);
+	memcpy(vi->fs_type, "FAT12   ", sizeof(vi->fs_type));
+	img[0x1fe] = 0x55;
+	img[0x1ff] = 0xaa;
+
+	fat_test_set_entry(fat, 0, 0xff8);
+	fat_test_set_entry(fat, 1, 0xfff);
+	for (i = 0; i < ARRAY_SIZE(fat_test_chain) - 1; i++)
+		fat_test_set_entry(fat, fat_test_chain[i], fat_test_chain[i + 1]);
+	fat_test_set_entry(fat, fat_test_chain[i], 0xfff);
+
+	memcpy(dent->nameext.name, "DATA    ", 8);
+	memcpy(dent->nameext.ext, "BIN", 3);
+	dent->attr = ATTR_ARCH;
+	dent->start = cpu_to_le16(fat_test_chain[0]);
+	dent->size = cpu_to_le32(FAT_TEST_SIZE);
+
+	for (i = 0; i < FAT_TEST_SIZE; i++) {
+		uint clust = fat_test_chain[i / FAT_TEST_SECT];
+
+		data[i] = i * 7 + i / FAT_TEST_SECT;
+		img[(FAT_TEST_DATA + clust - 2) * FAT_TEST_SECT +
+		    i % FAT_TEST_SECT] = data[i];
+	}
+}
+
+/* Read part of the file back and check it */
+static int fat_test_read(struct unit_test_state *uts, struct blk_desc *desc,
+			 const u8 *data, loff_t offset, loff_t len,
+			 loff_t expect)
+{
+	u8 *buf = malloc(FAT_TEST_SIZE);
+	loff_t actread;
+
+	ut_assertnonnull(buf);
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_assertok(fs_read("/data.bin", map_to_sysmem(buf), offset, len,
+			    &actread));
+	ut_asserteq(expect, actread);
+	ut_asserteq_mem(data + offset, buf, expect);
+	free(buf);
+
+	return 0;
+}
+
+/* Test reading a fragmented file, whole and in pieces */
+static int dm_test_fat_fragmented(struct unit_test_state *uts)
+{
+	struct udevice *dev, *blk;
+	u8 sect[FAT_TEST_SECT];
+	struct blk_desc *desc;
+	loff_t size;
+	u8 *data;
+
+	data = malloc(FAT_TEST_SIZE);
+	ut_assertnonnull(data);
+	fat_test_create(fat_test_image, data);
+	ut_assertok(blkmap_create("fattest", &dev));
+	ut_assertok(blkmap_map_mem(dev, 0, FAT_TEST_SECTS, fat_test_image));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	desc = dev_get_uclass_plat(blk);
+
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_asserteq(1, fs_exists("/data.bin"));
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_assertok(fs_size("/data.bin", &size));
+	ut_asserteq(FAT_TEST_SIZE, size);
+
+	/* whole file, then pieces starting and ending part-way into runs */
+	ut_assertok(fat_test_read(uts, desc, data, 0, 0, FAT_TEST_SIZE));
+	ut_assertok(fat_test_read(uts, desc, data, 700, 3000, 3000));
+	ut_assertok(fat_test_read(uts, desc, data, 1536, 512, 512));
+	ut_assertok(fat_test_read(uts, desc, data, 4000, 0,
+				  FAT_TEST_SIZE - 4000));
+	ut_assertok(fat_test_read(uts, desc, data, 10, 5, 5));
+
+	/* a change to the directory entry must be noticed */
+	memcpy(sect, fat_test_image + 2 * FAT_TEST_SECT, FAT_TEST_SECT);
+	put_unaligned_le32(4096, sect + offsetof(struct dir_entry, size));
+	ut_asserteq(1, blk_dwrite(desc, 2, 1, sect));
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_assertok(fs_size("/data.bin", &size));
+	ut_asserteq(4096, size);
+	ut_assertok(fat_test_read(uts, desc, data, 3000, 0, 4096 - 3000));
+
+	/* as must writing the file */
+	if (IS_ENABLED(CONFIG_FAT_WRITE)) {
+		int i;
+
+		for (i = 0; i < FAT_TEST_SIZE; i++)
+			data[i] = ~i;
+		ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+		ut_assertok(fs_write("/data.bin", map_to_sysmem(data), 0,
+				     FAT_TEST_SIZE, &size));
+		ut_assertok(fat_test_read(uts, desc, data, 0, 0,
+					  FAT_TEST_SIZE));
+		ut_assertok(fat_test_read(uts, desc, data, 2000, 100, 100));
+	}
+
+	ut_assertok(blkmap_destroy(dev));
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fat_fragmented, UTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(FS_MOUNT_CACHE)
+/* Test that a filesystem is kept mounted until its device is written */
+static int dm_test_fat_mount_cache(struct unit_test_state *uts)
+{
+	ulong hits, probes, old_hits, old_probes;
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	loff_t size;
+	u8 *data;
+
+	data = malloc(FAT_TEST_SIZE);
+	ut_assertnonnull(data);
+	fat_test_create(fat_test_image, data);
+	ut_assertok(blkmap_create("fattest", &dev));
+	ut_assertok(blkmap_map_mem(dev, 0, FAT_TEST_SECTS, fat_test_image));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	desc = dev_get_uclass_plat(blk);
+
+	fs_close_all();
+	ut_asserteq(0, fs_mount_stats(&old_hits, &old_probes));
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_assertok(fs_size("/data.bin", &size));
+	ut_asserteq(1, fs_mount_stats(&hits, &probes));
+	ut_asserteq(old_hits, hits);
+	ut_assert(probes > old_probes);
+
+	/* the filesystem is used again without being probed */
+	old_probes = probes;
+	ut_assertok(fat_test_read(uts, desc, data, 0, 0, FAT_TEST_SIZE));
+	ut_asserteq(1, fs_mount_stats(&hits, &probes));
+	ut_asserteq(old_hits + 1, hits);
+	ut_asserteq(old_probes, probes);
+
+	/* writing to the device means it must be probed again */
+	ut_asserteq(1, blk_dwrite(desc, FAT_TEST_SECTS - 1, 1,
+				  fat_test_image));
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_assertok(fs_size("/data.bin", &size));
+	ut_asserteq(FAT_TEST_SIZE, size);
+	ut_asserteq(1, fs_mount_stats(&hits, &probes));
+	ut_asserteq(old_hits + 1, hits);
+	ut_assert(probes > old_probes);
+
+	fs_close_all();
+	ut_asserteq(0, fs_mount_stats(&hits, &probes));
+	ut_assertok(blkmap_destroy(dev));
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fat_mount_cache, UTF_SCAN_FDT);
+#endif
@@ -119,3 +119,52 @@ static int dm_test_nand1_end(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_nand1_end, UTF_SCAN_FDT);
+
+/* Test finding runs of good blocks */
+static int dm_test_nand_good_run(struct unit_test_state *uts)
+{
+	struct mtd_info *mtd;
+	loff_t base, off;
+	u64 run;
+
+	mtd = get_nand_dev_by_index(0);
+	ut_assertnonnull(mtd);
+
+	/* Keep clear of the blocks used by the other tests */
+	base = mtd->erasesize * 16;
+	ut_assertok(mtd_block_markbad(mtd, base + mtd->erasesize * 2));
+
+	/* A run stops at the next bad block... */
+	off = base + mtd->writesize;
+	ut_assertok(mtd_block_good_run(mtd, &off, U64_MAX, &run));
+	ut_asserteq(base + mtd->writesize, off);
+	ut_asserteq(mtd->erasesize * 2 - mtd->writesize, run);
+
+	/* ...or after the requested length */
+	off = base;
+	ut_assertok(mtd_block_good_run(mtd, &off, 100, &run));
+	ut_asserteq(base, off);
+	ut_asserteq(100, run);
+
+	/* Bad blocks at the start are skipped */
+	off = base + mtd->erasesize * 2 + mtd->writesize;
+	ut_assertok(mtd_block_good_run(mtd, &off, mtd->erasesize * 3, &run));
+	ut_asserteq(base + mtd->erasesize * 3, off);
+	ut_asserteq(mtd->erasesize * 3, run);
+
+	/* The run stops at the end of the device */
+	off = mtd->size - mtd->erasesize;
+	ut_assertok(mtd_block_good_run(mtd, &off, U64_MAX, &run));
+	ut_asserteq(mtd->size - mtd->erasesize, off);
+	ut_asserteq(mtd->erasesize, run);
+
+	off = mtd->size;
+	ut_assertok(mtd_block_good_run(mtd, &off, U64_MAX, &run));
+	ut_asserteq(0, run);
+
+	off = mtd->size + mtd->erasesize;
+	ut_asserteq(-EINVAL, mtd_block_good_run(mtd, &off, U64_MAX, &run));
+
+	return 0;
+}
+DM_TEST(dm_test_nand_good_run, UTF_SCAN_FDT);
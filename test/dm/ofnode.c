@@ -17,9 +17,11 @@
  */
 
 #include <abuf.h>
+#include <command.h>
 #include <dm.h>
 #include <log.h>
 #include <of_live.h>
+#include <asm/global_data.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/of_extra.h>
@@ -31,6 +33,8 @@
 #include <test/test.h>
 #include <test/ut.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 /**
  * get_other_oftree() - Convert a flat tree into an oftree object
  *
@@ -1496,6 +1500,50 @@ static int dm_test_livetree_ensure(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_livetree_ensure, UTF_SCAN_FDT);
 
+#if CONFIG_IS_ENABLED(OF_LIVE_INDEX)
+/* check that lookups through the livetree index match walking the tree */
+static int dm_test_livetree_index(struct unit_test_state *uts)
+{
+	struct device_node *root = uts->of_other;
+	struct device_node *np, *found;
+	phandle handle;
+	int count = 0;
+
+	/* every node with a phandle is found through the index */
+	for_each_of_allnodes_from(root, np) {
+		if (!np->phandle)
+			continue;
+		ut_asserteq_ptr(np, of_find_node_by_phandle(root, np->phandle));
+		count++;
+	}
+	ut_asserteq(6, count);
+	ut_assertnull(of_find_node_by_phandle(root, 0x1000000));
+
+	/* the second lookup by path is answered from the cache */
+	np = of_find_node_opts_by_path(root, "/other-gpio-b", NULL);
+	ut_assertnonnull(np);
+	ut_asserteq_str("/other-gpio-b", np->full_name);
+	ut_asserteq_ptr(np, of_find_node_opts_by_path(root, "/other-gpio-b",
+						      NULL));
+	ut_assertnull(of_find_node_opts_by_path(root, "/other-gpio-d", NULL));
+
+	/* a removed node can no longer be found */
+	handle = np->phandle;
+	ut_assert(handle);
+	ut_assertok(of_remove_node(np));
+	ut_assertnull(of_find_node_opts_by_path(root, "/other-gpio-b", NULL));
+	ut_assertnull(of_find_node_by_phandle(root, handle));
+
+	/* the rest are still there after the index is rebuilt */
+	found = of_find_node_opts_by_path(root, "/other-gpio-c", NULL);
+	ut_assertnonnull(found);
+	ut_asserteq_ptr(found, of_find_node_by_phandle(root, found->phandle));
+
+	return 0;
+}
+DM_TEST(dm_test_livetree_index, UTF_SCAN_FDT | UTF_LIVE_TREE | UTF_OTHER_FDT);
+#endif
+
 static int dm_test_oftree_new(struct unit_test_state *uts)
 {
 	ofnode node, subnode, check;
@@ -1606,6 +1654,45 @@ static int dm_test_ofnode_delete(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_ofnode_delete, UTF_SCAN_FDT);
 
+#if CONFIG_IS_ENABLED(OFNODE_CACHE)
+/* check that repeated lookups in the control FDT are answered from the cache */
+static int dm_test_ofnode_cache(struct unit_test_state *uts)
+{
+	uint hits, misses;
+	ofnode node;
+
+	node = ofnode_path("/a-test");
+	ut_assert(ofnode_valid(node));
+	hits = gd->ofnode_cache_hits;
+	misses = gd->ofnode_cache_misses;
+	ut_assert(ofnode_equal(node, ofnode_path("/a-test")));
+	ut_asserteq(hits + 1, gd->ofnode_cache_hits);
+	ut_asserteq(misses, gd->ofnode_cache_misses);
+	ut_assert(!ofnode_valid(ofnode_path("/no-such-node")));
+	ut_asserteq(misses + 1, gd->ofnode_cache_misses);
+
+	node = ofnode_get_by_phandle(1);
+	ut_assert(ofnode_valid(node));
+	ut_assert(ofnode_equal(node, ofnode_get_by_phandle(1)));
+	ut_asserteq(hits + 2, gd->ofnode_cache_hits);
+
+	/* adding a property moves the nodes after it, so they are looked up */
+	ut_assertok(ofnode_write_bool(ofnode_root(), "cache-test", true));
+	misses = gd->ofnode_cache_misses;
+	node = ofnode_path("/a-test");
+	ut_asserteq_str("a-test", ofnode_get_name(node));
+	ut_asserteq(misses + 1, gd->ofnode_cache_misses);
+	ut_assertok(ofnode_write_bool(ofnode_root(), "cache-test", false));
+
+	ut_assertok(run_command("dm ofcache", 0));
+	ut_assert_nextlinen("Control FDT lookups: ");
+	ut_assert_console_end();
+
+	return 0;
+}
+DM_TEST(dm_test_ofnode_cache, UTF_SCAN_FDT | UTF_FLAT_TREE | UTF_CONSOLE);
+#endif
+
 static int dm_test_oftree_to_fdt(struct unit_test_state *uts)
 {
 	oftree tree, check;
@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for probing devices in the background
+ */
+
+#include <dm.h>
+#include <dm/device-internal.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <linux/delay.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <uthread.h>
+
+/* How long each test device takes to probe */
+#define ASYNC_TEST_DELAY_US	40000
+#define ASYNC_TEST_COUNT	4
+
+/**
+ * struct async_test_plat - Platform data for a test device
+ *
+ * @ret: Value to return from probe()
+ * @once: true to return @ret from the first probe() only, then succeed
+ */
+struct async_test_plat {
+	int ret;
+	bool once;
+};
+
+/**
+ * struct async_test_priv - Private data for a test device
+ *
+ * @done: true once probe() has finished waiting for the 'hardware'
+ * @start: sequence number when probe() started
+ * @end: sequence number when probe() finished
+ */
+struct async_test_priv {
+	bool done;
+	int start;
+	int end;
+};
+
+/* Counts the probes starting and finishing, to check their order */
+static int async_test_seq;
+
+static int async_test_probe(struct udevice *dev)
+{
+	struct async_test_plat *plat = dev_get_plat(dev);
+	struct async_test_priv *priv = dev_get_priv(dev);
+	int ret = plat->ret;
+
+	priv->start = async_test_seq++;
+	udelay(ASYNC_TEST_DELAY_US);
+	priv->done = true;
+	priv->end = async_test_seq++;
+	if (plat->once)
+		plat->ret = 0;
+
+	return ret;
+}
+
+U_BOOT_DRIVER(async_test_drv) = {
+	.name		= "async_test_drv",
+	.id		= UCLASS_TEST_ASYNC_PROBE,
+	.probe		= async_test_probe,
+	.priv_auto	= sizeof(struct async_test_priv),
+};
+
+UCLASS_DRIVER(async_test) = {
+	.name		= "async_test",
+	.id		= UCLASS_TEST_ASYNC_PROBE,
+	.flags		= DM_UC_FLAG_ASYNC_PROBE,
+};
+
+static struct async_test_plat async_test_plat[ASYNC_TEST_COUNT];
+
+static const char *const async_test_names[ASYNC_TEST_COUNT] = {
+	"async-test0", "async-test1", "async-test2", "async-test3",
+};
+
+static int async_test_bind(struct unit_test_state *uts, struct udevice **devs)
+{
+	int i;
+
+	for (i = 0; i < ASYNC_TEST_COUNT; i++) {
+		async_test_plat[i].ret = 0;
+		async_test_plat[i].once = false;
+		ut_assertok(device_bind(dm_root(), DM_DRIVER_GET(async_test_drv),
+					async_test_names[i], &async_test_plat[i],
+					ofnode_null(), &devs[i]));
+	}
+
+	return 0;
+}
+
+/* Test that background probes overlap and complete by dm_probe_join() */
+static int dm_test_probe_async(struct unit_test_state *uts)
+{
+	struct udevice *devs[ASYNC_TEST_COUNT];
+	struct async_test_priv *priv;
+	int i, last_start = 0, first_end = INT_MAX;
+
+	ut_assertok(async_test_bind(uts, devs));
+
+	async_test_seq = 0;
+	for (i = 0; i < ASYNC_TEST_COUNT; i++)
+		ut_assertok(device_probe_async(devs[i]));
+
+	ut_assertok(dm_probe_join());
+	for (i = 0; i < ASYNC_TEST_COUNT; i++) {
+		priv = dev_get_priv(devs[i]);
+		ut_assert(priv->done);
+		last_start = max(last_start, priv->start);
+		first_end = min(first_end, priv->end);
+	}
+
+	/* all the probes started before the first one finished */
+	ut_assert(last_start < first_end);
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async, 0);
+
+/* Test that using a device waits for its background probe to finish */
+static int dm_test_probe_async_wait(struct unit_test_state *uts)
+{
+	struct udevice *devs[ASYNC_TEST_COUNT];
+	struct async_test_priv *priv;
+	struct udevice *dev;
+
+	ut_assertok(async_test_bind(uts, devs));
+	ut_assertok(device_probe_async(devs[0]));
+	ut_assertok(device_probe_async(devs[1]));
+
+	/* let both probes start, so that they are waiting on the 'hardware' */
+	uthread_schedule();
+	ut_assert(device_active(devs[1]));
+	priv = dev_get_priv(devs[1]);
+	ut_assert(!priv->done);
+
+	/* finding the device through the uclass probes it, so must wait */
+	ut_assertok(uclass_get_device_by_name(UCLASS_TEST_ASYNC_PROBE,
+					      "async-test1", &dev));
+	ut_asserteq_ptr(devs[1], dev);
+	priv = dev_get_priv(dev);
+	ut_assert(priv->done);
+
+	ut_assertok(dm_probe_join());
+
+	/* nothing left to wait for */
+	ut_assertok(dm_probe_join());
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async_wait, 0);
+
+/* Test that a failing background probe is reported by dm_probe_join() */
+static int dm_test_probe_async_fail(struct unit_test_state *uts)
+{
+	struct udevice *devs[ASYNC_TEST_COUNT];
+	int i;
+
+	ut_assertok(async_test_bind(uts, devs));
+	async_test_plat[2].ret = -ETIMEDOUT;
+
+	for (i = 0; i < ASYNC_TEST_COUNT; i++)
+		ut_assertok(device_probe_async(devs[i]));
+	ut_asserteq(-ETIMEDOUT, dm_probe_join());
+
+	ut_assert(device_active(devs[1]));
+	ut_assert(!device_active(devs[2]));
+
+	/* the error is only reported once */
+	ut_assertok(dm_probe_join());
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async_fail, 0);
+
+/*
+ * Test probing a device while its background probe is waiting for the parent,
+ * when the background probe then fails
+ */
+static int dm_test_probe_async_retry(struct unit_test_state *uts)
+{
+	struct async_test_plat plat = { .ret = -ETIMEDOUT, .once = true };
+	struct udevice *devs[ASYNC_TEST_COUNT];
+	struct async_test_priv *priv;
+	struct udevice *child;
+
+	ut_assertok(async_test_bind(uts, devs));
+	ut_assertok(device_bind(devs[0], DM_DRIVER_GET(async_test_drv),
+				"async-child", &plat, ofnode_null(), &child));
+	ut_assertok(device_probe_async(child));
+
+	/* let the background probe start on the parent */
+	uthread_schedule();
+	ut_assert(device_active(devs[0]));
+	ut_assert(!device_active(child));
+
+	/*
+	 * This waits for the parent and then for the background probe of the
+	 * child, which fails, so the child must be probed again here
+	 */
+	ut_assertok(device_probe(child));
+	ut_assert(device_active(child));
+	priv = dev_get_priv(child);
+	ut_assert(priv->done);
+
+	ut_asserteq(-ETIMEDOUT, dm_probe_join());
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async_retry, 0);
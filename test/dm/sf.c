@@ -101,3 +101,47 @@ static int dm_test_spi_flash_func(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_spi_flash_func, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(CMD_SF_BENCH)
+/* Test the 'sf bench' command */
+static int dm_test_spi_flash_bench(struct unit_test_state *uts)
+{
+	ut_assertok(run_command_list(
+		"host save hostfs - 0 spi.bin 200000;"
+		"sf probe", -1, 0));
+	ut_assert_skip_to_linen("SF: Detected");
+
+	ut_assertok(run_command("sf bench 10000 20000", 0));
+	ut_assert_nextline("SF: bench 131072 bytes @ 0x10000");
+	ut_assert_nextlinen("erase ");
+	ut_assert_nextlinen("write ");
+	ut_assert_nextlinen("read ");
+	ut_assert_nextlinen("page-read ");
+	ut_assert_console_end();
+
+	ut_assertok(run_command("sf bench -r 10000 20000", 0));
+	ut_assert_nextline("SF: bench 131072 bytes @ 0x10000 (read only)");
+	ut_assert_nextlinen("read ");
+	ut_assert_nextlinen("page-read ");
+	ut_assert_console_end();
+
+	ut_asserteq(1, run_command("sf bench 1f0000 20000", 0));
+	ut_assert_nextline("Region 0x1f0000+0x20000 is outside the flash");
+	ut_assert_console_end();
+
+	/* erasing a region which does not start on a sector fails */
+	ut_asserteq(1, run_command("sf bench 100 20000", 0));
+	ut_assert_nextline("SF: bench 131072 bytes @ 0x100");
+	ut_assert_nextlinen("Erase failed");
+	ut_assert_console_end();
+
+	/*
+	 * Since we are about to destroy all devices, we must tell sandbox
+	 * to forget the emulation device
+	 */
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_spi_flash_bench, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
+#endif
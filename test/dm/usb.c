@@ -5,6 +5,7 @@
 
 #include <console.h>
 #include <dm.h>
+#include <mapmem.h>
 #include <part.h>
 #include <usb.h>
 #include <asm/io.h>
@@ -84,6 +85,35 @@ static int dm_test_usb_flash(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_flash, UTF_SCAN_PDATA | UTF_SCAN_FDT);
 
+/* Check that the usb read/write commands report the transfer rate */
+static int dm_test_usb_cmd_rate(struct unit_test_state *uts)
+{
+	char *buf;
+
+	/* the command keeps its own current device, which 'usb start' sets */
+	state_set_skip_delays(true);
+	ut_assertok(run_command("usb start", 0));
+	buf = map_sysmem(0x10000, 1024);
+	memset(buf, '\0', 1024);
+
+	ut_assertok(run_command("usb read 10000 0 2", 0));
+	ut_assert_skip_to_linen("usb read: device 0 block # 0, count 2 ... 2 blocks read: OK in ");
+	ut_assert(strstr(uts->actual_str, "/s)"));
+	ut_asserteq_str("this is a test", buf);
+
+	ut_assertok(run_command("usb write 10000 0 1", 0));
+	ut_assert_nextline_empty();
+	ut_assert_nextlinen("usb write: device 0 block # 0, count 1 ... 1 blocks written: OK in ");
+	ut_assert(strstr(uts->actual_str, "/s)"));
+	ut_assert_console_end();
+
+	unmap_sysmem(buf);
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_cmd_rate, UTF_SCAN_PDATA | UTF_SCAN_FDT | UTF_CONSOLE);
+
 /* test that we can handle multiple storage devices */
 static int dm_test_usb_multi(struct unit_test_state *uts)
 {
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the virtio block driver, using the sandbox emulation
+ */
+
+#include <blk.h>
+#include <dm.h>
+#include <malloc.h>
+#include <virtio.h>
+#include <asm/test.h>
+#include <dm/device-internal.h>
+#include <dm/test.h>
+#include <linux/sizes.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+static int virtio_blk_test_get(struct unit_test_state *uts,
+			       struct udevice **busp, struct udevice **devp)
+{
+	ut_assertok(uclass_get_device_by_name(UCLASS_VIRTIO,
+					      "sandbox-virtio-blk", busp));
+	ut_assertok(device_find_first_child_by_uclass(*busp, UCLASS_BLK,
+						      devp));
+	ut_assertok(device_probe(*devp));
+
+	return 0;
+}
+
+/* Test reading and writing through several requests in flight */
+static int dm_test_virtio_blk(struct unit_test_state *uts)
+{
+	struct udevice *bus, *dev;
+	struct blk_desc *desc;
+	uint notifies, max_batch;
+	u8 *disk, *buf;
+	int i;
+
+	ut_assertok(virtio_blk_test_get(uts, &bus, &dev));
+	desc = dev_get_uclass_plat(dev);
+	ut_asserteq(512, desc->blksz);
+	ut_asserteq(2048, desc->lba);
+
+	disk = sandbox_virtio_blk_get_disk(bus);
+	ut_assertnonnull(disk);
+	for (i = 0; i < SZ_1M; i++)
+		disk[i] = i * 13 + (i >> 9);
+
+	buf = malloc(SZ_256K);
+	ut_assertnonnull(buf);
+
+	/*
+	 * The emulated device has two queues of four descriptors and takes
+	 * two 4KiB segments per request. With indirect descriptors each queue
+	 * holds four requests, so 256KiB goes in four batches of eight 8KiB
+	 * requests, with one kick per queue per batch.
+	 */
+	sandbox_virtio_blk_get_stats(bus, &notifies, &max_batch);
+	ut_asserteq(512, blk_read(dev, 0, 512, buf));
+	ut_asserteq_mem(disk, buf, SZ_256K);
+	sandbox_virtio_blk_get_stats(bus, &notifies, &max_batch);
+	ut_asserteq(4, max_batch);
+	ut_asserteq(8, notifies);
+
+	/* a transfer which does not fill the last request */
+	memset(buf, '\0', SZ_256K);
+	ut_asserteq(37, blk_read(dev, 1001, 37, buf));
+	ut_asserteq_mem(disk + 1001 * 512, buf, 37 * 512);
+
+	/* write back something else and check it reaches the disk */
+	for (i = 0; i < 100 * 512; i++)
+		buf[i] = i ^ 0x5a;
+	ut_asserteq(100, blk_write(dev, 1900, 100, buf));
+	ut_asserteq_mem(buf, disk + 1900 * 512, 100 * 512);
+
+	/* requests past the end of the disk fail */
+	ut_assert(IS_ERR_VALUE(blk_read(dev, 2040, 16, buf)));
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_blk, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+/* Test asynchronous requests, which are split across the queues */
+static int dm_test_virtio_blk_async(struct unit_test_state *uts)
+{
+	struct udevice *bus, *dev;
+	uint notifies, max_batch;
+	struct blk_sg sg[2];
+	struct blk_req req;
+	u8 *disk, *buf;
+	int i;
+
+	ut_assertok(virtio_blk_test_get(uts, &bus, &dev));
+	disk = sandbox_virtio_blk_get_disk(bus);
+	ut_assertnonnull(disk);
+	for (i = 0; i < SZ_1M; i++)
+		disk[i] = i * 7 + (i >> 9);
+
+	buf = calloc(1, SZ_128K);
+	ut_assertnonnull(buf);
+
+	/* 64KiB into the second half of the buffer, then 3KiB at the start */
+	sg[0].buf = buf + SZ_64K;
+	sg[0].blkcnt = 128;
+	sg[1].buf = buf;
+	sg[1].blkcnt = 6;
+	blk_req_init(&req, dev, BLK_REQ_READ, 300, sg, ARRAY_SIZE(sg));
+	sandbox_virtio_blk_get_stats(bus, &notifies, &max_batch);
+	ut_assertok(blk_req_submit(&req));
+	ut_asserteq(-EINPROGRESS, req.status);
+	ut_assertok(blk_req_wait(&req));
+	ut_asserteq(134, req.done);
+	ut_asserteq_mem(disk + 300 * 512, buf + SZ_64K, SZ_64K);
+	ut_asserteq_mem(disk + 428 * 512, buf, 6 * 512);
+
+	/* the first eight 8KiB requests go in one batch, one kick per queue */
+	sandbox_virtio_blk_get_stats(bus, &notifies, &max_batch);
+	ut_asserteq(4, max_batch);
+
+	/* write it back somewhere else */
+	blk_req_init(&req, dev, BLK_REQ_WRITE, 1000, sg, ARRAY_SIZE(sg));
+	ut_assertok(blk_req_submit(&req));
+	ut_assertok(blk_req_wait(&req));
+	ut_asserteq_mem(disk + 300 * 512, disk + 1000 * 512, 134 * 512);
+
+	/* errors are reported once every piece is back */
+	blk_req_init(&req, dev, BLK_REQ_READ, 2040, sg, 1);
+	ut_assertok(blk_req_submit(&req));
+	ut_asserteq(-EIO, blk_req_wait(&req));
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_blk_async, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+#endif
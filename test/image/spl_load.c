@@ -13,6 +13,9 @@
 #include <test/spl.h>
 #include <test/ut.h>
 #include <u-boot/crc.h>
+#include <asm/global_data.h>
+
+DECLARE_GLOBAL_DATA_PTR;
 
 int board_fit_config_name_match(const char *name)
 {
@@ -657,3 +660,134 @@ int do_spl_test_load(struct unit_test_state *uts, const char *test_name,
 	free(img);
 	return 0;
 }
+
+/**
+ * create_fit_stream() - Create a FIT with an LZMA image and a crc32 hash
+ * @dst: Buffer for the FIT, followed by the image data
+ * @info: Image information
+ * @crc: Value to put in the hash node
+ *
+ * Return: Offset of the image data, or 0 on error
+ */
+static size_t create_fit_stream(void *dst, struct spl_image_info *info,
+				u32 crc)
+{
+	size_t size = 1024;
+	fdt32_t value = cpu_to_fdt32(crc);
+
+	if (fdt_create(dst, size) || fdt_finish_reservemap(dst) ||
+	    fdt_begin_node(dst, ""))
+		return 0;
+	if (fdt_property_u32(dst, "#address-cells", ADDRESS_CELLS))
+		return 0;
+
+	if (fdt_begin_node(dst, "images") || fdt_begin_node(dst, "u-boot"))
+		return 0;
+	if (fdt_property_string(dst, FIT_DESC_PROP, info->name) ||
+	    fdt_property_string(dst, FIT_TYPE_PROP, "firmware") ||
+	    fdt_property_string(dst, FIT_COMP_PROP, "lzma") ||
+	    fdt_property_u32(dst, FIT_DATA_OFFSET_PROP, 0) ||
+	    fdt_property_u32(dst, FIT_DATA_SIZE_PROP, info->size) ||
+	    fdt_property_string(dst, FIT_OS_PROP,
+				genimg_get_os_short_name(info->os)) ||
+	    fdt_property_string(dst, FIT_ARCH_PROP,
+				genimg_get_arch_short_name(IH_ARCH_DEFAULT)) ||
+	    fdt_property_addr(dst, FIT_ENTRY_PROP, info->entry_point) ||
+	    fdt_property_addr(dst, FIT_LOAD_PROP, info->load_addr))
+		return 0;
+	if (fdt_begin_node(dst, "hash-1") ||
+	    fdt_property_string(dst, FIT_ALGO_PROP, "crc32") ||
+	    fdt_property(dst, FIT_VALUE_PROP, &value, sizeof(value)))
+		return 0;
+	if (fdt_end_node(dst) || fdt_end_node(dst) || fdt_end_node(dst))
+		return 0;
+
+	if (fdt_begin_node(dst, "configurations") ||
+	    fdt_property_string(dst, FIT_DEFAULT_PROP, "config-1") ||
+	    fdt_begin_node(dst, "config-1") ||
+	    fdt_property_string(dst, FIT_DESC_PROP, info->name) ||
+	    fdt_property_string(dst, FIT_FIRMWARE_PROP, "u-boot"))
+		return 0;
+	if (fdt_end_node(dst) || fdt_end_node(dst) || fdt_end_node(dst))
+		return 0;
+	if (fdt_finish(dst) || fdt_totalsize(dst) > size)
+		return 0;
+	fdt_set_totalsize(dst, size);
+
+	return size;
+}
+
+/* Test that a compressed image is unpacked as it is read, and its hash checked */
+static int spl_test_fit_stream(struct unit_test_state *uts)
+{
+	size_t plain_size = SPL_TEST_DATA_SIZE;
+	struct spl_image_info info_write = {
+		.name = "lzma",
+		.os = IH_OS_TEE,
+		.load_addr = CONFIG_TEXT_BASE,
+		.entry_point = CONFIG_TEXT_BASE + 0x100,
+		.size = lzma_compressed_size,
+	}, info_read = { };
+	struct spl_load_info load;
+	size_t data_offset;
+	char *plain, *img;
+	u32 crc;
+	int ret;
+
+	if (!CONFIG_IS_ENABLED(LOAD_FIT_STREAM) || !CONFIG_IS_ENABLED(LZMA))
+		return -EAGAIN;
+
+	img = calloc(1024 + lzma_compressed_size, 1);
+	ut_assertnonnull(img);
+	plain = malloc(plain_size);
+	ut_assertnonnull(plain);
+	generate_data(plain, plain_size, "lzma");
+
+	crc = crc32(0, (u8 *)lzma_compressed, lzma_compressed_size);
+	data_offset = create_fit_stream(img, &info_write, crc);
+	ut_assert(data_offset);
+	memcpy(img + data_offset, lzma_compressed, lzma_compressed_size);
+
+	spl_load_init(&load, spl_test_read, img, 1);
+	memset(phys_to_virt(info_write.load_addr), '\0', plain_size);
+	ut_assertok(spl_load_simple_fit(&info_read, &load, 0, img));
+	ut_asserteq(info_write.os, info_read.os);
+	ut_asserteq(info_write.entry_point, info_read.entry_point);
+	ut_asserteq(info_write.load_addr, info_read.load_addr);
+	ut_asserteq(plain_size, info_read.size);
+	ut_asserteq_mem(plain, phys_to_virt(info_write.load_addr), plain_size);
+
+	/* a bad hash is only found once the image is unpacked */
+	ut_asserteq(data_offset, create_fit_stream(img, &info_write, ~crc));
+	ut_asserteq(-EPERM, spl_load_simple_fit(&info_read, &load, 0, img));
+
+	/* an unsigned image is refused if a key requires image signatures */
+	if (FIT_IMAGE_ENABLE_VERIFY) {
+		const void *old_blob = gd->fdt_blob;
+		char keys[256];
+
+		ut_assertok(fdt_create(keys, sizeof(keys)));
+		ut_assertok(fdt_finish_reservemap(keys));
+		ut_assertok(fdt_begin_node(keys, ""));
+		ut_assertok(fdt_begin_node(keys, FIT_SIG_NODENAME));
+		ut_assertok(fdt_begin_node(keys, "key-test"));
+		ut_assertok(fdt_property_string(keys, FIT_KEY_REQUIRED,
+						"image"));
+		ut_assertok(fdt_end_node(keys));
+		ut_assertok(fdt_end_node(keys));
+		ut_assertok(fdt_end_node(keys));
+		ut_assertok(fdt_finish(keys));
+
+		ut_asserteq(data_offset,
+			    create_fit_stream(img, &info_write, crc));
+		gd->fdt_blob = keys;
+		ret = spl_load_simple_fit(&info_read, &load, 0, img);
+		gd->fdt_blob = old_blob;
+		ut_asserteq(-EPERM, ret);
+	}
+
+	free(plain);
+	free(img);
+	return 0;
+}
+SPL_TEST(spl_test_fit_stream, 0);
@@ -6,6 +6,7 @@
 #include <abuf.h>
 #include <bootm.h>
 #include <command.h>
+#include <decomp_stream.h>
 #include <gzip.h>
 #include <image.h>
 #include <log.h>
@@ -606,3 +607,111 @@ static int compression_test_bootm_none(struct unit_test_state *uts)
 	return run_bootm_test(uts, IH_COMP_NONE, compress_using_none);
 }
 LIB_TEST(compression_test_bootm_none, 0);
+
+/* Feed compressed data to a stream @step bytes at a time */
+static int stream_decompress(int comp, const u8 *in, ulong in_size, ulong step,
+			     void *out, ulong out_max, ulong *out_size)
+{
+	struct decomp_stream ds;
+	ulong pos;
+	int ret;
+
+	ret = decomp_stream_init(&ds, comp, out, out_max);
+	if (ret)
+		return ret;
+	for (pos = 0; pos < in_size; pos += step) {
+		ret = decomp_stream_write(&ds, in + pos,
+					  min(step, in_size - pos));
+		if (ret) {
+			decomp_stream_finish(&ds, NULL);
+			return ret;
+		}
+	}
+
+	return decomp_stream_finish(&ds, out_size);
+}
+
+static int run_stream_test(struct unit_test_state *uts, int comp,
+			   mutate_func compress)
+{
+	static const ulong steps[] = { 1, 7, 64, TEST_BUFFER_SIZE };
+	ulong orig_size = strlen(plain);
+	ulong comp_size, out_size;
+	u8 *comp_buf, *out;
+	int i;
+
+	if (!CONFIG_IS_ENABLED(DECOMP_STREAM))
+		return -EAGAIN;
+	ut_assert(decomp_stream_supported(comp));
+
+	comp_buf = malloc(TEST_BUFFER_SIZE);
+	out = malloc(TEST_BUFFER_SIZE);
+	ut_assertnonnull(comp_buf);
+	ut_assertnonnull(out);
+	memset(comp_buf, 'A', TEST_BUFFER_SIZE);
+	ut_assertok(compress(uts, (void *)plain, orig_size, comp_buf,
+			     TEST_BUFFER_SIZE, &comp_size));
+
+	/* The result must not depend on how the input is split up */
+	for (i = 0; i < ARRAY_SIZE(steps); i++) {
+		memset(out, 'A', TEST_BUFFER_SIZE);
+		ut_assertok(stream_decompress(comp, comp_buf, comp_size,
+					      steps[i], out, TEST_BUFFER_SIZE,
+					      &out_size));
+		ut_asserteq(orig_size, out_size);
+		ut_asserteq_mem(plain, out, orig_size);
+		ut_asserteq('A', out[orig_size]);
+	}
+
+	/* Exactly the right size output buffer, with trailing garbage */
+	memset(out, 'A', TEST_BUFFER_SIZE);
+	ut_assertok(stream_decompress(comp, comp_buf, comp_size + 4, 7, out,
+				      orig_size, &out_size));
+	ut_asserteq(orig_size, out_size);
+	ut_asserteq_mem(plain, out, orig_size);
+
+	/* Decompression does not over-run */
+	memset(out, 'A', TEST_BUFFER_SIZE);
+	ut_asserteq(-ENOSPC, stream_decompress(comp, comp_buf, comp_size, 7,
+					       out, orig_size - 1, NULL));
+	ut_asserteq('A', out[orig_size - 1]);
+
+	/* Truncated input is noticed */
+	ut_asserteq(-EINVAL, stream_decompress(comp, comp_buf, comp_size - 5,
+					       7, out, TEST_BUFFER_SIZE, NULL));
+
+	free(out);
+	free(comp_buf);
+
+	return 0;
+}
+
+static int compression_test_stream_gzip(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_GZIP, compress_using_gzip);
+}
+LIB_TEST(compression_test_stream_gzip, 0);
+
+static int compression_test_stream_bzip2(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_BZIP2, compress_using_bzip2);
+}
+LIB_TEST(compression_test_stream_bzip2, 0);
+
+static int compression_test_stream_lzma(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZMA, compress_using_lzma);
+}
+LIB_TEST(compression_test_stream_lzma, 0);
+
+static int compression_test_stream_lz4(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZ4, compress_using_lz4);
+}
+LIB_TEST(compression_test_stream_lz4, 0);
+
+static int compression_test_stream_zstd(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_ZSTD, compress_using_zstd);
+}
+LIB_TEST(compression_test_stream_zstd, 0);
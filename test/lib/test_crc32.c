@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit test and benchmark for crc32
+ */
+
+#include <malloc.h>
+#include <time.h>
+#include <linux/sizes.h>
+#include <test/lib.h>
+#include <test/ut.h>
+#include <u-boot/crc.h>
+
+#define CRC32_BENCH_SIZE	SZ_1M
+#define CRC32_BENCH_LOOPS	16
+
+/* Bitwise reference implementation of the reflected 0xedb88320 polynomial */
+static u32 crc32_ref(u32 crc, const u8 *buf, uint len)
+{
+	int k;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (k = 0; k < 8; k++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+	}
+
+	return ~crc;
+}
+
+static int lib_crc32(struct unit_test_state *uts)
+{
+	const char check[] = "123456789";
+	uint ofs, len;
+	u8 buf[4104];
+
+	ut_asserteq(0xcbf43926, crc32(0, (const u8 *)check, 9));
+	ut_asserteq(0, crc32(0, (const u8 *)check, 0));
+	ut_asserteq(0x2dfd2d88, crc32_no_comp(0, (const u8 *)check, 9));
+
+	for (len = 0; len < sizeof(buf); len++)
+		buf[len] = len * 7 + (len >> 8);
+
+	/* every alignment and the head/body/tail split of the fast paths */
+	for (ofs = 0; ofs < 8; ofs++) {
+		for (len = 0; len < 80; len++)
+			ut_asserteq(crc32_ref(0, buf + ofs, len),
+				    crc32(0, buf + ofs, len));
+		ut_asserteq(crc32_ref(0, buf + ofs, 4096),
+			    crc32(0, buf + ofs, 4096));
+	}
+
+	/* the CRC can be calculated in pieces */
+	for (len = 1; len < 40; len++)
+		ut_asserteq(crc32(0, buf, 4096),
+			    crc32(crc32(0, buf, len), buf + len, 4096 - len));
+
+	return 0;
+}
+LIB_TEST(lib_crc32, 0);
+
+static int lib_crc32_bench(struct unit_test_state *uts)
+{
+	ulong start, elapsed;
+	u32 crc = 0;
+	u8 *buf;
+	int i;
+
+	buf = malloc(CRC32_BENCH_SIZE);
+	ut_assertnonnull(buf);
+	for (i = 0; i < CRC32_BENCH_SIZE; i++)
+		buf[i] = i;
+
+	start = timer_get_us();
+	for (i = 0; i < CRC32_BENCH_LOOPS; i++)
+		crc = crc32(crc, buf, CRC32_BENCH_SIZE);
+	elapsed = max(timer_get_us() - start, 1UL);
+	free(buf);
+
+	printf("crc32: %d MiB in %lu us, %lu MiB/s (crc %08x)\n",
+	       CRC32_BENCH_LOOPS, elapsed,
+	       CRC32_BENCH_LOOPS * 1000000UL / elapsed, crc);
+
+	return 0;
+}
+LIB_TEST(lib_crc32_bench, 0);
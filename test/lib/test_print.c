@@ -65,3 +65,27 @@ static int lib_test_print_size(struct unit_test_state *uts)
 	return 0;
 }
 LIB_TEST(lib_test_print_size, UTF_CONSOLE);
+
+static int test_print_rate(struct unit_test_state *uts, uint64_t bytes,
+			   ulong us, char *expected)
+{
+	print_rate(bytes, us, ";\n");
+	console_record_readline(uts->actual_str, sizeof(uts->actual_str));
+	ut_asserteq_str(expected, uts->actual_str);
+	ut_assert_console_end();
+
+	return 0;
+}
+
+static int lib_test_print_rate(struct unit_test_state *uts)
+{
+	ut_assertok(test_print_rate(uts, 1000, 1000000, "1000 Bytes/s;"));
+	ut_assertok(test_print_rate(uts, 1 << 20, 1000000, "1 MiB/s;"));
+	ut_assertok(test_print_rate(uts, 262144, 2097, "119.2 MiB/s;"));
+	ut_assertok(test_print_rate(uts, 7824930, 589000, "12.7 MiB/s;"));
+	ut_assertok(test_print_rate(uts, 4ULL << 30, 4000000, "1 GiB/s;"));
+	/* too quick to time */
+	ut_assertok(test_print_rate(uts, 512, 0, "488.3 MiB/s;"));
+	return 0;
+}
+LIB_TEST(lib_test_print_rate, UTF_CONSOLE);
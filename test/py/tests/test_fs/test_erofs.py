@@ -2,7 +2,9 @@
 # Copyright (C) 2022 Huang Jianan <jnhuang95@gmail.com>
 # Author: Huang Jianan <jnhuang95@gmail.com>
 
+import hashlib
 import os
+import random
 import pytest
 import shutil
 import subprocess
@@ -19,6 +21,19 @@ def generate_file(name, size):
     file.write(content)
     file.close()
 
+def generate_text_file(name, size):
+    """
+    Generates a file of text which compresses into many extents.
+    """
+    rand = random.Random(size)
+    words = ['boot', 'loader', 'kernel', 'device', 'tree', '\n']
+    content = ''
+    while len(content) < size:
+        content += rand.choice(words) + str(rand.randrange(1000))
+    file = open(name, 'w')
+    file.write(content[:size])
+    file.close()
+
 def make_erofs_image(build_dir):
     """
     Makes the EROFS images used for the test.
@@ -27,6 +42,7 @@ def make_erofs_image(build_dir):
     erofs_src_dir/
     ├── f4096
     ├── f7812
+    ├── f1048576
     ├── subdir/
     │   └── subdir-file
     ├── symdir -> subdir
@@ -41,6 +57,9 @@ def make_erofs_image(build_dir):
     # 7812: Compressed file
     generate_file(os.path.join(root, 'f7812'), 7812)
 
+    # 1048576: compressed file spanning many extents
+    generate_text_file(os.path.join(root, 'f1048576'), 1048576)
+
     # sub-directory with a single file inside
     subdir_path = os.path.join(root, 'subdir')
     os.makedirs(subdir_path)
@@ -73,8 +92,9 @@ def erofs_ls_at_root(ubman):
     slash = ubman.run_command('erofsls host 0 /')
     assert no_slash == slash
 
-    expected_lines = ['./', '../', '4096   f4096', '7812   f7812', 'subdir/',
-                      '<SYM>   symdir', '<SYM>   symfile', '4 file(s), 3 dir(s)']
+    expected_lines = ['./', '../', '4096   f4096', '7812   f7812',
+                      '1048576   f1048576', 'subdir/', '<SYM>   symdir',
+                      '<SYM>   symfile', '5 file(s), 3 dir(s)']
 
     output = ubman.run_command('erofsls host 0')
     for line in expected_lines:
@@ -138,11 +158,30 @@ def erofs_load_files_at_root(ubman):
     """
     Test load file from the root directory.
     """
-    files = ['f4096', 'f7812']
-    sizes = ['4096', '7812']
+    files = ['f4096', 'f7812', 'f1048576']
+    sizes = ['4096', '7812', '1048576']
     address = '$kernel_addr_r'
     erofs_load_files(ubman, files, sizes, address)
 
+def erofs_load_part_of_file(ubman):
+    """
+    Test loading part of a file, starting and ending part-way into extents.
+    """
+    build_dir = ubman.config.build_dir
+    offset = 100000
+    size = 500000
+    out = ubman.run_command('load host 0 $kernel_addr_r f1048576 {:x} {:x}'
+                            .format(size, offset))
+    assert str(size) in out
+    out = ubman.run_command('md5sum $kernel_addr_r {:x}'.format(size))
+    u_boot_checksum = out.split()[-1]
+
+    path = os.path.join(build_dir, EROFS_SRC_DIR, 'f1048576')
+    with open(path, 'rb') as inf:
+        inf.seek(offset)
+        original_checksum = hashlib.md5(inf.read(size)).hexdigest()
+    assert u_boot_checksum == original_checksum
+
 def erofs_load_files_at_subdir(ubman):
     """
     Test load file from the subdirectory.
@@ -179,6 +218,7 @@ def erofs_run_all_tests(ubman):
     erofs_ls_at_symlink(ubman)
     erofs_ls_at_non_existent_dir(ubman)
     erofs_load_files_at_root(ubman)
+    erofs_load_part_of_file(ubman)
     erofs_load_files_at_subdir(ubman)
     erofs_load_files_at_symlink(ubman)
     erofs_load_non_existent_file(ubman)
@@ -0,0 +1,65 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: ext4 directory index test
+
+"""
+This test checks looking files up in a large ext4 directory, which has a
+hash-tree (htree) index, with each of the hash algorithms.
+"""
+
+import hashlib
+import os
+from subprocess import call, check_call, check_output, DEVNULL
+import pytest
+from fs_helper import FsHelper
+
+ADDR = 0x01000000
+NUM_FILES = 2000
+
+def make_dir_index(fs_img, hash_alg, hash_flag):
+    """Rebuild the directories of an ext4 image with an htree index
+
+    Args:
+        fs_img (str): Filesystem image
+        hash_alg (str): Hash algorithm to use: legacy, half_md4 or tea
+        hash_flag (int): Superblock flag giving the signedness of the hash
+    """
+    check_call(f'debugfs -w -R "ssv def_hash_version {hash_alg}" {fs_img}',
+               shell=True, stdout=DEVNULL, stderr=DEVNULL)
+    check_call(f'debugfs -w -R "ssv flags {hash_flag}" {fs_img}', shell=True,
+               stdout=DEVNULL, stderr=DEVNULL)
+
+    # This returns 1 as it has changed the filesystem
+    call(f'e2fsck -fyD {fs_img}', shell=True, stdout=DEVNULL, stderr=DEVNULL)
+    out = check_output(f'debugfs -R "htree /bigdir" {fs_img}', shell=True,
+                       stderr=DEVNULL).decode()
+    assert 'Root node dump' in out
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_ext4')
+@pytest.mark.parametrize('hash_flag', [1, 2], ids=['signed', 'unsigned'])
+@pytest.mark.parametrize('hash_alg', ['legacy', 'half_md4', 'tea'])
+def test_ext4_dir_index(ubman, hash_alg, hash_flag):
+    """Test looking up files in a directory with an htree index"""
+    with FsHelper(ubman.config, 'ext4', 16, 'htree') as fsh:
+        bigdir = os.path.join(fsh.srcdir, 'bigdir')
+        os.mkdir(bigdir)
+        contents = []
+        for i in range(NUM_FILES):
+            contents.append(f'This is file {i}\n'.encode())
+            with open(os.path.join(bigdir, f'file{i:05}.txt'), 'wb') as outf:
+                outf.write(contents[i])
+        fsh.mk_fs()
+        make_dir_index(fsh.fs_img, hash_alg, hash_flag)
+
+        ubman.run_command(f'host bind 0 {fsh.fs_img}')
+        for i in (0, 1, 777, NUM_FILES - 1):
+            out = ubman.run_command(
+                f'ext4load host 0 {ADDR:x} /bigdir/file{i:05}.txt')
+            assert f'{len(contents[i])} bytes read' in out
+            out = ubman.run_command(f'md5sum {ADDR:x} $filesize')
+            assert hashlib.md5(contents[i]).hexdigest() in out
+
+        out = ubman.run_command(f'ext4load host 0 {ADDR:x} /bigdir/missing')
+        assert 'Failed to load' in out
+        ubman.run_command('host unbind 0')
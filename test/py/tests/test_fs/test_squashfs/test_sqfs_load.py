@@ -92,6 +92,20 @@ def sqfs_load_files_at_subdir(ubman):
     address = '$kernel_addr_r'
     sqfs_load_files(ubman, files, sizes, address)
 
+def sqfs_load_files_again(ubman):
+    """ Loads the files at the SquashFS image's root again, in reverse order.
+
+    The metadata and fragment blocks used by the previous loads may be kept
+    in memory, so this checks that reusing them gives the same contents.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+    """
+    files = ['f1000', 'f5096', 'f4096', 'subdir/subdir-file']
+    sizes = ['1000', '5096', '4096', '100']
+    address = '$kernel_addr_r'
+    sqfs_load_files(ubman, files, sizes, address)
+
 def sqfs_load_non_existent_file(ubman):
     """ Calls sqfs_load_files passing an non-existent file to raise an error.
 
@@ -114,6 +128,7 @@ def sqfs_run_all_load_tests(ubman):
     """
     sqfs_load_files_at_root(ubman)
     sqfs_load_files_at_subdir(ubman)
+    sqfs_load_files_again(ubman)
     sqfs_load_non_existent_file(ubman)
 
 @pytest.mark.boardspec('sandbox')
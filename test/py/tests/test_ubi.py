@@ -0,0 +1,162 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+""" Test for the ubi command on the sandbox NAND
+"""
+
+import os
+import random
+import re
+import shutil
+import zlib
+import pytest
+import utils
+
+# The sandbox NAND cannot program a page twice, so put the VID header in its
+# own page instead of a sub-page
+UBI_PART = 'ubi part nand2 2048'
+
+def crc32(ubman, addr, size):
+    """Get the CRC32 of a memory region
+
+    Args:
+        ubman -- U-Boot console
+        addr -- address of the region
+        size -- size of the region
+
+    Returns:
+        CRC32 as a hex string
+    """
+    output = ubman.run_command(f'crc32 {addr:x} {size:x}')
+    m = re.search('==> ([0-9a-f]{8})$', output)
+    assert m, output
+    return m.group(1)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_ubi')
+@pytest.mark.buildconfigspec('cmd_mtd')
+@pytest.mark.buildconfigspec('cmd_random')
+def test_ubi_reattach(ubman):
+    """Test that a volume reads back the same after attaching again
+
+    Attaching scans the headers of every PEB, so this checks that the volume
+    is found again and that its data is intact.
+
+    Args:
+        ubman -- U-Boot console
+    """
+    ram_base = utils.find_ram_base(ubman)
+    src = ram_base + 0x100000
+    dst = ram_base + 0x200000
+    # Not a multiple of the LEB size, so the last LEB is partly used
+    size = 0x41234
+
+    ubman.run_command('ubi detach')
+    ubman.run_command('mtd erase nand2')
+    output = ubman.run_command(UBI_PART)
+    assert 'attached mtd' in output
+
+    output = ubman.run_command('ubi create vol0 0x100000 dynamic')
+    assert 'Creating dynamic volume vol0' in output
+    ubman.run_command(f'random {src:x} {size:x} 1234')
+    expect = crc32(ubman, src, size)
+    output = ubman.run_command(f'ubi write {src:x} vol0 {size:x}')
+    assert f'{size} bytes written to volume vol0' in output
+    ubman.run_command('ubi detach')
+
+    output = ubman.run_command(UBI_PART)
+    assert 'attached mtd' in output
+    assert 'error' not in output
+    assert 'user volume: 1' in output
+
+    ubman.run_command(f'mw.b {dst:x} 0 {size:x}')
+    output = ubman.run_command(f'ubi read {dst:x} vol0 {size:x}')
+    assert f'Read {size} bytes from volume vol0' in output
+    assert crc32(ubman, dst, size) == expect
+    ubman.run_command('ubi detach')
+
+def make_ubifs_files(srcdir):
+    """Create the files to put in the UBIFS image
+
+    Args:
+        srcdir -- directory to create the files in
+
+    Returns:
+        dict mapping each filename to its contents
+    """
+    rnd = random.Random(1234)
+    files = {}
+
+    # Incompressible, so that each data node is nearly a full block, with a
+    # partial block at the end
+    files['random'] = rnd.randbytes(0x100000 + 1234)
+
+    # Compressible, with a partial block at the end
+    files['text'] = b''.join(b'line %d of the text file\n' % i
+                             for i in range(12000))
+
+    # Holes at the start, in the middle and at the end, which mkfs.ubifs
+    # stores without data nodes
+    holes = bytearray(0x4b141)
+    holes[0x3000:0x5000] = rnd.randbytes(0x2000)
+    holes[0x19000:0x1a234] = rnd.randbytes(0x1234)
+    files['holes'] = bytes(holes)
+
+    for name, data in files.items():
+        with open(os.path.join(srcdir, name), 'wb') as outf:
+            outf.write(data)
+    # Make the trailing hole a real one
+    with open(os.path.join(srcdir, 'holes'), 'r+b') as outf:
+        outf.truncate(0x1a234)
+        outf.truncate(len(files['holes']))
+
+    return files
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_ubifs')
+@pytest.mark.buildconfigspec('cmd_mtd')
+@pytest.mark.requiredtool('mkfs.ubifs')
+@pytest.mark.parametrize('compr', ['lzo', 'zlib', 'none'])
+def test_ubifs_load(ubman, compr):
+    """Test that files load from UBIFS with the right contents
+
+    Args:
+        ubman -- U-Boot console
+        compr -- compressor for mkfs.ubifs to use
+    """
+    srcdir = os.path.join(ubman.config.persistent_data_dir, 'ubifs_src')
+    img = os.path.join(ubman.config.persistent_data_dir,
+                       f'ubifs_{compr}.img')
+    shutil.rmtree(srcdir, ignore_errors=True)
+    os.mkdir(srcdir)
+    files = make_ubifs_files(srcdir)
+
+    # Match the sandbox NAND: 2KiB pages and 124KiB LEBs
+    utils.run_and_log(ubman, ['mkfs.ubifs', '-m', '2048', '-e', '126976',
+                              '-c', '64', '-x', compr, '-r', srcdir,
+                              '-o', img])
+
+    ram_base = utils.find_ram_base(ubman)
+    src = ram_base + 0x100000
+    dst = ram_base + 0x1000000
+
+    ubman.run_command('ubi detach')
+    ubman.run_command('mtd erase nand2')
+    output = ubman.run_command(UBI_PART)
+    assert 'attached mtd' in output
+    ubman.run_command('ubi create fs 0x800000 dynamic')
+    ubman.run_command(f'host load hostfs - {src:x} {img}')
+    output = ubman.run_command(f'ubi write {src:x} fs $filesize')
+    assert 'bytes written to volume fs' in output
+
+    output = ubman.run_command('ubifsmount ubi0:fs')
+    assert 'error' not in output.lower()
+    for name, data in files.items():
+        size = len(data)
+        ubman.run_command(f'mw.b {dst:x} a5 {size:x}')
+        output = ubman.run_command(f'ubifsload {dst:x} {name}')
+        assert 'Done' in output
+        assert ubman.run_command('printenv filesize') == f'filesize={size:x}'
+        assert crc32(ubman, dst, size) == f'{zlib.crc32(data):08x}'
+
+    ubman.run_command('ubifsumount')
+    ubman.run_command('ubi detach')
@@ -180,6 +180,31 @@ def test_vboot(ubman, name, sha_algo, padding, sign_options, required,
             assert('sandbox: continuing, as we cannot run'
                    not in ''.join(output))
 
+    def run_fitload(sha_algo, test_type, expect_string, loads):
+        """Run a 'fitload' command in U-Boot.
+
+        This always starts a fresh U-Boot instance since the device tree may
+        contain a new public key. It does nothing unless the FIT has external
+        data, since fitload cannot handle anything else.
+
+        Args:
+            sha_algo: Either 'sha1' or 'sha256', to select the algorithm to
+                    use.
+            test_type: A string identifying the test type.
+            expect_string: A string which is expected in the output.
+            loads: A boolean that is True if the kernel should be loaded and
+                    False if it should not
+        """
+        if not sign_options or '-E' not in sign_options.split(' '):
+            return
+        ubman.restart_uboot()
+        with ubman.log.section('Verified fitload %s %s' %
+                               (sha_algo, test_type)):
+            output = ubman.run_command('fitload hostfs - 1000000 %s - kernel'
+                                       % fit)
+        assert expect_string in output
+        assert ('bytes loaded to' in output) == loads
+
     def sign_fit(sha_algo, options):
         """Sign the FIT
 
@@ -395,6 +420,7 @@ def test_vboot(ubman, name, sha_algo, padding, sign_options, required,
         # Replace with existing header bytes
         replace_fit_totalsize(existing_size)
         run_bootm(sha_algo, 'signed config', 'dev+', True)
+        run_fitload(sha_algo, 'signed config', 'dev+', True)
         ubman.log.action('%s: Check default FIT header totalsize' % sha_algo)
 
         # Increment the first byte of the signature, which should cause failure
@@ -409,6 +435,8 @@ def test_vboot(ubman, name, sha_algo, padding, sign_options, required,
 
         run_bootm(sha_algo, 'Signed config with bad hash', 'Bad Data Hash',
                   False)
+        run_fitload(sha_algo, 'Signed config with bad hash', 'Bad Data Hash',
+                    False)
 
         ubman.log.action('%s: Check bad config on the host' % sha_algo)
         utils.run_and_log_expect_exception(